@@ -12,7 +12,10 @@ import os
 import json  # 載入/儲存 authorized_users 使用
 from PIL import Image, ImageDraw, ImageFont
 import base64
+import zlib                     # 🔹 壓縮回應，減少裝置收資料的時間
+import hashlib                  # 🔹 計算每天事件的 ETag
 import numpy as np
+from werkzeug.serving import WSGIRequestHandler
 
 
 def generate_session_token():
@@ -119,6 +122,58 @@ def token_required(f):
     return decorated
 
 
+def refresh_google_token(username):
+    """
+    確認使用者的 Google token 可用，過期時用 refresh token 更新。
+
+    回傳 (google_info, None)；無法使用時回傳 (None, 錯誤回應)。
+    """
+    # get google account info
+    google_info = authorized_users.get(username, {}).get('google')
+    if not google_info:
+        print(f"No Google token found for {username}")
+        return None, (jsonify({'error': 'Google account not linked'}), 401)
+
+    # get google token expiration
+    if time.time() > google_info.get('expires_at', 0):
+        refresh_token = google_info.get('refresh_token')
+        if not refresh_token:
+            print(f"No refresh token for {username}")
+            return None, (jsonify({'error': 'Google token expired and no refresh token available'}), 401)
+
+        print(f"Refreshing token for {username}...")
+        try:
+            response = requests.post(
+                "https://oauth2.googleapis.com/token",
+                data={
+                    "client_id": os.getenv("GOOGLE_CLIENT_ID"),
+                    "client_secret": os.getenv("GOOGLE_CLIENT_SECRET"),
+                    "refresh_token": refresh_token,
+                    "grant_type": "refresh_token"
+                },
+                timeout=10
+            )
+
+            if response.status_code == 200:
+                token_data = response.json()
+                google_info['access_token'] = token_data['access_token']
+                google_info['expires_at'] = time.time(
+                ) + token_data.get("expires_in", 3600)
+                save_authorized_users()
+                print(f"Token refreshed for {username}")
+            else:
+                error_detail = response.json().get('error_description', response.text)
+                print(
+                    f"Failed to refresh token for {username}, status: {response.status_code}, detail: {error_detail}")
+                return None, (jsonify({'error': 'Google token refresh failed', 'detail': error_detail}), 401)
+        except requests.exceptions.RequestException as e:
+            print(
+                f"Network error while refreshing token for {username}: {e}")
+            return None, (jsonify({'error': 'Network error during token refresh'}), 500)
+
+    return google_info, None
+
+
 def ensure_valid_google_token(f):
     @wraps(f)
     def wrapper(*args, **kwargs):
@@ -127,49 +182,9 @@ def ensure_valid_google_token(f):
         if not username:
             return jsonify({'error': 'No username found'}), 400
 
-        # get google account info
-        google_info = authorized_users.get(username, {}).get('google')
-        if not google_info:
-            print(f"No Google token found for {username}")
-            return jsonify({'error': 'Google account not linked'}), 401
-
-        # get google token expiration
-        if time.time() > google_info.get('expires_at', 0):
-            refresh_token = google_info.get('refresh_token')
-            if not refresh_token:
-                print(f"No refresh token for {username}")
-                return jsonify({'error': 'Google token expired and no refresh token available'}), 401
-
-            print(f"Refreshing token for {username}...")
-            try:
-                response = requests.post(
-                    "https://oauth2.googleapis.com/token",
-                    data={
-                        "client_id": os.getenv("GOOGLE_CLIENT_ID"),
-                        "client_secret": os.getenv("GOOGLE_CLIENT_SECRET"),
-                        "refresh_token": refresh_token,
-                        "grant_type": "refresh_token"
-                    },
-                    timeout=10
-                )
-
-                if response.status_code == 200:
-                    token_data = response.json()
-                    google_info['access_token'] = token_data['access_token']
-                    google_info['expires_at'] = time.time(
-                    ) + token_data.get("expires_in", 3600)
-                    save_authorized_users()
-                    print(f"Token refreshed for {username}")
-                else:
-                    error_detail = response.json().get('error_description', response.text)
-                    print(
-                        f"Failed to refresh token for {username}, status: {response.status_code}, detail: {error_detail}")
-                    return jsonify({'error': 'Google token refresh failed', 'detail': error_detail}), 401
-            except requests.exceptions.RequestException as e:
-                print(
-                    f"Network error while refreshing token for {username}: {e}")
-                return jsonify({'error': 'Network error during token refresh'}), 500
-
+        _, error = refresh_google_token(username)
+        if error:
+            return error
         return f(*args, **kwargs)
     return wrapper
 
@@ -320,21 +335,34 @@ def google_token_check():
     return jsonify({"status": "OK"})
 
 
-@app.route('/login', methods=['POST'])
-def login():
-    data = request.json
-    if not data or data.get('username') != os.getenv('QUANTIX_USERNAME') or data.get('password') != os.getenv('QUANTIX_PASSWORD'):
-        return jsonify({'error': 'Invalid credentials'}), 401
+def credentials_valid(data):
+    return bool(data) and data.get('username') == os.getenv('QUANTIX_USERNAME') \
+        and data.get('password') == os.getenv('QUANTIX_PASSWORD')
+
+
+def issue_token(username):
+    """產生 60 分鐘有效的 JWT 並註冊使用者"""
+    now = datetime.datetime.now(datetime.timezone.utc)
+    # 🔹 iat 讓裝置不需要正確的時鐘也能算出 token 的有效時間
     token = jwt.encode({
-        'user': data['username'],
-        'exp': datetime.datetime.utcnow() + datetime.timedelta(minutes=60)
+        'user': username,
+        'iat': now,
+        'exp': now + datetime.timedelta(minutes=60)
     }, os.getenv('SECRET_KEY'), algorithm='HS256')
     # 註冊 user
-    if data['username'] not in authorized_users:
-        authorized_users[data['username']] = {}
-    authorized_users[data['username']]['jwt'] = token
+    if username not in authorized_users:
+        authorized_users[username] = {}
+    authorized_users[username]['jwt'] = token
     save_authorized_users()  # 持久化
-    return jsonify({'token': token})
+    return token
+
+
+@app.route('/login', methods=['POST'])
+def login():
+    data = request.json
+    if not credentials_valid(data):
+        return jsonify({'error': 'Invalid credentials'}), 401
+    return jsonify({'token': issue_token(data['username'])})
 
 
 @app.route('/settings', methods=['POST'])
@@ -457,6 +485,124 @@ def get_stock():
     return jsonify({'stock': '2330.TW', 'price': 799.5})
 
 
+# /api/calendar/range 一次最多查詢的天數，避免回應過大
+CALENDAR_RANGE_MAX_DAYS = 31
+
+
+def fetch_google_events(google_info, time_min, time_max):
+    """
+    呼叫 Google Calendar events.list 取得 [time_min, time_max) 之間的事件 (含分頁)。
+
+    回傳 (events, None)；失敗時回傳 (None, 錯誤回應)。events 只保留裝置需要的欄位。
+    """
+    events = []
+    page_token = None
+    while True:
+        params = {
+            "timeMin": time_min,
+            "timeMax": time_max,
+            "singleEvents": True,
+            "orderBy": "startTime",
+            "maxResults": 2500
+        }
+        if page_token:
+            params["pageToken"] = page_token
+        resp = requests.get(
+            "https://www.googleapis.com/calendar/v3/calendars/primary/events",
+            params=params,
+            headers={
+                "Authorization": f"Bearer {google_info['access_token']}"
+            }
+        )
+
+        if resp.status_code != 200:
+            print(
+                f"Google Calendar API error: {resp.status_code}, detail: {resp.text}")
+            return None, (jsonify({'error': 'Google Calendar API 失敗', 'detail': resp.text}), 500)
+
+        body = resp.json()
+        # 只回傳必要欄位
+        for event in body.get('items', []):
+            events.append({
+                "summary": event.get("summary"),
+                "start": event.get("start", {}).get("dateTime") or event.get("start", {}).get("date"),
+                "end": event.get("end", {}).get("dateTime") or event.get("end", {}).get("date"),
+            })
+        page_token = body.get('nextPageToken')
+        if not page_token:
+            return events, None
+
+
+def events_etag(events):
+    """以事件內容計算 ETag，內容不變時 ETag 也不變"""
+    canonical = json.dumps(events, sort_keys=True, separators=(',', ':'), ensure_ascii=False)
+    return hashlib.sha1(canonical.encode('utf-8')).hexdigest()[:16]
+
+
+def parse_event_time(value):
+    """把 Google 的 date / dateTime 字串轉成 UTC 時間，全天事件視為當天 00:00Z"""
+    if 'T' not in value:
+        return datetime.datetime.strptime(value, "%Y-%m-%d").replace(tzinfo=datetime.timezone.utc)
+    return datetime.datetime.fromisoformat(value.replace('Z', '+00:00')).astimezone(datetime.timezone.utc)
+
+
+def parse_day_range(data):
+    """
+    讀取請求中的 "start" / "end" (YYYY-MM-DD，含)。
+
+    回傳 (start_day, day_count, None)；格式或範圍錯誤時回傳 (None, 0, 錯誤回應)。
+    """
+    try:
+        start_day = datetime.datetime.strptime(data.get('start', ''), "%Y-%m-%d")
+        end_day = datetime.datetime.strptime(data.get('end', ''), "%Y-%m-%d")
+    except (TypeError, ValueError):
+        return None, 0, (jsonify({'error': '日期格式錯誤，請用 YYYY-MM-DD'}), 400)
+
+    day_count = (end_day - start_day).days + 1
+    if day_count < 1 or day_count > CALENDAR_RANGE_MAX_DAYS:
+        return None, 0, (jsonify({'error': f'日期範圍需介於 1 到 {CALENDAR_RANGE_MAX_DAYS} 天'}), 400)
+    return start_day, day_count, None
+
+
+def fetch_events_by_day(google_info, start_day, day_count):
+    """
+    一次取得 start_day 起 day_count 天的事件，依日期分開。
+
+    回傳 ([(日期, 事件, ETag), ...], 事件總數, None)；失敗時回傳 (None, 0, 錯誤回應)。每天的範圍為
+    UTC 00:00 ~ 24:00，跨日事件會出現在它經過的每一天。
+    """
+    events, error = fetch_google_events(
+        google_info,
+        start_day.isoformat() + 'Z',
+        (start_day + datetime.timedelta(days=day_count)).isoformat() + 'Z')
+    if error:
+        return None, 0, error
+
+    spans = []
+    for event in events:
+        try:
+            spans.append((parse_event_time(event['start']), parse_event_time(event['end']), event))
+        except (TypeError, ValueError):
+            print(f"Skipping event with invalid time: {event}")
+
+    days = []
+    for i in range(day_count):
+        day_start = (start_day + datetime.timedelta(days=i)).replace(tzinfo=datetime.timezone.utc)
+        day_end = day_start + datetime.timedelta(days=1)
+        day_events = [
+            event for start, end, event in spans
+            if start < day_end and (end > day_start or (start == end and start >= day_start))
+        ]
+        days.append((day_start.strftime("%Y-%m-%d"), day_events, events_etag(day_events)))
+    return days, len(events), None
+
+
+def known_etags_of(data):
+    """請求中裝置已有的每日 ETag ("etags": {"YYYY-MM-DD": "..."})"""
+    known_etags = data.get('etags')
+    return known_etags if isinstance(known_etags, dict) else {}
+
+
 @app.route('/api/calendar', methods=['POST'])
 @token_required
 @ensure_valid_google_token
@@ -475,44 +621,283 @@ def get_calendar_events():
 
     # 產生 RFC3339 格式的開始與結束時間
     try:
-        from datetime import datetime, timedelta
-        start_dt = datetime.strptime(date_str, "%Y-%m-%d")
-        end_dt = start_dt + timedelta(days=1)
+        start_dt = datetime.datetime.strptime(date_str, "%Y-%m-%d")
+        end_dt = start_dt + datetime.timedelta(days=1)
         time_min = start_dt.isoformat() + 'Z'
         time_max = end_dt.isoformat() + 'Z'
     except Exception as e:
         return jsonify({'error': '日期格式錯誤，請用 YYYY-MM-DD'}), 400
 
     # 呼叫 Google Calendar API
-    resp = requests.get(
-        "https://www.googleapis.com/calendar/v3/calendars/primary/events",
-        params={
-            "timeMin": time_min,
-            "timeMax": time_max,
-            "singleEvents": True,
-            "orderBy": "startTime"
-        },
-        headers={
-            "Authorization": f"Bearer {google_info['access_token']}"
-        }
-    )
+    result, error = fetch_google_events(google_info, time_min, time_max)
+    if error:
+        return error
+    print(f"Found {len(result)} events for {date_str} in {username}'s calendar")
+    etag = events_etag(result)
+    if etag in request.if_none_match:
+        return Response(status=304, headers={"ETag": f'"{etag}"'})
+    response = jsonify({"events": result})
+    response.set_etag(etag)
+    return response
 
-    if resp.status_code != 200:
-        print(
-            f"Google Calendar API error: {resp.status_code}, detail: {resp.text}")
-        return jsonify({'error': 'Google Calendar API 失敗', 'detail': resp.text}), 500
 
-    events = resp.json().get('items', [])
-    # 只回傳必要欄位
-    result = []
-    for event in events:
-        result.append({
-            "summary": event.get("summary"),
-            "start": event.get("start", {}).get("dateTime") or event.get("start", {}).get("date"),
-            "end": event.get("end", {}).get("dateTime") or event.get("end", {}).get("date"),
-        })
-    print(f"Found {len(result)} events for {date_str} in {username}'s calendar")
-    return jsonify({"events": result})
+@app.route('/api/calendar/range', methods=['POST'])
+@token_required
+@ensure_valid_google_token
+def get_calendar_range():
+    """
+    一次取得 start ~ end (含) 每一天的事件，只呼叫一次 Google Calendar API。
+
+    回應格式：{"days": {"YYYY-MM-DD": [事件...], ...}, "etags": {"YYYY-MM-DD": "...", ...}}，
+    沒有事件的日期也會列出空陣列，讓裝置可以清掉舊的快取。每天的範圍與 /api/calendar 相同
+    (UTC 00:00 ~ 24:00)，跨日事件會出現在它經過的每一天。
+
+    請求可以帶 "etags": {"YYYY-MM-DD": "..."}，是裝置上次收到的 ETag。內容沒變的日期不會
+    出現在回應中；全部都沒變時回傳 304，沒有 body。
+    """
+    username = g.current_user
+
+    google_info = authorized_users[username].get('google')
+    if not google_info:
+        return jsonify({'error': 'Google 未授權'}), 403
+
+    data = request.json or {}
+    start_day, day_count, error = parse_day_range(data)
+    if error:
+        return error
+
+    by_day, event_count, error = fetch_events_by_day(google_info, start_day, day_count)
+    if error:
+        return error
+
+    known_etags = known_etags_of(data)
+    days = {}
+    etags = {}
+    for date_str, day_events, etag in by_day:
+        if known_etags.get(date_str) == etag:
+            continue  # 裝置上的資料已是最新
+        days[date_str] = day_events
+        etags[date_str] = etag
+    print(f"Found {event_count} events for {data['start']} ~ {data['end']} in {username}'s calendar, "
+          f"{len(days)}/{day_count} days changed")
+    if not days:
+        return Response(status=304)
+    return jsonify({"days": days, "etags": etags})
+
+
+# bootstrap 沒有指定日期時，以伺服器的今天 (UTC) 為中心前後各幾天
+BOOTSTRAP_RADIUS_DAYS = 5
+
+
+@app.route('/api/bootstrap', methods=['POST'])
+def bootstrap():
+    """
+    裝置連上網路後的第一個請求，取代 /login、/google_token_check 與第一次行事曆查詢的連續往返。
+
+    請求：{"username", "password", "start"?, "end"?, "etags"?: {"YYYY-MM-DD": "..."}}
+    start / end 省略時 (例如裝置時鐘還沒設定) 使用伺服器今天前後 BOOTSTRAP_RADIUS_DAYS 天。
+
+    回應：{"token": JWT, "server_time": Unix 秒數, "google_linked": bool,
+          "calendar": {"start", "end", "changed": ["YYYY-MM-DD", ...]}}
+    changed 是 ETag 與裝置不同 (或裝置沒有) 的日期，裝置只需要再用 /api/calendar/range 取這些日期。
+    Google 未連結或無法使用時沒有 "calendar"；暫時無法確認 Google 狀態時也沒有 "google_linked"。
+    """
+    data = request.json
+    if not credentials_valid(data):
+        return jsonify({'error': 'Invalid credentials'}), 401
+    username = data['username']
+    result = {
+        "token": issue_token(username),
+        "server_time": int(time.time()),
+    }
+
+    google_info, error = refresh_google_token(username)
+    if error:
+        # 401 表示需要重新連結 Google；其他錯誤 (例如網路) 不回傳狀態，讓裝置之後自己確認
+        if error[1] == 401:
+            result["google_linked"] = False
+        return jsonify(result)
+    result["google_linked"] = True
+
+    if data.get('start') and data.get('end'):
+        start_day, day_count, error = parse_day_range(data)
+        if error:
+            return error
+    else:
+        today = datetime.datetime.utcnow().replace(hour=0, minute=0, second=0, microsecond=0)
+        start_day = today - datetime.timedelta(days=BOOTSTRAP_RADIUS_DAYS)
+        day_count = 2 * BOOTSTRAP_RADIUS_DAYS + 1
+
+    by_day, event_count, error = fetch_events_by_day(google_info, start_day, day_count)
+    if error:
+        return jsonify(result)  # 行事曆查詢失敗不影響登入，裝置之後會自己再查
+    known_etags = known_etags_of(data)
+    result["calendar"] = {
+        "start": by_day[0][0],
+        "end": by_day[-1][0],
+        "changed": [date_str for date_str, _, etag in by_day if known_etags.get(date_str) != etag],
+    }
+    print(f"Bootstrap for {username}: {event_count} events, "
+          f"{len(result['calendar']['changed'])}/{day_count} days changed")
+    return jsonify(result)
+
+
+# 裝置上傳的網路請求統計，每次上傳一行 JSON
+TELEMETRY_FILE = "telemetry.jsonl"
+# 查詢統計時預設涵蓋的天數
+TELEMETRY_DEFAULT_DAYS = 7
+
+
+@app.route('/api/telemetry', methods=['POST'])
+@token_required
+def upload_telemetry():
+    """
+    儲存裝置的網路請求統計 (net_stats.c)，附上收到的時間與使用者。
+
+    請求：{"phases": ["dns", ...], "buckets_ms": [20, ..., 0],
+          "endpoints": [{"path", "n", "failed", "reused", "retries", "tx", "rx",
+                         "sum_ms": [每個階段], "hist": [[每一格] 每個階段]}]}
+    buckets_ms 是每一格的上限 (毫秒)，最後一格為 0 表示沒有上限。
+    """
+    data = request.get_json(silent=True)
+    if not isinstance(data, dict) or not all(
+            isinstance(data.get(key), list) for key in ('phases', 'buckets_ms', 'endpoints')):
+        return jsonify({'error': 'Invalid telemetry'}), 400
+    record = {
+        "received_at": int(time.time()),
+        "user": g.current_user,
+        "phases": data['phases'],
+        "buckets_ms": data['buckets_ms'],
+        "endpoints": data['endpoints'],
+    }
+    with open(TELEMETRY_FILE, 'a') as f:
+        f.write(json.dumps(record, separators=(',', ':')) + "\n")
+    return jsonify({"status": "OK"})
+
+
+def histogram_percentile(hist, buckets_ms, fraction):
+    """回傳分位數所在格的上限 (毫秒)，落在最後一格時為 None"""
+    total = sum(hist)
+    if total == 0:
+        return None
+    seen = 0
+    for count, limit in zip(hist, buckets_ms):
+        seen += count
+        if seen >= fraction * total:
+            return limit or None
+    return None
+
+
+@app.route('/api/telemetry', methods=['GET'])
+@token_required
+def telemetry_report():
+    """
+    彙整 since (Unix 秒數，預設 TELEMETRY_DEFAULT_DAYS 天前) 之後上傳的統計，用來追蹤延遲的變化。
+
+    回應：{"since", "uploads", "buckets_ms", "endpoints": {路徑: {"n", "failed", "reused",
+          "retries", "tx", "rx", "phases": {階段: {"n", "mean_ms", "p50_ms", "p90_ms", "hist"}}}}}
+    p50 / p90 是由 histogram 估計的上限，落在最後一格 (超過最大的上限) 時為 null。
+    與最新一次上傳的階段或分格不同的舊資料會被略過。
+    """
+    since = request.args.get('since', type=int)
+    if since is None:
+        since = int(time.time()) - TELEMETRY_DEFAULT_DAYS * 86400
+    records = []
+    if os.path.exists(TELEMETRY_FILE):
+        with open(TELEMETRY_FILE) as f:
+            for line in f:
+                try:
+                    record = json.loads(line)
+                except json.JSONDecodeError:
+                    continue
+                if record.get('received_at', 0) >= since:
+                    records.append(record)
+    if not records:
+        return jsonify({"since": since, "uploads": 0, "endpoints": {}})
+
+    phases = records[-1]['phases']
+    buckets_ms = records[-1]['buckets_ms']
+    totals = {}
+    uploads = 0
+    for record in records:
+        if record['phases'] != phases or record['buckets_ms'] != buckets_ms:
+            continue
+        uploads += 1
+        for ep in record['endpoints']:
+            total = totals.setdefault(ep.get('path', '?'), {
+                "n": 0, "failed": 0, "reused": 0, "retries": 0, "tx": 0, "rx": 0,
+                "sum_ms": [0] * len(phases),
+                "hist": [[0] * len(buckets_ms) for _ in phases],
+            })
+            for key in ('n', 'failed', 'reused', 'retries', 'tx', 'rx'):
+                total[key] += ep.get(key, 0)
+            for i, value in enumerate(ep.get('sum_ms', [])[:len(phases)]):
+                total['sum_ms'][i] += value
+            for i, hist in enumerate(ep.get('hist', [])[:len(phases)]):
+                for j, count in enumerate(hist[:len(buckets_ms)]):
+                    total['hist'][i][j] += count
+
+    endpoints = {}
+    for path, total in totals.items():
+        summary = {key: total[key] for key in ('n', 'failed', 'reused', 'retries', 'tx', 'rx')}
+        summary['phases'] = {}
+        for i, phase in enumerate(phases):
+            count = sum(total['hist'][i])
+            summary['phases'][phase] = {
+                "n": count,
+                "mean_ms": round(total['sum_ms'][i] / count, 1) if count else None,
+                "p50_ms": histogram_percentile(total['hist'][i], buckets_ms, 0.5),
+                "p90_ms": histogram_percentile(total['hist'][i], buckets_ms, 0.9),
+                "hist": total['hist'][i],
+            }
+        endpoints[path] = summary
+    return jsonify({"since": since, "uploads": uploads, "buckets_ms": buckets_ms,
+                    "endpoints": endpoints})
+
+
+# 裝置上傳的每次醒來的階段時間 (wake_profile.c)，一行一筆，由 wake_report.py 彙整
+WAKE_PROFILE_FILE = "wake_profile.jsonl"
+
+
+@app.route('/api/wake_profile', methods=['POST'])
+@token_required
+def upload_wake_profile():
+    """
+    儲存裝置一批醒來紀錄，每次醒來一行，附上收到的時間與使用者。
+
+    請求：{"phases": ["boot", ...], "wakes": [{"seq", "cause", "started",
+          "phase_ms": [每個階段，未到達為 null], "radio_ms", "cpu_ms"}],
+          "ticks": {"count", "awake_ms"}}
+    phase_ms 是從開機起算的毫秒數。ticks 是上次上傳以來時鐘喚醒的次數與醒著的總時間，
+    存成一行 (以這批最後一筆的 seq 標記)。回應遺失而重送的紀錄由 wake_report.py 去除重複。
+    """
+    data = request.get_json(silent=True)
+    if not isinstance(data, dict) or not isinstance(data.get('phases'), list) or \
+            not isinstance(data.get('wakes'), list):
+        return jsonify({'error': 'Invalid wake profile'}), 400
+    received_at = int(time.time())
+    with open(WAKE_PROFILE_FILE, 'a') as f:
+        for wake in data['wakes']:
+            if not isinstance(wake, dict) or not isinstance(wake.get('phase_ms'), list):
+                continue
+            record = {
+                "received_at": received_at,
+                "user": g.current_user,
+                "phases": data['phases'],
+                **wake,
+            }
+            f.write(json.dumps(record, separators=(',', ':')) + "\n")
+        ticks = data.get('ticks')
+        if isinstance(ticks, dict) and ticks.get('count'):
+            wakes = [w for w in data['wakes'] if isinstance(w, dict)]
+            record = {
+                "received_at": received_at,
+                "user": g.current_user,
+                "seq": wakes[-1].get('seq') if wakes else None,
+                "ticks": ticks,
+            }
+            f.write(json.dumps(record, separators=(',', ':')) + "\n")
+    return jsonify({"status": "OK"})
 
 
 @app.route("/font")
@@ -532,5 +917,37 @@ def get_font():
     return Response(compact_json_string, mimetype='application/json')
 
 
+# 會壓縮回應的路徑 (行事曆與字型)
+COMPRESSED_PATHS = {'/api/calendar', '/api/calendar/range', '/font'}
+# deflate 的視窗大小 (2^11 = 2 KB)，裝置用同樣大小的環狀緩衝區解壓縮，不能超過它
+DEFLATE_WINDOW_BITS = 11
+# 太小的回應壓縮後反而變大
+COMPRESS_MIN_BYTES = 128
+
+
+@app.after_request
+def compress_response(response):
+    """客戶端的 Accept-Encoding 有 deflate 時，以 zlib 格式 (RFC 1950) 壓縮行事曆與字型回應"""
+    if request.path not in COMPRESSED_PATHS:
+        return response
+    response.vary.add('Accept-Encoding')
+    if (response.status_code != 200 or response.direct_passthrough
+            or 'Content-Encoding' in response.headers
+            or not request.accept_encodings['deflate']):
+        return response
+
+    body = response.get_data()
+    if len(body) < COMPRESS_MIN_BYTES:
+        return response
+    compressor = zlib.compressobj(9, zlib.DEFLATED, DEFLATE_WINDOW_BITS)
+    compressed = compressor.compress(body) + compressor.flush()
+    response.set_data(compressed)
+    response.headers['Content-Encoding'] = 'deflate'
+    print(f"{request.path}: {len(body)} -> {len(compressed)} bytes (deflate)")
+    return response
+
+
 if __name__ == '__main__':
+    # 🔹 HTTP/1.1 才會保持連線 (keep-alive)，讓 ESP32 重複使用同一條 TLS 連線
+    WSGIRequestHandler.protocol_version = "HTTP/1.1"
     app.run(host='0.0.0.0', port=443, ssl_context=('cert.pem', 'key.pem'))
@@ -0,0 +1,105 @@
+"""
+彙整裝置上傳的醒來紀錄 (wake_profile.jsonl)，列出每個階段的分位數。
+
+每個階段列出兩種時間：從開機起算到達的時間，以及與前一個到達的階段之間的間隔，
+另外列出醒著的總時間 (到 sleep 階段)、射頻開啟時間與 CPU 時間。
+時鐘喚醒 (tick) 只上傳次數與醒著的總時間，另外列出平均。
+
+    python wake_report.py [--file wake_profile.jsonl] [--days 7] [--cause timer] [--user NAME]
+"""
+import argparse
+import json
+import time
+
+PERCENTILES = (50, 90, 99)
+
+
+def percentile(values, p):
+    """最近排名法的分位數，values 需已排序"""
+    rank = max(1, -(-len(values) * p // 100))
+    return values[rank - 1]
+
+
+def load_wakes(path, since, cause, user):
+    """讀取紀錄並去除重送的重複紀錄 (同一使用者、seq 與開始時間)，時鐘喚醒的彙總另外回傳"""
+    wakes = {}
+    ticks = {}
+    with open(path) as f:
+        for line in f:
+            try:
+                record = json.loads(line)
+            except json.JSONDecodeError:
+                continue
+            if record.get('received_at', 0) < since:
+                continue
+            if user and record.get('user') != user:
+                continue
+            if 'ticks' in record:
+                ticks[(record.get('user'), record.get('seq'))] = record['ticks']
+                continue
+            if cause and record.get('cause') != cause:
+                continue
+            key = (record.get('user'), record.get('seq'), record.get('started'))
+            wakes[key] = record
+    return list(wakes.values()), list(ticks.values())
+
+
+def collect(wakes):
+    """依最新紀錄的階段順序收集每個階段的時間，階段不同的舊紀錄會被略過"""
+    phases = wakes[-1]['phases']
+    rows = {}
+    for wake in wakes:
+        if wake['phases'] != phases:
+            continue
+        previous = None
+        for phase, ms in zip(phases, wake['phase_ms']):
+            if ms is None:
+                continue
+            row = rows.setdefault(phase, {"at": [], "step": []})
+            row['at'].append(ms)
+            if previous is not None:
+                row['step'].append(ms - previous)
+            previous = ms
+        for key in ('radio_ms', 'cpu_ms'):
+            if wake.get(key) is not None:
+                rows.setdefault(key, {"at": [], "step": []})['at'].append(wake[key])
+    return phases, rows
+
+
+def format_stats(values):
+    if not values:
+        return "%6s" % "-" + " " * 8 * len(PERCENTILES)
+    values = sorted(values)
+    return "%6d" % len(values) + "".join("%8d" % percentile(values, p) for p in PERCENTILES)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Per-phase percentiles of the wake profiles")
+    parser.add_argument('--file', default="wake_profile.jsonl")
+    parser.add_argument('--days', type=float, default=7, help="only records of the last days")
+    parser.add_argument('--cause', help="only wakes of this cause (gpio, timer, power_on)")
+    parser.add_argument('--user', help="only wakes of this user")
+    args = parser.parse_args()
+
+    since = int(time.time() - args.days * 86400)
+    wakes, ticks = load_wakes(args.file, since, args.cause, args.user)
+    tick_count = sum(t.get('count', 0) for t in ticks)
+    if tick_count:
+        tick_ms = sum(t.get('awake_ms', 0) for t in ticks)
+        print("%d clock ticks, %.1f ms awake on average" % (tick_count, tick_ms / tick_count))
+    if not wakes:
+        print("No wake records.")
+        return
+    phases, rows = collect(wakes)
+
+    header = "%6s" % "n" + "".join("%8s" % ("p%d" % p) for p in PERCENTILES)
+    print("%d wakes, times in ms" % len(wakes))
+    print("%-16s%s   |%s" % ("phase", header, header))
+    print("%-16s%-33s|%s" % ("", "   since boot (or total)", "   since previous phase"))
+    for phase in phases + ['radio_ms', 'cpu_ms']:
+        row = rows.get(phase, {"at": [], "step": []})
+        print("%-16s%s   |%s" % (phase, format_stats(row['at']), format_stats(row['step'])))
+
+
+if __name__ == '__main__':
+    main()
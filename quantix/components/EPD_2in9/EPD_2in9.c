@@ -30,6 +30,7 @@
 ******************************************************************************/
 #include "EPD_2in9.h"
 #include "Debug.h"
+#include <string.h>
 
 UBYTE _WF_PARTIAL_2IN9[159] = {
     0x0,  0x40, 0x0,  0x0,  0x0,  0x0,  0x0,  0x0, 0x0,  0x0, 0x0,  0x0,  0x80,
@@ -116,6 +117,71 @@ unsigned char WF_FULL[159] = {
     0x22, 0x17, 0x41, 0xAE, 0x32, 0x38, // EOPT VGH VSH1 VSH2 VSL VCOM
 };
 
+/**
+ * Controller configuration currently loaded (registers + LUT). Lets repeated
+ * init calls skip the reset, register writes and LUT upload while the panel
+ * has not been put to deep sleep.
+ */
+typedef enum {
+    EPD_2IN9_V2_CONFIG_NONE = 0, // unknown, asleep or unpowered
+    EPD_2IN9_V2_CONFIG_FULL,
+    EPD_2IN9_V2_CONFIG_FAST,
+    EPD_2IN9_V2_CONFIG_GRAY4,
+    EPD_2IN9_V2_CONFIG_PARTIAL,
+    EPD_2IN9_V2_CONFIG_BASE,
+} EPD_2IN9_V2_CONFIG;
+
+static EPD_2IN9_V2_CONFIG EPD_2IN9_V2_Config = EPD_2IN9_V2_CONFIG_NONE;
+
+// Command tables: command, number of data bytes, data...
+#define EPD_2IN9_V2_WINDOW_X_END ((EPD_2IN9_V2_WIDTH - 1) >> 3)
+#define EPD_2IN9_V2_WINDOW_Y_END_L ((EPD_2IN9_V2_HEIGHT - 1) & 0xFF)
+#define EPD_2IN9_V2_WINDOW_Y_END_H ((EPD_2IN9_V2_HEIGHT - 1) >> 8)
+
+static const UBYTE EPD_2IN9_V2_Init_Seq[] = {
+    0x01, 3, 0x27, 0x01, 0x00, // Driver output control
+    0x11, 1, 0x03,             // data entry mode
+    0x44, 2, 0x00, EPD_2IN9_V2_WINDOW_X_END,
+    0x45, 4, 0x00, 0x00, EPD_2IN9_V2_WINDOW_Y_END_L, EPD_2IN9_V2_WINDOW_Y_END_H,
+    0x21, 2, 0x00, 0x80, //  Display update control
+    0x4E, 1, 0x00,       // SET_RAM_X_ADDRESS_COUNTER
+    0x4F, 2, 0x00, 0x00, // SET_RAM_Y_ADDRESS_COUNTER
+};
+
+static const UBYTE EPD_2IN9_V2_Init_Fast_Seq[] = {
+    0x01, 3, 0x27, 0x01, 0x00, // Driver output control
+    0x11, 1, 0x03,             // data entry mode
+    0x44, 2, 0x00, EPD_2IN9_V2_WINDOW_X_END,
+    0x45, 4, 0x00, 0x00, EPD_2IN9_V2_WINDOW_Y_END_L, EPD_2IN9_V2_WINDOW_Y_END_H,
+    0x3C, 1, 0x05,       // BorderWavefrom
+    0x21, 2, 0x00, 0x80, //  Display update control
+    0x4E, 1, 0x00,       // SET_RAM_X_ADDRESS_COUNTER
+    0x4F, 2, 0x00, 0x00, // SET_RAM_Y_ADDRESS_COUNTER
+};
+
+static const UBYTE EPD_2IN9_V2_Gray4_Init_Seq[] = {
+    0x01, 3, 0x27, 0x01, 0x00, // Driver output control
+    0x11, 1, 0x03,             // data entry mode
+    0x44, 2, 8 >> 3, EPD_2IN9_V2_WIDTH >> 3,
+    0x45, 4, 0x00, 0x00, EPD_2IN9_V2_WINDOW_Y_END_L, EPD_2IN9_V2_WINDOW_Y_END_H,
+    0x3C, 1, 0x04,       // BorderWavefrom
+    0x4E, 1, 0x01,       // SET_RAM_X_ADDRESS_COUNTER
+    0x4F, 2, 0x00, 0x00, // SET_RAM_Y_ADDRESS_COUNTER
+};
+
+static const UBYTE EPD_2IN9_V2_Partial_Seq[] = {
+    0x37, 10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00,
+    0x3C, 1, 0x80, // BorderWavefrom
+};
+
+static const UBYTE EPD_2IN9_V2_Base_Seq[] = {
+    0x11, 1, 0x03, // data entry mode
+    0x44, 2, 0x00, EPD_2IN9_V2_WINDOW_X_END,
+    0x45, 4, 0x00, 0x00, EPD_2IN9_V2_WINDOW_Y_END_L, EPD_2IN9_V2_WINDOW_Y_END_H,
+    0x4E, 1, 0x00,       // SET_RAM_X_ADDRESS_COUNTER
+    0x4F, 2, 0x00, 0x00, // SET_RAM_Y_ADDRESS_COUNTER
+};
+
 /******************************************************************************
 function :	Software reset
 parameter:
@@ -153,6 +219,100 @@ static void EPD_2IN9_V2_SendData(UBYTE Data) {
     DEV_Digital_Write(EPD_CS_PIN, 1);
 }
 
+/******************************************************************************
+function :	send a command followed by its data under one chip select
+            The DC line has to change between them, so the command byte and
+            the data go out as two SPI transactions
+parameter:
+     Reg  : Command register
+     Data : Parameter bytes
+     Len  : Number of parameter bytes
+******************************************************************************/
+static void EPD_2IN9_V2_SendCommandData(UBYTE Reg, const UBYTE *Data, UWORD Len) {
+    DEV_Digital_Write(EPD_DC_PIN, 0);
+    DEV_Digital_Write(EPD_CS_PIN, 0);
+    DEV_SPI_WriteByte(Reg);
+    if (Len > 0) {
+        DEV_Digital_Write(EPD_DC_PIN, 1);
+        DEV_SPI_Write_nByte((UBYTE *)Data, Len);
+    }
+    DEV_Digital_Write(EPD_CS_PIN, 1);
+}
+
+/******************************************************************************
+function :	send a command table
+parameter:
+     Seq : Entries of command, number of data bytes, data...
+     Len : Size of the table in bytes
+******************************************************************************/
+static void EPD_2IN9_V2_SendSequence(const UBYTE *Seq, UWORD Len) {
+    UWORD i = 0;
+    while (i + 1 < Len) {
+        EPD_2IN9_V2_SendCommandData(Seq[i], &Seq[i + 2], Seq[i + 1]);
+        i += 2 + Seq[i + 1];
+    }
+}
+
+/******************************************************************************
+function :	write a full image to RAM in bulk transactions
+parameter:
+     Reg   : 0x24 (new) or 0x26 (old) RAM
+     Image : EPD_2IN9_V2_IMAGE_SIZE bytes, or NULL to fill with white
+******************************************************************************/
+static void EPD_2IN9_V2_SendRAM(UBYTE Reg, const UBYTE *Image) {
+    static UBYTE white[256];
+    UWORD sent = 0;
+
+    if (Image == NULL && white[0] != 0xFF) {
+        memset(white, 0xFF, sizeof(white));
+    }
+    EPD_2IN9_V2_SendCommand(Reg);
+    DEV_Digital_Write(EPD_DC_PIN, 1);
+    DEV_Digital_Write(EPD_CS_PIN, 0);
+    while (sent < EPD_2IN9_V2_IMAGE_SIZE) {
+        UWORD chunk = EPD_2IN9_V2_IMAGE_SIZE - sent;
+        UWORD limit = Image ? EPD_SPI_MAX_TRANSFER : sizeof(white);
+        if (chunk > limit) {
+            chunk = limit;
+        }
+        DEV_SPI_Write_nByte(Image ? (UBYTE *)Image + sent : white, chunk);
+        sent += chunk;
+    }
+    DEV_Digital_Write(EPD_CS_PIN, 1);
+}
+
+/******************************************************************************
+function :	write a window of an image to RAM in bulk transactions
+parameter:
+     Reg   : 0x24 (new) or 0x26 (old) RAM
+     Image : full EPD_2IN9_V2_IMAGE_SIZE image the window is taken from
+     Xstart, Ystart, Xend, Yend : window in panel pixels, X a multiple of 8
+info:
+    The RAM window and cursor must already be set to the same area.
+******************************************************************************/
+static void EPD_2IN9_V2_SendWindowRAM(UBYTE Reg, const UBYTE *Image, UWORD Xstart, UWORD Ystart,
+                                      UWORD Xend, UWORD Yend) {
+    static UBYTE chunk[256];
+    UWORD width = (Xend >> 3) - (Xstart >> 3) + 1;
+    UWORD used = 0;
+
+    EPD_2IN9_V2_SendCommand(Reg);
+    DEV_Digital_Write(EPD_DC_PIN, 1);
+    DEV_Digital_Write(EPD_CS_PIN, 0);
+    for (UWORD y = Ystart; y <= Yend; y++) {
+        if (used + width > sizeof(chunk)) {
+            DEV_SPI_Write_nByte(chunk, used);
+            used = 0;
+        }
+        memcpy(chunk + used, Image + y * (EPD_2IN9_V2_WIDTH / 8) + (Xstart >> 3), width);
+        used += width;
+    }
+    if (used > 0) {
+        DEV_SPI_Write_nByte(chunk, used);
+    }
+    DEV_Digital_Write(EPD_CS_PIN, 1);
+}
+
 /******************************************************************************
 function :	Wait until the busy_pin goes LOW
 parameter:
@@ -187,10 +347,7 @@ bool EPD_2IN9_V2_WaitUntilIdle(void) {
 }
 
 static void EPD_2IN9_V2_LUT(UBYTE *lut) {
-    UBYTE count;
-    EPD_2IN9_V2_SendCommand(0x32);
-    for (count = 0; count < 153; count++)
-        EPD_2IN9_V2_SendData(lut[count]);
+    EPD_2IN9_V2_SendCommandData(0x32, lut, 153);
     if (!EPD_2IN9_V2_WaitUntilIdle()) {
         // 錯誤處理：重試、記錄、或報錯
         Debug("EPD BUSY timeout");
@@ -199,17 +356,11 @@ static void EPD_2IN9_V2_LUT(UBYTE *lut) {
 }
 
 static void EPD_2IN9_V2_LUT_by_host(UBYTE *lut) {
-    EPD_2IN9_V2_LUT((UBYTE *)lut); // lut
-    EPD_2IN9_V2_SendCommand(0x3f);
-    EPD_2IN9_V2_SendData(*(lut + 153));
-    EPD_2IN9_V2_SendCommand(0x03); // gate voltage
-    EPD_2IN9_V2_SendData(*(lut + 154));
-    EPD_2IN9_V2_SendCommand(0x04);      // source voltage
-    EPD_2IN9_V2_SendData(*(lut + 155)); // VSH
-    EPD_2IN9_V2_SendData(*(lut + 156)); // VSH2
-    EPD_2IN9_V2_SendData(*(lut + 157)); // VSL
-    EPD_2IN9_V2_SendCommand(0x2c);      // VCOM
-    EPD_2IN9_V2_SendData(*(lut + 158));
+    EPD_2IN9_V2_LUT((UBYTE *)lut);                      // lut
+    EPD_2IN9_V2_SendCommandData(0x3f, lut + 153, 1); // EOPT
+    EPD_2IN9_V2_SendCommandData(0x03, lut + 154, 1); // gate voltage
+    EPD_2IN9_V2_SendCommandData(0x04, lut + 155, 3); // source voltage VSH, VSH2, VSL
+    EPD_2IN9_V2_SendCommandData(0x2c, lut + 158, 1); // VCOM
 }
 
 /******************************************************************************
@@ -269,50 +420,22 @@ static void EPD_2IN9_V2_SetCursor(UWORD Xstart, UWORD Ystart) {
 }
 
 /******************************************************************************
-function :	Initialize the e-Paper register
+function :	Load a register table and LUT unless already loaded
 parameter:
+    Config : Configuration the table and LUT correspond to
+    Seq    : Register command table
+    Len    : Size of the command table
+    lut    : Waveform sent with EPD_2IN9_V2_LUT_by_host
 ******************************************************************************/
-void EPD_2IN9_V2_Init(void) {
-    EPD_2IN9_V2_Reset();
-    DEV_Delay_ms(100);
-
-    if (!EPD_2IN9_V2_WaitUntilIdle()) {
-        // 錯誤處理：重試、記錄、或報錯
-        Debug("EPD BUSY timeout");
+static void EPD_2IN9_V2_Init_Config(EPD_2IN9_V2_CONFIG Config, const UBYTE *Seq, UWORD Len,
+                                    UBYTE *lut) {
+    if (EPD_2IN9_V2_Config == Config) {
+        // 面板未進入 deep sleep，暫存器與 LUT 仍有效，只需重設游標
+        EPD_2IN9_V2_SetCursor(Config == EPD_2IN9_V2_CONFIG_GRAY4 ? 1 : 0, 0);
         return;
     }
-    EPD_2IN9_V2_SendCommand(0x12); // soft reset
-    if (!EPD_2IN9_V2_WaitUntilIdle()) {
-        // 錯誤處理：重試、記錄、或報錯
-        Debug("EPD BUSY timeout");
-        return;
-    }
-
-    EPD_2IN9_V2_SendCommand(0x01); // Driver output control
-    EPD_2IN9_V2_SendData(0x27);
-    EPD_2IN9_V2_SendData(0x01);
-    EPD_2IN9_V2_SendData(0x00);
+    EPD_2IN9_V2_Config = EPD_2IN9_V2_CONFIG_NONE;
 
-    EPD_2IN9_V2_SendCommand(0x11); // data entry mode
-    EPD_2IN9_V2_SendData(0x03);
-
-    EPD_2IN9_V2_SetWindows(0, 0, EPD_2IN9_V2_WIDTH - 1, EPD_2IN9_V2_HEIGHT - 1);
-
-    EPD_2IN9_V2_SendCommand(0x21); //  Display update control
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x80);
-
-    EPD_2IN9_V2_SetCursor(0, 0);
-    if (!EPD_2IN9_V2_WaitUntilIdle()) {
-        // 錯誤處理：重試、記錄、或報錯
-        Debug("EPD BUSY timeout");
-        return;
-    }
-
-    EPD_2IN9_V2_LUT_by_host(WS_20_30);
-}
-
-void EPD_2IN9_V2_Init_Fast(void) {
     EPD_2IN9_V2_Reset();
     DEV_Delay_ms(100);
 
@@ -328,70 +451,34 @@ void EPD_2IN9_V2_Init_Fast(void) {
         return;
     }
 
-    EPD_2IN9_V2_SendCommand(0x01); // Driver output control
-    EPD_2IN9_V2_SendData(0x27);
-    EPD_2IN9_V2_SendData(0x01);
-    EPD_2IN9_V2_SendData(0x00);
-
-    EPD_2IN9_V2_SendCommand(0x11); // data entry mode
-    EPD_2IN9_V2_SendData(0x03);
-
-    EPD_2IN9_V2_SetWindows(0, 0, EPD_2IN9_V2_WIDTH - 1, EPD_2IN9_V2_HEIGHT - 1);
-
-    EPD_2IN9_V2_SendCommand(0x3C);
-    EPD_2IN9_V2_SendData(0x05);
-
-    EPD_2IN9_V2_SendCommand(0x21); //  Display update control
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x80);
-
-    EPD_2IN9_V2_SetCursor(0, 0);
+    EPD_2IN9_V2_SendSequence(Seq, Len);
     if (!EPD_2IN9_V2_WaitUntilIdle()) {
         // 錯誤處理：重試、記錄、或報錯
         Debug("EPD BUSY timeout");
         return;
     }
 
-    EPD_2IN9_V2_LUT_by_host(WF_FULL);
+    EPD_2IN9_V2_LUT_by_host(lut);
+    EPD_2IN9_V2_Config = Config;
 }
 
-void EPD_2IN9_V2_Gray4_Init(void) {
-    EPD_2IN9_V2_Reset();
-    DEV_Delay_ms(100);
-
-    if (!EPD_2IN9_V2_WaitUntilIdle()) {
-        // 錯誤處理：重試、記錄、或報錯
-        Debug("EPD BUSY timeout");
-        return;
-    }
-    EPD_2IN9_V2_SendCommand(0x12); // soft reset
-    if (!EPD_2IN9_V2_WaitUntilIdle()) {
-        // 錯誤處理：重試、記錄、或報錯
-        Debug("EPD BUSY timeout");
-        return;
-    }
-
-    EPD_2IN9_V2_SendCommand(0x01); // Driver output control
-    EPD_2IN9_V2_SendData(0x27);
-    EPD_2IN9_V2_SendData(0x01);
-    EPD_2IN9_V2_SendData(0x00);
-
-    EPD_2IN9_V2_SendCommand(0x11); // data entry mode
-    EPD_2IN9_V2_SendData(0x03);
-
-    EPD_2IN9_V2_SetWindows(8, 0, EPD_2IN9_V2_WIDTH, EPD_2IN9_V2_HEIGHT - 1);
-
-    EPD_2IN9_V2_SendCommand(0x3C);
-    EPD_2IN9_V2_SendData(0x04);
+/******************************************************************************
+function :	Initialize the e-Paper register
+parameter:
+******************************************************************************/
+void EPD_2IN9_V2_Init(void) {
+    EPD_2IN9_V2_Init_Config(EPD_2IN9_V2_CONFIG_FULL, EPD_2IN9_V2_Init_Seq,
+                            sizeof(EPD_2IN9_V2_Init_Seq), WS_20_30);
+}
 
-    EPD_2IN9_V2_SetCursor(1, 0);
-    if (!EPD_2IN9_V2_WaitUntilIdle()) {
-        // 錯誤處理：重試、記錄、或報錯
-        Debug("EPD BUSY timeout");
-        return;
-    }
+void EPD_2IN9_V2_Init_Fast(void) {
+    EPD_2IN9_V2_Init_Config(EPD_2IN9_V2_CONFIG_FAST, EPD_2IN9_V2_Init_Fast_Seq,
+                            sizeof(EPD_2IN9_V2_Init_Fast_Seq), WF_FULL);
+}
 
-    EPD_2IN9_V2_LUT_by_host(Gray4);
+void EPD_2IN9_V2_Gray4_Init(void) {
+    EPD_2IN9_V2_Init_Config(EPD_2IN9_V2_CONFIG_GRAY4, EPD_2IN9_V2_Gray4_Init_Seq,
+                            sizeof(EPD_2IN9_V2_Gray4_Init_Seq), Gray4);
 }
 
 /******************************************************************************
@@ -399,17 +486,8 @@ function :	Clear screen
 parameter:
 ******************************************************************************/
 void EPD_2IN9_V2_Clear(void) {
-    UWORD i;
-
-    EPD_2IN9_V2_SendCommand(0x24); // write RAM for black(0)/white (1)
-    for (i = 0; i < 4736; i++) {
-        EPD_2IN9_V2_SendData(0xff);
-    }
-
-    EPD_2IN9_V2_SendCommand(0x26); // write RAM for black(0)/white (1)
-    for (i = 0; i < 4736; i++) {
-        EPD_2IN9_V2_SendData(0xff);
-    }
+    EPD_2IN9_V2_SendRAM(0x24, NULL); // write RAM for black(0)/white (1)
+    EPD_2IN9_V2_SendRAM(0x26, NULL); // write RAM for black(0)/white (1)
     EPD_2IN9_V2_TurnOnDisplay();
 }
 
@@ -418,25 +496,13 @@ function :	Sends the image buffer in RAM to e-Paper and displays
 parameter:
 ******************************************************************************/
 void EPD_2IN9_V2_Display(UBYTE *Image) {
-    UWORD i;
-    EPD_2IN9_V2_SendCommand(0x24); // write RAM for black(0)/white (1)
-    for (i = 0; i < 4736; i++) {
-        EPD_2IN9_V2_SendData(Image[i]);
-    }
+    EPD_2IN9_V2_SendRAM(0x24, Image); // write RAM for black(0)/white (1)
     EPD_2IN9_V2_TurnOnDisplay();
 }
 
 void EPD_2IN9_V2_Display_Base(UBYTE *Image) {
-    UWORD i;
-
-    EPD_2IN9_V2_SendCommand(0x24); // Write Black and White image to RAM
-    for (i = 0; i < 4736; i++) {
-        EPD_2IN9_V2_SendData(Image[i]);
-    }
-    EPD_2IN9_V2_SendCommand(0x26); // Write Black and White image to RAM
-    for (i = 0; i < 4736; i++) {
-        EPD_2IN9_V2_SendData(Image[i]);
-    }
+    EPD_2IN9_V2_SendRAM(0x24, Image); // Write Black and White image to RAM
+    EPD_2IN9_V2_SendRAM(0x26, Image); // Write Black and White image to RAM
     EPD_2IN9_V2_TurnOnDisplay();
 }
 
@@ -522,30 +588,24 @@ void EPD_2IN9_V2_4GrayDisplay(UBYTE *Image) {
     EPD_2IN9_V2_TurnOnDisplay();
 }
 
-void EPD_2IN9_V2_Display_Partial(UBYTE *Image) {
-    UWORD i;
-
-    // Reset
-    DEV_Digital_Write(EPD_RST_PIN, 0);
-    DEV_Delay_ms(1);
-    DEV_Digital_Write(EPD_RST_PIN, 1);
-    DEV_Delay_ms(2);
-
-    EPD_2IN9_V2_LUT(_WF_PARTIAL_2IN9);
-    EPD_2IN9_V2_SendCommand(0x37);
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x40);
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x00);
-    EPD_2IN9_V2_SendData(0x00);
-
-    EPD_2IN9_V2_SendCommand(0x3C); // BorderWavefrom
-    EPD_2IN9_V2_SendData(0x80);
+/******************************************************************************
+function :	Load the partial waveform unless it is already loaded, then turn
+            on the clock and analog circuits for the update
+******************************************************************************/
+static bool EPD_2IN9_V2_Init_Partial(void) {
+    if (EPD_2IN9_V2_Config != EPD_2IN9_V2_CONFIG_PARTIAL) {
+        EPD_2IN9_V2_Config = EPD_2IN9_V2_CONFIG_NONE;
+
+        // Reset
+        DEV_Digital_Write(EPD_RST_PIN, 0);
+        DEV_Delay_ms(1);
+        DEV_Digital_Write(EPD_RST_PIN, 1);
+        DEV_Delay_ms(2);
+
+        EPD_2IN9_V2_LUT(_WF_PARTIAL_2IN9);
+        EPD_2IN9_V2_SendSequence(EPD_2IN9_V2_Partial_Seq, sizeof(EPD_2IN9_V2_Partial_Seq));
+        EPD_2IN9_V2_Config = EPD_2IN9_V2_CONFIG_PARTIAL;
+    }
 
     EPD_2IN9_V2_SendCommand(0x22);
     EPD_2IN9_V2_SendData(0xC0);
@@ -553,19 +613,72 @@ void EPD_2IN9_V2_Display_Partial(UBYTE *Image) {
     if (!EPD_2IN9_V2_WaitUntilIdle()) {
         // 錯誤處理：重試、記錄、或報錯
         Debug("EPD BUSY timeout");
+        EPD_2IN9_V2_Config = EPD_2IN9_V2_CONFIG_NONE;
+        return false;
+    }
+    return true;
+}
+
+void EPD_2IN9_V2_Display_Partial(UBYTE *Image) {
+    if (!EPD_2IN9_V2_Init_Partial()) {
         return;
     }
 
     EPD_2IN9_V2_SetWindows(0, 0, EPD_2IN9_V2_WIDTH - 1, EPD_2IN9_V2_HEIGHT - 1);
     EPD_2IN9_V2_SetCursor(0, 0);
 
-    EPD_2IN9_V2_SendCommand(0x24); // Write Black and White image to RAM
-    for (i = 0; i < 4736; i++) {
-        EPD_2IN9_V2_SendData(Image[i]);
+    EPD_2IN9_V2_SendRAM(0x24, Image); // Write Black and White image to RAM
+    EPD_2IN9_V2_TurnOnDisplay_Partial();
+}
+
+/******************************************************************************
+function :	Partial refresh that only sends a window of the image
+parameter:
+    Image  : full image; only the window is sent
+    Xstart, Ystart, Xend, Yend : window in panel pixels, X a multiple of 8
+info:
+    The rest of the "new" RAM must still hold what is on the glass, e.g.
+    after EPD_2IN9_V2_Load_Base, so only the window changes on the panel.
+******************************************************************************/
+void EPD_2IN9_V2_Display_Partial_Window(UBYTE *Image, UWORD Xstart, UWORD Ystart, UWORD Xend,
+                                        UWORD Yend) {
+    if (!EPD_2IN9_V2_Init_Partial()) {
+        return;
     }
+
+    EPD_2IN9_V2_SetWindows(Xstart, Ystart, Xend, Yend);
+    EPD_2IN9_V2_SetCursor(Xstart >> 3, Ystart);
+    EPD_2IN9_V2_SendWindowRAM(0x24, Image, Xstart, Ystart, Xend, Yend);
     EPD_2IN9_V2_TurnOnDisplay_Partial();
 }
 
+/******************************************************************************
+function :	Load an image into both RAMs without refreshing the panel
+parameter:
+    Image : The image that is physically shown on the glass
+info:
+    After the module loses power its RAM no longer matches the glass. Writing
+    the last shown image to the "old" (0x26) and "new" (0x24) RAM lets the next
+    fast or partial refresh drive each pixel relative to what is really shown.
+******************************************************************************/
+void EPD_2IN9_V2_Load_Base(UBYTE *Image) {
+    EPD_2IN9_V2_Config = EPD_2IN9_V2_CONFIG_NONE;
+
+    EPD_2IN9_V2_Reset();
+    DEV_Delay_ms(10);
+    EPD_2IN9_V2_SendCommand(0x12); // soft reset, RAM is unaffected
+    if (!EPD_2IN9_V2_WaitUntilIdle()) {
+        Debug("EPD BUSY timeout");
+        return;
+    }
+
+    EPD_2IN9_V2_SendSequence(EPD_2IN9_V2_Base_Seq, sizeof(EPD_2IN9_V2_Base_Seq));
+    EPD_2IN9_V2_SendRAM(0x24, Image); // Write Black and White image to RAM
+    EPD_2IN9_V2_SetCursor(0, 0);
+    EPD_2IN9_V2_SendRAM(0x26, Image); // Write base image to "old" RAM
+    EPD_2IN9_V2_Config = EPD_2IN9_V2_CONFIG_BASE;
+}
+
 /******************************************************************************
 function :	Enter sleep mode
 parameter:
@@ -573,5 +686,6 @@ parameter:
 void EPD_2IN9_V2_Sleep(void) {
     EPD_2IN9_V2_SendCommand(0x10); // enter deep sleep
     EPD_2IN9_V2_SendData(0x01);
+    EPD_2IN9_V2_Config = EPD_2IN9_V2_CONFIG_NONE;
     DEV_Delay_ms(100);
 }
@@ -95,6 +95,7 @@ void DEV_SPI_Init() {
         .sclk_io_num = EPD_SCK_PIN,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
+        .max_transfer_sz = EPD_SPI_MAX_TRANSFER,
     };
     spi_device_interface_config_t devcfg = {
         .clock_speed_hz = 10 * 1000 * 1000, // 10MHz
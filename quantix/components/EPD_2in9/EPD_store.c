@@ -0,0 +1,152 @@
+/*****************************************************************************
+* | File      	:	EPD_store.c
+* | Function    :	Remember the image that is physically on the glass
+* | Info        :
+*   The panel keeps its picture without power but the controller RAM does not.
+*   A run-length encoded copy lives in RTC memory so deep sleep wakes can go
+*   straight to a partial refresh, and a raw copy is written to LittleFS before
+*   sleeping so a cold boot can still load a correct "old" image.
+******************************************************************************/
+#include "EPD_store.h"
+#include "Debug.h"
+#include "EPD_2in9.h"
+#include "esp_attr.h"
+#include <stdio.h>
+#include <string.h>
+
+#define EPD_STORE_MAGIC 0x45504431 // "EPD1"
+
+typedef struct {
+    UDOUBLE magic;
+    UDOUBLE checksum; // FNV-1a of the raw image
+    UWORD length;     // encoded bytes in rle[]
+    UBYTE rle[EPD_STORE_RTC_BYTES];
+} epd_rtc_store_t;
+
+typedef struct {
+    UDOUBLE magic;
+    UDOUBLE checksum;
+} epd_file_header_t;
+
+RTC_DATA_ATTR static epd_rtc_store_t rtc_store;
+
+static UBYTE pending_image[EPD_2IN9_V2_IMAGE_SIZE]; // image waiting to be flushed to LittleFS
+static bool pending = false;
+
+static UDOUBLE EPD_Store_Checksum(const UBYTE *Image) {
+    UDOUBLE hash = 2166136261u;
+    for (UDOUBLE i = 0; i < EPD_2IN9_V2_IMAGE_SIZE; i++) {
+        hash ^= Image[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/******************************************************************************
+function :	Encode the image as (count, value) pairs into RTC memory
+info:
+    Calendar screens are mostly white so this usually fits in well under 2KB.
+    If it does not, the RTC copy is dropped and only the LittleFS copy remains.
+******************************************************************************/
+static bool EPD_Store_Encode(const UBYTE *Image) {
+    UDOUBLE in = 0;
+    UWORD out = 0;
+
+    while (in < EPD_2IN9_V2_IMAGE_SIZE) {
+        UBYTE value = Image[in];
+        UBYTE count = 1;
+        while (in + count < EPD_2IN9_V2_IMAGE_SIZE && count < 255 && Image[in + count] == value) {
+            count++;
+        }
+        if (out + 2 > EPD_STORE_RTC_BYTES) {
+            return false;
+        }
+        rtc_store.rle[out++] = count;
+        rtc_store.rle[out++] = value;
+        in += count;
+    }
+    rtc_store.length = out;
+    return true;
+}
+
+static bool EPD_Store_Decode(UBYTE *Image) {
+    UDOUBLE out = 0;
+
+    if (rtc_store.length > EPD_STORE_RTC_BYTES || rtc_store.length % 2) {
+        return false;
+    }
+    for (UWORD in = 0; in < rtc_store.length; in += 2) {
+        UBYTE count = rtc_store.rle[in];
+        if (count == 0 || out + count > EPD_2IN9_V2_IMAGE_SIZE) {
+            return false;
+        }
+        memset(Image + out, rtc_store.rle[in + 1], count);
+        out += count;
+    }
+    return out == EPD_2IN9_V2_IMAGE_SIZE;
+}
+
+void EPD_Store_Remember(const UBYTE *Image) {
+    UDOUBLE checksum = EPD_Store_Checksum(Image);
+
+    rtc_store.magic = 0;
+    if (EPD_Store_Encode(Image)) {
+        rtc_store.checksum = checksum;
+        rtc_store.magic = EPD_STORE_MAGIC;
+    } else {
+        Debug("EPD store: image too complex for RTC copy\r\n");
+    }
+    memcpy(pending_image, Image, EPD_2IN9_V2_IMAGE_SIZE);
+    pending = true;
+}
+
+static bool EPD_Store_Load_File(UBYTE *Image) {
+    epd_file_header_t header;
+    FILE *f = fopen(EPD_STORE_PATH, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == EPD_STORE_MAGIC &&
+              fread(Image, 1, EPD_2IN9_V2_IMAGE_SIZE, f) == EPD_2IN9_V2_IMAGE_SIZE &&
+              EPD_Store_Checksum(Image) == header.checksum;
+    fclose(f);
+    return ok;
+}
+
+epd_store_source_t EPD_Store_Recall(UBYTE *Image) {
+    if (rtc_store.magic == EPD_STORE_MAGIC && EPD_Store_Decode(Image) &&
+        EPD_Store_Checksum(Image) == rtc_store.checksum) {
+        return EPD_STORE_RTC;
+    }
+    rtc_store.magic = 0;
+    if (EPD_Store_Load_File(Image)) {
+        return EPD_STORE_FLASH;
+    }
+    return EPD_STORE_NONE;
+}
+
+bool EPD_Store_In_RTC(void) { return rtc_store.magic == EPD_STORE_MAGIC; }
+
+bool EPD_Store_Flush(void) {
+    if (!pending) {
+        return true;
+    }
+    epd_file_header_t header = {
+        .magic = EPD_STORE_MAGIC,
+        .checksum = EPD_Store_Checksum(pending_image),
+    };
+    FILE *f = fopen(EPD_STORE_PATH, "wb");
+    if (f == NULL) {
+        Debug("EPD store: cannot open %s\r\n", EPD_STORE_PATH);
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(pending_image, 1, EPD_2IN9_V2_IMAGE_SIZE, f) == EPD_2IN9_V2_IMAGE_SIZE;
+    fclose(f);
+    if (ok) {
+        pending = false;
+    } else {
+        remove(EPD_STORE_PATH);
+    }
+    return ok;
+}
@@ -0,0 +1,46 @@
+/*****************************************************************************
+* | File      	:	EPD_config_host.c
+* | Function    :	DEV_* hardware layer backed by the panel emulator
+* | Info        :
+*   Drop-in replacement for EPD_config.c when building with
+*   EPD_HOST_EMULATOR. Delays advance the simulated clock instead of sleeping.
+******************************************************************************/
+#include "EPD_config.h"
+#include "EPD_emulator.h"
+
+void DEV_Delay_ms(uint32_t ms) { EPD_Emu_Delay_us((uint64_t)ms * 1000); }
+
+void DEV_SPI_WriteByte(uint8_t value) { EPD_Emu_SPI_Write(&value, 1); }
+
+void DEV_SPI_Write_nByte(uint8_t *value, size_t len) { EPD_Emu_SPI_Write(value, len); }
+
+void DEV_GPIO_Write(int pin, int value) { EPD_Emu_GPIO_Write(pin, value); }
+
+int DEV_GPIO_Read(int pin) { return EPD_Emu_GPIO_Read(pin); }
+
+void DEV_GPIO_Init(void) {}
+
+void DEV_SPI_Init(void) {}
+
+void DEV_SPI_SendData(UBYTE Reg) { EPD_Emu_SPI_Write(&Reg, 1); }
+
+UBYTE DEV_SPI_ReadData(void) { return 0xFF; }
+
+int DEV_Module_Init(void) {
+    DEV_GPIO_Init();
+    DEV_SPI_Init();
+    DEV_Digital_Write(EPD_DC_PIN, 0);
+    DEV_Digital_Write(EPD_CS_PIN, 0);
+    DEV_Digital_Write(EPD_PWR_PIN, 1);
+    DEV_Digital_Write(EPD_RST_PIN, 1);
+    return 0;
+}
+
+void DEV_Module_Exit(void) {
+    DEV_Digital_Write(EPD_DC_PIN, 0);
+    DEV_Digital_Write(EPD_CS_PIN, 0);
+
+    // close 5V
+    DEV_Digital_Write(EPD_PWR_PIN, 0);
+    DEV_Digital_Write(EPD_RST_PIN, 0);
+}
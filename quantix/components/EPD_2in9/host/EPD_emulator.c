@@ -0,0 +1,418 @@
+/*****************************************************************************
+* | File      	:	EPD_emulator.c
+* | Function    :	Host-side SSD1680 panel emulator
+* | Info        :
+*   Only the subset of the SSD1680 command set used by EPD_2in9.c is decoded.
+*   Timing is modelled, not measured: SPI bytes cost EPD_EMU_SPI_HZ bit times
+*   plus a fixed per-transaction overhead, and an update keeps BUSY high for
+*   the frame count of the loaded LUT at EPD_EMU_FRAME_US per frame.
+*
+*   The glass follows the waveform semantics that matter for ghosting:
+*   a display mode 1 update (0x22 bit 3 clear) drives every pixel to the new
+*   RAM, while a display mode 2 (partial) update only drives pixels whose old
+*   and new RAM differ and then copies the new RAM into the old RAM. Pixels
+*   where the old RAM did not match the glass are reported as stale.
+******************************************************************************/
+#include "EPD_emulator.h"
+#include "EPD_2in9.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define EMU_X_BYTES (EPD_2IN9_V2_WIDTH / 8)
+#define EMU_LINES EPD_2IN9_V2_HEIGHT
+#define EMU_LUT_SIZE 153
+#define EMU_LUT_GROUPS 12
+#define EMU_MAX_LUT_NAMES 8
+
+typedef struct {
+    UBYTE lut[EMU_LUT_SIZE];
+    const char *name;
+} emu_lut_name_t;
+
+static struct {
+    UBYTE ram_new[EPD_2IN9_V2_IMAGE_SIZE]; // 0x24
+    UBYTE ram_old[EPD_2IN9_V2_IMAGE_SIZE]; // 0x26
+    UBYTE glass[EPD_2IN9_V2_IMAGE_SIZE];
+    UBYTE lut[EMU_LUT_SIZE];
+    bool lut_loaded;
+
+    UBYTE entry_mode;
+    UBYTE x_start, x_end, x;
+    UWORD y_start, y_end, y;
+    UBYTE update_control;
+
+    UBYTE cmd;
+    UDOUBLE data_index;
+    bool sleeping;
+    bool powered;
+    int dc, cs, rst;
+
+    uint64_t now_ns;
+    uint64_t busy_until_ns;
+    uint64_t last_refresh_end_ns;
+    UDOUBLE bytes, transactions;
+    UDOUBLE total_bytes, total_transactions;
+    UDOUBLE refresh_count;
+    UDOUBLE seed;
+} emu;
+
+static emu_lut_name_t lut_names[EMU_MAX_LUT_NAMES];
+static UDOUBLE lut_name_count = 0;
+static epd_emu_refresh_cb_t refresh_cb = NULL;
+
+static UDOUBLE emu_popcount(UBYTE value) {
+    UDOUBLE count = 0;
+    while (value) {
+        value &= value - 1;
+        count++;
+    }
+    return count;
+}
+
+/******************************************************************************
+function :	Fill both RAMs with noise, as after the module loses power
+******************************************************************************/
+static void emu_scramble_ram(void) {
+    for (UDOUBLE i = 0; i < EPD_2IN9_V2_IMAGE_SIZE; i++) {
+        emu.seed ^= emu.seed << 13;
+        emu.seed ^= emu.seed >> 17;
+        emu.seed ^= emu.seed << 5;
+        emu.ram_new[i] = emu.seed & 0xFF;
+        emu.ram_old[i] = (emu.seed >> 8) & 0xFF;
+    }
+    emu.lut_loaded = false;
+}
+
+/******************************************************************************
+function :	Register defaults after a hardware or software reset (RAM is kept)
+******************************************************************************/
+static void emu_reset_registers(void) {
+    emu.entry_mode = 0x03;
+    emu.x_start = 0;
+    emu.x_end = EMU_X_BYTES - 1;
+    emu.y_start = 0;
+    emu.y_end = EMU_LINES - 1;
+    emu.x = 0;
+    emu.y = 0;
+    emu.update_control = 0xFF;
+    emu.sleeping = false;
+}
+
+void EPD_Emu_Reset(void) {
+    memset(&emu, 0, sizeof(emu));
+    emu.seed = 0x2545F491;
+    emu.cs = 1;
+    emu.rst = 1;
+    memset(emu.glass, 0xFF, sizeof(emu.glass));
+    emu_scramble_ram();
+    emu_reset_registers();
+}
+
+void EPD_Emu_Set_Glass(const UBYTE *Image) { memcpy(emu.glass, Image, sizeof(emu.glass)); }
+
+void EPD_Emu_Name_LUT(const UBYTE *lut, const char *name) {
+    for (UDOUBLE i = 0; i < lut_name_count; i++) {
+        if (memcmp(lut_names[i].lut, lut, EMU_LUT_SIZE) == 0) {
+            lut_names[i].name = name;
+            return;
+        }
+    }
+    if (lut_name_count < EMU_MAX_LUT_NAMES) {
+        memcpy(lut_names[lut_name_count].lut, lut, EMU_LUT_SIZE);
+        lut_names[lut_name_count].name = name;
+        lut_name_count++;
+    }
+}
+
+void EPD_Emu_Set_Refresh_Callback(epd_emu_refresh_cb_t cb) { refresh_cb = cb; }
+
+const UBYTE *EPD_Emu_Glass(void) { return emu.glass; }
+const UBYTE *EPD_Emu_RAM_New(void) { return emu.ram_new; }
+const UBYTE *EPD_Emu_RAM_Old(void) { return emu.ram_old; }
+uint64_t EPD_Emu_Now_us(void) { return emu.now_ns / 1000; }
+UDOUBLE EPD_Emu_Total_Bytes(void) { return emu.total_bytes; }
+UDOUBLE EPD_Emu_Total_Transactions(void) { return emu.total_transactions; }
+UDOUBLE EPD_Emu_Refresh_Count(void) { return emu.refresh_count; }
+
+static const char *emu_lut_name(void) {
+    if (!emu.lut_loaded || (emu.update_control & 0x10)) {
+        return "otp";
+    }
+    for (UDOUBLE i = 0; i < lut_name_count; i++) {
+        if (memcmp(lut_names[i].lut, emu.lut, EMU_LUT_SIZE) == 0) {
+            return lut_names[i].name;
+        }
+    }
+    return "unknown";
+}
+
+/******************************************************************************
+function :	Count waveform frames of the loaded LUT
+info:
+    Each of the 12 groups is TPA TPB SRAB TPC TPD SRCD RP, starting at byte 60.
+******************************************************************************/
+static UDOUBLE emu_lut_frames(void) {
+    if (!emu.lut_loaded || (emu.update_control & 0x10)) {
+        return EPD_EMU_OTP_FRAMES;
+    }
+    UDOUBLE frames = 0;
+    for (UDOUBLE g = 0; g < EMU_LUT_GROUPS; g++) {
+        const UBYTE *p = &emu.lut[60 + g * 7];
+        UDOUBLE ab = (p[0] + p[1]) * (p[2] + 1);
+        UDOUBLE cd = (p[3] + p[4]) * (p[5] + 1);
+        frames += (ab + cd) * (p[6] + 1);
+    }
+    return frames;
+}
+
+static void emu_update_glass(bool partial, epd_emu_refresh_t *refresh) {
+    for (UDOUBLE i = 0; i < EPD_2IN9_V2_IMAGE_SIZE; i++) {
+        UBYTE before = emu.glass[i];
+        UBYTE after = emu.ram_new[i];
+        if (partial) {
+            UBYTE driven = emu.ram_old[i] ^ emu.ram_new[i];
+            after = (before & ~driven) | (emu.ram_new[i] & driven);
+            refresh->stale_pixels += emu_popcount(~driven & (before ^ emu.ram_new[i]));
+            emu.ram_old[i] = emu.ram_new[i];
+        }
+        refresh->pixels_changed += emu_popcount(before ^ after);
+        emu.glass[i] = after;
+    }
+}
+
+/******************************************************************************
+function :	Master activation (0x20): run the sequence selected by 0x22
+******************************************************************************/
+static void emu_activate(void) {
+    UBYTE ctrl = emu.update_control;
+    uint64_t busy_us = 0;
+
+    if (ctrl & 0x40) { // enable analog
+        busy_us += EPD_EMU_ANALOG_US;
+    }
+    if (ctrl & 0x02) { // disable analog
+        busy_us += EPD_EMU_ANALOG_US;
+    }
+    if (ctrl & 0x04) { // display
+        epd_emu_refresh_t refresh = {
+            .index = ++emu.refresh_count,
+            .waveform = emu_lut_name(),
+            .update_control = ctrl,
+            .frames = emu_lut_frames(),
+            .spi_bytes = emu.bytes,
+            .spi_transactions = emu.transactions,
+            .host_us = (emu.now_ns - emu.last_refresh_end_ns) / 1000,
+        };
+        busy_us += (uint64_t)refresh.frames * EPD_EMU_FRAME_US;
+        refresh.busy_us = busy_us;
+        emu_update_glass(ctrl & 0x08, &refresh);
+
+        emu.bytes = 0;
+        emu.transactions = 0;
+        emu.last_refresh_end_ns = emu.now_ns + busy_us * 1000;
+        if (refresh_cb) {
+            refresh_cb(&refresh);
+        }
+    }
+    emu.busy_until_ns = emu.now_ns + busy_us * 1000;
+}
+
+/******************************************************************************
+function :	Move the RAM address counter according to the data entry mode
+******************************************************************************/
+static bool emu_step_x(void) {
+    if (emu.x == emu.x_end) {
+        emu.x = emu.x_start;
+        return true;
+    }
+    emu.x += (emu.entry_mode & 0x01) ? 1 : -1;
+    return false;
+}
+
+static bool emu_step_y(void) {
+    if (emu.y == emu.y_end) {
+        emu.y = emu.y_start;
+        return true;
+    }
+    emu.y += (emu.entry_mode & 0x02) ? 1 : -1;
+    return false;
+}
+
+static void emu_ram_write(UBYTE *ram, UBYTE value) {
+    if (emu.x < EMU_X_BYTES && emu.y < EMU_LINES) {
+        ram[emu.y * EMU_X_BYTES + emu.x] = value;
+    }
+    if (emu.entry_mode & 0x04) {
+        if (emu_step_y()) {
+            emu_step_x();
+        }
+    } else if (emu_step_x()) {
+        emu_step_y();
+    }
+}
+
+static void emu_command(UBYTE cmd) {
+    emu.cmd = cmd;
+    emu.data_index = 0;
+    switch (cmd) {
+    case 0x12: // software reset
+        emu_reset_registers();
+        emu.busy_until_ns = emu.now_ns + (uint64_t)EPD_EMU_SWRESET_US * 1000;
+        break;
+    case 0x20:
+        emu_activate();
+        break;
+    default:
+        break;
+    }
+}
+
+static void emu_data(UBYTE value) {
+    UDOUBLE i = emu.data_index++;
+
+    switch (emu.cmd) {
+    case 0x10: // deep sleep mode
+        if (value & 0x03) {
+            emu.sleeping = true;
+        }
+        if ((value & 0x03) == 0x03) { // mode 2 does not retain RAM
+            emu_scramble_ram();
+        }
+        break;
+    case 0x11:
+        emu.entry_mode = value & 0x07;
+        break;
+    case 0x22:
+        emu.update_control = value;
+        break;
+    case 0x24:
+        emu_ram_write(emu.ram_new, value);
+        break;
+    case 0x26:
+        emu_ram_write(emu.ram_old, value);
+        break;
+    case 0x32:
+        if (i < EMU_LUT_SIZE) {
+            emu.lut[i] = value;
+            emu.lut_loaded = (i == EMU_LUT_SIZE - 1) || emu.lut_loaded;
+        }
+        break;
+    case 0x44:
+        if (i == 0) {
+            emu.x_start = value & 0x3F;
+        } else if (i == 1) {
+            emu.x_end = value & 0x3F;
+        }
+        break;
+    case 0x45:
+        if (i == 0) {
+            emu.y_start = value;
+        } else if (i == 1) {
+            emu.y_start |= (value & 0x01) << 8;
+        } else if (i == 2) {
+            emu.y_end = value;
+        } else if (i == 3) {
+            emu.y_end |= (value & 0x01) << 8;
+        }
+        break;
+    case 0x4E:
+        emu.x = value & 0x3F;
+        break;
+    case 0x4F:
+        if (i == 0) {
+            emu.y = value;
+        } else if (i == 1) {
+            emu.y |= (value & 0x01) << 8;
+        }
+        break;
+    default: // 0x01, 0x03, 0x04, 0x21, 0x2C, 0x37, 0x3C, 0x3F: no visible effect
+        break;
+    }
+}
+
+void EPD_Emu_SPI_Write(const UBYTE *data, size_t len) {
+    emu.now_ns += EPD_EMU_SPI_TRANSACTION_NS + (uint64_t)len * 8 * 1000000000ull / EPD_EMU_SPI_HZ;
+    emu.transactions++;
+    emu.total_transactions++;
+    emu.bytes += len;
+    emu.total_bytes += len;
+
+    if (!emu.powered || emu.sleeping || emu.cs) {
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (emu.dc == 0) {
+            emu_command(data[i]);
+        } else {
+            emu_data(data[i]);
+        }
+    }
+}
+
+void EPD_Emu_GPIO_Write(int pin, int value) {
+    if (pin == EPD_DC_PIN) {
+        emu.dc = value;
+    } else if (pin == EPD_CS_PIN) {
+        emu.cs = value;
+    } else if (pin == EPD_RST_PIN) {
+        if (emu.rst && !value) { // falling edge: hardware reset
+            emu_reset_registers();
+        }
+        emu.rst = value;
+    } else if (pin == EPD_PWR_PIN) {
+        if (emu.powered && !value) {
+            emu_scramble_ram();
+        }
+        emu.powered = value;
+    }
+}
+
+int EPD_Emu_GPIO_Read(int pin) {
+    if (pin == EPD_BUSY_PIN) {
+        return emu.now_ns < emu.busy_until_ns ? 1 : 0;
+    }
+    return 0;
+}
+
+void EPD_Emu_Delay_us(uint64_t us) { emu.now_ns += us * 1000; }
+
+/******************************************************************************
+function :	Write the glass as a binary PBM (1 = black)
+parameter:
+    rotate : 0 for the native 128x296 layout, 90 for the landscape UI layout
+******************************************************************************/
+int EPD_Emu_Save_PBM(const char *path, UWORD rotate) {
+    UWORD width = rotate == 90 ? EMU_LINES : EPD_2IN9_V2_WIDTH;
+    UWORD height = rotate == 90 ? EPD_2IN9_V2_WIDTH : EMU_LINES;
+    UBYTE row[(EMU_LINES + 7) / 8];
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+
+    fprintf(f, "P4\n%u %u\n", width, height);
+    for (UWORD ly = 0; ly < height; ly++) {
+        memset(row, 0, sizeof(row));
+        for (UWORD lx = 0; lx < width; lx++) {
+            // 與 Paint_SetPixel 的 ROTATE_90 對應
+            UWORD mx = rotate == 90 ? EPD_2IN9_V2_WIDTH - 1 - ly : lx;
+            UWORD my = rotate == 90 ? lx : ly;
+            bool white = emu.glass[my * EMU_X_BYTES + mx / 8] & (0x80 >> (mx % 8));
+            if (!white) {
+                row[lx / 8] |= 0x80 >> (lx % 8);
+            }
+        }
+        fwrite(row, 1, (width + 7) / 8, f);
+    }
+    fclose(f);
+    return 0;
+}
+
+void EPD_Emu_Print_Refresh(FILE *out, const epd_emu_refresh_t *refresh) {
+    fprintf(out,
+            "refresh #%u %-8s ctrl=0x%02X frames=%-3u busy=%7.1fms host=%7.1fms "
+            "spi=%5u bytes/%5u xfers changed=%5u stale=%u\n",
+            refresh->index, refresh->waveform, refresh->update_control, refresh->frames,
+            refresh->busy_us / 1000.0, refresh->host_us / 1000.0, refresh->spi_bytes,
+            refresh->spi_transactions, refresh->pixels_changed, refresh->stale_pixels);
+}
@@ -0,0 +1,94 @@
+/*****************************************************************************
+* | File      	:	epd_emu_demo.c
+* | Function    :	Run the display path against the panel emulator
+* | Info        :
+*   Replays the refresh sequence of a cold boot followed by a scroll:
+*   full refresh of a blank screen, fast refresh of a calendar view and
+*   partial refreshes of the next two days, then a clock tick after deep sleep
+*   that reloads the base image and refreshes only a small window. The glass
+*   is written as PBM after every step and per-refresh statistics are printed.
+*
+*   usage: epd_emu_demo [output directory]
+******************************************************************************/
+#include "EPD_2in9.h"
+#include "EPD_emulator.h"
+#include "GUI_Paint.h"
+#include <stdlib.h>
+
+// 驅動程式中的波形表
+extern UBYTE WS_20_30[159];
+extern unsigned char WF_FULL[159];
+extern UBYTE _WF_PARTIAL_2IN9[159];
+
+static void print_refresh(const epd_emu_refresh_t *refresh) { EPD_Emu_Print_Refresh(stdout, refresh); }
+
+static void draw_day(UBYTE *image, const char *date, const char *event) {
+    Paint_SelectImage(image);
+    Paint_Clear(WHITE);
+    Paint_DrawRectangle(1, 1, EPD_2IN9_V2_HEIGHT, EPD_2IN9_V2_WIDTH, BLACK, DOT_PIXEL_1X1,
+                        DRAW_FILL_EMPTY);
+    Paint_DrawString_EN(8, 8, date, &Font24, WHITE, BLACK);
+    Paint_DrawLine(8, 40, EPD_2IN9_V2_HEIGHT - 8, 40, BLACK, DOT_PIXEL_1X1, LINE_STYLE_SOLID);
+    Paint_DrawString_EN(8, 52, event, &Font16, WHITE, BLACK);
+}
+
+static void save(const char *dir, const char *name) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (EPD_Emu_Save_PBM(path, 90) != 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : ".";
+    UBYTE *image = malloc(EPD_2IN9_V2_IMAGE_SIZE);
+    if (image == NULL) {
+        return 1;
+    }
+
+    EPD_Emu_Reset();
+    EPD_Emu_Name_LUT(WS_20_30, "full");
+    EPD_Emu_Name_LUT(WF_FULL, "fast");
+    EPD_Emu_Name_LUT(_WF_PARTIAL_2IN9, "partial");
+    EPD_Emu_Set_Refresh_Callback(print_refresh);
+
+    DEV_Module_Init();
+    Paint_NewImage(image, EPD_2IN9_V2_WIDTH, EPD_2IN9_V2_HEIGHT, 90, WHITE);
+
+    Paint_Clear(WHITE);
+    EPD_2IN9_V2_Init();
+    EPD_2IN9_V2_Display_Base(image);
+    save(dir, "epd_emu_1_full.pbm");
+
+    draw_day(image, "2025-06-01", "10:00 Team sync");
+    EPD_2IN9_V2_Init_Fast();
+    EPD_2IN9_V2_Display_Base(image);
+    save(dir, "epd_emu_2_fast.pbm");
+
+    draw_day(image, "2025-06-02", "No events");
+    EPD_2IN9_V2_Display_Partial(image);
+    save(dir, "epd_emu_3_partial.pbm");
+
+    draw_day(image, "2025-06-03", "19:30 Dinner");
+    EPD_2IN9_V2_Display_Partial(image);
+    save(dir, "epd_emu_4_partial.pbm");
+
+    // 深度睡眠時面板斷電：RAM 遺失，面板保留影像。時鐘喚醒只送出時間所在的視窗
+    EPD_2IN9_V2_Sleep();
+    DEV_Module_Exit();
+    DEV_Module_Init();
+    EPD_2IN9_V2_Load_Base(image);
+    Paint_DrawString_EN(13, 106, "10:31", &Font12, WHITE, BLACK);
+    // 旋轉 90 度：畫面 x 13..42 為面板第 13..42 行，y 104..119 為面板 X 8..23
+    EPD_2IN9_V2_Display_Partial_Window(image, 8, 13, 23, 42);
+    save(dir, "epd_emu_5_window.pbm");
+
+    EPD_2IN9_V2_Sleep();
+
+    printf("total: %u refreshes, %u bytes in %u transactions, %.1f ms simulated\n",
+           EPD_Emu_Refresh_Count(), EPD_Emu_Total_Bytes(), EPD_Emu_Total_Transactions(),
+           EPD_Emu_Now_us() / 1000.0);
+    free(image);
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*****************************************************************************
+* | File      	:	EPD_emulator.h
+* | Function    :	Host-side SSD1680 panel emulator
+* | Info        :
+*   Decodes the command stream produced by EPD_2in9.c through the DEV_* layer,
+*   keeps the controller RAM and the image on the glass, and simulates BUSY
+*   timing so the whole rendering path can run on a Linux host.
+******************************************************************************/
+#ifndef __EPD_EMULATOR_H_
+#define __EPD_EMULATOR_H_
+
+#include "EPD_config.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// 模擬 SPI 時脈，與 EPD_config.c 的 10MHz 相同
+#define EPD_EMU_SPI_HZ 10000000
+// 每次 spi_device_transmit 的固定成本 (驅動程式 + 中斷)
+#define EPD_EMU_SPI_TRANSACTION_NS 15000
+// 波形每一幀的時間 (50Hz)
+#define EPD_EMU_FRAME_US 20000
+// 每次開/關類比電源的時間
+#define EPD_EMU_ANALOG_US 5000
+// 軟體重置 (0x12) 的 BUSY 時間
+#define EPD_EMU_SWRESET_US 2000
+// 未載入 LUT 時 (OTP 波形) 假設的幀數
+#define EPD_EMU_OTP_FRAMES 150
+
+// 一次面板刷新 (0x20) 的統計
+typedef struct {
+    UDOUBLE index;            // 第幾次刷新，從 1 開始
+    const char *waveform;     // EPD_Emu_Name_LUT 註冊的名稱，或 "otp"/"unknown"
+    UBYTE update_control;     // 0x22 的參數
+    UDOUBLE frames;           // 波形幀數
+    uint64_t busy_us;         // 刷新期間 BUSY 的模擬時間
+    UDOUBLE spi_bytes;        // 自上次刷新以來送出的 bytes
+    UDOUBLE spi_transactions; // 自上次刷新以來的 SPI transaction 數
+    uint64_t host_us;         // 自上次刷新結束到這次刷新開始的模擬時間
+    UDOUBLE pixels_changed;   // 面板上實際改變的像素
+    UDOUBLE stale_pixels;     // 局部刷新時舊 RAM 與面板不一致而未被驅動的像素
+} epd_emu_refresh_t;
+
+typedef void (*epd_emu_refresh_cb_t)(const epd_emu_refresh_t *refresh);
+
+// 重設模擬器：面板為白色，控制器 RAM 為亂數 (與剛上電相同)
+void EPD_Emu_Reset(void);
+// 設定面板上目前的影像 (EPD_2IN9_V2_IMAGE_SIZE bytes，1 = 白)
+void EPD_Emu_Set_Glass(const UBYTE *Image);
+// 為 LUT 命名，刷新統計會以此名稱回報波形
+void EPD_Emu_Name_LUT(const UBYTE *lut, const char *name);
+// 每次刷新完成後呼叫 cb
+void EPD_Emu_Set_Refresh_Callback(epd_emu_refresh_cb_t cb);
+
+// 面板上的影像與控制器 RAM (0x24 / 0x26)
+const UBYTE *EPD_Emu_Glass(void);
+const UBYTE *EPD_Emu_RAM_New(void);
+const UBYTE *EPD_Emu_RAM_Old(void);
+
+// 模擬時間與累計的 SPI 流量
+uint64_t EPD_Emu_Now_us(void);
+UDOUBLE EPD_Emu_Total_Bytes(void);
+UDOUBLE EPD_Emu_Total_Transactions(void);
+UDOUBLE EPD_Emu_Refresh_Count(void);
+
+// 以 PBM (P4) 格式輸出面板影像，rotate 為 0 或 90 (與 Paint_NewImage 相同)
+int EPD_Emu_Save_PBM(const char *path, UWORD rotate);
+void EPD_Emu_Print_Refresh(FILE *out, const epd_emu_refresh_t *refresh);
+
+// 由 EPD_config_host.c 呼叫的硬體介面
+void EPD_Emu_GPIO_Write(int pin, int value);
+int EPD_Emu_GPIO_Read(int pin);
+void EPD_Emu_SPI_Write(const UBYTE *data, size_t len);
+void EPD_Emu_Delay_us(uint64_t us);
+
+#endif
@@ -36,6 +36,7 @@
 // Display resolution
 #define EPD_2IN9_V2_WIDTH 128
 #define EPD_2IN9_V2_HEIGHT 296
+#define EPD_2IN9_V2_IMAGE_SIZE ((EPD_2IN9_V2_WIDTH / 8) * EPD_2IN9_V2_HEIGHT)
 #define EPD_BUSY_TIMEOUT_MS 15000 // 15 秒 timeout
 
 void EPD_2IN9_V2_Init(void);
@@ -46,5 +47,8 @@ void EPD_2IN9_V2_Display(UBYTE *Image);
 void EPD_2IN9_V2_Display_Base(UBYTE *Image);
 void EPD_2IN9_V2_4GrayDisplay(UBYTE *Image);
 void EPD_2IN9_V2_Display_Partial(UBYTE *Image);
+void EPD_2IN9_V2_Display_Partial_Window(UBYTE *Image, UWORD Xstart, UWORD Ystart, UWORD Xend,
+                                        UWORD Yend);
+void EPD_2IN9_V2_Load_Base(UBYTE *Image);
 void EPD_2IN9_V2_Sleep(void);
 #endif
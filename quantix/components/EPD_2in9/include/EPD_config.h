@@ -48,10 +48,16 @@
 #ifndef _DEV_CONFIG_H_
 #define _DEV_CONFIG_H_
 
+#ifdef EPD_HOST_EMULATOR
+// Linux host build: the DEV_* layer is backed by host/EPD_emulator.c
+#include <stdbool.h>
+#include <stddef.h>
+#else
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/spi_master.h"
+#endif
 #include <stdint.h>
 #include <stdio.h>
 
@@ -74,11 +80,21 @@
 #define EPD_MISO_PIN    -1
 #define EPD_PWR_PIN     17
 
+// Largest single SPI transaction, also used as the bus max_transfer_sz
+#define EPD_SPI_MAX_TRANSFER 4096
+
 /**
  * GPIO read and write
 **/
+#ifdef EPD_HOST_EMULATOR
+void DEV_GPIO_Write(int pin, int value);
+int DEV_GPIO_Read(int pin);
+#define DEV_Digital_Write(_pin, _value) DEV_GPIO_Write(_pin, (_value) ? 1 : 0)
+#define DEV_Digital_Read(_pin) DEV_GPIO_Read(_pin)
+#else
 #define DEV_Digital_Write(_pin, _value) gpio_set_level(_pin, (_value) ? 1 : 0)
 #define DEV_Digital_Read(_pin) gpio_get_level(_pin)
+#endif
 
 /**
  * Function prototypes
@@ -0,0 +1,28 @@
+#ifndef __EPD_STORE_H_
+#define __EPD_STORE_H_
+
+#include "EPD_config.h"
+#include <stdbool.h>
+
+// 最後一張顯示影像的 LittleFS 備份
+#define EPD_STORE_PATH "/littlefs/epd_last.bin"
+// RTC 記憶體中 RLE 壓縮影像的上限 (bytes)
+#define EPD_STORE_RTC_BYTES 2048
+
+// 取回影像的來源
+typedef enum {
+    EPD_STORE_NONE = 0, // 沒有可用的影像，面板內容未知
+    EPD_STORE_RTC,      // 來自 RTC 記憶體 (deep sleep 喚醒)，與面板一致
+    EPD_STORE_FLASH,    // 來自 LittleFS (冷開機)，可能比面板舊一次刷新
+} epd_store_source_t;
+
+// 記錄剛刷新到面板上的影像 (RTC 立即更新，LittleFS 延後到 EPD_Store_Flush)
+void EPD_Store_Remember(const UBYTE *Image);
+// 取回最後顯示的影像，Image 需有 EPD_2IN9_V2_IMAGE_SIZE bytes
+epd_store_source_t EPD_Store_Recall(UBYTE *Image);
+// RTC 記憶體中是否有影像 (EPD_Store_Recall 不需要 LittleFS)
+bool EPD_Store_In_RTC(void);
+// 若有尚未寫入的影像，寫入 LittleFS (進入 deep sleep 前呼叫)
+bool EPD_Store_Flush(void);
+
+#endif
@@ -15,7 +15,11 @@ char *jwt_load_from_nvs() {
     }
 
     char *jwt = malloc(required_size);
-    nvs_get_str(handle, "jwt", jwt, &required_size);
+    if (jwt == NULL || nvs_get_str(handle, "jwt", jwt, &required_size) != ESP_OK) {
+        free(jwt);
+        nvs_close(handle);
+        return NULL;
+    }
     nvs_close(handle);
     return jwt;
 }
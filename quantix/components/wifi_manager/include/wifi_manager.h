@@ -216,7 +216,9 @@ typedef enum message_code_t {
     WM_EVENT_SCAN_DONE = 11,
     WM_EVENT_STA_GOT_IP = 12,
     WM_ORDER_STOP_AP = 13,
-    WM_MESSAGE_CODE_COUNT = 14 /* important for the callback array */
+    WM_ORDER_STOP_STA = 14,
+    WM_ORDER_RESUME_STA = 15,
+    WM_MESSAGE_CODE_COUNT = 16 /* important for the callback array */
 
 } message_code_t;
 
@@ -328,6 +330,19 @@ void wifi_manager_scan_awifi_manager_send_messagesync();
  */
 void wifi_manager_disconnect_async();
 
+/**
+ * @brief requests to switch the radio off (esp_wifi_stop) while keeping the access point saved.
+ *
+ * Ignored while the SoftAP is running. A lost connection is not retried until the radio is
+ * resumed with wifi_manager_resume_sta_async.
+ */
+void wifi_manager_stop_sta_async();
+
+/**
+ * @brief requests to switch the radio back on and reconnect to the saved access point.
+ */
+void wifi_manager_resume_sta_async();
+
 /**
  * @brief Tries to get access to json buffer mutex.
  *
@@ -29,8 +29,10 @@ Contains the freeRTOS task and all necessary support
 @see https://github.com/tonyp7/esp32-wifi-manager
 */
 
+#include "esp_attr.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_mac.h"
 #include "esp_netif.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
@@ -53,6 +55,7 @@ Contains the freeRTOS task and all necessary support
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "dns_server.h"
 #include "json.h"
@@ -81,6 +84,33 @@ char *accessp_json = NULL;
 char *ip_info_json = NULL;
 wifi_config_t *wifi_manager_config_sta = NULL;
 
+/* @brief Magic value marking rtc_fast_reconnect as valid */
+#define FAST_RECONNECT_MAGIC 0x57464152
+
+/* @brief The last successful connection, kept in RTC memory so that a wake from deep sleep can
+ * connect to the same AP without scanning every channel, and reuse the IP lease without DHCP */
+typedef struct {
+    uint32_t magic;
+    uint8_t ssid[MAX_SSID_SIZE];
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns;
+    int64_t leased_at; /* system time (s) at which ip_info was obtained from the DHCP server */
+} wifi_manager_fast_reconnect_t;
+
+RTC_DATA_ATTR static wifi_manager_fast_reconnect_t rtc_fast_reconnect;
+
+/* @brief Set while a connection attempt targets the AP saved in rtc_fast_reconnect */
+static bool fast_reconnect_attempt = false;
+
+/* @brief Set when the radio was stopped while connected, until the disconnection this causes has
+ * been handled. It may be handled after the radio was already resumed */
+static bool sta_stop_disconnect_pending = false;
+
+/* @brief Set while the STA netif uses the saved lease instead of its DHCP client */
+static bool fast_reconnect_static_ip = false;
+
 /* @brief Array of callback function pointers */
 void (**cb_ptr_arr)(void *) = NULL;
 
@@ -141,6 +171,9 @@ const int WIFI_MANAGER_SCAN_BIT = BIT7;
 /* @brief When set, means user requested for a disconnect */
 const int WIFI_MANAGER_REQUEST_DISCONNECT_BIT = BIT8;
 
+/* @brief When set, the radio was switched off on request and stays off until it is resumed */
+const int WIFI_MANAGER_STA_STOPPED_BIT = BIT9;
+
 void wifi_manager_timer_retry_cb(TimerHandle_t xTimer) {
 
     ESP_LOGI(TAG, "Retry Timer Tick! Sending ORDER_CONNECT_STA with reason "
@@ -166,6 +199,95 @@ void wifi_manager_scan_async() { wifi_manager_send_message(WM_ORDER_START_WIFI_S
 
 void wifi_manager_disconnect_async() { wifi_manager_send_message(WM_ORDER_DISCONNECT_STA, NULL); }
 
+void wifi_manager_stop_sta_async() { wifi_manager_send_message(WM_ORDER_STOP_STA, NULL); }
+
+void wifi_manager_resume_sta_async() { wifi_manager_send_message(WM_ORDER_RESUME_STA, NULL); }
+
+/* @brief Stops using the saved lease and gives the STA netif back to its DHCP client */
+static void wifi_manager_fast_reconnect_use_dhcp() {
+    if (fast_reconnect_static_ip) {
+        fast_reconnect_static_ip = false;
+        esp_netif_dhcpc_start(esp_netif_sta);
+    }
+}
+
+/* @brief Forgets the saved connection, e.g. when it failed or the credentials changed */
+static void wifi_manager_fast_reconnect_clear() { rtc_fast_reconnect.magic = 0; }
+
+/* @brief Directs a connection attempt to the AP saved in rtc_fast_reconnect.
+ *
+ * When the saved SSID matches, the BSSID and channel are set in config so the driver probes a
+ * single channel instead of scanning all of them. If the lease is younger than
+ * CONFIG_WIFI_MANAGER_FAST_RECONNECT_LEASE_MIN it is also applied as a static configuration,
+ * so IP_EVENT_STA_GOT_IP arises as soon as the station is associated.
+ *
+ * @return true if config was directed to the saved AP
+ */
+static bool wifi_manager_fast_reconnect_apply(wifi_config_t *config) {
+#ifdef CONFIG_WIFI_MANAGER_FAST_RECONNECT
+    wifi_manager_fast_reconnect_t *saved = &rtc_fast_reconnect;
+    if (saved->magic != FAST_RECONNECT_MAGIC ||
+        memcmp(saved->ssid, config->sta.ssid, sizeof(saved->ssid)) != 0) {
+        wifi_manager_fast_reconnect_use_dhcp();
+        return false;
+    }
+
+    config->sta.bssid_set = true;
+    memcpy(config->sta.bssid, saved->bssid, sizeof(config->sta.bssid));
+    config->sta.channel = saved->channel;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t age = (int64_t)tv.tv_sec - saved->leased_at;
+    if (age >= 0 && age < CONFIG_WIFI_MANAGER_FAST_RECONNECT_LEASE_MIN * 60) {
+        /* DHCP client must be stopped before setting new IP information. */
+        esp_netif_dhcpc_stop(esp_netif_sta);
+        if (esp_netif_set_ip_info(esp_netif_sta, &saved->ip_info) == ESP_OK) {
+            esp_netif_set_dns_info(esp_netif_sta, ESP_NETIF_DNS_MAIN, &saved->dns);
+            fast_reconnect_static_ip = true;
+        } else {
+            fast_reconnect_static_ip = false;
+            esp_netif_dhcpc_start(esp_netif_sta);
+        }
+    } else {
+        wifi_manager_fast_reconnect_use_dhcp();
+    }
+
+    ESP_LOGI(TAG, "fast reconnect to " MACSTR " on channel %u (%s)", MAC2STR(saved->bssid),
+             saved->channel, fast_reconnect_static_ip ? "saved lease" : "dhcp");
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* @brief Saves the AP and the lease of the connection that just got an IP.
+ *
+ * The lease time is only updated when the address came from the DHCP server, so a saved lease
+ * is not reused beyond CONFIG_WIFI_MANAGER_FAST_RECONNECT_LEASE_MIN without renewing it.
+ */
+static void wifi_manager_fast_reconnect_save(const esp_netif_ip_info_t *ip_info) {
+#ifdef CONFIG_WIFI_MANAGER_FAST_RECONNECT
+    wifi_manager_fast_reconnect_t *saved = &rtc_fast_reconnect;
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+
+    if (!fast_reconnect_static_ip) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        saved->leased_at = tv.tv_sec;
+        esp_netif_get_dns_info(esp_netif_sta, ESP_NETIF_DNS_MAIN, &saved->dns);
+    }
+    memcpy(saved->ssid, wifi_manager_config_sta->sta.ssid, sizeof(saved->ssid));
+    memcpy(saved->bssid, ap.bssid, sizeof(saved->bssid));
+    saved->channel = ap.primary;
+    saved->ip_info = *ip_info;
+    saved->magic = FAST_RECONNECT_MAGIC;
+#endif
+}
+
 void wifi_manager_start() {
 
     /* disable the default wifi logging */
@@ -873,6 +995,24 @@ esp_netif_t *wifi_manager_get_esp_netif_ap() { return esp_netif_ap; }
 
 esp_netif_t *wifi_manager_get_esp_netif_sta() { return esp_netif_sta; }
 
+/* @brief Forgets the saved access point after the user asked to disconnect from it */
+static void wifi_manager_forget_sta() {
+    /* erase configuration */
+    if (wifi_manager_config_sta) {
+        memset(wifi_manager_config_sta, 0x00, sizeof(wifi_config_t));
+    }
+
+    /* regenerate json status */
+    if (wifi_manager_lock_json_buffer(portMAX_DELAY)) {
+        wifi_manager_generate_ip_info_json(UPDATE_USER_DISCONNECT);
+        wifi_manager_unlock_json_buffer();
+    }
+
+    /* save NVS memory */
+    wifi_manager_save_sta_config();
+    wifi_manager_fast_reconnect_clear();
+}
+
 void wifi_manager(void *pvParameters) {
 
     queue_message msg;
@@ -1041,10 +1181,17 @@ void wifi_manager(void *pvParameters) {
                 }
 
                 uxBits = xEventGroupGetBits(wifi_manager_event_group);
-                if (!(uxBits & WIFI_MANAGER_WIFI_CONNECTED_BIT)) {
-                    /* update config to latest and attempt connection */
-                    ESP_ERROR_CHECK(
-                        esp_wifi_set_config(ESP_IF_WIFI_STA, wifi_manager_get_wifi_sta_config()));
+                if (!(uxBits & (WIFI_MANAGER_WIFI_CONNECTED_BIT | WIFI_MANAGER_STA_STOPPED_BIT))) {
+                    /* update config to latest and attempt connection. Unless a user is trying new
+                     * credentials, the attempt goes straight to the last AP that worked */
+                    wifi_config_t sta_config = *wifi_manager_get_wifi_sta_config();
+                    if ((BaseType_t)msg.param == CONNECTION_REQUEST_USER) {
+                        fast_reconnect_attempt = false;
+                        wifi_manager_fast_reconnect_use_dhcp();
+                    } else {
+                        fast_reconnect_attempt = wifi_manager_fast_reconnect_apply(&sta_config);
+                    }
+                    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &sta_config));
 
                     /* if there is a wifi scan in progress abort it first
                        Calling esp_wifi_scan_stop will trigger a SCAN_DONE event which will reset
@@ -1142,23 +1289,26 @@ void wifi_manager(void *pvParameters) {
                      * event. Clear the flag and restart the AP */
                     xEventGroupClearBits(wifi_manager_event_group,
                                          WIFI_MANAGER_REQUEST_DISCONNECT_BIT);
-
-                    /* erase configuration */
-                    if (wifi_manager_config_sta) {
-                        memset(wifi_manager_config_sta, 0x00, sizeof(wifi_config_t));
-                    }
-
-                    /* regenerate json status */
-                    if (wifi_manager_lock_json_buffer(portMAX_DELAY)) {
-                        wifi_manager_generate_ip_info_json(UPDATE_USER_DISCONNECT);
-                        wifi_manager_unlock_json_buffer();
-                    }
-
-                    /* save NVS memory */
-                    wifi_manager_save_sta_config();
+                    wifi_manager_forget_sta();
 
                     /* start SoftAP */
                     wifi_manager_send_message(WM_ORDER_START_AP, NULL);
+                } else if (sta_stop_disconnect_pending || (uxBits & WIFI_MANAGER_STA_STOPPED_BIT)) {
+                    /* the radio was switched off on request: the connection was not lost and
+                     * there is nothing to retry. The saved AP is kept for the resume */
+                    sta_stop_disconnect_pending = false;
+                    if (uxBits & WIFI_MANAGER_STA_STOPPED_BIT) {
+                        fast_reconnect_attempt = false;
+                    }
+                } else if (fast_reconnect_attempt) {
+                    /* the saved AP could not be reached on its channel, or the saved lease was
+                     * refused: forget them and fall back to a full scan and DHCP straight away */
+                    ESP_LOGW(TAG, "fast reconnect failed, falling back to a normal connection");
+                    fast_reconnect_attempt = false;
+                    wifi_manager_fast_reconnect_clear();
+                    wifi_manager_fast_reconnect_use_dhcp();
+                    wifi_manager_send_message(WM_ORDER_CONNECT_STA,
+                                              (void *)CONNECTION_REQUEST_RESTORE_CONNECTION);
                 } else {
                     /* lost connection ? */
                     if (wifi_manager_lock_json_buffer(portMAX_DELAY)) {
@@ -1258,6 +1408,10 @@ void wifi_manager(void *pvParameters) {
                 /* save IP as a string for the HTTP server host */
                 wifi_manager_safe_update_sta_ip_string(ip_event_got_ip->ip_info.ip.addr);
 
+                /* remember the AP and the lease for the next wake */
+                fast_reconnect_attempt = false;
+                wifi_manager_fast_reconnect_save(&ip_event_got_ip->ip_info);
+
                 /* save wifi config in NVS if it wasn't a restored of a connection */
                 if (uxBits & WIFI_MANAGER_REQUEST_RESTORE_STA_BIT) {
                     xEventGroupClearBits(wifi_manager_event_group,
@@ -1307,11 +1461,22 @@ void wifi_manager(void *pvParameters) {
             case WM_ORDER_DISCONNECT_STA:
                 ESP_LOGI(TAG, "MESSAGE: ORDER_DISCONNECT_STA");
 
-                /* precise this is coming from a user request */
-                xEventGroupSetBits(wifi_manager_event_group, WIFI_MANAGER_REQUEST_DISCONNECT_BIT);
+                uxBits = xEventGroupGetBits(wifi_manager_event_group);
+                if (uxBits & WIFI_MANAGER_STA_STOPPED_BIT) {
+                    /* the radio is off, so there is no connection to drop: forget the AP and
+                     * bring the radio back up for the SoftAP straight away */
+                    xEventGroupClearBits(wifi_manager_event_group, WIFI_MANAGER_STA_STOPPED_BIT);
+                    ESP_ERROR_CHECK(esp_wifi_start());
+                    wifi_manager_forget_sta();
+                    wifi_manager_send_message(WM_ORDER_START_AP, NULL);
+                } else {
+                    /* precise this is coming from a user request */
+                    xEventGroupSetBits(wifi_manager_event_group,
+                                       WIFI_MANAGER_REQUEST_DISCONNECT_BIT);
 
-                /* order wifi discconect */
-                ESP_ERROR_CHECK(esp_wifi_disconnect());
+                    /* order wifi discconect */
+                    ESP_ERROR_CHECK(esp_wifi_disconnect());
+                }
 
                 /* callback */
                 if (cb_ptr_arr[msg.code])
@@ -1319,6 +1484,44 @@ void wifi_manager(void *pvParameters) {
 
                 break;
 
+            case WM_ORDER_STOP_STA:
+                ESP_LOGI(TAG, "MESSAGE: ORDER_STOP_STA");
+
+                /* the SoftAP serves the configuration portal: the radio stays on while it runs */
+                uxBits = xEventGroupGetBits(wifi_manager_event_group);
+                if (!(uxBits & (WIFI_MANAGER_AP_STARTED_BIT | WIFI_MANAGER_STA_STOPPED_BIT))) {
+                    /* mark the stop first, so the disconnection it causes is not retried */
+                    xEventGroupSetBits(wifi_manager_event_group, WIFI_MANAGER_STA_STOPPED_BIT);
+                    sta_stop_disconnect_pending = (uxBits & WIFI_MANAGER_WIFI_CONNECTED_BIT) != 0;
+                    xTimerStop(wifi_manager_retry_timer, (TickType_t)0);
+                    ESP_ERROR_CHECK(esp_wifi_stop());
+
+                    /* callback */
+                    if (cb_ptr_arr[msg.code])
+                        (*cb_ptr_arr[msg.code])(NULL);
+                }
+
+                break;
+
+            case WM_ORDER_RESUME_STA:
+                ESP_LOGI(TAG, "MESSAGE: ORDER_RESUME_STA");
+
+                uxBits = xEventGroupGetBits(wifi_manager_event_group);
+                if (uxBits & WIFI_MANAGER_STA_STOPPED_BIT) {
+                    xEventGroupClearBits(wifi_manager_event_group, WIFI_MANAGER_STA_STOPPED_BIT);
+                    ESP_ERROR_CHECK(esp_wifi_start());
+
+                    /* reconnect to the AP of the last connection, on its saved channel and lease */
+                    wifi_manager_send_message(WM_ORDER_CONNECT_STA,
+                                              (void *)CONNECTION_REQUEST_RESTORE_CONNECTION);
+
+                    /* callback */
+                    if (cb_ptr_arr[msg.code])
+                        (*cb_ptr_arr[msg.code])(NULL);
+                }
+
+                break;
+
             default:
                 break;
 
@@ -1341,6 +1544,7 @@ void wifi_manager_clear_sta_config() {
         }
         nvs_sync_unlock();
     }
+    wifi_manager_fast_reconnect_clear();
     if (wifi_manager_config_sta) {
         memset(wifi_manager_config_sta->sta.ssid, 0x00, sizeof(wifi_manager_config_sta->sta.ssid));
         memset(wifi_manager_config_sta->sta.password, 0x00,
@@ -0,0 +1,238 @@
+#include "auth_manager.h"
+#include "JWT_storage.h"
+#include "cJSON.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mbedtls/base64.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "AUTH";
+
+/** @brief Magic value marking `rtc_token` as valid. */
+#define AUTH_TOKEN_MAGIC 0x4A575431
+/** @brief System times before this (2024-01-01) mean the clock has not been set yet. */
+#define AUTH_CLOCK_VALID_AFTER 1704067200
+
+/** @brief The server's JWT, kept in RTC memory so a wake from deep sleep needs no login. */
+typedef struct {
+    uint32_t magic;
+    time_t expires_at; /**< System time at which the token expires, 0 if unknown. */
+    char token[AUTH_TOKEN_MAX_LEN];
+} auth_rtc_token_t;
+
+RTC_DATA_ATTR static auth_rtc_token_t rtc_token;
+
+/** @brief Whether NVS has been checked for a token since power-on. */
+static bool nvs_checked;
+/** @brief Protects `rtc_token` and `nvs_checked`. */
+static SemaphoreHandle_t auth_mutex;
+
+/**
+ * @brief Initialises the credential cache.
+ *
+ * Must be called before any task uses the token.
+ */
+void auth_init(void) {
+    if (auth_mutex == NULL) {
+        auth_mutex = xSemaphoreCreateMutex();
+    }
+}
+
+/**
+ * @brief Reads the "exp" and "iat" claims from the payload of a JWT.
+ *
+ * The signature is not checked; the claims are only used to schedule the refresh.
+ *
+ * @return `true` if an "exp" claim was found. `iat` is 0 if the token has none.
+ */
+static bool auth_decode_claims(const char *jwt, int64_t *exp, int64_t *iat) {
+    const char *payload = strchr(jwt, '.');
+    const char *end = payload ? strchr(payload + 1, '.') : NULL;
+    if (end == NULL) {
+        return false;
+    }
+    payload++;
+
+    // base64url without padding -> base64
+    char b64[AUTH_TOKEN_MAX_LEN];
+    size_t len = end - payload;
+    if (len + 3 >= sizeof(b64)) {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        b64[i] = payload[i] == '-' ? '+' : payload[i] == '_' ? '/' : payload[i];
+    }
+    while (len % 4) {
+        b64[len++] = '=';
+    }
+
+    unsigned char json[AUTH_TOKEN_MAX_LEN];
+    size_t json_len = 0;
+    if (mbedtls_base64_decode(json, sizeof(json), &json_len, (const unsigned char *)b64, len) !=
+        0) {
+        return false;
+    }
+    cJSON *root = cJSON_ParseWithLength((const char *)json, json_len);
+    cJSON *exp_item = cJSON_GetObjectItem(root, "exp");
+    cJSON *iat_item = cJSON_GetObjectItem(root, "iat");
+    bool ok = cJSON_IsNumber(exp_item);
+    *exp = ok ? (int64_t)exp_item->valuedouble : 0;
+    *iat = cJSON_IsNumber(iat_item) ? (int64_t)iat_item->valuedouble : 0;
+    cJSON_Delete(root);
+    return ok;
+}
+
+/**
+ * @brief Works out when a token expires on the local clock.
+ *
+ * For a token that was just issued, the lifetime (exp - iat) is added to the local time,
+ * which stays correct even if the clock is off or not yet set. A token read back from NVS
+ * can only be compared with a clock that has been set.
+ *
+ * @param fresh `true` if the server issued the token just now.
+ * @return The expiry time, or 0 if it is unknown.
+ */
+static time_t auth_local_expiry(const char *jwt, bool fresh) {
+    int64_t exp;
+    int64_t iat;
+    if (!auth_decode_claims(jwt, &exp, &iat)) {
+        ESP_LOGW(TAG, "Token has no readable expiry, relying on the server to reject it.");
+        return 0;
+    }
+    time_t now = time(NULL);
+    if (fresh && iat > 0 && exp > iat) {
+        return now + (exp - iat);
+    }
+    return now >= AUTH_CLOCK_VALID_AFTER ? (time_t)exp : 0;
+}
+
+/** @brief Stores a token in the RTC cache. Must be called with `auth_mutex` held. */
+static esp_err_t auth_store(const char *jwt, bool fresh) {
+    if (strlen(jwt) >= sizeof(rtc_token.token)) {
+        ESP_LOGE(TAG, "Token too long (%u bytes)", (unsigned)strlen(jwt));
+        rtc_token.magic = 0;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    strlcpy(rtc_token.token, jwt, sizeof(rtc_token.token));
+    rtc_token.expires_at = auth_local_expiry(jwt, fresh);
+    rtc_token.magic = AUTH_TOKEN_MAGIC;
+    return ESP_OK;
+}
+
+/**
+ * @brief Stores a token issued by the server.
+ *
+ * The token is kept in RAM and RTC memory for the requests of this and later wakes, and
+ * written to NVS so it also survives a power loss.
+ *
+ * @param jwt The token.
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if the token does not fit.
+ */
+esp_err_t auth_set_token(const char *jwt) {
+    xSemaphoreTake(auth_mutex, portMAX_DELAY);
+    esp_err_t err = auth_store(jwt, true);
+    nvs_checked = true;
+    time_t expires_at = rtc_token.expires_at;
+    xSemaphoreGive(auth_mutex);
+    if (err == ESP_OK) {
+        jwt_save_to_nvs(jwt);
+        if (expires_at) {
+            ESP_LOGI(TAG, "New token, valid for %lld s", (long long)(expires_at - time(NULL)));
+        }
+    }
+    return err;
+}
+
+/**
+ * @brief Loads the token saved in NVS if the RTC cache is empty.
+ *
+ * NVS is only read once per power-on; after a deep sleep the RTC cache is still valid.
+ * Must be called with `auth_mutex` held.
+ */
+static void auth_load(void) {
+    if (rtc_token.magic == AUTH_TOKEN_MAGIC || nvs_checked) {
+        return;
+    }
+    nvs_checked = true;
+    char *jwt = jwt_load_from_nvs();
+    if (jwt) {
+        auth_store(jwt, false);
+        free(jwt);
+    }
+}
+
+/**
+ * @brief Copies the current token into `buf`.
+ *
+ * @return `false` if there is no token or it does not fit.
+ */
+bool auth_get_token(char *buf, size_t size) {
+    xSemaphoreTake(auth_mutex, portMAX_DELAY);
+    auth_load();
+    bool ok = rtc_token.magic == AUTH_TOKEN_MAGIC && strlen(rtc_token.token) < size;
+    if (ok) {
+        strlcpy(buf, rtc_token.token, size);
+    }
+    xSemaphoreGive(auth_mutex);
+    return ok;
+}
+
+/**
+ * @brief Drops the cached token after the server rejected it.
+ */
+void auth_invalidate(void) {
+    xSemaphoreTake(auth_mutex, portMAX_DELAY);
+    rtc_token.magic = 0;
+    nvs_checked = true; // The copy in NVS is the same rejected token
+    xSemaphoreGive(auth_mutex);
+}
+
+/**
+ * @brief Returns seconds until the token should be refreshed.
+ *
+ * @return 0 if it should be refreshed now, or -1 if there is no token or its expiry is
+ *         unknown.
+ */
+int64_t auth_refresh_in_seconds(void) {
+    xSemaphoreTake(auth_mutex, portMAX_DELAY);
+    auth_load();
+    int64_t left = -1;
+    if (rtc_token.magic == AUTH_TOKEN_MAGIC && rtc_token.expires_at) {
+        left = (int64_t)(rtc_token.expires_at - time(NULL)) - AUTH_REFRESH_MARGIN_S;
+        if (left < 0) {
+            left = 0;
+        }
+    }
+    xSemaphoreGive(auth_mutex);
+    return left;
+}
+
+/**
+ * @brief Returns true if a token is available and not known to be expired.
+ */
+bool auth_token_valid(void) {
+    xSemaphoreTake(auth_mutex, portMAX_DELAY);
+    auth_load();
+    bool valid = rtc_token.magic == AUTH_TOKEN_MAGIC &&
+                 (rtc_token.expires_at == 0 || time(NULL) < rtc_token.expires_at);
+    xSemaphoreGive(auth_mutex);
+    return valid;
+}
+
+/**
+ * @brief Returns true if there is no token or it expires within AUTH_REFRESH_MARGIN_S.
+ */
+bool auth_needs_refresh(void) {
+    xSemaphoreTake(auth_mutex, portMAX_DELAY);
+    auth_load();
+    bool refresh = rtc_token.magic != AUTH_TOKEN_MAGIC ||
+                   (rtc_token.expires_at != 0 &&
+                    time(NULL) + AUTH_REFRESH_MARGIN_S >= rtc_token.expires_at);
+    xSemaphoreGive(auth_mutex);
+    return refresh;
+}
@@ -0,0 +1,122 @@
+#include "boot.h"
+#include "calendar.h"
+#include "esp_err.h"
+#include "esp_littlefs.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "font_task.h"
+#include "nvs_flash.h"
+#include "sleep_manager.h"
+#include "wake_profile.h"
+#include <errno.h>
+#include <freertos/task.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "BOOT";
+
+/** @brief Core the file system task runs on; Wi-Fi and its event loop run on core 0. */
+#define BOOT_FS_CORE 1
+
+/** @brief The BOOT_*_BIT of the initialisations that are done. */
+static EventGroupHandle_t boot_event_group;
+
+/** @brief Records that an initialisation is done and wakes the tasks waiting for it. */
+static void boot_ready(EventBits_t bit, wake_phase_t phase, const char *what) {
+    wake_profile_mark(phase);
+    ESP_LOGI(TAG, "%s ready after %lu ms.", what, (unsigned long)(esp_timer_get_time() / 1000));
+    xEventGroupSetBits(boot_event_group, bit);
+}
+
+/** @brief Creates `path` unless it exists. */
+static void boot_make_dir(const char *path) {
+    struct stat st = {0};
+    if (stat(path, &st) == 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "Directory %s not found, creating...", path);
+    if (mkdir(path, 0755) != 0) {
+        ESP_LOGE(TAG, "Failed to create directory %s: %s", path, strerror(errno));
+    }
+}
+
+/**
+ * @brief Initialises NVS, which holds the Wi-Fi credentials and the login.
+ *
+ * @param pvParameters Unused.
+ */
+static void boot_nvs_task(void *pvParameters) {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        // NVS 分區已滿或版本不符時，執行 erase 再 init
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+    boot_ready(BOOT_NVS_READY_BIT, WAKE_PHASE_NVS_READY, "NVS");
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Mounts LittleFS, creates the data directories and builds the font index.
+ *
+ * Deep sleep is held off until the mount is done, so the panel image can still be saved
+ * before sleeping. A failed mount is logged and the bits are set anyway: the device keeps
+ * working without the cached days and fonts, as it always did.
+ *
+ * @param pvParameters Unused.
+ */
+static void boot_fs_task(void *pvParameters) {
+    sleep_manager_hold(SLEEP_HOLD_STORAGE);
+    esp_vfs_littlefs_conf_t conf = {
+        .base_path = "/littlefs",       // LittleFS 掛載點
+        .partition_label = "storage",   // 對應 partitions.csv 中的標籤
+        .format_if_mount_failed = true, // 如果掛載失敗則格式化
+        .dont_mount = false,
+    };
+    esp_err_t ret = esp_vfs_littlefs_register(&conf);
+    if (ret == ESP_FAIL) {
+        ESP_LOGE(TAG, "Failed to mount or format LittleFS filesystem");
+    } else if (ret == ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "Failed to find LittleFS partition");
+    } else if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize LittleFS (%s)", esp_err_to_name(ret));
+    } else {
+        boot_make_dir(FONT_DIR);
+        boot_make_dir(CALENDAR_DIR);
+    }
+    boot_ready(BOOT_FS_READY_BIT, WAKE_PHASE_FS_MOUNTED, "LittleFS");
+
+    font_table_init();
+    boot_ready(BOOT_FONTS_READY_BIT, WAKE_PHASE_FONTS_READY, "Font index");
+    sleep_manager_release(SLEEP_HOLD_STORAGE);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Starts the storage initialisations in parallel with the rest of the boot.
+ *
+ * NVS and LittleFS are brought up by their own tasks, the file system on the second core,
+ * while `wakeup_handler` starts the e-paper and Wi-Fi. Each user waits in `boot_wait` for
+ * what it actually reads: Wi-Fi for NVS, the calendar screen for the font index, the panel
+ * restore only when its image is not kept in RTC memory.
+ */
+void boot_start(void) {
+    boot_event_group = xEventGroupCreate();
+    if (boot_event_group == NULL) {
+        ESP_LOGE(TAG, "Failed to create boot_event_group!");
+        return;
+    }
+    xTaskCreate(boot_nvs_task, "boot_nvs", 4096, NULL, 5, NULL);
+    xTaskCreatePinnedToCore(boot_fs_task, "boot_fs", 4096, NULL, 5, NULL, BOOT_FS_CORE);
+}
+
+/**
+ * @brief Blocks until all of the initialisations in `bits` are done.
+ *
+ * @param bits BOOT_*_BIT flags.
+ */
+void boot_wait(EventBits_t bits) {
+    xEventGroupWaitBits(boot_event_group, bits, pdFALSE, pdTRUE, portMAX_DELAY);
+}
@@ -1,15 +1,18 @@
 #include "EC11_driver.h"
+#include "boot.h"
 #include "cJSON.h"
 #include "driver/gpio.h"   // For GPIO configuration
-#include "driver/rtc_io.h" // For RTC GPIO pull-up/down control
 #include "esp_heap_caps.h"
 #include "esp_log.h"
-#include "esp_sleep.h" // For deep sleep
-#include "esp_sntp.h"  // ESP_SNTP_OPMODE_POLL etc.
 #include "font_task.h"
 #include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "json_stream.h"
 #include "net_task.h"
 #include "nvs.h"
+#include "sleep_manager.h"
+#include "sync_scheduler.h"
+#include "timekeeping.h"
 #include "ui_task.h"
 #include <errno.h> // For errno, ENOENT
 #include <freertos/FreeRTOS.h>
@@ -19,24 +22,24 @@
 #include <string.h>   // For strlen
 #include <sys/time.h> // For struct timeval, time_t
 #include <time.h>
+#include <unistd.h> // For access
 
 /** @brief Log tag for general calendar operations. */
 #define TAG_CALENDAR "CALENDAR"
-/** @brief Log tag for the deep sleep manager. */
-#define TAG_SLEEP_MGR "SLEEP_MGR"
-/** @brief URL for the backend calendar API. */
-#define CALENDAR_URL "https://peng-pc.tail941dce.ts.net/api/calendar"
+/** @brief URL for the backend calendar range API (one request for a window of days). */
+#define CALENDAR_RANGE_URL "https://peng-pc.tail941dce.ts.net/api/calendar/range"
 
 /** @brief Directory in LittleFS for storing cached calendar event files. */
 #define CALENDAR_DIR "/littlefs/calendar"
 
+/** @brief Unix time of 2023-01-01; an earlier clock has not been set yet. */
+#define CALENDAR_CLOCK_SET_AFTER 1672531200
+
 /** @brief Notification value used by the encoder callback to signify a command. */
 #define CALENDAR_NOTIFY_INDEX_CMD 0
 /** @brief Notification value used by network callbacks to signify data is ready. */
 #define CALENDAR_NOTIFY_INDEX_DATA_READY 1
 
-/** @brief Static buffer for storing API responses related to calendar events. */
-static char calendar_api_response_buffer[512];
 /** @brief Task handle for the calendar data prefetch task. */
 TaskHandle_t xCalendarPrefetchHandle;
 /** @brief Task handle for the calendar display/interaction task. */
@@ -44,18 +47,21 @@ TaskHandle_t xCalendarDisplayHandle = NULL;
 
 /** @brief Log tag for the prefetch mechanism. */
 #define TAG_PREFETCH "PREFETCH_CAL"
-/** @brief Number of days to cache prefetch status for (+/- 5 days). */
-#define MAX_PREFETCH_CACHE_SIZE 11
+/** @brief Number of days prefetched on each side of the displayed date. */
+#define PREFETCH_RADIUS_DAYS 5
+/** @brief Number of recently fetched date ranges to remember. */
+#define MAX_PREFETCH_CACHE_SIZE 4
 /** @brief Cooldown period in seconds before re-fetching data for a cached date. */
 #define PREFETCH_COOLDOWN_SECONDS (5 * 60)
 
-/** @brief Structure to hold prefetch cache information for a specific date. */
+/** @brief Structure to hold prefetch cache information for a range of dates. */
 typedef struct {
-    struct tm date_t;     /**< The date (normalized to midnight). */
-    time_t last_fetch_ts; /**< Timestamp of the last fetch for this date. */
+    int32_t first_day;    /**< First day of the range (see `prefetch_day_number`). */
+    int32_t last_day;     /**< Last day of the range, inclusive. */
+    time_t last_fetch_ts; /**< Timestamp of the last fetch for this range. */
 } PrefetchCacheEntry;
 
-/** @brief Array-based cache to track recently prefetched dates. */
+/** @brief Array-based cache to track recently prefetched date ranges. */
 static PrefetchCacheEntry prefetch_cache[MAX_PREFETCH_CACHE_SIZE];
 /** @brief The current number of valid entries in the prefetch cache. */
 static int prefetch_cache_fill_count = 0;
@@ -65,16 +71,30 @@ static int prefetch_cache_next_replace_idx = 0;
 /** @brief Mutex to protect access to the prefetch cache. */
 static SemaphoreHandle_t xPrefetchCacheMutex = NULL;
 
+/** @brief Calendar manifest of the bootstrap response, applied by the prefetch task. */
+typedef struct {
+    bool pending;          /**< Not yet applied. */
+    int32_t first_day;     /**< First day of the window the manifest covers. */
+    int32_t last_day;      /**< Last day of the window, inclusive. */
+    int32_t changed_first; /**< First changed day; greater than `changed_last` if none. */
+    int32_t changed_last;  /**< Last changed day. */
+} calendar_manifest_t;
+
+static calendar_manifest_t bootstrap_manifest;
+/** @brief Protects `bootstrap_manifest`, written by the net worker. */
+static portMUX_TYPE bootstrap_manifest_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Set during a timer wake until something has to be drawn; the screen is not
+ * started meanwhile. Only changes from true to false, in `calendar_display`.
+ */
+static volatile bool calendar_headless = false;
+
 /**
  * @brief The date currently being displayed, stored in RTC memory to survive deep sleep.
  */
 RTC_DATA_ATTR struct tm current_display_time;
 
-/** @brief Event group used to coordinate sleep state transitions. */
-EventGroupHandle_t sleep_event_group;
-/** @brief Bit in `sleep_event_group` indicating that a task has requested deep sleep. */
-#define DEEP_SLEEP_REQUESTED_BIT (1 << 0)
-
 /** @brief Extern reference from font_task.c to check font table usage. */
 extern int font_table_count;
 
@@ -115,134 +135,6 @@ bool parse_date_string(const char *date_str, struct tm *tm_out) {
     return false;
 }
 
-/**
- * @brief Saves a single event to its corresponding date file in LittleFS.
- *
- * This function manages a JSON file for each day (e.g., "2023-10-27.json").
- * It reads the existing file (if any), parses it as a JSON array, checks if the
- * new event (by summary and start time) already exists, and if not, appends it.
- * The entire updated array is then written back to the file, overwriting the old one.
- *
- * @param date_yyyymmdd The date string ("YYYY-MM-DD") which determines the filename.
- * @param event_json A cJSON object representing the single event to be saved.
- * @return ESP_OK on success, or an esp_err_t code on failure.
- */
-esp_err_t save_event_for_date(const char *date_yyyymmdd, const cJSON *event_json) {
-    if (!date_yyyymmdd || !event_json) {
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    // Construct file path: CALENDAR_DIR/YYYY-MM-DD.json
-    char file_path[64];
-    snprintf(file_path, sizeof(file_path), "%s/%s.json", CALENDAR_DIR, date_yyyymmdd);
-
-    cJSON *events_for_day = NULL;
-    char *existing_content = NULL;
-    FILE *f = fopen(file_path, "rb"); // Open in read-binary mode
-
-    if (f) {
-        // File exists, read its content
-        fseek(f, 0, SEEK_END);
-        long fsize = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        if (fsize > 0) {
-            existing_content = malloc(fsize + 1);
-            if (existing_content) {
-                fread(existing_content, 1, fsize, f);
-                existing_content[fsize] = '\0';
-                events_for_day = cJSON_Parse(existing_content);
-                if (!events_for_day || !cJSON_IsArray(events_for_day)) {
-                    ESP_LOGW(TAG_CALENDAR,
-                             "Existing file %s is not a valid JSON array, will overwrite.",
-                             file_path);
-                    cJSON_Delete(events_for_day);
-                    events_for_day = cJSON_CreateArray();
-                }
-            } else {
-                ESP_LOGE(TAG_CALENDAR, "Failed to allocate memory for reading %s", file_path);
-                fclose(f);
-                return ESP_ERR_NO_MEM;
-            }
-        } else {
-            events_for_day = cJSON_CreateArray(); // File is empty
-        }
-        fclose(f);
-        free(existing_content);
-    } else {
-        events_for_day = cJSON_CreateArray(); // File does not exist
-    }
-
-    if (!events_for_day) {
-        ESP_LOGE(TAG_CALENDAR, "Failed to get or create JSON array for %s", file_path);
-        return ESP_FAIL;
-    }
-
-    // Check if an event with the same summary and start time already exists in the array
-    bool event_exists = false;
-    cJSON *existing_event_iterator = NULL;
-    cJSON *new_summary_item = cJSON_GetObjectItemCaseSensitive(event_json, "summary");
-
-    cJSON_ArrayForEach(existing_event_iterator, events_for_day) {
-        cJSON *existing_summary_item =
-            cJSON_GetObjectItemCaseSensitive(existing_event_iterator, "summary");
-        cJSON *existing_start_item =
-            cJSON_GetObjectItemCaseSensitive(existing_event_iterator, "start");
-
-        if (cJSON_IsString(existing_summary_item) && cJSON_IsString(existing_start_item) &&
-            cJSON_IsString(new_summary_item) && existing_summary_item->valuestring &&
-            existing_start_item->valuestring && new_summary_item->valuestring &&
-            (strcmp(existing_summary_item->valuestring, new_summary_item->valuestring) == 0) &&
-            (strcmp(existing_start_item->valuestring, new_summary_item->valuestring) == 0)) {
-            event_exists = true; // Event already exists
-            ESP_LOGI(TAG_CALENDAR, "Event with summary '%s' already exists in %s, skipping.",
-                     new_summary_item->valuestring, file_path);
-            break;
-        }
-    }
-
-    if (!event_exists) {
-        cJSON *event_copy = cJSON_Duplicate(event_json, true);
-        if (!event_copy) {
-            ESP_LOGE(TAG_CALENDAR, "Failed to duplicate event JSON for saving.");
-            cJSON_Delete(events_for_day); // Clean up before returning
-            return ESP_ERR_NO_MEM;
-        }
-        cJSON_AddItemToArray(events_for_day, event_copy);
-    }
-
-    char *updated_content = cJSON_PrintUnformatted(events_for_day);
-    cJSON_Delete(events_for_day);
-
-    if (!updated_content) {
-        ESP_LOGE(TAG_CALENDAR, "Failed to print updated JSON array.");
-        return ESP_FAIL;
-    }
-
-    // Write the updated content back to the file (overwrite)
-    f = fopen(file_path, "wb");
-    if (!f) {
-        ESP_LOGE(TAG_CALENDAR, "Failed to open file for writing: %s", file_path);
-        free(updated_content);
-        return ESP_FAIL;
-    }
-
-    size_t content_len = strlen(updated_content);
-    size_t written = fwrite(updated_content, 1, content_len, f);
-    fclose(f);
-
-    if (written != content_len) {
-        ESP_LOGE(TAG_CALENDAR, "Failed to write full content to %s (wrote %zu / expected %zu)",
-                 file_path, written, content_len);
-        return ESP_FAIL;
-    }
-    free(updated_content); // Free memory allocated by cJSON_PrintUnformatted
-
-    if (!event_exists) {
-        ESP_LOGI(TAG_CALENDAR, "New event saved to %s", file_path);
-    }
-    return ESP_OK;
-}
-
 static void check_calendar_settings_callback(net_event_t *event, esp_err_t err) {
     if (err == ESP_OK && event->json_root) {
         char *error_message = NULL;
@@ -274,349 +166,788 @@ static void check_calendar_settings_callback(net_event_t *event, esp_err_t err)
 void check_calendar_settings(void) {
     nvs_handle_t nvs;
     esp_err_t err = nvs_open("calendar", NVS_READONLY, &nvs);
-    if (err != ESP_OK)
+    if (err != ESP_OK) {
         userSettings();
+        return;
+    }
 
     size_t buf_size;
     err = nvs_get_str(nvs, "email", NULL, &buf_size);
     if (err != ESP_OK) {
         nvs_close(nvs);
         userSettings();
+        return;
     }
 
-    calendar_api_response_buffer[0] = '\0';
     net_event_t event = {
         .url = "https://peng-pc.tail941dce.ts.net/google_token_check",
         .method = HTTP_METHOD_POST,
         .use_jwt = true,
-        .response_buffer = calendar_api_response_buffer,
-        .response_buffer_size = sizeof(calendar_api_response_buffer),
+        .response_buffer_size = NET_RESPONSE_BUFFER_SIZE,
         .on_finish = check_calendar_settings_callback,
         .user_data = NULL,
+        .priority = NET_PRIO_AUTH,
+        .key = NET_KEY_GOOGLE_TOKEN_CHECK,
     };
-    xQueueSend(net_queue, &event, portMAX_DELAY);
+    net_submit(&event, portMAX_DELAY);
     nvs_close(nvs);
 }
 
 /**
- * @brief Callback function to process the response from a calendar data request.
+ * @brief Converts a normalized date to a day number (days since 1970-01-01).
  *
- * This function is called by the `net_worker_task` after an HTTP request for calendar
- * events completes. It performs the following steps:
- * 1. Parses the JSON response to get an array of events.
- * 2. Clears the old event file for the requested date to ensure a full refresh.
- * 3. Iterates through the new events:
- *    a. Checks the event summary for any Chinese characters whose fonts are not cached locally.
- *    b. Aggregates all missing font characters and queues a request to download them.
- *    c. Saves each new event to the corresponding date file in LittleFS.
- * 4. Sets an event group bit to signal that calendar data is available.
- * 5. Frees the memory allocated for the network request's `post_data` and `user_data`.
+ * Only the date fields are used, so consecutive dates always differ by exactly one.
  *
- * @param event The network event structure containing the response and other data.
- * @param result The result of the HTTP request (ESP_OK on success).
+ * @param date The date to convert.
+ * @return The day number.
  */
-void collect_event_data_callback(net_event_t *event, esp_err_t result) {
-    char date[11] = {0};
-    if (result == ESP_OK && event->json_root) {
-        if (event->user_data) {
-            strncpy(date, (char *)event->user_data, sizeof(date) - 1);
-        } else {
-            ESP_LOGW(TAG_CALENDAR, "user_data (date) for calendar UI event is NULL.");
+static int32_t prefetch_day_number(const struct tm *date) {
+    int32_t year = date->tm_year + 1900;
+    int32_t month = date->tm_mon + 1;
+    if (month <= 2) {
+        year -= 1;
+    }
+    int32_t era = (year >= 0 ? year : year - 399) / 400;
+    int32_t year_of_era = year - era * 400;
+    int32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + date->tm_mday - 1;
+    int32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+/**
+ * @brief Converts a day number back to a date string ("YYYY-MM-DD").
+ *
+ * Day numbers count days since 1970-01-01, so the UTC date of `day` * 86400 is the date.
+ */
+static void calendar_day_date(int32_t day, char *date, size_t size) {
+    time_t t = (time_t)day * 86400;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(date, size, "%Y-%m-%d", &tm);
+}
+
+/** @brief State of a calendar range response that is being streamed to LittleFS. */
+typedef struct {
+    json_stream_t parser;
+    int32_t first_day;       /**< First day of the requested range (prefetch day number). */
+    int32_t last_day;        /**< Last day of the requested range. */
+    char top_key[8];         /**< Last key of the top-level object ("days" or "etags"). */
+    char event_key[16];      /**< Last key inside the current event. */
+    char date[11];           /**< Date of the day being written ("YYYY-MM-DD"). */
+    FILE *day_file;          /**< Temporary file of the day being written, or NULL. */
+    int day_events;          /**< Events written to `day_file`. */
+    int day_count;           /**< Days stored from this response. */
+    cJSON *event;            /**< Event being collected, or NULL. */
+    char missing_chars[256]; /**< Hex keys of glyphs missing for the current day. */
+    bool visible_changed;    /**< The displayed day was rewritten. */
+} calendar_range_sink_t;
+
+/**
+ * @brief Builds the path of one of a day's files.
+ *
+ * @param ext "json" for the events, "tmp" while they are being written, "etag" for the
+ *            server's validator of the stored events, "sync" for the time the server last
+ *            confirmed them.
+ */
+static void calendar_day_path(char *path, size_t size, const char *date, const char *ext) {
+    snprintf(path, size, "%s/%s.%s", CALENDAR_DIR, date, ext);
+}
+
+/**
+ * @brief Reads the ETag stored with a day's events.
+ *
+ * @return `true` if the day has both an event file and an ETag.
+ */
+static bool calendar_day_read_etag(const char *date, char *etag, size_t size) {
+    char path[64];
+    calendar_day_path(path, sizeof(path), date, "json");
+    if (access(path, F_OK) != 0) {
+        return false; // The ETag is useless without the events it describes
+    }
+    calendar_day_path(path, sizeof(path), date, "etag");
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = fgets(etag, size, f) != NULL;
+    fclose(f);
+    if (ok) {
+        etag[strcspn(etag, "\r\n")] = '\0';
+    }
+    return ok && etag[0] != '\0';
+}
+
+/**
+ * @brief Stores the ETag of a day whose events have just been saved.
+ *
+ * Failures are only logged: without an ETag the day is simply sent again next time.
+ */
+static void calendar_day_write_etag(const char *date, const char *etag) {
+    char path[64];
+    calendar_day_path(path, sizeof(path), date, "etag");
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        ESP_LOGW(TAG_CALENDAR, "Failed to open %s", path);
+        return;
+    }
+    bool ok = fputs(etag, f) != EOF;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        ESP_LOGW(TAG_CALENDAR, "Failed to write %s", path);
+        remove(path);
+    }
+}
+
+/**
+ * @brief Reads the time at which a day's stored events were last confirmed by the server.
+ *
+ * @return The time of the last sync, or 0 if the day is not stored or was never synced.
+ */
+static time_t calendar_day_read_sync(const char *date) {
+    char path[64];
+    calendar_day_path(path, sizeof(path), date, "json");
+    if (access(path, F_OK) != 0) {
+        return 0;
+    }
+    calendar_day_path(path, sizeof(path), date, "sync");
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    long long synced = 0;
+    if (fscanf(f, "%lld", &synced) != 1) {
+        synced = 0;
+    }
+    fclose(f);
+    return (time_t)synced;
+}
+
+/**
+ * @brief Records every stored day from `first_day` to `last_day` as confirmed by the server
+ * at `now`.
+ *
+ * Days without an event file are skipped: the server only confirmed that they have not
+ * changed relative to what the device sent, which for them is nothing.
+ */
+static void calendar_mark_synced(int32_t first_day, int32_t last_day, time_t now) {
+    if (now < CALENDAR_CLOCK_SET_AFTER) {
+        return; // The clock is not set, the time would be meaningless
+    }
+    sleep_manager_hold(SLEEP_HOLD_STORAGE);
+    for (int32_t day = first_day; day <= last_day; ++day) {
+        char date[11];
+        char path[64];
+        calendar_day_date(day, date, sizeof(date));
+        calendar_day_path(path, sizeof(path), date, "json");
+        if (access(path, F_OK) != 0) {
+            continue;
+        }
+        calendar_day_path(path, sizeof(path), date, "sync");
+        FILE *f = fopen(path, "w");
+        if (!f) {
+            ESP_LOGW(TAG_CALENDAR, "Failed to open %s", path);
+            continue;
         }
+        bool ok = fprintf(f, "%lld\n", (long long)now) > 0;
+        if (!((fclose(f) == 0) && ok)) {
+            ESP_LOGW(TAG_CALENDAR, "Failed to write %s", path);
+            remove(path);
+        }
+    }
+    sleep_manager_release(SLEEP_HOLD_STORAGE);
+}
 
-        // Free the dynamically allocated post_data if it exists.
-        // This callback knows that for this specific event type, post_data was malloc'd.
-        if (event->post_data) {
-            free((void *)event->post_data);
+/**
+ * @brief Checks whether the days around the displayed date were synced recently.
+ *
+ * Every stored day within CONFIG_CALENDAR_OFFLINE_RADIUS_DAYS of `current_display_time`
+ * must have been confirmed by the server within CONFIG_CALENDAR_FRESH_MAX_AGE_MIN. A day
+ * that is not stored, or a clock that is not set, makes the window stale. Waits for
+ * LittleFS if it is still being mounted.
+ *
+ * @return `true` if the window can be shown without going online.
+ */
+bool calendar_window_is_fresh(void) {
+    time_t now = time(NULL);
+    struct tm center = current_display_time;
+    if (now < CALENDAR_CLOCK_SET_AFTER || center.tm_year < (2023 - 1900)) {
+        return false;
+    }
+    boot_wait(BOOT_FS_READY_BIT);
+    mktime(&center);
+    int32_t center_day = prefetch_day_number(&center);
+    for (int32_t day = center_day - CONFIG_CALENDAR_OFFLINE_RADIUS_DAYS;
+         day <= center_day + CONFIG_CALENDAR_OFFLINE_RADIUS_DAYS; ++day) {
+        char date[11];
+        calendar_day_date(day, date, sizeof(date));
+        time_t age = now - calendar_day_read_sync(date);
+        if (age < 0 || age >= CONFIG_CALENDAR_FRESH_MAX_AGE_MIN * 60) {
+            ESP_LOGI(TAG_CALENDAR, "%s is not fresh.", date);
+            return false;
         }
-        // Free the dynamically allocated user_data (the date string).
-        if (event->user_data) {
-            free(event->user_data);
+    }
+    return true;
+}
+
+/**
+ * @brief Adds a date window and the ETags stored for its days to a request body.
+ *
+ * {"start": ..., "end": ..., "etags": {"YYYY-MM-DD": "<etag of the stored events>", ...}}
+ * lets the server skip the days that have not changed.
+ */
+static void calendar_add_window(cJSON *root, struct tm first, struct tm last) {
+    char start_date[11];
+    char end_date[11];
+    strftime(start_date, sizeof(start_date), "%Y-%m-%d", &first);
+    strftime(end_date, sizeof(end_date), "%Y-%m-%d", &last);
+
+    cJSON *etags = cJSON_AddObjectToObject(root, "etags");
+    cJSON_AddStringToObject(root, "start", start_date);
+    cJSON_AddStringToObject(root, "end", end_date);
+    int32_t last_day = prefetch_day_number(&last);
+    struct tm day = first;
+    for (int32_t n = prefetch_day_number(&day); etags && n <= last_day; n++) {
+        char date[11];
+        char etag[48];
+        strftime(date, sizeof(date), "%Y-%m-%d", &day);
+        if (calendar_day_read_etag(date, etag, sizeof(etag))) {
+            cJSON_AddStringToObject(etags, date, etag);
         }
+        day.tm_mday++;
+        mktime(&day);
+    }
+}
 
-        ESP_LOGI(TAG_CALENDAR, "Received calendar data, processing events...");
-        cJSON *events_array = cJSON_GetObjectItemCaseSensitive(event->json_root, "events");
+/** @brief Drops the partially written day file and event of an aborted response. */
+static void calendar_range_sink_discard(calendar_range_sink_t *sink) {
+    if (sink->day_file) {
+        char path[64];
+        fclose(sink->day_file);
+        sink->day_file = NULL;
+        calendar_day_path(path, sizeof(path), sink->date, "tmp");
+        remove(path);
+        sleep_manager_release(SLEEP_HOLD_STORAGE);
+    }
+    if (sink->event) {
+        cJSON_Delete(sink->event);
+        sink->event = NULL;
+    }
+}
 
-        if (cJSON_IsArray(events_array)) {
-            char missing_chars_total[256] = {0};
-            size_t current_missing_len = 0;
-            const size_t max_missing_len = sizeof(missing_chars_total) - (HEX_KEY_LEN - 1) - 1;
+/**
+ * @brief Requests the glyphs collected for the current day.
+ *
+ * Glyphs for the displayed date are needed right away; those of other days are
+ * background work.
+ */
+static void calendar_range_sink_request_fonts(calendar_range_sink_t *sink) {
+    char display_date[11];
+    strftime(display_date, sizeof(display_date), "%Y-%m-%d", &current_display_time);
+    download_missing_characters(sink->missing_chars, strcmp(sink->date, display_date) == 0
+                                                         ? NET_PRIO_GLYPH
+                                                         : NET_PRIO_BACKGROUND);
+    sink->missing_chars[0] = '\0';
+}
 
-            cJSON *event_scanner_json = NULL;
+/**
+ * @brief Queues the glyphs missing from an event summary for download.
+ *
+ * Missing glyphs are collected per day and requested in batches.
+ */
+static void calendar_range_sink_check_fonts(calendar_range_sink_t *sink, const char *summary) {
+    const size_t max_missing_len = sizeof(sink->missing_chars) - (HEX_KEY_LEN - 1) - 1;
+    char missing_for_event[256] = {0};
+    if (find_missing_characters(summary, missing_for_event, sizeof(missing_for_event)) == 0) {
+        return;
+    }
+    size_t current_missing_len = strlen(sink->missing_chars);
+    if (current_missing_len + strlen(missing_for_event) > max_missing_len) {
+        // If too many missing fonts are found, download the current batch first.
+        calendar_range_sink_request_fonts(sink);
+    }
+    strlcat(sink->missing_chars, missing_for_event, sizeof(sink->missing_chars));
+}
 
-            // Before saving new events, delete the old file for this date to ensure a clean
-            // slate.
-            char file_to_delete_path[64];
-            snprintf(file_to_delete_path, sizeof(file_to_delete_path), "%s/%s.json", CALENDAR_DIR,
-                     date);
-            if (remove(file_to_delete_path) == 0) {
-                ESP_LOGI(TAG_CALENDAR, "Cleared existing event file: %s", file_to_delete_path);
-            } else {
-                // ENOENT (No such file or directory) is normal, means the file didn't exist.
-                if (errno != ENOENT) {
-                    ESP_LOGW(TAG_CALENDAR, "Failed to delete %s: %s (errno %d)",
-                             file_to_delete_path, strerror(errno), errno);
-                }
-            }
-            errno = 0; // Reset errno
+/**
+ * @brief Starts the temporary file for the day whose events follow.
+ *
+ * The day's old ETag no longer matches once its events change, so it is dropped here and
+ * replaced by the one in the "etags" object that follows "days".
+ */
+static bool calendar_range_sink_begin_day(calendar_range_sink_t *sink) {
+    char path[64];
+    calendar_day_path(path, sizeof(path), sink->date, "etag");
+    remove(path);
+    calendar_day_path(path, sizeof(path), sink->date, "tmp");
+    sink->day_file = fopen(path, "wb");
+    if (!sink->day_file) {
+        ESP_LOGE(TAG_CALENDAR, "Failed to open file for writing: %s", path);
+        return false;
+    }
+    sleep_manager_hold(SLEEP_HOLD_STORAGE); // Until the day file is closed
+    sink->day_events = 0;
+    sink->missing_chars[0] = '\0';
+    return fputc('[', sink->day_file) != EOF;
+}
 
-            // Iterate through all received events for the date.
-            cJSON_ArrayForEach(event_scanner_json, events_array) {
-                if (!cJSON_IsObject(event_scanner_json)) {
-                    ESP_LOGW(TAG_CALENDAR, "Skipping non-object item in events array (scan pass).");
-                    continue;
-                }
+/** @brief Appends the collected event to the day file. */
+static bool calendar_range_sink_write_event(calendar_range_sink_t *sink) {
+    cJSON *summary_item = cJSON_GetObjectItemCaseSensitive(sink->event, "summary");
+    if (cJSON_IsString(summary_item) && summary_item->valuestring) {
+        calendar_range_sink_check_fonts(sink, summary_item->valuestring);
+    }
 
-                // 1. Process the summary to find missing font characters.
-                cJSON *summary_item =
-                    cJSON_GetObjectItemCaseSensitive(event_scanner_json, "summary");
-                if (cJSON_IsString(summary_item) && (summary_item->valuestring != NULL)) {
-                    const char *summary_utf8 = summary_item->valuestring;
-                    char missing_for_event[256] = {0};
-                    if (find_missing_characters(summary_utf8, missing_for_event,
-                                                sizeof(missing_for_event)) > 0) {
-                        if (current_missing_len + strlen(missing_for_event) <= max_missing_len) {
-                            strcat(missing_chars_total, missing_for_event);
-                            current_missing_len += strlen(missing_for_event);
-                        } else {
-                            // If too many missing fonts are found, download the current batch
-                            // first.
-                            download_missing_characters(missing_chars_total);
-                            ESP_LOGW(TAG_CALENDAR,
-                                     "Total missing characters buffer full. Cannot add more from "
-                                     "event '%s'.",
-                                     summary_utf8);
-                            memset(missing_chars_total, 0, sizeof(missing_chars_total));
-                            current_missing_len = strlen(missing_for_event);
-                            strcat(missing_chars_total, missing_for_event);
-                        }
-                    }
-                }
-                download_missing_characters(missing_chars_total);
+    char *event_str = cJSON_PrintUnformatted(sink->event);
+    cJSON_Delete(sink->event);
+    sink->event = NULL;
+    if (!event_str) {
+        ESP_LOGE(TAG_CALENDAR, "Failed to print event JSON.");
+        return false;
+    }
+    bool ok = (sink->day_events == 0 || fputc(',', sink->day_file) != EOF) &&
+              fputs(event_str, sink->day_file) != EOF;
+    free(event_str);
+    sink->day_events++;
+    return ok;
+}
 
-                // 2. Save the event to the file system.
-                cJSON *event_to_save = cJSON_Duplicate(event_scanner_json, true);
-                if (!event_to_save) {
-                    ESP_LOGE(TAG_CALENDAR, "Failed to duplicate event_json for saving.");
-                    continue;
-                }
-                save_event_for_date(date, event_to_save);
-                cJSON_Delete(event_to_save); // Clean up the duplicated event
-            }
+/**
+ * @brief Completes the day file and replaces the day's cached events with it.
+ *
+ * Writing to a temporary file first keeps the old events if the response is cut off.
+ */
+static bool calendar_range_sink_end_day(calendar_range_sink_t *sink) {
+    char tmp_path[64];
+    char path[64];
+    bool ok = fputc(']', sink->day_file) != EOF;
+    ok = (fclose(sink->day_file) == 0) && ok;
+    sink->day_file = NULL;
+    sleep_manager_release(SLEEP_HOLD_STORAGE);
+    calendar_day_path(tmp_path, sizeof(tmp_path), sink->date, "tmp");
+    calendar_day_path(path, sizeof(path), sink->date, "json");
+    if (!ok) {
+        ESP_LOGE(TAG_CALENDAR, "Failed to write %s", tmp_path);
+        remove(tmp_path);
+        return false;
+    }
+    remove(path);
+    if (rename(tmp_path, path) != 0) {
+        ESP_LOGE(TAG_CALENDAR, "Failed to rename %s: %s", tmp_path, strerror(errno));
+        remove(tmp_path);
+        return false;
+    }
+    char display_date[11];
+    strftime(display_date, sizeof(display_date), "%Y-%m-%d", &current_display_time);
+    sink->visible_changed = sink->visible_changed || strcmp(sink->date, display_date) == 0;
+    calendar_range_sink_request_fonts(sink);
+    ESP_LOGI(TAG_CALENDAR, "Saved %d events to %s", sink->day_events, path);
+    sink->day_count++;
+    return true;
+}
 
-            ESP_LOGI(TAG_CALENDAR,
-                     "Finished processing and saving calendar events. Notifying on index %d.",
-                     CALENDAR_NOTIFY_INDEX_DATA_READY);
-            xEventGroupSetBits(net_event_group, NET_CALENDAR_AVAILABLE_BIT);
-        } else {
-            ESP_LOGW(TAG_CALENDAR, "Events array is invalid or empty.");
+/**
+ * @brief Handles one token of a calendar range response.
+ *
+ * The response is {"days": {"YYYY-MM-DD": [{"summary", "start", "end"}, ...], ...},
+ * "etags": {"YYYY-MM-DD": "...", ...}} and only lists the days that changed. Each event is
+ * collected into a small cJSON object and appended to the day's file as soon as it is
+ * complete, so only one event is held in memory at a time.
+ */
+static bool calendar_range_token(json_stream_t *js, json_stream_token_t token, const char *value,
+                                 size_t len, void *ctx) {
+    calendar_range_sink_t *sink = ctx;
+    switch (js->depth) {
+    case 1: // Keys of the top-level object
+        if (token == JSON_STREAM_KEY) {
+            strlcpy(sink->top_key, value, sizeof(sink->top_key));
         }
-        cJSON_Delete(event->json_root); // Free the parsed JSON tree
-        event->json_root = NULL;        // Mark as processed
-    } else {
-        // Even on failure, free the dynamically allocated post_data
-        if (event->post_data) {
-            free((void *)event->post_data);
-            event->post_data = NULL;
+        return true;
+    case 2: // Dates of the "days" or "etags" object
+        if (strcmp(sink->top_key, "etags") == 0) {
+            if (token == JSON_STREAM_KEY) {
+                strlcpy(sink->date, len == sizeof(sink->date) - 1 ? value : "", sizeof(sink->date));
+            } else if (token == JSON_STREAM_STRING && sink->date[0] && len > 0 && !js->truncated) {
+                calendar_day_write_etag(sink->date, value);
+            }
+            return true;
+        }
+        if (strcmp(sink->top_key, "days") != 0) {
+            return true;
+        }
+        if (token == JSON_STREAM_KEY) {
+            if (len != sizeof(sink->date) - 1) {
+                ESP_LOGW(TAG_CALENDAR, "Invalid date in calendar range: %s", value);
+                return false;
+            }
+            strlcpy(sink->date, value, sizeof(sink->date));
+        } else if (token == JSON_STREAM_ARRAY_START) {
+            return calendar_range_sink_begin_day(sink);
+        } else if (token == JSON_STREAM_ARRAY_END) {
+            return calendar_range_sink_end_day(sink);
         }
-        // Even on failure, free the dynamically allocated user_data
-        if (event->user_data) {
-            free(event->user_data);
-            event->user_data = NULL;
+        return true;
+    case 3: // Events of a day
+        if (!sink->day_file) {
+            return true;
         }
-        ESP_LOGE(TAG_CALENDAR,
-                 "Failed to receive calendar data or JSON parse error. HTTP result: %s",
-                 esp_err_to_name(result));
-        if (event->response_buffer && strlen(event->response_buffer) > 0) {
-            ESP_LOGE(TAG_CALENDAR, "Response: %s", event->response_buffer);
+        if (token == JSON_STREAM_OBJECT_START) {
+            sink->event = cJSON_CreateObject();
+            return sink->event != NULL;
+        } else if (token == JSON_STREAM_OBJECT_END && sink->event) {
+            return calendar_range_sink_write_event(sink);
         }
-        // If json_root is not NULL (e.g., parsing was done in net_task but another error was
-        // detected in the callback)
-        if (event->json_root) {
-            cJSON_Delete(event->json_root);
-            event->json_root = NULL;
+        return true;
+    case 4: // Fields of an event
+        if (!sink->event) {
+            return true;
         }
+        if (token == JSON_STREAM_KEY) {
+            strlcpy(sink->event_key, value, sizeof(sink->event_key));
+        } else if (token == JSON_STREAM_STRING) {
+            cJSON_AddStringToObject(sink->event, sink->event_key, value);
+        } else if (token == JSON_STREAM_NULL) {
+            cJSON_AddNullToObject(sink->event, sink->event_key);
+        }
+        return true;
+    default:
+        return true;
     }
 }
 
 /**
- * @brief Queues a network request to fetch calendar events for a specific date.
+ * @brief Streaming sink of a calendar range request, called by `net_worker_task`.
  *
- * This function constructs a `net_event_t` to request calendar data for the given
- * `timeinfo`. It dynamically allocates memory for the POST data and the `user_data`
- * (which carries the date string for the callback). The request is then sent to
- * the `net_queue` to be processed by the `net_worker_task`.
- *
- * @param timeinfo A `struct tm` representing the date for which to fetch events.
+ * A NULL `data` marks the start of a (re)tried response and resets the parser.
  */
-void collect_event_data(struct tm timeinfo) {
-    char date[11];
-    strftime(date, sizeof(date), "%Y-%m-%d", &timeinfo);
+static esp_err_t calendar_range_on_data(net_event_t *event, const char *data, size_t len) {
+    calendar_range_sink_t *sink = event->user_data;
+    if (data == NULL) {
+        calendar_range_sink_discard(sink);
+        json_stream_init(&sink->parser, calendar_range_token, sink);
+        sink->top_key[0] = '\0';
+        sink->day_count = 0;
+        sink->visible_changed = false;
+        return ESP_OK;
+    }
+    if (event->status_code != 200) {
+        return ESP_OK; // Error body (or none for 304), reported by the callback
+    }
+    return json_stream_feed(&sink->parser, data, len);
+}
 
-    // Dynamically allocate buffer for post_data, e.g., {"date":"YYYY-MM-DD"} needs ~27 bytes.
-    char *dynamic_post_data = malloc(27);
-    if (!dynamic_post_data) {
-        ESP_LOGE(TAG_CALENDAR, "Failed to allocate memory for post_data");
+/**
+ * @brief Marks the prefetched ranges overlapping a range as not fetched, so the next
+ * prefetch cycle requests them again.
+ *
+ * Used when a range request fails or is cancelled after `should_prefetch_range` or the
+ * bootstrap manifest recorded it.
+ */
+static void prefetch_forget_range(int32_t first_day, int32_t last_day) {
+    if (xSemaphoreTake(xPrefetchCacheMutex, portMAX_DELAY) == pdFALSE) {
         return;
     }
-    snprintf(dynamic_post_data, 27, "{\"date\":\"%s\"}", date);
+    for (int i = 0; i < prefetch_cache_fill_count; ++i) {
+        if (prefetch_cache[i].first_day <= last_day && prefetch_cache[i].last_day >= first_day) {
+            prefetch_cache[i].last_fetch_ts = 0;
+        }
+    }
+    xSemaphoreGive(xPrefetchCacheMutex);
+}
 
-    // Duplicate the date string for the UI event message.
-    char *date_for_ui_event = strdup(date); // strdup uses malloc
-    if (!date_for_ui_event) {
-        ESP_LOGE(TAG_CALENDAR, "Failed to allocate memory for date_for_ui_event");
-        free(dynamic_post_data); // Clean up previously allocated memory
-        return;
+/**
+ * @brief Callback function to process the result of a calendar range request.
+ *
+ * This function is called by the `net_worker_task` after an HTTP request for a range of
+ * days completes. The events have already been written to LittleFS by
+ * `calendar_range_on_data`; here the response is checked for completeness and the event
+ * group bit signalling that calendar data is available is set. The `post_data` and the
+ * sink allocated by `collect_event_range` are freed here.
+ *
+ * @param event The network event structure containing the response and other data.
+ * @param result The result of the HTTP request (ESP_OK on success).
+ */
+static void collect_event_range_callback(net_event_t *event, esp_err_t result) {
+    calendar_range_sink_t *sink = event->user_data;
+    // This callback knows that for this request type, post_data was malloc'd.
+    free((void *)event->post_data);
+    event->post_data = NULL;
+
+    if (result == ESP_OK && event->status_code == 304) {
+        ESP_LOGI(TAG_CALENDAR, "Calendar events unchanged, keeping the stored days.");
+        calendar_mark_synced(sink->first_day, sink->last_day, time(NULL));
+        sync_scheduler_report(false);
+        xEventGroupSetBits(net_event_group, NET_CALENDAR_AVAILABLE_BIT);
+    } else if (result == ESP_OK && event->status_code == 200 &&
+               json_stream_finish(&sink->parser) == ESP_OK) {
+        ESP_LOGI(TAG_CALENDAR, "Finished processing and saving calendar events for %d days.",
+                 sink->day_count);
+        calendar_mark_synced(sink->first_day, sink->last_day, time(NULL));
+        sync_scheduler_report(sink->day_count > 0);
+        xEventGroupSetBits(net_event_group, NET_CALENDAR_AVAILABLE_BIT);
+    } else if (result == NET_ERR_CANCELLED) {
+        ESP_LOGI(TAG_CALENDAR, "Calendar range request cancelled.");
+        prefetch_forget_range(sink->first_day, sink->last_day);
+    } else {
+        ESP_LOGE(TAG_CALENDAR, "Failed to receive calendar data. HTTP result: %s, status %d",
+                 esp_err_to_name(result), event->status_code);
+        prefetch_forget_range(sink->first_day, sink->last_day);
+        if (sink->day_count > 0) {
+            // Days completed before the failure are stored and can be shown
+            xEventGroupSetBits(net_event_group, NET_CALENDAR_AVAILABLE_BIT);
+        }
+    }
+    if (sink->visible_changed && calendar_headless) {
+        // Background sync: the screen is only started because the displayed day changed
+        xTaskNotify(xCalendarDisplayHandle, 0, eSetValueWithoutOverwrite);
     }
+    calendar_range_sink_discard(sink);
+    free(sink);
+    event->user_data = NULL;
+}
 
-    // 使用前清除靜態回應緩衝區
-    calendar_api_response_buffer[0] = '\0';
+/**
+ * @brief Queues one network request for the calendar events of a range of dates.
+ *
+ * The server answers with the events of every day from `first` to `last` (inclusive)
+ * using a single Google Calendar query. The response is streamed straight into the
+ * per-day files, so its size is not limited by a buffer. The POST data and the sink
+ * state are allocated here and freed by the callback.
+ *
+ * Only one range request is queued at a time (NET_KEY_CALENDAR_RANGE). A background
+ * request is dropped if the request queue is full; its range is then forgotten so the
+ * next prefetch cycle tries again.
+ *
+ * @param first    The first date to fetch.
+ * @param last     The last date to fetch.
+ * @param priority NET_PRIO_INTERACTIVE if the range contains the displayed date.
+ */
+static void collect_event_range(struct tm first, struct tm last, net_priority_t priority) {
+    cJSON *root = cJSON_CreateObject();
+    calendar_add_window(root, first, last);
+    char *dynamic_post_data = root ? cJSON_PrintUnformatted(root) : NULL;
+    cJSON_Delete(root);
+    int32_t last_day = prefetch_day_number(&last);
+
+    calendar_range_sink_t *sink = calloc(1, sizeof(calendar_range_sink_t));
+    if (!dynamic_post_data || !sink) {
+        ESP_LOGE(TAG_CALENDAR, "Failed to allocate memory for calendar range request");
+        free(dynamic_post_data);
+        free(sink);
+        return;
+    }
+    sink->first_day = prefetch_day_number(&first);
+    sink->last_day = last_day;
 
     net_event_t event = {
-        .url = CALENDAR_URL,
+        .url = CALENDAR_RANGE_URL,
         .method = HTTP_METHOD_POST,
         .post_data = dynamic_post_data, // Use the dynamically allocated buffer.
         .use_jwt = true,
-        .response_buffer = calendar_api_response_buffer, // Use the static calendar response buffer.
-        .response_buffer_size = sizeof(calendar_api_response_buffer),
-        .on_finish = collect_event_data_callback,
-        .user_data = date_for_ui_event, // Pass the date string to the UI.
+        .on_data = calendar_range_on_data,
+        .on_finish = collect_event_range_callback,
+        .user_data = sink,
+        .priority = priority,
+        .key = NET_KEY_CALENDAR_RANGE,
     };
-    xQueueSend(net_queue, &event, portMAX_DELAY);
+    TickType_t wait = priority == NET_PRIO_BACKGROUND ? 0 : portMAX_DELAY;
+    if (net_submit(&event, wait) != ESP_OK) {
+        prefetch_forget_range(sink->first_day, sink->last_day);
+        free(dynamic_post_data);
+        free(sink);
+    }
 }
 
 /**
- * @brief Manages the transition to deep sleep.
+ * @brief Adds the prefetch window around today and its stored ETags to the bootstrap
+ * request, so the server can tell which days changed.
  *
- * This task waits for the `DEEP_SLEEP_REQUESTED_BIT` to be set in the `sleep_event_group`.
- * Once requested, it continuously checks if the system is idle (e.g., queues are empty,
- * critical semaphores are available). When all conditions are met, it configures the
- * wakeup sources (GPIO pins) and puts the device into deep sleep.
+ * Nothing is added while the clock is not set; the server then uses its own date.
  *
- * @param pvParameters Unused.
+ * @param body The bootstrap request body.
  */
-void deep_sleep_manager_task(void *pvParameters) {
-    const TickType_t check_interval = pdMS_TO_TICKS(2000); // Check conditions every 2 seconds.
-    ESP_LOGI(TAG_SLEEP_MGR, "Deep Sleep Manager task started.");
-
-    for (;;) {
-        xEventGroupWaitBits(sleep_event_group, DEEP_SLEEP_REQUESTED_BIT, pdFALSE, pdTRUE,
-                            portMAX_DELAY);
-        ESP_LOGI(TAG_SLEEP_MGR, "Deep sleep request received. Starting checks...");
+void calendar_add_sync_state(cJSON *body) {
+    time_t now = time(NULL);
+    struct tm today;
+    localtime_r(&now, &today);
+    if (today.tm_year < (2023 - 1900)) {
+        return;
+    }
+    struct tm first = today;
+    struct tm last = today;
+    first.tm_mday -= PREFETCH_RADIUS_DAYS;
+    last.tm_mday += PREFETCH_RADIUS_DAYS;
+    mktime(&first);
+    mktime(&last);
+    calendar_add_window(body, first, last);
+}
 
-        bool can_sleep_now = false;
+/**
+ * @brief Stores the calendar manifest of the bootstrap response for the prefetch task.
+ *
+ * The manifest is {"start", "end", "changed": ["YYYY-MM-DD", ...]}: the days of the window
+ * whose events differ from the ones stored on the device.
+ *
+ * @param calendar The "calendar" object of the bootstrap response.
+ */
+void calendar_apply_bootstrap(const cJSON *calendar) {
+    struct tm first;
+    struct tm last;
+    cJSON *changed = cJSON_GetObjectItem(calendar, "changed");
+    if (!parse_date_string(cJSON_GetStringValue(cJSON_GetObjectItem(calendar, "start")), &first) ||
+        !parse_date_string(cJSON_GetStringValue(cJSON_GetObjectItem(calendar, "end")), &last) ||
+        !cJSON_IsArray(changed)) {
+        ESP_LOGW(TAG_CALENDAR, "Invalid calendar manifest in bootstrap response.");
+        return;
+    }
+    calendar_manifest_t manifest = {
+        .pending = true,
+        .first_day = prefetch_day_number(&first),
+        .last_day = prefetch_day_number(&last),
+        .changed_first = INT32_MAX,
+        .changed_last = INT32_MIN,
+    };
+    const cJSON *item;
+    cJSON_ArrayForEach(item, changed) {
+        struct tm date;
+        if (parse_date_string(cJSON_GetStringValue(item), &date)) {
+            int32_t day = prefetch_day_number(&date);
+            manifest.changed_first = day < manifest.changed_first ? day : manifest.changed_first;
+            manifest.changed_last = day > manifest.changed_last ? day : manifest.changed_last;
+        }
+    }
+    taskENTER_CRITICAL(&bootstrap_manifest_lock);
+    bootstrap_manifest = manifest;
+    taskEXIT_CRITICAL(&bootstrap_manifest_lock);
+}
 
-        // Keep checking conditions as long as the sleep request is active.
-        while (xEventGroupGetBits(sleep_event_group) & DEEP_SLEEP_REQUESTED_BIT) {
-            can_sleep_now = false; // Reset status for this iteration.
+/**
+ * @brief Returns true if `day` lies in a range fetched within the cooldown period.
+ *
+ * Must be called with `xPrefetchCacheMutex` held.
+ */
+static bool prefetch_day_is_fresh(int32_t day, time_t now) {
+    for (int i = 0; i < prefetch_cache_fill_count; ++i) {
+        if (day >= prefetch_cache[i].first_day && day <= prefetch_cache[i].last_day &&
+            (now - prefetch_cache[i].last_fetch_ts) < PREFETCH_COOLDOWN_SECONDS) {
+            return true;
+        }
+    }
+    return false;
+}
 
-            // 1. 檢查佇列 (非阻塞)
-            if (uxQueueMessagesWaiting(gui_queue) != 0) {
-                ESP_LOGD(TAG_SLEEP_MGR, "GUI queue not empty. Postponing sleep check.");
-                vTaskDelay(check_interval);
-                continue;
-            }
-            if (uxQueueMessagesWaiting(net_queue) != 0) {
-                ESP_LOGD(TAG_SLEEP_MGR, "Net queue not empty. Postponing sleep check.");
-                vTaskDelay(check_interval);
-                continue;
-            }
-            ESP_LOGD(TAG_SLEEP_MGR, "Queues are empty.");
-
-            // 2. Try to acquire semaphores with a short timeout.
-            bool screen_locked = false;
-            bool wifi_locked = false;
-
-            if (xSemaphoreTake(xScreen, pdMS_TO_TICKS(50)) == pdTRUE) {
-                screen_locked = true;
-                ESP_LOGD(TAG_SLEEP_MGR, "Screen semaphore acquired.");
-                if (xSemaphoreTake(xWifi, pdMS_TO_TICKS(50)) == pdTRUE) {
-                    wifi_locked = true;
-                    ESP_LOGD(TAG_SLEEP_MGR, "WiFi semaphore acquired.");
-                    can_sleep_now = true;
-                } else {
-                    ESP_LOGD(TAG_SLEEP_MGR,
-                             "Could not acquire WiFi semaphore. Releasing screen lock.");
-                    xSemaphoreGive(xScreen); // Release screen lock if wifi acquire fails.
-                    screen_locked = false;
-                }
-            } else {
-                ESP_LOGD(TAG_SLEEP_MGR, "Could not acquire screen semaphore.");
-            }
+/**
+ * @brief Records a date range as fetched at `now`.
+ *
+ * The range replaces an expired entry if there is one, otherwise the cache is replaced
+ * circularly once full. Must be called with `xPrefetchCacheMutex` held.
+ */
+static void prefetch_record_range(int32_t first_day, int32_t last_day, time_t now) {
+    int slot = -1;
+    for (int i = 0; i < prefetch_cache_fill_count; ++i) {
+        if ((now - prefetch_cache[i].last_fetch_ts) >= PREFETCH_COOLDOWN_SECONDS) {
+            slot = i; // Reuse an expired entry.
+            break;
+        }
+    }
+    if (slot < 0) {
+        if (prefetch_cache_fill_count < MAX_PREFETCH_CACHE_SIZE) {
+            // Add to the cache if there is space.
+            slot = prefetch_cache_fill_count++;
+        } else {
+            // Cache is full, use circular replacement strategy.
+            ESP_LOGW(TAG_PREFETCH, "Prefetch cache full. Replacing entry at index %d.",
+                     prefetch_cache_next_replace_idx);
+            slot = prefetch_cache_next_replace_idx;
+            prefetch_cache_next_replace_idx =
+                (prefetch_cache_next_replace_idx + 1) % MAX_PREFETCH_CACHE_SIZE;
+        }
+    }
+    prefetch_cache[slot].first_day = first_day;
+    prefetch_cache[slot].last_day = last_day;
+    prefetch_cache[slot].last_fetch_ts = now;
+}
 
-            if (can_sleep_now) {
-                ESP_LOGI(TAG_SLEEP_MGR,
-                         "All conditions met. Proceeding to deep sleep configuration.");
-
-                // 3. Configure wakeup sources.
-                uint64_t ext1_wakeup_pins_mask =
-                    (1ULL << PIN_BUTTON) | (1ULL << PIN_ENCODER_A) | (1ULL << PIN_ENCODER_B);
-                esp_sleep_ext1_wakeup_mode_t wakeup_mode = ESP_EXT1_WAKEUP_ANY_LOW;
-                esp_err_t err_wakeup =
-                    esp_sleep_enable_ext1_wakeup(ext1_wakeup_pins_mask, wakeup_mode);
-
-                if (err_wakeup != ESP_OK) {
-                    ESP_LOGE(TAG_SLEEP_MGR,
-                             "Failed to enable ext1 wakeup: %s. Aborting sleep attempt.",
-                             esp_err_to_name(err_wakeup));
-                    if (wifi_locked)
-                        xSemaphoreGive(xWifi);
-                    if (screen_locked)
-                        xSemaphoreGive(xScreen);
-                    vTaskDelay(check_interval); // Wait and retry setting.
-                    continue;                   // Continue while loop to re-check conditions.
-                }
+/**
+ * @brief Applies a pending bootstrap manifest.
+ *
+ * The manifest window is recorded as fetched, and only the span of changed days is
+ * requested. If nothing changed, the stored days are shown without another request.
+ *
+ * @param center_t   The displayed date, normalized.
+ * @param center_day Its day number.
+ */
+static void prefetch_apply_manifest(const struct tm *center_t, int32_t center_day) {
+    calendar_manifest_t manifest;
+    taskENTER_CRITICAL(&bootstrap_manifest_lock);
+    manifest = bootstrap_manifest;
+    bootstrap_manifest.pending = false;
+    taskEXIT_CRITICAL(&bootstrap_manifest_lock);
+    if (!manifest.pending) {
+        return;
+    }
 
-                ec11_clean_button_callback();
-                ec11_clean_encoder_callback();
-                if (rtc_gpio_is_valid_gpio(PIN_BUTTON)) {
-                    rtc_gpio_pullup_en(PIN_BUTTON);
-                    rtc_gpio_pulldown_dis(PIN_BUTTON);
-                }
-                if (rtc_gpio_is_valid_gpio(PIN_ENCODER_A)) {
-                    rtc_gpio_pullup_en(PIN_ENCODER_A);
-                    rtc_gpio_pulldown_dis(PIN_ENCODER_A);
-                }
-                if (rtc_gpio_is_valid_gpio(PIN_ENCODER_B)) {
-                    rtc_gpio_pullup_en(PIN_ENCODER_B);
-                    rtc_gpio_pulldown_dis(PIN_ENCODER_B);
-                }
+    time_t now = time(NULL);
+    if (xSemaphoreTake(xPrefetchCacheMutex, portMAX_DELAY) == pdTRUE) {
+        prefetch_record_range(manifest.first_day, manifest.last_day, now);
+        xSemaphoreGive(xPrefetchCacheMutex);
+    }
+    if (manifest.changed_first > manifest.changed_last) {
+        ESP_LOGI(TAG_PREFETCH, "Bootstrap manifest: no changed days.");
+        calendar_mark_synced(manifest.first_day, manifest.last_day, now);
+        sync_scheduler_report(false);
+        xEventGroupSetBits(net_event_group, NET_CALENDAR_AVAILABLE_BIT);
+        return;
+    }
+    // The days outside the changed span are confirmed; the span is once its request succeeds
+    calendar_mark_synced(manifest.first_day, manifest.changed_first - 1, now);
+    calendar_mark_synced(manifest.changed_last + 1, manifest.last_day, now);
+    ESP_LOGI(TAG_PREFETCH, "Bootstrap manifest: fetching %ld changed day(s) span.",
+             (long)(manifest.changed_last - manifest.changed_first + 1));
+    struct tm first_t = *center_t;
+    struct tm last_t = *center_t;
+    first_t.tm_mday += manifest.changed_first - center_day;
+    last_t.tm_mday += manifest.changed_last - center_day;
+    mktime(&first_t);
+    mktime(&last_t);
+    bool has_center = manifest.changed_first <= center_day && center_day <= manifest.changed_last;
+    collect_event_range(first_t, last_t, has_center ? NET_PRIO_INTERACTIVE : NET_PRIO_BACKGROUND);
+}
 
-                ESP_LOGI(TAG_SLEEP_MGR, "Entering deep sleep NOW.");
-                vTaskDelay(pdMS_TO_TICKS(100)); // Ensure log is flushed.
-                esp_deep_sleep_start();
-                // Code will not reach here if esp_deep_sleep_start() is successful.
-            } else {
-                ESP_LOGD(TAG_SLEEP_MGR, "Conditions not met for sleep. Retrying in %d ms.",
-                         (int)pdTICKS_TO_MS(check_interval));
-                vTaskDelay(check_interval);
-            }
-        }
-        ESP_LOGI(TAG_SLEEP_MGR, "Sleep request cancelled or processed. Waiting for new request.");
+/**
+ * @brief Starts the screen if it was left off by a background sync.
+ *
+ * Screen events are accepted again from here on; those posted while the screen was off
+ * were discarded.
+ */
+static void calendar_show_screen(void) {
+    if (!calendar_headless) {
+        return;
     }
+    ESP_LOGI(TAG_CALENDAR, "Starting the screen.");
+    calendar_headless = false;
+    ui_set_discard(false);
+    xTaskCreate(screenStartup, "screenStartup", 4096, NULL, 6, NULL);
 }
 
 /**
- * @brief Checks if a given date should be prefetched based on cache status and cooldown.
+ * @brief Determines which part of a date window should be prefetched.
  *
- * This helper function determines whether to initiate a network request for a specific date.
- * It checks a local cache (`prefetch_cache`) to see if the date has been fetched recently.
- * - If the date is in the cache and was fetched within the `PREFETCH_COOLDOWN_SECONDS` period,
- * it returns `false`.
- * - If the date is in the cache but the cooldown has expired, it updates the timestamp and
- * returns `true`.
- * - If the date is not in the cache, it adds it to the cache (using a circular replacement
- *   strategy if full) and returns `true`.
+ * The cache (`prefetch_cache`) records the date ranges fetched recently. A day is
+ * covered if a range fetched within `PREFETCH_COOLDOWN_SECONDS` contains it. The function
+ * returns the smallest range spanning every uncovered day of the window, so that it can
+ * be fetched with one request, and records that range as fetched. When the displayed date
+ * moves by one day, only the newly exposed day at the edge of the window is returned.
  *
  * This function is thread-safe and uses `xPrefetchCacheMutex` to protect the cache.
  *
- * @param target_date_ts A `struct tm` representing the date to check.
- * @return `true` if the date should be prefetched, `false` otherwise.
+ * @param first_day   First day of the window (see `prefetch_day_number`).
+ * @param last_day    Last day of the window, inclusive.
+ * @param fetch_first Receives the first day to fetch.
+ * @param fetch_last  Receives the last day to fetch.
+ * @return `true` if a range should be prefetched, `false` if the window is covered.
  */
-static bool should_prefetch_date(struct tm target_date_ts) {
-    char date_str_log[12];
-    strftime(date_str_log, sizeof(date_str_log), "%Y-%m-%d", &target_date_ts);
-
+static bool should_prefetch_range(int32_t first_day, int32_t last_day, int32_t *fetch_first,
+                                  int32_t *fetch_last) {
     if (xSemaphoreTake(xPrefetchCacheMutex, portMAX_DELAY) == pdFALSE) {
         ESP_LOGE(TAG_PREFETCH, "Failed to take prefetch cache mutex");
         return false; // Don't prefetch if mutex cannot be acquired.
@@ -625,73 +956,62 @@ static bool should_prefetch_date(struct tm target_date_ts) {
     time_t current_sys_time;
     time(&current_sys_time);
 
-    for (int i = 0; i < prefetch_cache_fill_count; ++i) {
-        if (prefetch_cache[i].date_t.tm_year == target_date_ts.tm_year &&
-            prefetch_cache[i].date_t.tm_mon == target_date_ts.tm_mon &&
-            prefetch_cache[i].date_t.tm_mday == target_date_ts.tm_mday) {
-            // Date found in cache, check cooldown.
-            if ((current_sys_time - prefetch_cache[i].last_fetch_ts) < PREFETCH_COOLDOWN_SECONDS) {
-                xSemaphoreGive(xPrefetchCacheMutex);
-                ESP_LOGI(TAG_PREFETCH, "Date %s already fetched within %d mins. Skipping.",
-                         date_str_log, PREFETCH_COOLDOWN_SECONDS / 60);
-                return false; // Recently fetched.
-            } else {
-                // Cooldown expired, update timestamp and re-fetch.
-                prefetch_cache[i].last_fetch_ts = current_sys_time;
-                xSemaphoreGive(xPrefetchCacheMutex);
-                ESP_LOGI(TAG_PREFETCH, "Date %s found in cache, older than %d mins. Refetching.",
-                         date_str_log, PREFETCH_COOLDOWN_SECONDS / 60);
-                return true;
+    bool found = false;
+    for (int32_t day = first_day; day <= last_day; ++day) {
+        if (!prefetch_day_is_fresh(day, current_sys_time)) {
+            if (!found) {
+                *fetch_first = day;
+                found = true;
             }
+            *fetch_last = day;
         }
     }
-
-    // Not in cache, add it.
-    if (prefetch_cache_fill_count < MAX_PREFETCH_CACHE_SIZE) {
-        // Add to the cache if there is space.
-        prefetch_cache[prefetch_cache_fill_count].date_t = target_date_ts;
-        prefetch_cache[prefetch_cache_fill_count].last_fetch_ts = current_sys_time;
-        prefetch_cache_fill_count++;
-        ESP_LOGI(TAG_PREFETCH, "Date %s not in cache. Added. Fetching.", date_str_log);
-    } else {
-        // Cache is full, use circular replacement strategy.
-        ESP_LOGW(TAG_PREFETCH, "Prefetch cache full. Replacing entry at index %d for date %s.",
-                 prefetch_cache_next_replace_idx, date_str_log);
-        prefetch_cache[prefetch_cache_next_replace_idx].date_t = target_date_ts;
-        prefetch_cache[prefetch_cache_next_replace_idx].last_fetch_ts = current_sys_time;
-        prefetch_cache_next_replace_idx =
-            (prefetch_cache_next_replace_idx + 1) % MAX_PREFETCH_CACHE_SIZE;
+    if (!found) {
+        xSemaphoreGive(xPrefetchCacheMutex);
+        ESP_LOGI(TAG_PREFETCH, "Window already fetched within %d mins. Skipping.",
+                 PREFETCH_COOLDOWN_SECONDS / 60);
+        return false;
     }
+
+    prefetch_record_range(*fetch_first, *fetch_last, current_sys_time);
     xSemaphoreGive(xPrefetchCacheMutex);
+    ESP_LOGI(TAG_PREFETCH, "%ld of %ld days not fetched recently. Fetching.",
+             (long)(*fetch_last - *fetch_first + 1), (long)(last_day - first_day + 1));
     return true;
 }
 
 void calendar_prefetch_task(void *pvParameters) {
+    // 讀寫日曆檔與重建字型表之前，等待 LittleFS 與字型索引
+    boot_wait(BOOT_FONTS_READY_BIT);
     // 等待 WiFi 連接
     xEventGroupWaitBits(net_event_group, NET_WIFI_CONNECTED_BIT, false, true, portMAX_DELAY);
-    // 設定 NTP 伺服器和操作模式
-    esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    esp_sntp_setservername(0, "pool.ntp.org");
-    esp_sntp_init();
-    // 等待NTP同步完成
-    ESP_LOGI(TAG_CALENDAR, "Waiting for NTP time synchronization...");
+    // RTC 時鐘可信時立即設定 NET_TIME_SYNCED_BIT，SNTP 只在需要時於背景執行
+    timekeeping_start_sync();
     time_t now;
-    // 初始化 timeinfo 避免在 sntp_get_sync_status() 返回 SNTP_SYNC_STATUS_RESET 時 localtime_r
-    // 出錯
-    memset(&current_display_time, 0, sizeof(struct tm));
-
-    while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET ||
-           current_display_time.tm_year < (2023 - 1900)) {
-        vTaskDelay(2000 / portTICK_PERIOD_MS); // 每2秒檢查一次
+    // 旋鈕喚醒時保留 RTC 中正在顯示的日期，預取以它為中心
+    if (!isr_woken || current_display_time.tm_year < (2023 - 1900)) {
         time(&now);
         localtime_r(&now, &current_display_time);
+    }
+
+    // SNTP 或 bootstrap 回應的伺服器時間都會設定 NET_TIME_SYNCED_BIT
+    while ((xEventGroupGetBits(net_event_group) & NET_TIME_SYNCED_BIT) == 0 ||
+           current_display_time.tm_year < (2023 - 1900)) {
+        xEventGroupWaitBits(net_event_group, NET_TIME_SYNCED_BIT, pdFALSE, pdTRUE,
+                            pdMS_TO_TICKS(2000)); // 最多每2秒檢查一次
+        if (!isr_woken || current_display_time.tm_year < (2023 - 1900)) {
+            time(&now);
+            localtime_r(&now, &current_display_time);
+        }
         ESP_LOGI(TAG_CALENDAR, "Current time: %04d-%02d-%02d %02d:%02d:%02d, waiting for sync...",
                  current_display_time.tm_year + 1900, current_display_time.tm_mon + 1,
                  current_display_time.tm_mday, current_display_time.tm_hour,
                  current_display_time.tm_min, current_display_time.tm_sec);
     }
-    check_calendar_settings();
     xEventGroupWaitBits(net_event_group, NET_SERVER_CONNECTED_BIT, false, true, portMAX_DELAY);
+    if ((xEventGroupGetBits(net_event_group) & NET_BOOTSTRAP_BIT) == 0) {
+        check_calendar_settings(); // 伺服器沒有 bootstrap，另外確認 Google 授權
+    }
     xPrefetchCacheMutex = xSemaphoreCreateMutex();
     memset(prefetch_cache, 0, sizeof(prefetch_cache)); // 初始化快取
     if (xPrefetchCacheMutex == NULL) {                 // 確保互斥鎖已創建
@@ -708,7 +1028,10 @@ void calendar_prefetch_task(void *pvParameters) {
         xEventGroupWaitBits(net_event_group, NET_GOOGLE_TOKEN_AVAILABLE_BIT, false, true,
                             portMAX_DELAY);
         // 在等待新命令前，清除睡眠請求，因為我們即將處理新命令
-        xEventGroupClearBits(sleep_event_group, DEEP_SLEEP_REQUESTED_BIT);
+        sleep_manager_cancel_request();
+        sleep_manager_hold(SLEEP_HOLD_PREFETCH);
+        // 範圍請求排入前保持射頻開啟，讓它和 bootstrap、遙測上傳在同一段連線內完成
+        net_radio_hold(NET_RADIO_HOLD_PREFETCH);
 
         // 檢查字體表快取使用情況
         // MAX_FONTS 是在 font_task.h 中定義的
@@ -740,71 +1063,33 @@ void calendar_prefetch_task(void *pvParameters) {
         // 在開始預取前，如果之前有睡眠請求，先取消它，因為我們現在要忙了
         ESP_LOGI(TAG_PREFETCH, "Clearing deep sleep request before starting prefetch cycle.");
 
-        struct tm day_to_fetch_t = current_display_time;
-        if (should_prefetch_date(day_to_fetch_t)) {
-            ESP_LOGI(TAG_PREFETCH, "fetching for today : %04d-%02d-%02d",
-                     day_to_fetch_t.tm_year + 1900, day_to_fetch_t.tm_mon + 1,
-                     day_to_fetch_t.tm_mday);
-            collect_event_data(day_to_fetch_t); // 非同步呼叫
+        // 使用者已捲到別的日期，還在排隊的舊預取不再需要
+        int cancelled = net_cancel(NET_KEY_CALENDAR_RANGE);
+        if (cancelled > 0) {
+            ESP_LOGI(TAG_PREFETCH, "Cancelled %d stale prefetch request(s).", cancelled);
         }
 
-        for (int offset = 1; offset <= 5; ++offset) {
-            // 檢查是否有新的通知以中斷當前預取序列
-            if (xTaskNotifyWait(0, ULONG_MAX, NULL, 0) == pdPASS) {
-                ESP_LOGI(TAG_PREFETCH,
-                         "Prefetch cycle interrupted by new date. Clearing sleep request.");
-                xEventGroupClearBits(sleep_event_group, DEEP_SLEEP_REQUESTED_BIT);
-                ESP_LOGI(TAG_PREFETCH,
-                         "Prefetch interrupted by new trigger for date: %04d-%02d-%02d. "
-                         "Restarting prefetch.",
-                         current_display_time.tm_year + 1900, current_display_time.tm_mon + 1,
-                         current_display_time.tm_mday);
-                offset = 0; // 會在下一次迭代變成 1，重新開始
-                xEventGroupWaitBits(net_event_group, NET_GOOGLE_TOKEN_AVAILABLE_BIT, pdFALSE,
-                                    pdTRUE,
-                                    portMAX_DELAY); // 再次檢查
-                continue;
-            }
-
-            // 預取 後一天 (current_center_day_t + offset)
-            day_to_fetch_t = current_display_time;
-            day_to_fetch_t.tm_mday += offset;
-            mktime(&day_to_fetch_t);
-            if (should_prefetch_date(day_to_fetch_t)) {
-                ESP_LOGI(TAG_PREFETCH, "Prefetching for next day (+%d): %04d-%02d-%02d", offset,
-                         day_to_fetch_t.tm_year + 1900, day_to_fetch_t.tm_mon + 1,
-                         day_to_fetch_t.tm_mday);
-                collect_event_data(day_to_fetch_t); // 非同步呼叫
-            }
-
-            // 再次檢查中斷
-            if (xTaskNotifyWait(0, ULONG_MAX, NULL, 0) == pdPASS) {
-                ESP_LOGI(TAG_PREFETCH,
-                         "Prefetch cycle interrupted by new date. Clearing sleep request.");
-                xEventGroupClearBits(sleep_event_group, DEEP_SLEEP_REQUESTED_BIT);
-                ESP_LOGI(TAG_PREFETCH,
-                         "Prefetch interrupted by new trigger for date: %04d-%02d-%02d. "
-                         "Restarting prefetch.",
-                         current_display_time.tm_year + 1900, current_display_time.tm_mon + 1,
-                         current_display_time.tm_mday);
-                offset = 0;
-                xEventGroupWaitBits(net_event_group, NET_GOOGLE_TOKEN_AVAILABLE_BIT, pdFALSE,
-                                    pdTRUE, portMAX_DELAY);
-                continue;
-            }
-
-            // 預取 前一天 (current_center_day_t - offset)
-            day_to_fetch_t = current_display_time;
-            day_to_fetch_t.tm_mday -= offset;
-            mktime(&day_to_fetch_t);
-            if (should_prefetch_date(day_to_fetch_t)) {
-                ESP_LOGI(TAG_PREFETCH, "Prefetching for next day (-%d): %04d-%02d-%02d", offset,
-                         day_to_fetch_t.tm_year + 1900, day_to_fetch_t.tm_mon + 1,
-                         day_to_fetch_t.tm_mday);
-                collect_event_data(day_to_fetch_t); // 非同步呼叫
-            }
-
-            vTaskDelay(pdMS_TO_TICKS(200)); // 短暫延遲以允許其他任務執行，並避免過於頻繁的API請求
+        // 整個 ±PREFETCH_RADIUS_DAYS 視窗只送一個範圍請求
+        struct tm center_t = current_display_time;
+        mktime(&center_t);
+        int32_t center_day = prefetch_day_number(&center_t);
+        prefetch_apply_manifest(&center_t, center_day);
+        int32_t fetch_first, fetch_last;
+        if (should_prefetch_range(center_day - PREFETCH_RADIUS_DAYS,
+                                  center_day + PREFETCH_RADIUS_DAYS, &fetch_first, &fetch_last)) {
+            struct tm first_t = center_t;
+            struct tm last_t = center_t;
+            first_t.tm_mday += fetch_first - center_day;
+            last_t.tm_mday += fetch_last - center_day;
+            mktime(&first_t);
+            mktime(&last_t);
+            ESP_LOGI(TAG_PREFETCH, "Prefetching %04d-%02d-%02d ~ %04d-%02d-%02d",
+                     first_t.tm_year + 1900, first_t.tm_mon + 1, first_t.tm_mday,
+                     last_t.tm_year + 1900, last_t.tm_mon + 1, last_t.tm_mday);
+            // 範圍包含目前顯示的日期時優先處理
+            bool has_center = fetch_first <= center_day && center_day <= fetch_last;
+            net_priority_t priority = has_center ? NET_PRIO_INTERACTIVE : NET_PRIO_BACKGROUND;
+            collect_event_range(first_t, last_t, priority); // 非同步呼叫
         }
         ESP_LOGI(TAG_PREFETCH, "Finished prefetch cycle for center date %04d-%02d-%02d",
                  current_display_time.tm_year + 1900, current_display_time.tm_mon + 1,
@@ -812,12 +1097,102 @@ void calendar_prefetch_task(void *pvParameters) {
 
         // 預取完成後，請求進入睡眠
         ESP_LOGI(TAG_PREFETCH, "Prefetch cycle complete. Requesting deep sleep.");
-        xEventGroupSetBits(sleep_event_group, DEEP_SLEEP_REQUESTED_BIT);
+        sleep_manager_request();
         ec11_set_encoder_callback(xCalendarDisplayHandle);
         ESP_LOGI("HEAP_TRACK", "--- Heap Usage Per Task ---");
         heap_caps_print_heap_info((uint32_t)NULL); // 傳 NULL 表示印到日誌
         ESP_LOGI("HEAP_TRACK", "---------------------------");
+        net_radio_release(NET_RADIO_HOLD_PREFETCH); // 沒有要抓的日期時，射頻可以立即關閉
+        sleep_manager_release(SLEEP_HOLD_PREFETCH);
+    }
+}
+
+/** @brief Set once the network tasks have been started. Only written before
+ * `calendar_display` receives its first command, and by `calendar_display` itself. */
+static bool calendar_online = false;
+
+/**
+ * @brief Starts Wi-Fi, the server connection and the prefetch task, once.
+ *
+ * The device is kept awake until Wi-Fi connects (or a background sync gives up on it).
+ */
+static void calendar_go_online(void) {
+    if (calendar_online) {
+        return;
+    }
+    calendar_online = true;
+    net_wifi_wait_begin();
+    xTaskCreate(netStartup, "netStartup", 4096, NULL, 5, NULL);
+    xTaskCreate(calendar_prefetch_task, "calendar_prefetch_task", 4096, NULL, 5,
+                &xCalendarPrefetchHandle);
+}
+
+/**
+ * @brief Starts the network for this boot or wake, unless it can be skipped.
+ *
+ * With `offline_ok`, the network stays off while the days around the displayed date were
+ * synced recently (`calendar_window_is_fresh`): knob turns are served from LittleFS and only
+ * cost display energy. `calendar_display` goes online later if the user scrolls to a stale
+ * day. Must be called before `calendar_display` receives its first command.
+ *
+ * @param offline_ok `true` for wakes that only browse the calendar.
+ */
+void calendar_start_network(bool offline_ok) {
+    if (offline_ok && calendar_window_is_fresh()) {
+        ESP_LOGI(TAG_CALENDAR, "Cached days are fresh, staying offline.");
+        return;
+    }
+    calendar_go_online();
+}
+
+/**
+ * @brief Ends a background sync that is taking too long.
+ *
+ * Runs in the timer service task. If Wi-Fi never connected, the device stops waiting for
+ * it; requests already being sent are still allowed to finish.
+ */
+static void calendar_sync_wake_timeout(TimerHandle_t timer) {
+    if (!calendar_headless) {
+        return; // The user started interacting, the normal flow decides when to sleep
+    }
+    ESP_LOGW(TAG_CALENDAR, "Background sync did not finish in %d s, going back to sleep.",
+             CONFIG_SYNC_WAKE_TIMEOUT_S);
+    net_wifi_wait_end();
+    sleep_manager_request();
+}
+
+/**
+ * @brief Starts a background sync after a timer wake.
+ *
+ * The network and the prefetch task are started as usual, but the screen stays off: it is
+ * only started by `calendar_display`, when the sync rewrote the displayed day or the user
+ * turned the knob. Must be called before `calendar_display` receives its first command.
+ */
+void calendar_start_sync_wake(void) {
+    calendar_headless = true;
+    ui_set_discard(true); // Nobody would see them, and they would keep the device awake
+    TimerHandle_t timeout =
+        xTimerCreate("sync_timeout", pdMS_TO_TICKS(CONFIG_SYNC_WAKE_TIMEOUT_S * 1000), pdFALSE,
+                     NULL, calendar_sync_wake_timeout);
+    if (timeout) {
+        xTimerStart(timeout, 0);
     }
+    calendar_go_online();
+}
+
+/**
+ * @brief Shows today's calendar after a clock tick wake found that the day had changed.
+ *
+ * The displayed date moves to today and the screen is started as on a knob wake, so the
+ * calendar and its clock are redrawn for the new date. Wi-Fi is only started if the days
+ * around today are not fresh. Must be called after `calendar_display` has been created.
+ */
+void calendar_start_new_day_wake(void) {
+    time_t now = time(NULL);
+    localtime_r(&now, &current_display_time);
+    xTaskCreate(screenStartup, "screenStartup", 4096, NULL, 6, NULL);
+    calendar_start_network(true);
+    xTaskNotify(xCalendarDisplayHandle, 0, eSetValueWithOverwrite);
 }
 
 /**
@@ -840,7 +1215,7 @@ void calendar_display(void *pvParameters) {
         // Before waiting for a new command, clear the sleep request.
         ESP_LOGI(TAG_CALENDAR, "Clearing deep sleep request before waiting for new command.");
         xTaskNotifyWait(pdTRUE, pdTRUE, &time_shift, portMAX_DELAY);
-        xEventGroupClearBits(sleep_event_group, DEEP_SLEEP_REQUESTED_BIT);
+        sleep_manager_cancel_request();
         xEventGroupWaitBits(net_event_group, NET_CALENDAR_AVAILABLE_BIT, pdFALSE, pdTRUE,
                             portMAX_DELAY);
         switch (time_shift) {
@@ -865,9 +1240,17 @@ void calendar_display(void *pvParameters) {
             .event_id = SCREEN_EVENT_CALENDAR,
         };
         strftime(ev.msg, 11, "%Y-%m-%d", &current_display_time);
-        xQueueSend(gui_queue, &ev, portMAX_DELAY);
+        calendar_show_screen();
+        ui_send_event(&ev);
+        if (!calendar_online && !calendar_window_is_fresh()) {
+            ESP_LOGI(TAG_CALENDAR, "Displayed days need a sync, starting the network.");
+            calendar_go_online();
+        }
         if (xEventGroupGetBits(net_event_group) & NET_SERVER_CONNECTED_BIT) {
             xTaskNotifyGive(xCalendarPrefetchHandle);
+        } else if (!calendar_online) {
+            // Offline, no prefetch cycle will request sleep
+            sleep_manager_request();
         }
         ESP_LOGI(TAG_CALENDAR, "Setting encoder callback to notify task %p on index %d",
                  xCalendarDisplayHandle, CALENDAR_NOTIFY_INDEX_CMD);
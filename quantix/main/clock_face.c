@@ -0,0 +1,268 @@
+#include "clock_face.h"
+#include "EPD_2in9.h"
+#include "EPD_store.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "fonts.h"
+#include "refresh_scheduler.h"
+#include "sdkconfig.h"
+#include "sleep_manager.h"
+#include "sync_scheduler.h"
+#include "wake_profile.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#ifdef CONFIG_CLOCK_FACE
+/** @brief Log tag for this module. */
+static const char *TAG = "CLOCK_FACE";
+
+/** @brief Magic value marking `rtc_face` as valid. */
+#define CLOCK_FACE_MAGIC 0x434C4B32
+/** @brief Earliest year treated as a synchronised wall clock. */
+#define CLOCK_FACE_MIN_VALID_YEAR 2023
+
+/** @brief Characters of "HH:MM". */
+#define CLOCK_FACE_LEN 5
+/** @brief Glyphs of the strip: the digits, then the colon. */
+#define CLOCK_FACE_GLYPHS 11
+/** @brief Index of the colon in the strip. */
+#define CLOCK_FACE_COLON 10
+/** @brief Size of a Font12 character; each of its rows is one byte, MSB first. */
+#define CLOCK_FACE_FONT_WIDTH 6
+#define CLOCK_FACE_FONT_HEIGHT 12
+
+/**
+ * @brief The bytes of a panel line covered by the clock.
+ *
+ * The calendar is drawn rotated by 90 degrees, so a row of the text runs down the panel
+ * lines and the logical y of a pixel maps to panel x = EPD_2IN9_V2_WIDTH - 1 - y.
+ */
+#define CLOCK_FACE_BYTE0                                                                          \
+    ((EPD_2IN9_V2_WIDTH - CLOCK_FACE_Y - CLOCK_FACE_FONT_HEIGHT) / 8)
+#define CLOCK_FACE_BYTES (((EPD_2IN9_V2_WIDTH - 1 - CLOCK_FACE_Y) / 8) - CLOCK_FACE_BYTE0 + 1)
+/** @brief First and last panel line of the clock. */
+#define CLOCK_FACE_LINE0 CLOCK_FACE_X
+#define CLOCK_FACE_LINE1 (CLOCK_FACE_X + CLOCK_FACE_LEN * CLOCK_FACE_FONT_WIDTH - 1)
+
+/** @brief What the glass shows, and the glyphs pre-rendered in panel order. */
+typedef struct {
+    uint32_t magic;
+    bool shown;            /**< The calendar with the clock is on the glass. */
+    uint16_t shown_minute; /**< Minute of the day the clock on the glass shows. */
+    uint32_t shown_day;    /**< Day of the calendar on the glass, see clock_face_minute(). */
+    /** Every glyph as the panel bytes of its lines, ready to be copied into a frame buffer. */
+    UBYTE glyphs[CLOCK_FACE_GLYPHS][CLOCK_FACE_FONT_WIDTH][CLOCK_FACE_BYTES];
+} clock_face_rtc_t;
+
+RTC_DATA_ATTR static clock_face_rtc_t rtc_face;
+
+/** @brief This boot is a tick wake that found the calendar on the glass showing yesterday. */
+static bool new_day_wake = false;
+
+/**
+ * @brief Reads the minute of the day the clock should show, rounded down to a tick.
+ *
+ * @param slack_s Seconds added to the clock, so a timer wake that fires a little early
+ *                still shows the new time.
+ * @param minute  Receives the minute of the day.
+ * @param day     Receives the local date as year * 366 + day of the year, only compared.
+ * @return `false` if the clock has not been set yet.
+ */
+static bool clock_face_minute(int slack_s, uint16_t *minute, uint32_t *day) {
+    time_t now;
+    struct tm now_tm;
+    time(&now);
+    now += slack_s;
+    localtime_r(&now, &now_tm);
+    if (now_tm.tm_year < (CLOCK_FACE_MIN_VALID_YEAR - 1900)) {
+        return false;
+    }
+    int m = now_tm.tm_hour * 60 + now_tm.tm_min;
+    *minute = m - m % CONFIG_CLOCK_FACE_TICK_MINUTES;
+    *day = (uint32_t)now_tm.tm_year * 366 + now_tm.tm_yday;
+    return true;
+}
+
+/**
+ * @brief Renders the Font12 digits and colon into `rtc_face.glyphs`.
+ *
+ * Done once per power-on; afterwards drawing the clock is a copy of a few bytes per line,
+ * both in the UI task and on the tick wakes.
+ */
+static void clock_face_render_glyphs(void) {
+    static const char chars[] = "0123456789:";
+    memset(rtc_face.glyphs, 0xFF, sizeof(rtc_face.glyphs));
+    for (int g = 0; g < CLOCK_FACE_GLYPHS; ++g) {
+        const uint8_t *rows = &Font12.table[(chars[g] - ' ') * CLOCK_FACE_FONT_HEIGHT];
+        for (int ry = 0; ry < CLOCK_FACE_FONT_HEIGHT; ++ry) {
+            int bit = EPD_2IN9_V2_WIDTH - 1 - CLOCK_FACE_Y - ry - CLOCK_FACE_BYTE0 * 8;
+            for (int cx = 0; cx < CLOCK_FACE_FONT_WIDTH; ++cx) {
+                if (rows[ry] & (0x80 >> cx)) {
+                    rtc_face.glyphs[g][cx][bit / 8] &= ~(0x80 >> (bit % 8)); // Black
+                }
+            }
+        }
+    }
+}
+
+/** @brief Copies "HH:MM" for `minute` into the frame buffer. */
+static void clock_face_compose(UBYTE *image, uint16_t minute) {
+    const int glyphs[CLOCK_FACE_LEN] = {
+        minute / 600, minute / 60 % 10, CLOCK_FACE_COLON, minute % 60 / 10, minute % 10,
+    };
+    for (int i = 0; i < CLOCK_FACE_LEN; ++i) {
+        for (int cx = 0; cx < CLOCK_FACE_FONT_WIDTH; ++cx) {
+            int line = CLOCK_FACE_LINE0 + i * CLOCK_FACE_FONT_WIDTH + cx;
+            memcpy(image + line * (EPD_2IN9_V2_WIDTH / 8) + CLOCK_FACE_BYTE0,
+                   rtc_face.glyphs[glyphs[i]][cx], CLOCK_FACE_BYTES);
+        }
+    }
+}
+#endif // CONFIG_CLOCK_FACE
+
+/**
+ * @brief Draws the current time into the calendar screen.
+ *
+ * Called just before the calendar is refreshed; from then on the timer wakes keep the
+ * clock on the glass current. Nothing is drawn before the clock has been set.
+ *
+ * @param image Frame buffer of the calendar screen.
+ */
+void clock_face_draw(UBYTE *image) {
+#ifdef CONFIG_CLOCK_FACE
+    uint16_t minute;
+    uint32_t day;
+    if (!clock_face_minute(0, &minute, &day)) {
+        clock_face_hide();
+        return;
+    }
+    if (rtc_face.magic != CLOCK_FACE_MAGIC) {
+        clock_face_render_glyphs();
+        rtc_face.magic = CLOCK_FACE_MAGIC;
+    }
+    clock_face_compose(image, minute);
+    rtc_face.shown = true;
+    rtc_face.shown_minute = minute;
+    rtc_face.shown_day = day;
+#endif
+}
+
+/** @brief Stops the tick wakes until the calendar is drawn again. */
+void clock_face_hide(void) {
+#ifdef CONFIG_CLOCK_FACE
+    rtc_face.shown = false;
+#endif
+}
+
+/**
+ * @brief Computes when the clock on the glass next has to change.
+ *
+ * @return Microseconds until the next tick, or 0 if no clock is shown.
+ */
+uint64_t clock_face_next_tick_us(void) {
+#ifdef CONFIG_CLOCK_FACE
+    if (rtc_face.magic != CLOCK_FACE_MAGIC || !rtc_face.shown) {
+        return 0;
+    }
+    struct timeval tv;
+    struct tm now_tm;
+    gettimeofday(&tv, NULL);
+    localtime_r(&tv.tv_sec, &now_tm);
+    if (now_tm.tm_year < (CLOCK_FACE_MIN_VALID_YEAR - 1900)) {
+        return 0;
+    }
+    int m = now_tm.tm_hour * 60 + now_tm.tm_min;
+    int64_t wait_s = (CONFIG_CLOCK_FACE_TICK_MINUTES - m % CONFIG_CLOCK_FACE_TICK_MINUTES) * 60 -
+                     now_tm.tm_sec;
+    return (uint64_t)(wait_s * 1000000 - tv.tv_usec);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Updates the clock on a timer wake and goes straight back to deep sleep.
+ *
+ * Runs before NVS, LittleFS, the tasks and Wi-Fi are started. The screen comes back from
+ * the RTC copy of `EPD_Store`, is loaded into both controller RAMs, and only the lines of
+ * the clock are sent for a partial refresh. Such a refresh touches a few hundred pixels, so
+ * it is not charged to the ghosting budget; when the refresh scheduler wants a fast or full
+ * refresh anyway (budget, age of the last full refresh, night window), the whole screen is
+ * refreshed that way instead.
+ *
+ * The new image is only kept in RTC memory: LittleFS is not mounted, so the copy used after
+ * a power loss may show an older time.
+ *
+ * Returns, and the device boots as usual, if this is no tick wake, a background sync is due,
+ * the day has changed since the calendar was drawn (`clock_face_new_day` then tells
+ * `wakeup_handler` to redraw it for today), or the screen cannot be restored.
+ */
+void clock_face_tick_wake(void) {
+#ifdef CONFIG_CLOCK_FACE
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER ||
+        rtc_face.magic != CLOCK_FACE_MAGIC || !rtc_face.shown || sync_scheduler_due()) {
+        return;
+    }
+    uint16_t minute;
+    uint32_t day;
+    if (!clock_face_minute(CLOCK_FACE_EARLY_SLACK_S, &minute, &day)) {
+        clock_face_hide();
+        return;
+    }
+    if (day != rtc_face.shown_day) {
+        ESP_LOGI(TAG, "New day, redrawing the calendar.");
+        new_day_wake = true;
+        return;
+    }
+    wake_profile_clock_tick();
+    if (minute == rtc_face.shown_minute) {
+        ESP_LOGI(TAG, "Clock unchanged, back to sleep.");
+        sleep_manager_sleep_now();
+        return;
+    }
+
+    UBYTE *image = malloc(EPD_2IN9_V2_IMAGE_SIZE);
+    if (image == NULL) {
+        return;
+    }
+    // Without LittleFS only the RTC copy can be found; check it before waking the panel
+    if (EPD_Store_Recall(image) != EPD_STORE_RTC) {
+        ESP_LOGW(TAG, "Screen not kept in RTC memory, clock stopped.");
+        clock_face_hide();
+        free(image);
+        return;
+    }
+    DEV_Module_Init();
+    refresh_scheduler_restore_base(image);
+    clock_face_compose(image, minute);
+    epd_refresh_mode_t mode = refresh_scheduler_select();
+    if (mode == EPD_REFRESH_PARTIAL) {
+        wake_profile_mark(WAKE_PHASE_RENDER_DONE);
+        EPD_2IN9_V2_Display_Partial_Window(image, CLOCK_FACE_BYTE0 * 8, CLOCK_FACE_LINE0,
+                                           (CLOCK_FACE_BYTE0 + CLOCK_FACE_BYTES) * 8 - 1,
+                                           CLOCK_FACE_LINE1);
+        EPD_Store_Remember(image);
+        wake_profile_mark(WAKE_PHASE_REFRESH_DONE);
+    } else {
+        screen_refresh_with(image, mode);
+    }
+    EPD_2IN9_V2_Sleep();
+    free(image);
+    rtc_face.shown_minute = minute;
+    ESP_LOGI(TAG, "Clock %02d:%02d shown.", minute / 60, minute % 60);
+    sleep_manager_sleep_now();
+#endif
+}
+
+/** @brief Returns true if `clock_face_tick_wake` returned because the day had changed. */
+bool clock_face_new_day(void) {
+#ifdef CONFIG_CLOCK_FACE
+    return new_day_wake;
+#else
+    return false;
+#endif
+}
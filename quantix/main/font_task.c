@@ -5,11 +5,13 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h" // For portMAX_DELAY
 #include "freertos/queue.h"    // For xQueueSend
-#include "net_task.h"          // Required for net_event_t, net_queue
-#include <cJSON.h>
+#include "json_stream.h"
+#include "net_task.h"          // Required for net_event_t, net_submit
+#include "sleep_manager.h"
 #include <dirent.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // Log tag
@@ -19,8 +21,6 @@ static const char *TAG_FONT = "FONT_TASK";
 #define FONT_DIR_LEN (sizeof(FONT_DIR) - 1)
 // 字型hash table大小
 #define HASH_TABLE_SIZE 4096
-// 字型下載緩衝區大小 (如果需要可以調整)
-#define FONT_DOWNLOAD_BUFFER_SIZE 4096
 
 // 字型條目結構，存儲字型的十六進位key和像素數據
 typedef struct {
@@ -37,10 +37,9 @@ typedef struct {
 
 int font_table_count = 0; // Current number of fonts loaded into font_table
 
-static char
-    font_download_response_buffer[FONT_DOWNLOAD_BUFFER_SIZE]; // Font download response buffer
-FontEntry font_table[MAX_FONTS];                              // 字型數據表 (RAM 緩存)
+FontEntry font_table[MAX_FONTS];                       // 字型數據表 (RAM 緩存)
 static FontHashEntry font_hash_table[HASH_TABLE_SIZE]; // 字型hash table，用於快速查找
+static portMUX_TYPE font_table_lock = portMUX_INITIALIZER_UNLOCKED; // 保護 font_table 的寫入
 
 // 將單個 UTF-8 字元 (最多3字節) 轉換為固定的6字元十六進位string
 void utf8_to_hex(const char *utf8, char *hex_out, size_t hex_out_size) {
@@ -78,6 +77,23 @@ static void font_hash_insert(const char *hex, int table_index) {
     }
 }
 
+// 將字型加入 RAM 緩存，回傳在 font_table 的索引，緩存已滿時回傳 -1。
+// 繪製與多個 net worker 的字型下載可能同時寫入，以 font_table_lock 保護
+static int font_cache_insert(const char *hex, const uint8_t *data) {
+    int table_index = -1;
+    taskENTER_CRITICAL(&font_table_lock);
+    if (font_table_count < MAX_FONTS) {
+        table_index = font_table_count;
+        FontEntry *e = &font_table[table_index];
+        strcpy(e->hex_key, hex);
+        memcpy(e->data, data, FONT_SIZE);
+        font_hash_insert(hex, table_index);
+        font_table_count++;
+    }
+    taskEXIT_CRITICAL(&font_table_lock);
+    return table_index;
+}
+
 // 在hash table中查找十六進位key對應的 font_table 索引
 static int font_hash_find(const char *hex) {
     unsigned int idx = hash_hex(hex);
@@ -246,101 +262,142 @@ int find_missing_characters(const char *str, char *missing, int missing_buffer_s
     return missing_chars_count;
 }
 
+// 字型下載回應的串流解析狀態
+typedef struct {
+    json_stream_t parser;
+    char hex_key[HEX_KEY_LEN]; // 目前字元的十六進位key
+    uint8_t data[FONT_SIZE];   // 目前字元的點陣
+    int byte_count;            // data 已填入的字節數
+    int saved_count;           // 已儲存的字型數
+    char url[256];             // 請求 URL，需保留到請求結束 (多個請求可能同時進行)
+} FontDownloadSink;
+
 /**
- * @brief Callback function executed after a font download request is complete.
+ * @brief Saves a downloaded glyph to LittleFS and, if space is available, the RAM cache.
  *
- * This function is called by the `net_worker_task`. It processes the JSON response
- * from the font server, which should contain an array of font data. For each font,
- * it saves the bitmap data to a file on LittleFS and, if space is available,
- * loads it into the RAM cache.
- *
- * @param event The network event structure containing the response data.
- * @param result The result of the HTTP request (ESP_OK on success).
+ * @param hex_key The glyph's hex key (e.g. "e4bda0").
+ * @param data    FONT_SIZE bytes of bitmap data.
+ * @return `true` if the glyph was written to LittleFS.
  */
-// 字型下載完成後的回調函數
-static void font_download_callback(net_event_t *event, esp_err_t result) {
-    if (result == ESP_OK && event->json_root) {
-        ESP_LOGI(TAG_FONT, "Response: %s", event->response_buffer);
-        ESP_LOGI(TAG_FONT, "Font download successful, processing JSON response.");
-        cJSON *font_item = NULL;
-        int saved_count = 0;
-        cJSON_ArrayForEach(font_item, event->json_root) {
-            const char *hex_filename = font_item->string; // 這是十六進位key，例如 "e4bda0"
-            cJSON *bitmap_array = font_item;              // 這是字節的 cJSON 陣列
-
-            if (!cJSON_IsArray(bitmap_array)) {
-                ESP_LOGW(TAG_FONT, "Bitmap data for %s is not an array.", hex_filename);
-                continue;
-            }
+static bool font_store_glyph(const char *hex_key, const uint8_t *data) {
+    // 構造字型檔案路徑: FONT_DIR/hex_key
+    char path[FONT_DIR_LEN + HEX_KEY_LEN + 2];
+    snprintf(path, sizeof(path), "%s/%s", FONT_DIR, hex_key);
+    sleep_manager_hold(SLEEP_HOLD_STORAGE);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        sleep_manager_release(SLEEP_HOLD_STORAGE);
+        ESP_LOGE(TAG_FONT, "Failed to open file for writing: %s", path);
+        return false;
+    }
 
-            // 構造字型檔案路徑: FONT_DIR/hex_filename
-            char path[FONT_DIR_LEN + HEX_KEY_LEN + 2];
-            snprintf(path, sizeof(path), "%s/%s", FONT_DIR, hex_filename);
-            FILE *f = fopen(path, "wb");
-            if (!f) {
-                ESP_LOGE(TAG_FONT, "Failed to open file for writing: %s", path);
-                continue;
-            }
+    // 始終寫入 FONT_SIZE 字節
+    size_t written_count = fwrite(data, 1, FONT_SIZE, f);
+    fclose(f);
+    sleep_manager_release(SLEEP_HOLD_STORAGE);
 
-            uint8_t font_pixel_data[FONT_SIZE] = {
-                0}; // Initialize to ensure padding if server sends less
-            int bytes_in_array = cJSON_GetArraySize(bitmap_array);
-            int bytes_to_process = (bytes_in_array < FONT_SIZE) ? bytes_in_array : FONT_SIZE;
+    if (written_count != FONT_SIZE) {
+        ESP_LOGE(TAG_FONT, "Failed to write complete font data for %s to LittleFS (wrote %zu/%d)",
+                 path, written_count, FONT_SIZE);
+        return false;
+    }
+    ESP_LOGI(TAG_FONT, "Saved font %s to LittleFS.", path);
 
-            for (int i = 0; i < bytes_to_process; i++) {
-                cJSON *byte_val_item = cJSON_GetArrayItem(bitmap_array, i);
-                if (cJSON_IsNumber(byte_val_item)) {
-                    font_pixel_data[i] = (uint8_t)byte_val_item->valueint;
-                } else {
-                    ESP_LOGW(TAG_FONT, "Invalid byte data in bitmap array for %s at index %d",
-                             hex_filename, i);
-                }
-            }
+    // Attempt to load into RAM cache if space is available
+    int table_idx = font_cache_insert(hex_key, data);
+    if (table_idx >= 0) {
+        ESP_LOGI(TAG_FONT, "Loaded font %s into RAM. Cache size: %d/%d", hex_key, table_idx + 1,
+                 MAX_FONTS);
+    } else {
+        ESP_LOGW(TAG_FONT, "RAM cache full. Font %s saved to LittleFS but not loaded to RAM.",
+                 hex_key);
+    }
+    return true;
+}
 
-            // 始終寫入 FONT_SIZE 字節
-            size_t written_count = fwrite(font_pixel_data, 1, FONT_SIZE, f);
-            fclose(f);
-
-            if (written_count == FONT_SIZE) {
-                ESP_LOGI(TAG_FONT, "Saved font %s to LittleFS.", path);
-                saved_count++;
-
-                // Attempt to load into RAM cache if space is available
-                if (font_table_count < MAX_FONTS) {
-                    FontEntry *ram_entry = &font_table[font_table_count];
-                    strcpy(ram_entry->hex_key, hex_filename);
-                    memcpy(ram_entry->data, font_pixel_data, FONT_SIZE); // Use the downloaded data
-                    font_hash_insert(hex_filename, font_table_count);    // Add to hash table
-                    font_table_count++; // Increment RAM cache count
-                    ESP_LOGI(TAG_FONT, "Loaded font %s into RAM. Cache size: %d/%d", hex_filename,
-                             font_table_count, MAX_FONTS);
-                } else {
-                    ESP_LOGW(TAG_FONT,
-                             "RAM cache full. Font %s saved to LittleFS but not loaded to RAM.",
-                             hex_filename);
-                }
+/**
+ * @brief Handles one token of a font download response.
+ *
+ * The response maps each hex key to an array of bitmap bytes, e.g. {"e4bda0": [0, 12, ...]}.
+ * Each glyph is stored as soon as its array ends.
+ */
+static bool font_download_token(json_stream_t *js, json_stream_token_t token, const char *value,
+                                size_t len, void *ctx) {
+    FontDownloadSink *sink = ctx;
+    if (js->depth == 1) {
+        if (token == JSON_STREAM_KEY) {
+            // 這是十六進位key，例如 "e4bda0"
+            if (len >= HEX_KEY_LEN) {
+                ESP_LOGW(TAG_FONT, "Invalid font key: %s", value);
+                sink->hex_key[0] = '\0';
             } else {
-                ESP_LOGE(TAG_FONT,
-                         "Failed to write complete font data for %s to LittleFS (wrote %zu/%d)",
-                         path, written_count, FONT_SIZE);
+                strcpy(sink->hex_key, value);
+            }
+        } else if (token == JSON_STREAM_ARRAY_START) {
+            // Initialize to ensure padding if server sends less
+            memset(sink->data, 0, sizeof(sink->data));
+            sink->byte_count = 0;
+        } else if (token == JSON_STREAM_ARRAY_END && sink->hex_key[0]) {
+            if (font_store_glyph(sink->hex_key, sink->data)) {
+                sink->saved_count++;
             }
         }
-        cJSON_Delete(event->json_root);
-        event->json_root = NULL; // 標記為已處理
-
-        if (saved_count > 0) {
-            ESP_LOGI(TAG_FONT, "Finished processing and caching %d downloaded fonts.", saved_count);
+    } else if (js->depth == 2) {
+        if (token != JSON_STREAM_NUMBER) {
+            ESP_LOGW(TAG_FONT, "Invalid byte data in bitmap array for %s at index %d",
+                     sink->hex_key, sink->byte_count);
+        } else if (sink->byte_count < FONT_SIZE) {
+            sink->data[sink->byte_count] = (uint8_t)atoi(value);
         }
+        sink->byte_count++;
+    }
+    return true;
+}
 
-    } else {
-        ESP_LOGE(TAG_FONT, "Font download failed or JSON parse error. HTTP result: %s",
-                 esp_err_to_name(result));
-        // 如果 result != ESP_OK，從 net_worker_task 的角度來看，json_root 應該為 null
-        if (event->json_root) {
-            cJSON_Delete(event->json_root);
-            event->json_root = NULL;
+/**
+ * @brief Streaming sink of a font download, called by `net_worker_task`.
+ *
+ * A NULL `data` marks the start of a (re)tried response and resets the parser.
+ */
+static esp_err_t font_download_on_data(net_event_t *event, const char *data, size_t len) {
+    FontDownloadSink *sink = event->user_data;
+    if (data == NULL) {
+        json_stream_init(&sink->parser, font_download_token, sink);
+        sink->hex_key[0] = '\0';
+        sink->saved_count = 0;
+        return ESP_OK;
+    }
+    if (event->status_code != 200) {
+        return ESP_OK; // Error body, reported by the callback
+    }
+    return json_stream_feed(&sink->parser, data, len);
+}
+
+/**
+ * @brief Callback function executed after a font download request is complete.
+ *
+ * This function is called by the `net_worker_task`. The glyphs have already been saved
+ * to LittleFS (and the RAM cache) by `font_download_on_data` while the response was
+ * received; this reports the result and frees the sink.
+ *
+ * @param event The network event structure.
+ * @param result The result of the HTTP request (ESP_OK on success).
+ */
+// 字型下載完成後的回調函數
+static void font_download_callback(net_event_t *event, esp_err_t result) {
+    FontDownloadSink *sink = event->user_data;
+    if (result == ESP_OK && event->status_code == 200 &&
+        json_stream_finish(&sink->parser) == ESP_OK) {
+        if (sink->saved_count > 0) {
+            ESP_LOGI(TAG_FONT, "Finished processing and caching %d downloaded fonts.",
+                     sink->saved_count);
         }
+    } else {
+        ESP_LOGE(TAG_FONT, "Font download failed or JSON parse error. HTTP result: %s, status %d",
+                 esp_err_to_name(result), event->status_code);
     }
+    free(sink);
+    event->user_data = NULL;
 }
 
 // 通用繪製string函數，支持中英文混合，自動換行
@@ -497,29 +554,19 @@ UWORD Paint_DrawString_Gen(UWORD x_start, UWORD y_start, UWORD area_width, UWORD
                 FILE *fp_lfs = fopen(lfs_font_path, "rb");
 
                 if (fp_lfs) { // Font found on LittleFS
-                    if (font_table_count < MAX_FONTS) {
-                        // Load from LittleFS to RAM
-                        // 注意：此處直接修改 font_table 和 font_table_count，
-                        // 如果多個任務同時操作，可能需要互斥鎖保護。
-                        FontEntry *e = &font_table[font_table_count];
-                        strcpy(e->hex_key, hex_key_output);
-                        size_t bytes_read = fread(e->data, 1, FONT_SIZE, fp_lfs);
-                        if (bytes_read == FONT_SIZE) {
-                            font_hash_insert(hex_key_output, font_table_count);
-                            table_idx =
-                                font_table_count; // Update table_idx to the newly loaded font
-                            font_table_count++;
-                            ESP_LOGI(TAG_FONT,
-                                     "Loaded font %s (hex: %s) from LFS to RAM during drawing. "
-                                     "Cache: %d/%d",
-                                     utf8_char_bytes, hex_key_output, font_table_count, MAX_FONTS);
-                        } else {
-                            ESP_LOGE(TAG_FONT,
-                                     "Failed to read full font %s from LFS (%s). Read %zu bytes. "
-                                     "Drawing placeholder.",
-                                     hex_key_output, lfs_font_path, bytes_read);
-                            // table_idx remains < 0, placeholder will be drawn
-                        }
+                    uint8_t data[FONT_SIZE];
+                    size_t bytes_read = fread(data, 1, FONT_SIZE, fp_lfs);
+                    if (bytes_read != FONT_SIZE) {
+                        ESP_LOGE(TAG_FONT,
+                                 "Failed to read full font %s from LFS (%s). Read %zu bytes. "
+                                 "Drawing placeholder.",
+                                 hex_key_output, lfs_font_path, bytes_read);
+                        // table_idx remains < 0, placeholder will be drawn
+                    } else if ((table_idx = font_cache_insert(hex_key_output, data)) >= 0) {
+                        ESP_LOGI(TAG_FONT,
+                                 "Loaded font %s (hex: %s) from LFS to RAM during drawing. "
+                                 "Cache: %d/%d",
+                                 utf8_char_bytes, hex_key_output, table_idx + 1, MAX_FONTS);
                     } else {
                         ESP_LOGW(
                             TAG_FONT,
@@ -557,32 +604,38 @@ end_of_string_loop_label:; // 標籤用於 goto 跳轉
 }
 
 // 將下載缺失字型字元的請求加入queue。
-esp_err_t download_missing_characters(const char *missing_chars) {
+// priority 為 NET_PRIO_GLYPH (目前顯示的日期) 或 NET_PRIO_BACKGROUND；背景請求在佇列滿時會被丟棄。
+esp_err_t download_missing_characters(const char *missing_chars, net_priority_t priority) {
     if (missing_chars == NULL || strlen(missing_chars) == 0) {
         ESP_LOGI(TAG_FONT, "No missing characters to download.");
         return ESP_OK;
     }
 
-    // 使用靜態 URL 緩衝區
-    // URL 最大長度需要考慮基礎 URL 和 missing_chars 的長度
-    static char url[256];
-    snprintf(url, sizeof(url), "https://peng-pc.tail941dce.ts.net/font?chars=%s", missing_chars);
-    ESP_LOGI(TAG_FONT, "Requesting missing fonts from: %s", url);
+    // 回應以串流方式解析，狀態 (含 URL) 由 callback 釋放
+    FontDownloadSink *sink = calloc(1, sizeof(FontDownloadSink));
+    if (!sink) {
+        ESP_LOGE(TAG_FONT, "Failed to allocate font download state");
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(sink->url, sizeof(sink->url), "https://peng-pc.tail941dce.ts.net/font?chars=%s",
+             missing_chars);
+    ESP_LOGI(TAG_FONT, "Requesting missing fonts from: %s", sink->url);
 
     net_event_t font_event = {
-        .url = url,
+        .url = sink->url,
         .method = HTTP_METHOD_GET,
         .post_data = NULL,
         .use_jwt = false,
-        .response_buffer = font_download_response_buffer,
-        .response_buffer_size = sizeof(font_download_response_buffer),
+        .on_data = font_download_on_data,
         .on_finish = font_download_callback,
-        .user_data = NULL,
+        .user_data = sink,
+        .priority = priority,
     };
 
-    // 使用前確保 font_download_response_buffer 是乾淨的
-    font_download_response_buffer[0] = '\0';
-
-    xQueueSend(net_queue, &font_event, pdMS_TO_TICKS(1000));
-    return ESP_OK;
+    esp_err_t err = net_submit(&font_event, pdMS_TO_TICKS(1000));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG_FONT, "Font request not queued: %s", esp_err_to_name(err));
+        free(sink);
+    }
+    return err;
 }
@@ -0,0 +1,525 @@
+#include "https_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "tls_session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "HTTPS";
+
+// Root CA certificate for the server.
+extern const char isrgrootx1_pem_start[] asm("_binary_isrgrootx1_pem_start");
+extern const char isrgrootx1_pem_end[] asm("_binary_isrgrootx1_pem_end");
+
+/** @brief Longest status, header or chunk-size line that is parsed. */
+#define HTTPS_LINE_MAX 256
+
+#ifdef CONFIG_NET_HTTP_DEFLATE
+
+#include "miniz.h"
+
+#define HTTPS_ACCEPT_ENCODING "deflate"
+
+/**
+ * @brief Streaming decoder of a deflate (zlib, RFC 1950) response body.
+ *
+ * The decoded bytes are written to a circular window that doubles as the LZ77 dictionary,
+ * so memory use does not depend on the size of the response. The zlib header announces
+ * the window the server compressed with; tinfl rejects streams whose window is larger
+ * than HTTPS_INFLATE_WINDOW_SIZE.
+ */
+typedef struct https_inflate_t {
+    tinfl_decompressor decomp;
+    uint8_t window[HTTPS_INFLATE_WINDOW_SIZE];
+    size_t window_pos; /**< Where the decoder writes next. */
+    size_t out_pos;    /**< First decoded byte not yet returned by `https_read`. */
+    size_t out_len;    /**< Decoded bytes not yet returned. */
+    uint8_t in[HTTPS_INFLATE_INPUT_SIZE];
+    size_t in_pos;
+    size_t in_len;
+    bool in_eof; /**< The compressed body has been read completely. */
+    bool done;   /**< The stream ended and its checksum matched. */
+} https_inflate_t;
+
+#else
+
+#define HTTPS_ACCEPT_ENCODING "identity"
+
+#endif // CONFIG_NET_HTTP_DEFLATE
+
+/**
+ * @brief Splits an https:// URL into host, port and path.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for other schemes or an over-long host.
+ */
+esp_err_t https_parse_url(const char *url, char *host, int *port, const char **path) {
+    const char *scheme = "https://";
+    if (strncmp(url, scheme, strlen(scheme)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char *start = url + strlen(scheme);
+    const char *end = start + strcspn(start, ":/?");
+    size_t host_len = end - start;
+    if (host_len == 0 || host_len >= HTTPS_HOST_MAX_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(host, start, host_len);
+    host[host_len] = '\0';
+
+    *port = 443;
+    if (*end == ':') {
+        *port = atoi(end + 1);
+        end += strcspn(end, "/?");
+    }
+    *path = *end ? end : "/";
+    return ESP_OK;
+}
+
+/**
+ * @brief Opens the TLS connection, offering a saved session when one is available.
+ */
+static esp_err_t https_connect(https_conn_t *conn) {
+    esp_tls_cfg_t cfg = {
+        .cacert_buf = (const unsigned char *)isrgrootx1_pem_start,
+        .cacert_bytes = isrgrootx1_pem_end - isrgrootx1_pem_start,
+        .timeout_ms = HTTPS_TIMEOUT_MS,
+    };
+    tls_session_apply(&cfg, conn->host);
+
+    conn->tls = esp_tls_init();
+    if (conn->tls == NULL) {
+        tls_session_discard(&cfg);
+        return ESP_ERR_NO_MEM;
+    }
+    // Resolve first to time DNS on its own; esp-tls then gets the address from the lwIP cache
+    int64_t start = esp_timer_get_time();
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addr = NULL;
+    if (getaddrinfo(conn->host, NULL, &hints, &addr) == 0) {
+        freeaddrinfo(addr);
+    }
+    conn->timing.dns_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    int ret = esp_tls_conn_new_sync(conn->host, strlen(conn->host), conn->port, &cfg, conn->tls);
+    if (ret != 1) {
+        ESP_LOGE(TAG, "TLS connection to %s failed", conn->host);
+        tls_session_discard(&cfg);
+        esp_tls_conn_destroy(conn->tls);
+        conn->tls = NULL;
+        return ESP_FAIL;
+    }
+    conn->timing.connect_us = esp_timer_get_time() - start;
+    tls_session_update(conn->tls, &cfg, conn->host, conn->timing.connect_us);
+
+    // esp-tls only applies timeout_ms to the connect, so bound reads on the socket as well
+    int sockfd = -1;
+    if (esp_tls_get_conn_sockfd(conn->tls, &sockfd) == ESP_OK && sockfd >= 0) {
+        struct timeval tv = {
+            .tv_sec = HTTPS_TIMEOUT_MS / 1000,
+            .tv_usec = (HTTPS_TIMEOUT_MS % 1000) * 1000,
+        };
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    conn->rx_len = 0;
+    conn->rx_pos = 0;
+    return ESP_OK;
+}
+
+/**
+ * @brief Writes the whole buffer to the connection.
+ */
+static esp_err_t https_write_all(https_conn_t *conn, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = esp_tls_conn_write(conn->tls, data, len);
+        if (written == ESP_TLS_ERR_SSL_WANT_READ || written == ESP_TLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (written <= 0) {
+            return ESP_FAIL;
+        }
+        data += written;
+        len -= written;
+        conn->timing.tx_bytes += written;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Refills the receive buffer once it is empty.
+ *
+ * @return Bytes available, 0 if the server closed the connection, negative on error.
+ */
+static int https_fill(https_conn_t *conn) {
+    if (conn->rx_pos < conn->rx_len) {
+        return conn->rx_len - conn->rx_pos;
+    }
+    for (;;) {
+        ssize_t n = esp_tls_conn_read(conn->tls, conn->rx, sizeof(conn->rx));
+        if (n == ESP_TLS_ERR_SSL_WANT_READ || n == ESP_TLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (n < 0) {
+            return n;
+        }
+        conn->rx_len = n;
+        conn->rx_pos = 0;
+        conn->timing.rx_bytes += n;
+        return n;
+    }
+}
+
+/**
+ * @brief Reads one CRLF-terminated line, without the terminator.
+ */
+static esp_err_t https_read_line(https_conn_t *conn, char *line, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        if (https_fill(conn) <= 0) {
+            return ESP_FAIL;
+        }
+        char c = conn->rx[conn->rx_pos++];
+        if (c == '\n') {
+            if (len > 0 && line[len - 1] == '\r') {
+                len--;
+            }
+            line[len] = '\0';
+            return ESP_OK;
+        }
+        if (len + 1 < size) {
+            line[len++] = c;
+        }
+    }
+}
+
+/**
+ * @brief Reads the status line and headers of the response.
+ */
+static esp_err_t https_read_headers(https_conn_t *conn) {
+    char line[HTTPS_LINE_MAX];
+    int minor = 1;
+
+    if (https_read_line(conn, line, sizeof(line)) != ESP_OK ||
+        sscanf(line, "HTTP/1.%d %d", &minor, &conn->status_code) != 2) {
+        return ESP_FAIL;
+    }
+    conn->content_length = -1;
+    conn->chunked = false;
+    conn->deflate = false;
+    conn->close_after = (minor == 0);
+    conn->chunk_started = false;
+
+    for (;;) {
+        if (https_read_line(conn, line, sizeof(line)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        if (line[0] == '\0') {
+            break;
+        }
+        char *value = strchr(line, ':');
+        if (value == NULL) {
+            continue;
+        }
+        *value++ = '\0';
+        value += strspn(value, " \t");
+        if (strcasecmp(line, "Content-Length") == 0) {
+            conn->content_length = atoi(value);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+            conn->chunked = strcasecmp(value, "chunked") == 0;
+        } else if (strcasecmp(line, "Content-Encoding") == 0) {
+            conn->deflate = strcasecmp(value, "deflate") == 0;
+        } else if (strcasecmp(line, "Connection") == 0) {
+            if (strcasecmp(value, "close") == 0) {
+                conn->close_after = true;
+            } else if (strcasecmp(value, "keep-alive") == 0) {
+                conn->close_after = false;
+            }
+        }
+    }
+
+    conn->body_done = false;
+    conn->body_remaining = conn->content_length > 0 ? conn->content_length : 0;
+    if (conn->status_code == 204 || conn->status_code == 304 ||
+        (!conn->chunked && conn->content_length == 0)) {
+        conn->body_done = true;
+    }
+    if (!conn->chunked && conn->content_length < 0) {
+        conn->close_after = true; // body ends when the server closes the connection
+    }
+    if (conn->body_done) {
+        conn->deflate = false;
+    }
+#ifdef CONFIG_NET_HTTP_DEFLATE
+    if (conn->deflate) {
+        if (conn->inflate == NULL) {
+            conn->inflate = malloc(sizeof(https_inflate_t));
+            if (conn->inflate == NULL) {
+                ESP_LOGE(TAG, "No memory to decompress the response");
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        https_inflate_t *inf = conn->inflate;
+        tinfl_init(&inf->decomp);
+        inf->window_pos = 0;
+        inf->out_pos = 0;
+        inf->out_len = 0;
+        inf->in_pos = 0;
+        inf->in_len = 0;
+        inf->in_eof = false;
+        inf->done = false;
+    }
+#else
+    if (conn->deflate) {
+        ESP_LOGE(TAG, "Compressed response without CONFIG_NET_HTTP_DEFLATE");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+#endif
+    return ESP_OK;
+}
+
+/**
+ * @brief Sends a request and reads the response headers.
+ *
+ * Reuses the open connection when it points at the same host and port; otherwise the
+ * connection is (re)established first. The response body is then read with `https_read`.
+ * The time of each phase and the bytes sent and received are recorded in `conn->timing`.
+ *
+ * @param conn Connection state.
+ * @param req  Request to send.
+ * @return ESP_OK once the response headers have been read.
+ */
+esp_err_t https_request(https_conn_t *conn, const https_request_t *req) {
+    char host[HTTPS_HOST_MAX_LEN];
+    int port;
+    const char *path;
+    esp_err_t err = https_parse_url(req->url, host, &port, &path);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unsupported URL: %s", req->url);
+        return err;
+    }
+
+    if (conn->tls && (strcmp(conn->host, host) != 0 || conn->port != port)) {
+        https_close(conn);
+    }
+    memset(&conn->timing, 0, sizeof(conn->timing));
+    conn->timing.reused = conn->tls != NULL;
+    if (conn->tls == NULL) {
+        strlcpy(conn->host, host, sizeof(conn->host));
+        conn->port = port;
+        err = https_connect(conn);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    char header[512];
+    size_t len = snprintf(header, sizeof(header),
+                          "%s %s HTTP/1.1\r\n"
+                          "Host: %s\r\n"
+                          "User-Agent: quantix\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Accept-Encoding: " HTTPS_ACCEPT_ENCODING "\r\n"
+                          "Connection: keep-alive\r\n"
+                          "Content-Length: %u\r\n",
+                          req->method, path, host, (unsigned)req->body_len);
+    if (req->authorization && len < sizeof(header)) {
+        len += snprintf(header + len, sizeof(header) - len, "Authorization: %s\r\n",
+                        req->authorization);
+    }
+    if (len < sizeof(header)) {
+        len += snprintf(header + len, sizeof(header) - len, "\r\n");
+    }
+    if (len >= sizeof(header)) {
+        ESP_LOGE(TAG, "Request header too long");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    conn->mark_us = esp_timer_get_time();
+    err = https_write_all(conn, header, len);
+    if (err == ESP_OK && req->body_len > 0) {
+        err = https_write_all(conn, req->body, req->body_len);
+    }
+    if (err == ESP_OK) {
+        err = https_read_headers(conn);
+    }
+    int64_t now = esp_timer_get_time();
+    conn->timing.ttfb_us = now - conn->mark_us;
+    conn->mark_us = now;
+    if (err != ESP_OK) {
+        https_close(conn);
+    }
+    return err;
+}
+
+/**
+ * @brief Reads up to `len` bytes of the response body as sent, without decoding it.
+ *
+ * Handles both Content-Length and chunked bodies.
+ *
+ * @return Bytes read, 0 at the end of the body, or a negative value on error.
+ */
+static int https_read_body(https_conn_t *conn, char *buf, size_t len) {
+    if (conn->tls == NULL) {
+        return -1;
+    }
+    if (conn->body_done || len == 0) {
+        return 0;
+    }
+
+    if (conn->chunked && conn->body_remaining == 0) {
+        char line[HTTPS_LINE_MAX];
+        if (conn->chunk_started && (https_read_line(conn, line, sizeof(line)) != ESP_OK)) {
+            return -1; // CRLF after the previous chunk
+        }
+        if (https_read_line(conn, line, sizeof(line)) != ESP_OK) {
+            return -1;
+        }
+        conn->chunk_started = true;
+        conn->body_remaining = strtoul(line, NULL, 16);
+        if (conn->body_remaining == 0) {
+            do { // trailers
+                if (https_read_line(conn, line, sizeof(line)) != ESP_OK) {
+                    return -1;
+                }
+            } while (line[0] != '\0');
+            conn->body_done = true;
+            return 0;
+        }
+    }
+
+    int avail = https_fill(conn);
+    if (avail < 0) {
+        return avail;
+    }
+    if (avail == 0) {
+        if (!conn->chunked && conn->content_length < 0) {
+            conn->body_done = true; // connection closed marks the end of the body
+            return 0;
+        }
+        return -1;
+    }
+
+    size_t n = (size_t)avail < len ? (size_t)avail : len;
+    if ((conn->chunked || conn->content_length >= 0) && n > conn->body_remaining) {
+        n = conn->body_remaining;
+    }
+    memcpy(buf, conn->rx + conn->rx_pos, n);
+    conn->rx_pos += n;
+    if (conn->chunked || conn->content_length >= 0) {
+        conn->body_remaining -= n;
+        if (!conn->chunked && conn->body_remaining == 0) {
+            conn->body_done = true;
+        }
+    }
+    return n;
+}
+
+#ifdef CONFIG_NET_HTTP_DEFLATE
+/**
+ * @brief Reads up to `len` decoded bytes of a deflate-encoded body.
+ *
+ * @return Bytes read, 0 at the end of the stream, or a negative value on a read error,
+ *         a corrupt stream or a body that ends before the stream does.
+ */
+static int https_inflate_read(https_conn_t *conn, char *buf, size_t len) {
+    https_inflate_t *inf = conn->inflate;
+    for (;;) {
+        if (inf->out_len > 0) {
+            size_t n = inf->out_len < len ? inf->out_len : len;
+            memcpy(buf, inf->window + inf->out_pos, n);
+            inf->out_pos += n;
+            inf->out_len -= n;
+            return n;
+        }
+        if (inf->done) {
+            return 0;
+        }
+        if (inf->in_pos == inf->in_len && !inf->in_eof) {
+            int n = https_read_body(conn, (char *)inf->in, sizeof(inf->in));
+            if (n < 0) {
+                return n;
+            }
+            inf->in_pos = 0;
+            inf->in_len = n;
+            inf->in_eof = (n == 0);
+        }
+
+        // Decode into the free part of the window up to its end; tinfl wraps around itself
+        // and reads back-references from the whole window.
+        size_t in_size = inf->in_len - inf->in_pos;
+        size_t out_size = sizeof(inf->window) - inf->window_pos;
+        int flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (inf->in_eof ? 0 : TINFL_FLAG_HAS_MORE_INPUT);
+        tinfl_status status =
+            tinfl_decompress(&inf->decomp, inf->in + inf->in_pos, &in_size, inf->window,
+                             inf->window + inf->window_pos, &out_size, flags);
+        inf->in_pos += in_size;
+        inf->out_pos = inf->window_pos;
+        inf->out_len = out_size;
+        inf->window_pos = (inf->window_pos + out_size) & (sizeof(inf->window) - 1);
+
+        if (status == TINFL_STATUS_DONE) {
+            inf->done = true;
+        } else if (status < 0 || (status == TINFL_STATUS_NEEDS_MORE_INPUT && inf->in_eof)) {
+            ESP_LOGE(TAG, "Invalid deflate stream (status %d)", status);
+            return -1;
+        }
+    }
+}
+#endif
+
+/**
+ * @brief Reads up to `len` bytes of the response body.
+ *
+ * Deflate-encoded bodies are decompressed on the fly.
+ *
+ * @return Bytes read, 0 at the end of the body, or a negative value on error.
+ */
+int https_read(https_conn_t *conn, char *buf, size_t len) {
+#ifdef CONFIG_NET_HTTP_DEFLATE
+    if (conn->deflate && conn->tls) {
+        return https_inflate_read(conn, buf, len);
+    }
+#endif
+    return https_read_body(conn, buf, len);
+}
+
+/**
+ * @brief Discards the rest of the response so the connection can carry the next request.
+ *
+ * Closes the connection if the server asked for it, and records the body time.
+ */
+esp_err_t https_finish(https_conn_t *conn) {
+    char discard[64];
+    int n;
+    while ((n = https_read_body(conn, discard, sizeof(discard))) > 0)
+        ;
+    conn->timing.body_us = esp_timer_get_time() - conn->mark_us;
+    if (n < 0 || conn->close_after) {
+        https_close(conn);
+    }
+    return n < 0 ? ESP_FAIL : ESP_OK;
+}
+
+bool https_is_connected(const https_conn_t *conn) { return conn->tls != NULL; }
+
+/**
+ * @brief Closes the connection; the next request opens a new one.
+ */
+void https_close(https_conn_t *conn) {
+    if (conn->tls) {
+        esp_tls_conn_destroy(conn->tls);
+        conn->tls = NULL;
+    }
+    conn->rx_len = 0;
+    conn->rx_pos = 0;
+    free(conn->inflate);
+    conn->inflate = NULL;
+    conn->deflate = false;
+}
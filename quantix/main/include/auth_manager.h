@@ -0,0 +1,35 @@
+#ifndef AUTH_MANAGER_H
+#define AUTH_MANAGER_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// JWT 的最大長度 (含結尾的 '\0')
+#define AUTH_TOKEN_MAX_LEN 384
+// 在到期前多久更新 token
+#define AUTH_REFRESH_MARGIN_S (5 * 60)
+
+// 初始化，需在任何 task 使用 token 之前呼叫
+void auth_init(void);
+
+// 儲存伺服器給的新 token：解出到期時間，存入 RAM/RTC 並寫入 NVS (供斷電後使用)
+esp_err_t auth_set_token(const char *jwt);
+
+// 將目前的 token 複製到 buf，沒有 token 時回傳 false。只在開機後第一次讀取 NVS
+bool auth_get_token(char *buf, size_t size);
+
+// token 被伺服器拒絕時呼叫，下次使用前會重新登入
+void auth_invalidate(void);
+
+// 是否有未過期的 token (到期時間未知時視為有效，由伺服器的 401 判斷)
+bool auth_token_valid(void);
+
+// token 是否快要到期或已到期，應在使用前更新
+bool auth_needs_refresh(void);
+
+// 距離應該更新 token 的秒數 (已到時間時為 0)，沒有 token 或到期時間未知時為 -1
+int64_t auth_refresh_in_seconds(void);
+
+#endif // AUTH_MANAGER_H
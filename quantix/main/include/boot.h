@@ -0,0 +1,18 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+// 開機各項初始化完成的旗標，彼此獨立並行，使用者只等自己需要的
+#define BOOT_NVS_READY_BIT BIT0   // NVS 可用 (Wi-Fi 設定、登入資料)
+#define BOOT_FS_READY_BIT BIT1    // LittleFS 已掛載 (失敗時也會設定，與原本照常開機一致)
+#define BOOT_FONTS_READY_BIT BIT2 // 字型索引已建立
+
+// 在 sleep_manager_init 之後、建立其他任務之前呼叫：啟動 NVS 與 LittleFS 的初始化任務
+void boot_start(void);
+
+// 等待指定的初始化全部完成
+void boot_wait(EventBits_t bits);
+
+#endif // BOOT_H
@@ -1,11 +1,11 @@
 #ifndef CALENDAR_H
 #define CALENDAR_H
+#include "cJSON.h"
 #include "freertos/event_groups.h"
 
 extern TaskHandle_t xCalendarPrefetchHandle;
 extern TaskHandle_t xPrefetchCalendarTaskHandle;
 extern TaskHandle_t xCalendarDisplayHandle; // Handle for CalenderStartupNoWifi task
-extern EventGroupHandle_t sleep_event_group;
 extern RTC_DATA_ATTR bool isr_woken;
 
 // Directory for calendar data in LittleFS
@@ -14,7 +14,24 @@ extern RTC_DATA_ATTR bool isr_woken;
 void calendar_prefetch_task(void *pvParameters);
 void calendar_display(void *pvParameters);// In calendar.h (or extern declarations in calendar.c if no .h)
 
-void deep_sleep_manager_task(void *pvParameters);
+// 目前顯示日期前後 CONFIG_CALENDAR_OFFLINE_RADIUS_DAYS 天是否都在
+// CONFIG_CALENDAR_FRESH_MAX_AGE_MIN 內與伺服器同步過 (同步時間和資料一起存在 LittleFS)
+bool calendar_window_is_fresh(void);
+
+// 啟動網路與預取 task。offline_ok 時若資料夠新就先不開 Wi-Fi，轉到需要同步的日期時才啟動
+void calendar_start_network(bool offline_ok);
+
+// 計時器喚醒的背景同步：啟動網路但不啟動螢幕，逾時 (CONFIG_SYNC_WAKE_TIMEOUT_S) 就回到睡眠
+void calendar_start_sync_wake(void);
+
+// 時鐘的計時器喚醒發現已經跨日：改顯示今天並啟動螢幕，日曆與時鐘一起重畫
+void calendar_start_new_day_wake(void);
+
+// 在 bootstrap 請求中加入今天前後的日期視窗與已存的 ETag (時鐘尚未設定時不加)
+void calendar_add_sync_state(cJSON *body);
+
+// 儲存 bootstrap 回應中的 "calendar" 清單，由預取 task 只抓有變動的日期
+void calendar_apply_bootstrap(const cJSON *calendar);
 
 void calendar_prefetch_task(void *pvParameters);
 
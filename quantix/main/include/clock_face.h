@@ -0,0 +1,31 @@
+#ifndef CLOCK_FACE_H
+#define CLOCK_FACE_H
+
+#include "EPD_config.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// 時鐘在日曆畫面上的位置 (橫向座標，日期框下方的空白區)，以 Font12 顯示 "HH:MM"
+#define CLOCK_FACE_X 13
+#define CLOCK_FACE_Y 106
+
+// 計時器喚醒可能略早於設定的時間，判斷該顯示哪個時間時往後推的秒數
+#define CLOCK_FACE_EARLY_SLACK_S 2
+
+// 將目前時間畫進日曆畫面的影像 (在刷新前呼叫)，之後計時器喚醒會自行更新時鐘
+void clock_face_draw(UBYTE *image);
+
+// 畫面已不是日曆，停止更新時鐘
+void clock_face_hide(void);
+
+// 距離下一次時鐘要變動的時間 (微秒)，在進入深度睡眠前呼叫；0 表示不需要計時器喚醒
+uint64_t clock_face_next_tick_us(void);
+
+// 在 app_main 一開始呼叫：時鐘的計時器喚醒只做局部刷新就回到深度睡眠，不會返回；
+// 其他喚醒或無法局部刷新時直接返回，照常開機
+void clock_face_tick_wake(void);
+
+// clock_face_tick_wake 因為已經跨日而返回：這次開機要重畫今天的日曆
+bool clock_face_new_day(void);
+
+#endif // CLOCK_FACE_H
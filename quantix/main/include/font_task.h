@@ -3,6 +3,7 @@
 
 #include "GUI_Paint.h"
 #include "freertos/semphr.h" // For SemaphoreHandle_t
+#include "net_task.h"        // For net_priority_t
 #include <esp_err.h>
 
 #define FONT_DIR "/littlefs/fonts"
@@ -17,6 +18,6 @@ void font_table_init(void);
 int find_missing_characters(const char *str, char *missing, int max);
 UWORD Paint_DrawString_Gen(UWORD x_start, UWORD y_start, UWORD area_width, UWORD area_height,
                            const char *text, sFONT *font, UWORD fg, UWORD bg);
-esp_err_t download_missing_characters(const char *missing_chars);
+esp_err_t download_missing_characters(const char *missing_chars, net_priority_t priority);
 
 #endif // FS_TASK_H
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef HTTPS_CLIENT_H
+#define HTTPS_CLIENT_H
+
+#include "esp_err.h"
+#include "esp_tls.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HTTPS_HOST_MAX_LEN 64
+#define HTTPS_RX_BUFFER_SIZE 512
+// 連線與讀取逾時
+#define HTTPS_TIMEOUT_MS 5000
+// deflate 解壓縮的環狀視窗大小，需大於等於伺服器的視窗 (DEFLATE_WINDOW_BITS = 11)
+#define HTTPS_INFLATE_WINDOW_SIZE 2048
+#define HTTPS_INFLATE_INPUT_SIZE 256
+
+// 解壓縮狀態 (https_client.c)
+struct https_inflate_t;
+
+// 目前 (或最近一次) 請求各階段的耗時 (微秒) 與傳輸量
+typedef struct {
+    int64_t dns_us;     // DNS 查詢，沿用連線時為 0
+    int64_t connect_us; // TCP 連線與 TLS 交握，沿用連線時為 0
+    int64_t ttfb_us;    // 送出請求到讀完回應標頭
+    int64_t body_us;    // 讀完回應標頭到 https_finish (含接收端處理的時間)
+    uint32_t tx_bytes;  // 送出的 bytes (請求標頭與內容)
+    uint32_t rx_bytes;  // 收到的 bytes (回應標頭與壓縮前的內容)
+    bool reused;        // 沿用了保持中的連線
+} https_timing_t;
+
+// 一條保持連線 (keep-alive) 的 HTTPS 連線與目前回應的解析狀態
+typedef struct {
+    esp_tls_t *tls;
+    char host[HTTPS_HOST_MAX_LEN];
+    int port;
+
+    int status_code;       // 回應狀態碼
+    int content_length;    // Content-Length，未知時為 -1
+    bool chunked;          // Transfer-Encoding: chunked
+    bool close_after;      // 伺服器要求關閉連線 (Connection: close 或 HTTP/1.0)
+    bool body_done;        // 回應內容已讀完
+    bool chunk_started;    // 已讀過第一個 chunk 標頭
+    size_t body_remaining; // 目前 chunk (或 Content-Length) 剩下的 bytes
+    bool deflate;          // Content-Encoding: deflate，https_read 會解壓縮
+
+    struct https_inflate_t *inflate; // 第一次收到壓縮回應時配置，關閉連線時釋放
+
+    https_timing_t timing; // 每個請求開始時重設
+    int64_t mark_us;       // 目前階段開始的時間
+
+    char rx[HTTPS_RX_BUFFER_SIZE];
+    size_t rx_len;
+    size_t rx_pos;
+} https_conn_t;
+
+// 一個請求
+typedef struct {
+    const char *method;        // "GET"、"POST"...
+    const char *url;           // https://host[:port]/path
+    const char *authorization; // Authorization 標頭值，可為 NULL
+    const char *body;          // 請求內容，可為 NULL
+    size_t body_len;
+} https_request_t;
+
+// 將 https:// URL 拆成主機 (長度 HTTPS_HOST_MAX_LEN)、埠號與路徑
+esp_err_t https_parse_url(const char *url, char *host, int *port, const char **path);
+
+// 送出請求並讀取回應標頭；必要時建立 (或重建) 連線
+esp_err_t https_request(https_conn_t *conn, const https_request_t *req);
+
+// 讀取 (解壓縮後的) 回應內容，回傳讀到的 bytes，0 表示結束，負值表示錯誤
+int https_read(https_conn_t *conn, char *buf, size_t len);
+
+// 丟棄剩下的回應內容，讓連線可以送下一個請求
+esp_err_t https_finish(https_conn_t *conn);
+
+// 是否有可重複使用的連線
+bool https_is_connected(const https_conn_t *conn);
+
+// 關閉連線
+void https_close(https_conn_t *conn);
+
+#endif // HTTPS_CLIENT_H
@@ -0,0 +1,63 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 最大巢狀深度
+#define JSON_STREAM_MAX_DEPTH 8
+// 單一字串 / 數字 token 的最大長度，超過的部分會被截斷
+#define JSON_STREAM_MAX_TOKEN 256
+
+// 解析出的 token 種類
+typedef enum {
+    JSON_STREAM_OBJECT_START,
+    JSON_STREAM_OBJECT_END,
+    JSON_STREAM_ARRAY_START,
+    JSON_STREAM_ARRAY_END,
+    JSON_STREAM_KEY,    // 物件的 key，value 為解碼後的字串
+    JSON_STREAM_STRING, // 字串值，value 為解碼後的 UTF-8 字串
+    JSON_STREAM_NUMBER, // 數字，value 為原始文字
+    JSON_STREAM_TRUE,
+    JSON_STREAM_FALSE,
+    JSON_STREAM_NULL,
+} json_stream_token_t;
+
+struct json_stream_t;
+
+// token callback，回傳 false 會中止解析。
+// 呼叫時 js->depth 為 token 所在的深度：最外層的 { } 或 [ ] 為 0，其中的 key 與值為 1，依此類推
+typedef bool (*json_stream_cb_t)(struct json_stream_t *js, json_stream_token_t token,
+                                 const char *value, size_t len, void *ctx);
+
+// 增量 JSON 解析器，資料可以任意切段餵入，使用固定大小的記憶體
+typedef struct json_stream_t {
+    json_stream_cb_t cb;
+    void *ctx;
+
+    uint8_t state;     // 詞法狀態
+    uint8_t depth;     // 目前開啟的容器數
+    bool expect_key;   // 下一個字串是物件的 key
+    bool failed;       // 語法錯誤或被 callback 中止
+    bool truncated;    // 目前 token 超過 JSON_STREAM_MAX_TOKEN
+    uint8_t hex_count; // \uXXXX 已讀的十六進位數
+    uint16_t hex_value;
+    uint16_t high_surrogate;
+    uint8_t stack[JSON_STREAM_MAX_DEPTH]; // 每層是物件 ('{') 還是陣列 ('[')
+
+    char token[JSON_STREAM_MAX_TOKEN + 1];
+    size_t token_len;
+} json_stream_t;
+
+// 初始化 (或重設) 解析器
+void json_stream_init(json_stream_t *js, json_stream_cb_t cb, void *ctx);
+
+// 餵入一段資料
+esp_err_t json_stream_feed(json_stream_t *js, const char *data, size_t len);
+
+// 資料結束，確認文件完整
+esp_err_t json_stream_finish(json_stream_t *js);
+
+#endif // JSON_STREAM_H
@@ -0,0 +1,38 @@
+#ifndef NET_HEALTH_H
+#define NET_HEALTH_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// 連續失敗幾次後斷路 (停止送出請求)
+#define NET_HEALTH_FAILURE_THRESHOLD 3
+// 斷路後第一次試探前的等待時間，之後每次試探失敗加倍
+#define NET_HEALTH_BASE_BACKOFF_MS 2000
+#define NET_HEALTH_MAX_BACKOFF_MS (15 * 60 * 1000)
+// 試探請求進行中時，其他請求再次檢查前的等待時間
+#define NET_HEALTH_PROBE_WAIT_MS 2000
+
+// 斷路器狀態，保存在 RTC 記憶體中，深度睡眠醒來後沿用
+typedef enum {
+    NET_HEALTH_CLOSED,    // 正常
+    NET_HEALTH_OPEN,      // 伺服器無法使用，請求直接失敗
+    NET_HEALTH_HALF_OPEN, // 等待時間已過，只放行一個試探請求，其他請求等它的結果
+} net_health_state_t;
+
+// 初始化，需在 net worker 啟動前呼叫
+void net_health_init(void);
+
+// 是否可以送出請求；不行時 wait_ms 為還要等待的時間
+bool net_health_allow(uint32_t *wait_ms);
+
+// 回報請求結果 (連線錯誤與 5xx 視為失敗)，回傳 true 表示這次失敗使斷路器打開
+bool net_health_report(bool success);
+
+// 同一個請求重試前的等待時間 (依共用的連續失敗次數做指數退避並加上隨機抖動)
+uint32_t net_health_retry_delay_ms(void);
+
+// 目前狀態
+net_health_state_t net_health_state(void);
+
+#endif // NET_HEALTH_H
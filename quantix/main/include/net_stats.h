@@ -0,0 +1,48 @@
+#ifndef NET_STATS_H
+#define NET_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 最多統計幾個 endpoint (路徑)，超過時併入最後一格 "*"。每格約 180 bytes RTC 記憶體；
+// 上傳後格子會釋放，兩次上傳之間通常只用到 bootstrap、日曆、字型與上傳本身
+#define NET_STATS_MAX_ENDPOINTS 6
+#define NET_STATS_PATH_LEN 24
+// 每個階段的耗時分布 (histogram) 格數
+#define NET_STATS_BUCKETS 8
+
+// 請求的各個階段
+typedef enum {
+    NET_PHASE_DNS,      // DNS 查詢 (只在建立新連線時)
+    NET_PHASE_CONNECT,  // TCP 連線與 TLS 交握 (只在建立新連線時)
+    NET_PHASE_TTFB,     // 送出請求到讀完回應標頭
+    NET_PHASE_BODY,     // 接收回應內容 (含串流接收端的處理)
+    NET_PHASE_PARSE,    // cJSON 解析回應
+    NET_PHASE_CALLBACK, // on_finish
+    NET_PHASE_TOTAL,    // 從 worker 取出請求到 on_finish 返回 (含重試)
+    NET_PHASE_COUNT,
+} net_phase_t;
+
+// 一個請求的量測結果
+typedef struct {
+    int64_t us[NET_PHASE_COUNT]; // 每個階段的耗時 (微秒)
+    uint32_t tx_bytes;           // 最後一次嘗試送出的 bytes
+    uint32_t rx_bytes;           // 最後一次嘗試收到的 bytes (壓縮前)
+    uint8_t attempts;            // 實際送出的次數，0 表示沒有送出 (不統計)
+    bool reused;                 // 最後一次嘗試沿用了保持中的連線
+} net_stats_sample_t;
+
+// 初始化，需在 net worker 啟動前呼叫。統計保存在 RTC 記憶體中，深度睡眠後繼續累積
+void net_stats_init(void);
+
+// 取出 URL 的路徑 (不含主機與查詢字串)，作為統計的分類
+void net_stats_url_path(const char *url, char *path, size_t size);
+
+// 記錄一個請求；failed 為連線錯誤或 5xx
+void net_stats_record(const char *path, bool failed, const net_stats_sample_t *sample);
+
+// 上傳目前的統計 (背景請求)，伺服器收下後才從統計中扣除
+void net_stats_upload(void);
+
+#endif // NET_STATS_H
@@ -12,7 +12,6 @@
 extern SemaphoreHandle_t xWifi;
 extern TaskHandle_t xServerCheckHandle;
 extern TaskHandle_t xServerLoginHandle;
-extern QueueHandle_t net_queue;
 extern EventGroupHandle_t net_event_group;
 extern RTC_DATA_ATTR bool isr_woken;
 
@@ -21,6 +20,35 @@ extern RTC_DATA_ATTR bool isr_woken;
 #define NET_TOKEN_AVAILABLE_BIT BIT2
 #define NET_GOOGLE_TOKEN_AVAILABLE_BIT BIT3
 #define NET_CALENDAR_AVAILABLE_BIT BIT4
+#define NET_TIME_SYNCED_BIT BIT5 // 時鐘已由 SNTP 或 bootstrap 的伺服器時間設定
+#define NET_BOOTSTRAP_BIT BIT6   // bootstrap 已確認 Google 授權狀態
+
+// 請求的優先順序，數字越小越先處理
+typedef enum {
+    NET_PRIO_INTERACTIVE = 0, // 目前顯示日期的資料
+    NET_PRIO_AUTH,            // 登入與授權
+    NET_PRIO_GLYPH,           // 目前顯示日期需要的字型
+    NET_PRIO_BACKGROUND,      // 預取等背景工作，佇列滿時會被丟棄或擠掉
+} net_priority_t;
+
+// 請求 key：佇列中 key 相同的請求會被新的請求取代，也可用 net_cancel 取消
+#define NET_KEY_NONE 0
+#define NET_KEY_LOGIN 1
+#define NET_KEY_SETTINGS 2
+#define NET_KEY_AUTH_RESULT 3
+#define NET_KEY_GOOGLE_TOKEN_CHECK 4
+#define NET_KEY_CALENDAR_RANGE 5
+#define NET_KEY_AUTH_REFRESH 6
+#define NET_KEY_TELEMETRY 7
+#define NET_KEY_WAKE_PROFILE 8
+
+// 一般 JSON 回應的 buffer 大小
+#define NET_RESPONSE_BUFFER_SIZE 512
+
+// 已排入佇列但被取消、取代或擠掉的請求，on_finish 會收到這個結果
+#define NET_ERR_CANCELLED ESP_ERR_NOT_FINISHED
+// 伺服器目前被斷路器判定為無法使用，請求沒有送出
+#define NET_ERR_SERVER_UNAVAILABLE ESP_ERR_INVALID_STATE
 
 // 網路事件結構
 typedef struct net_event_t {
@@ -28,13 +56,46 @@ typedef struct net_event_t {
     esp_http_client_method_t method; // HTTP 方法
     const char *post_data;           // POST 資料（可為 NULL）
     bool use_jwt;                    // 是否帶 JWT token
-    char *response_buffer;           // 回應 buffer（由呼叫者分配）
-    size_t response_buffer_size;     // buffer 大小
+    // 回應 buffer：為 NULL 時由 worker 依 response_buffer_size 配置，on_finish 返回後釋放。
+    // 由呼叫者提供時，需保留到 on_finish 被呼叫 (多個 worker 會同時處理請求)
+    char *response_buffer;
+    size_t response_buffer_size; // buffer 大小
     void (*on_finish)(struct net_event_t *event, esp_err_t result); // 完成 callback
     void *user_data;
     cJSON *json_root; // 若不為 NULL，則自動 parse JSON 並存於此
+    // 串流接收回應：設定後回應內容會分段交給 on_data，不使用 response_buffer。
+    // 每次 (重新) 嘗試開始時會先以 data = NULL 呼叫一次，讓接收端重設狀態；回傳錯誤會中止請求
+    esp_err_t (*on_data)(struct net_event_t *event, const char *data, size_t len);
+    int status_code; // 回應狀態碼 (由 net_worker_task 填入)
+    net_priority_t priority; // 優先順序
+    uint32_t key;            // 請求 key，NET_KEY_NONE 表示不取代其他請求
 } net_event_t;
 
+// 排入請求；佇列滿時背景請求直接被拒絕，其他請求會擠掉背景請求或最多等待 wait。
+// 回傳 ESP_OK 表示已排入，之後 on_finish 一定會被呼叫一次；失敗時不會呼叫 on_finish
+esp_err_t net_submit(const net_event_t *event, TickType_t wait);
+
+// 取消佇列中 key 相同的請求 (不影響正在處理的請求)，回傳取消的數量
+int net_cancel(uint32_t key);
+
+// 網路啟動後等待 Wi-Fi 連線，期間裝置保持清醒；連線成功或放棄等待時呼叫 end
+void net_wifi_wait_begin(void);
+void net_wifi_wait_end(void);
+
+// 射頻工作階段：醒來後的網路工作 (bootstrap、變動的日期、缺字、遙測上傳) 集中一次做完。
+// 沒有持有者且佇列清空後立即關閉 Wi-Fi，不等畫面刷新或深度睡眠；之後有新請求時自動重新連線
+typedef enum {
+    NET_RADIO_HOLD_CONNECT,  // 連線並完成 bootstrap，醒來要做的工作在這之後才排入
+    NET_RADIO_HOLD_PREFETCH, // 預取週期正在排入請求
+    NET_RADIO_HOLD_SNTP,     // SNTP 校時中
+    NET_RADIO_HOLD_COUNT,
+} net_radio_hold_t;
+
+// 持有者還會排入網路工作時保持射頻開啟 (不會開啟已關閉的射頻，由之後排入的請求開啟)；
+// 同一持有者重複 hold 沒有效果，一次 release 就放開
+void net_radio_hold(net_radio_hold_t holder);
+void net_radio_release(net_radio_hold_t holder);
+
 // 公用網路 worker task
 void net_worker_task(void *pvParameters);
 
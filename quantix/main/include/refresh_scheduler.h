@@ -0,0 +1,35 @@
+#ifndef REFRESH_SCHEDULER_H
+#define REFRESH_SCHEDULER_H
+
+#include "EPD_config.h"
+#include <stdbool.h>
+
+// 面板刷新波形，依成本由低到高排列
+typedef enum {
+    EPD_REFRESH_PARTIAL = 0, // 局部刷新 (_WF_PARTIAL_2IN9)，需要控制器舊 RAM 與面板一致
+    EPD_REFRESH_FAST,        // 快速全刷 (WF_FULL)
+    EPD_REFRESH_FULL,        // 完整全刷 (WS_20_30)，清除殘影
+} epd_refresh_mode_t;
+
+// 選擇下一次刷新使用的波形 (不會驅動面板)
+epd_refresh_mode_t refresh_scheduler_select(void);
+
+// 記錄一次已完成的刷新，更新殘影計數
+void refresh_scheduler_commit(epd_refresh_mode_t mode);
+
+// 將最後顯示的影像載回控制器 RAM (scratch 會被覆寫)，成功時下一次可用局部刷新
+bool refresh_scheduler_restore_base(UBYTE *scratch);
+
+// 面板 RAM 已不可信 (例如斷電)，下一次刷新不可使用局部刷新
+void refresh_scheduler_invalidate_base(void);
+
+// 空閒時是否值得做一次維護用的全刷
+bool refresh_scheduler_wants_maintenance(void);
+
+// 選擇波形、刷新面板並記錄，回傳實際使用的波形
+epd_refresh_mode_t screen_refresh(UBYTE *image);
+
+// 以指定波形刷新面板並記錄
+void screen_refresh_with(UBYTE *image, epd_refresh_mode_t mode);
+
+#endif // REFRESH_SCHEDULER_H
@@ -6,7 +6,42 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
+#include <stdbool.h>
+
+// 已請求睡眠卻仍有活動時，每隔多久列出讓裝置保持清醒的活動 (毫秒)
+#define SLEEP_HOLD_REPORT_MS 5000
+
+// 讓裝置保持清醒的活動，各自以參考計數追蹤。已請求睡眠且全部歸零時立即進入深度睡眠
+typedef enum {
+    SLEEP_HOLD_WIFI,     // 網路已啟動，等待 Wi-Fi 連線
+    SLEEP_HOLD_NET,      // 網路請求排隊或處理中
+    SLEEP_HOLD_SCREEN,   // 螢幕初始化、刷新中，或佇列中還有待畫的事件
+    SLEEP_HOLD_STORAGE,  // LittleFS 寫入中
+    SLEEP_HOLD_PREFETCH, // 預取週期進行中
+    SLEEP_HOLD_COUNT,
+} sleep_hold_t;
+
+// 初始化，需在建立任何任務前呼叫
+void sleep_manager_init(void);
+
+// 活動開始 / 結束，可從任何 task 呼叫 (不可在 ISR 中)
+void sleep_manager_hold(sleep_hold_t holder);
+void sleep_manager_release(sleep_hold_t holder);
+
+// 可省略的活動 (例如閒置時的維護刷新)：裝置已開始進入睡眠時不啟動並回傳 false
+bool sleep_manager_try_hold(sleep_hold_t holder);
+
+// 使用者操作結束，活動都結束後就可以睡眠；有新的操作時取消
+void sleep_manager_request(void);
+void sleep_manager_cancel_request(void);
+
+// 列出目前讓裝置保持清醒的活動
+void sleep_manager_log_holders(void);
+
+// 不經過睡眠管理任務直接進入深度睡眠，給尚未建立任務的早期開機流程使用
+void sleep_manager_sleep_now(void);
 
 void wakeup_handler(void);
+void deep_sleep_manager_task(void *pvParameters);
 
-#endif // WAKEUP_MANAGER_H
\ No newline at end of file
+#endif // WAKEUP_MANAGER_H
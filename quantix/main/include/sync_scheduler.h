@@ -0,0 +1,22 @@
+#ifndef SYNC_SCHEDULER_H
+#define SYNC_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 進入睡眠到下一次背景同步之間至少間隔的時間 (秒)
+#define SYNC_MIN_SLEEP_S 60
+
+// 計時器喚醒可能略早於排定的時間，差距在這個秒數內仍視為背景同步到期
+#define SYNC_DUE_SLACK_S 5
+
+// 記錄一次同步結果 (changed 表示有日期的事件變動)，睡眠前依本次醒來的結果調整間隔
+void sync_scheduler_report(bool changed);
+
+// 距離下一次背景同步的時間 (微秒)，在進入深度睡眠前呼叫；0 表示不用計時器喚醒
+uint64_t sync_scheduler_next_wake_us(void);
+
+// 這次計時器喚醒是否該做背景同步 (否則是其他原因的計時器喚醒，例如更新時鐘)
+bool sync_scheduler_due(void);
+
+#endif // SYNC_SCHEDULER_H
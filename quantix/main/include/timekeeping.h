@@ -0,0 +1,25 @@
+#ifndef TIMEKEEPING_H
+#define TIMEKEEPING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// 兩次 SNTP 同步至少間隔多久 (秒) 才用來估計 RTC 的漂移
+#define TIMEKEEPING_MIN_CALIBRATION_S 3600
+// 估計過漂移後，剩餘誤差的假設值 (ppm)
+#define TIMEKEEPING_RESIDUAL_PPM 50
+
+// 開機時呼叫：依估計的漂移修正深度睡眠期間 RTC 累積的誤差
+void timekeeping_init(void);
+
+// 時鐘的誤差是否仍在 CONFIG_TIMEKEEPING_MAX_ERROR_MS 之內，不需要等待 SNTP
+bool timekeeping_is_trusted(void);
+
+// 以秒為單位的時間 (例如伺服器時間) 設定時鐘，不影響漂移的估計
+void timekeeping_set_coarse(time_t now);
+
+// Wi-Fi 連線後呼叫：時鐘可信時立即設定 NET_TIME_SYNCED_BIT，需要時在背景啟動 SNTP
+void timekeeping_start_sync(void);
+
+#endif // TIMEKEEPING_H
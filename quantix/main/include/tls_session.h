@@ -0,0 +1,20 @@
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+#include "esp_tls.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// 初始化，需在建立任何連線之前呼叫 (多個連線可能同時交握)
+void tls_session_init(void);
+
+// 若 RTC 中有此主機且未過期的 session，放入 cfg->client_session，回傳是否有提供
+bool tls_session_apply(esp_tls_cfg_t *cfg, const char *host);
+
+// 交握成功後呼叫：記錄交握類型與時間，並將新的 session 存入 RTC
+void tls_session_update(esp_tls_t *tls, esp_tls_cfg_t *cfg, const char *host, int64_t handshake_us);
+
+// 交握失敗時呼叫：釋放提供的 session 並清除 RTC 中的 session
+void tls_session_discard(esp_tls_cfg_t *cfg);
+
+#endif // TLS_SESSION_H
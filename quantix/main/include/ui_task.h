@@ -29,6 +29,11 @@ typedef struct {
     char msg[MAX_MSG_LEN];
 } event_t;
 
+// 送出螢幕事件 (代替直接寫入 gui_queue)，畫完前裝置不會進入睡眠
+void ui_send_event(const event_t *ev);
+// 螢幕關閉時 (例如背景同步) 丟棄佇列中與之後送出的事件
+void ui_set_discard(bool discard);
+
 void setting_qrcode_setting(char *qrcode);
 void screenStartup(void *pvParameters);
 void viewDisplay(void *PvParameters);
@@ -0,0 +1,44 @@
+#ifndef WAKE_PROFILE_H
+#define WAKE_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// RTC 記憶體中保留最近幾次醒來的紀錄，上傳前滿了會覆蓋最舊的 (時鐘喚醒只計數，不佔紀錄)
+#define WAKE_PROFILE_RECORDS 8
+
+// 每次醒來依序經過的階段，記錄第一次到達的時間 (從開機起算)
+typedef enum {
+    WAKE_PHASE_BOOT,          // ROM 與 bootloader 結束，應用程式開始初始化
+    WAKE_PHASE_APP_MAIN,      // 進入 app_main
+    WAKE_PHASE_NVS_READY,     // NVS 初始化完成
+    WAKE_PHASE_FS_MOUNTED,    // LittleFS 掛載完成
+    WAKE_PHASE_FONTS_READY,   // 字型索引建立完成
+    WAKE_PHASE_EPD_INIT,      // 電子紙初始化完成
+    WAKE_PHASE_WIFI_UP,       // Wi-Fi 取得 IP
+    WAKE_PHASE_FIRST_REQUEST, // net worker 開始處理第一個請求
+    WAKE_PHASE_RENDER_DONE,   // 第一個畫面畫進 frame buffer，開始刷新
+    WAKE_PHASE_REFRESH_DONE,  // 第一次面板刷新完成
+    WAKE_PHASE_SLEEP,         // 進入深度睡眠
+    WAKE_PHASE_COUNT,
+} wake_phase_t;
+
+// 初始化，在 app_main 一開始呼叫
+void wake_profile_init(void);
+
+// 記錄到達某個階段，只保留每次醒來的第一次
+void wake_profile_mark(wake_phase_t phase);
+
+// 這次醒來只更新時鐘 (clock_face)：不存成一筆紀錄，只累計次數與醒著的時間
+void wake_profile_clock_tick(void);
+
+// 射頻開啟 / 關閉，用來累計這次醒來的射頻時間
+void wake_profile_radio(bool on);
+
+// 進入深度睡眠前呼叫：結束這次醒來的紀錄並存入 RTC 記憶體
+void wake_profile_finish(void);
+
+// 累積到 CONFIG_WAKE_PROFILE_UPLOAD_BATCH 筆後上傳 (背景請求)，伺服器收下後才從紀錄中移除
+void wake_profile_upload(void);
+
+#endif // WAKE_PROFILE_H
@@ -0,0 +1,273 @@
+#include "json_stream.h"
+#include <string.h>
+
+/** @brief Lexer states of `json_stream_t`. */
+enum {
+    JSON_ST_VALUE,   /**< Between tokens. */
+    JSON_ST_STRING,  /**< Inside a string. */
+    JSON_ST_ESCAPE,  /**< After a backslash in a string. */
+    JSON_ST_UNICODE, /**< Reading the four hex digits of a \uXXXX escape. */
+    JSON_ST_NUMBER,  /**< Inside a number. */
+    JSON_ST_LITERAL, /**< Inside true, false or null. */
+    JSON_ST_DONE,    /**< The top-level value is complete. */
+};
+
+/**
+ * @brief Initialises (or resets) a streaming JSON parser.
+ *
+ * @param js  Parser state.
+ * @param cb  Called for every token.
+ * @param ctx Passed to `cb`.
+ */
+void json_stream_init(json_stream_t *js, json_stream_cb_t cb, void *ctx) {
+    memset(js, 0, sizeof(*js));
+    js->cb = cb;
+    js->ctx = ctx;
+    js->state = JSON_ST_VALUE;
+}
+
+/** @brief Appends a byte to the current token, truncating over-long tokens. */
+static void json_stream_append(json_stream_t *js, char c) {
+    if (js->token_len < JSON_STREAM_MAX_TOKEN) {
+        js->token[js->token_len++] = c;
+    } else {
+        js->truncated = true;
+    }
+}
+
+/** @brief Appends a Unicode code point to the current token as UTF-8. */
+static void json_stream_append_utf8(json_stream_t *js, uint32_t cp) {
+    if (cp < 0x80) {
+        json_stream_append(js, cp);
+    } else if (cp < 0x800) {
+        json_stream_append(js, 0xC0 | (cp >> 6));
+        json_stream_append(js, 0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        json_stream_append(js, 0xE0 | (cp >> 12));
+        json_stream_append(js, 0x80 | ((cp >> 6) & 0x3F));
+        json_stream_append(js, 0x80 | (cp & 0x3F));
+    } else {
+        json_stream_append(js, 0xF0 | (cp >> 18));
+        json_stream_append(js, 0x80 | ((cp >> 12) & 0x3F));
+        json_stream_append(js, 0x80 | ((cp >> 6) & 0x3F));
+        json_stream_append(js, 0x80 | (cp & 0x3F));
+    }
+}
+
+/** @brief Passes a token to the callback; a false return aborts parsing. */
+static void json_stream_emit(json_stream_t *js, json_stream_token_t token) {
+    js->token[js->token_len] = '\0';
+    if (!js->cb(js, token, js->token, js->token_len, js->ctx)) {
+        js->failed = true;
+    }
+    js->token_len = 0;
+    js->truncated = false;
+}
+
+/** @brief Marks the end of a scalar value. */
+static void json_stream_value_done(json_stream_t *js) {
+    js->state = js->depth == 0 ? JSON_ST_DONE : JSON_ST_VALUE;
+}
+
+/** @brief Emits the number or literal that has just ended. */
+static void json_stream_end_scalar(json_stream_t *js) {
+    if (js->state == JSON_ST_NUMBER) {
+        json_stream_emit(js, JSON_STREAM_NUMBER);
+    } else {
+        js->token[js->token_len] = '\0';
+        if (strcmp(js->token, "true") == 0) {
+            json_stream_emit(js, JSON_STREAM_TRUE);
+        } else if (strcmp(js->token, "false") == 0) {
+            json_stream_emit(js, JSON_STREAM_FALSE);
+        } else if (strcmp(js->token, "null") == 0) {
+            json_stream_emit(js, JSON_STREAM_NULL);
+        } else {
+            js->failed = true;
+        }
+    }
+    json_stream_value_done(js);
+}
+
+/** @brief Handles a byte between tokens. */
+static void json_stream_structural(json_stream_t *js, char c) {
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        return;
+    }
+    if (js->state == JSON_ST_DONE) {
+        js->failed = true; // Data after the top-level value
+        return;
+    }
+
+    switch (c) {
+    case '{':
+    case '[':
+        if (js->depth >= JSON_STREAM_MAX_DEPTH) {
+            js->failed = true;
+            return;
+        }
+        json_stream_emit(js, c == '{' ? JSON_STREAM_OBJECT_START : JSON_STREAM_ARRAY_START);
+        js->stack[js->depth++] = c;
+        js->expect_key = (c == '{');
+        break;
+    case '}':
+    case ']':
+        if (js->depth == 0 || js->stack[js->depth - 1] != (c == '}' ? '{' : '[')) {
+            js->failed = true;
+            return;
+        }
+        js->depth--;
+        json_stream_emit(js, c == '}' ? JSON_STREAM_OBJECT_END : JSON_STREAM_ARRAY_END);
+        js->expect_key = false;
+        json_stream_value_done(js);
+        break;
+    case ',':
+        js->expect_key = js->depth > 0 && js->stack[js->depth - 1] == '{';
+        break;
+    case ':':
+        js->expect_key = false;
+        break;
+    case '"':
+        js->state = JSON_ST_STRING;
+        js->high_surrogate = 0;
+        break;
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            js->state = JSON_ST_NUMBER;
+            json_stream_append(js, c);
+        } else if (c >= 'a' && c <= 'z') {
+            js->state = JSON_ST_LITERAL;
+            json_stream_append(js, c);
+        } else {
+            js->failed = true;
+        }
+        break;
+    }
+}
+
+/** @brief Decodes the code point of a completed \uXXXX escape, joining surrogate pairs. */
+static void json_stream_unicode(json_stream_t *js) {
+    uint16_t v = js->hex_value;
+    if (v >= 0xD800 && v <= 0xDBFF) {
+        js->high_surrogate = v; // Expect the low surrogate next
+    } else if (v >= 0xDC00 && v <= 0xDFFF) {
+        if (js->high_surrogate) {
+            json_stream_append_utf8(js, 0x10000 + ((uint32_t)(js->high_surrogate - 0xD800) << 10) +
+                                            (v - 0xDC00));
+        }
+        js->high_surrogate = 0;
+    } else {
+        json_stream_append_utf8(js, v);
+        js->high_surrogate = 0;
+    }
+    js->state = JSON_ST_STRING;
+}
+
+/**
+ * @brief Processes one byte.
+ *
+ * @return `false` if the byte ended a number or literal and must be processed again.
+ */
+static bool json_stream_char(json_stream_t *js, char c) {
+    switch (js->state) {
+    case JSON_ST_STRING:
+        if (c == '"') {
+            json_stream_emit(js, js->expect_key ? JSON_STREAM_KEY : JSON_STREAM_STRING);
+            json_stream_value_done(js);
+        } else if (c == '\\') {
+            js->state = JSON_ST_ESCAPE;
+        } else {
+            json_stream_append(js, c);
+        }
+        return true;
+
+    case JSON_ST_ESCAPE: {
+        const char *from = "\"\\/bfnrt";
+        const char *to = "\"\\/\b\f\n\r\t";
+        const char *pos = strchr(from, c);
+        if (c == 'u') {
+            js->state = JSON_ST_UNICODE;
+            js->hex_count = 0;
+            js->hex_value = 0;
+        } else if (c != '\0' && pos) {
+            json_stream_append(js, to[pos - from]);
+            js->state = JSON_ST_STRING;
+        } else {
+            js->failed = true;
+        }
+        return true;
+    }
+
+    case JSON_ST_UNICODE: {
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            js->failed = true;
+            return true;
+        }
+        js->hex_value = (js->hex_value << 4) | digit;
+        if (++js->hex_count == 4) {
+            json_stream_unicode(js);
+        }
+        return true;
+    }
+
+    case JSON_ST_NUMBER:
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+            json_stream_append(js, c);
+            return true;
+        }
+        json_stream_end_scalar(js);
+        return false;
+
+    case JSON_ST_LITERAL:
+        if (c >= 'a' && c <= 'z') {
+            json_stream_append(js, c);
+            return true;
+        }
+        json_stream_end_scalar(js);
+        return false;
+
+    default:
+        json_stream_structural(js, c);
+        return true;
+    }
+}
+
+/**
+ * @brief Feeds the next piece of the document to the parser.
+ *
+ * The document may be split at any byte. Tokens are passed to the callback as soon as
+ * they are complete; strings and numbers longer than JSON_STREAM_MAX_TOKEN are truncated.
+ *
+ * @param js   Parser state.
+ * @param data Next bytes of the document.
+ * @param len  Number of bytes.
+ * @return ESP_OK, or ESP_FAIL on a syntax error or if the callback aborted.
+ */
+esp_err_t json_stream_feed(json_stream_t *js, const char *data, size_t len) {
+    size_t i = 0;
+    while (i < len && !js->failed) {
+        if (json_stream_char(js, data[i])) {
+            i++;
+        }
+    }
+    return js->failed ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * @brief Ends the document.
+ *
+ * @param js Parser state.
+ * @return ESP_OK if a complete top-level value was parsed.
+ */
+esp_err_t json_stream_finish(json_stream_t *js) {
+    if (!js->failed && (js->state == JSON_ST_NUMBER || js->state == JSON_ST_LITERAL)) {
+        json_stream_end_scalar(js);
+    }
+    return (!js->failed && js->state == JSON_ST_DONE) ? ESP_OK : ESP_FAIL;
+}
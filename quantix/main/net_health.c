@@ -0,0 +1,177 @@
+#include "net_health.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <sys/time.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "NET_HEALTH";
+
+/** @brief Magic value marking `rtc_health` as valid. */
+#define NET_HEALTH_MAGIC 0x4E484C54
+
+/** @brief Circuit breaker shared by all requests, kept in RTC memory across deep sleep. */
+typedef struct {
+    uint32_t magic;
+    uint8_t state;         /**< `net_health_state_t`. */
+    uint8_t failures;      /**< Consecutive failed requests. */
+    uint8_t open_count;    /**< Consecutive openings, the backoff exponent. */
+    int64_t open_until_ms; /**< System time (ms) at which a probe is allowed. */
+} net_health_rtc_t;
+
+RTC_DATA_ATTR static net_health_rtc_t rtc_health;
+
+/** @brief Protects `rtc_health` and `probe_in_flight`. */
+static SemaphoreHandle_t net_health_mutex;
+/**
+ * @brief A request was let through as the probe of the half-open circuit and has not
+ * reported yet. Not kept across deep sleep, where no request can be in flight.
+ */
+static bool probe_in_flight;
+
+/** @brief Current system time in milliseconds; keeps running through deep sleep. */
+static int64_t net_health_now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/**
+ * @brief Returns `base_ms * 2^exponent`, capped at NET_HEALTH_MAX_BACKOFF_MS, with "equal
+ * jitter": a random value between half and all of it.
+ *
+ * The jitter keeps devices that lost the server at the same moment from probing it in
+ * lockstep.
+ */
+static uint32_t net_health_jitter(uint32_t base_ms, uint8_t exponent) {
+    uint32_t delay = NET_HEALTH_MAX_BACKOFF_MS;
+    if (exponent < 20 && ((uint64_t)base_ms << exponent) < NET_HEALTH_MAX_BACKOFF_MS) {
+        delay = base_ms << exponent;
+    }
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+/**
+ * @brief Initialises the circuit breaker.
+ *
+ * The state in RTC memory is kept after a deep sleep, so a wake during a server outage
+ * keeps backing off instead of starting over. It is reset on power-on.
+ */
+void net_health_init(void) {
+    if (net_health_mutex == NULL) {
+        net_health_mutex = xSemaphoreCreateMutex();
+    }
+    if (rtc_health.magic != NET_HEALTH_MAGIC) {
+        rtc_health = (net_health_rtc_t){.magic = NET_HEALTH_MAGIC, .state = NET_HEALTH_CLOSED};
+    } else if (rtc_health.state != NET_HEALTH_CLOSED) {
+        ESP_LOGI(TAG, "Server marked unavailable before sleep (%u failures).",
+                 rtc_health.failures);
+    }
+}
+
+/**
+ * @brief Checks whether a request may be sent now.
+ *
+ * While the circuit is open, requests are refused until the backoff has elapsed. The
+ * first request after that is let through as a probe (half-open); its result closes the
+ * circuit or opens it again for a longer time. Until it reports, every other request is
+ * refused with NET_HEALTH_PROBE_WAIT_MS, so the workers do not all hit a server that may
+ * still be down.
+ *
+ * @param wait_ms Receives the time until a probe is allowed if the request is refused.
+ * @return `true` if the request may be sent.
+ */
+bool net_health_allow(uint32_t *wait_ms) {
+    bool allow = true;
+    *wait_ms = 0;
+    xSemaphoreTake(net_health_mutex, portMAX_DELAY);
+    if (rtc_health.state == NET_HEALTH_OPEN) {
+        int64_t left = rtc_health.open_until_ms - net_health_now_ms();
+        if (left > NET_HEALTH_MAX_BACKOFF_MS) {
+            left = 0; // The clock was set backwards since the circuit opened
+        }
+        if (left > 0) {
+            allow = false;
+            *wait_ms = left;
+        } else {
+            rtc_health.state = NET_HEALTH_HALF_OPEN;
+        }
+    }
+    if (allow && rtc_health.state == NET_HEALTH_HALF_OPEN) {
+        if (probe_in_flight) {
+            allow = false;
+            *wait_ms = NET_HEALTH_PROBE_WAIT_MS;
+        } else {
+            probe_in_flight = true;
+            ESP_LOGI(TAG, "Probing the server.");
+        }
+    }
+    xSemaphoreGive(net_health_mutex);
+    return allow;
+}
+
+/**
+ * @brief Records the result of a request.
+ *
+ * A success closes the circuit. NET_HEALTH_FAILURE_THRESHOLD consecutive failures, or a
+ * failed probe, open it with a jittered backoff that doubles on each opening.
+ *
+ * @param success `false` for connection errors and server errors (5xx).
+ * @return `true` if this failure opened the circuit.
+ */
+bool net_health_report(bool success) {
+    bool opened = false;
+    xSemaphoreTake(net_health_mutex, portMAX_DELAY);
+    if (success) {
+        if (rtc_health.state != NET_HEALTH_CLOSED) {
+            ESP_LOGI(TAG, "Server reachable again.");
+        }
+        rtc_health.state = NET_HEALTH_CLOSED;
+        rtc_health.failures = 0;
+        rtc_health.open_count = 0;
+        probe_in_flight = false;
+    } else {
+        if (rtc_health.failures < UINT8_MAX) {
+            rtc_health.failures++;
+        }
+        if (rtc_health.state == NET_HEALTH_HALF_OPEN ||
+            (rtc_health.state == NET_HEALTH_CLOSED &&
+             rtc_health.failures >= NET_HEALTH_FAILURE_THRESHOLD)) {
+            uint32_t backoff = net_health_jitter(NET_HEALTH_BASE_BACKOFF_MS, rtc_health.open_count);
+            if (rtc_health.open_count < UINT8_MAX) {
+                rtc_health.open_count++;
+            }
+            rtc_health.state = NET_HEALTH_OPEN;
+            rtc_health.open_until_ms = net_health_now_ms() + backoff;
+            probe_in_flight = false;
+            opened = true;
+            ESP_LOGW(TAG, "Server unavailable after %u failures, pausing requests for %lu ms.",
+                     rtc_health.failures, (unsigned long)backoff);
+        }
+    }
+    xSemaphoreGive(net_health_mutex);
+    return opened;
+}
+
+/**
+ * @brief Returns the delay before retrying a failed request while the circuit is closed.
+ *
+ * The delay grows with the failures shared by all requests, so a request queued behind
+ * failed ones does not start again from the shortest delay.
+ */
+uint32_t net_health_retry_delay_ms(void) {
+    xSemaphoreTake(net_health_mutex, portMAX_DELAY);
+    uint8_t failures = rtc_health.failures;
+    xSemaphoreGive(net_health_mutex);
+    return net_health_jitter(1000, failures > 0 ? failures - 1 : 0);
+}
+
+/** @brief Returns the current state of the circuit breaker. */
+net_health_state_t net_health_state(void) {
+    xSemaphoreTake(net_health_mutex, portMAX_DELAY);
+    net_health_state_t state = rtc_health.state;
+    xSemaphoreGive(net_health_mutex);
+    return state;
+}
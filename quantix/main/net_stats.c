@@ -0,0 +1,302 @@
+#include "net_stats.h"
+#include "cJSON.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "net_task.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "NET_STATS";
+
+#define TELEMETRY_URL "https://peng-pc.tail941dce.ts.net/api/telemetry"
+
+/** @brief Magic value marking `rtc_stats` as valid; change it when the layout changes. */
+#define NET_STATS_MAGIC 0x4E535432
+
+/** @brief Upper bounds (ms) of the histogram buckets; the last one takes everything above. */
+static const uint32_t bucket_limits_ms[NET_STATS_BUCKETS] = {20,   50,   100,  200,
+                                                              500,  1000, 2000, UINT32_MAX};
+
+/** @brief Phase names used in the uploaded summary, in `net_phase_t` order. */
+static const char *const phase_names[NET_PHASE_COUNT] = {
+    "dns", "connect", "ttfb", "body", "parse", "callback", "total",
+};
+
+/** @brief Statistics of the requests to one path. */
+typedef struct {
+    char path[NET_STATS_PATH_LEN];
+    uint16_t count;    /**< Recorded requests. */
+    uint16_t failed;   /**< Requests that ended in a connection error or 5xx. */
+    uint16_t reused;   /**< Requests sent on a kept-alive connection. */
+    uint16_t retries;  /**< Attempts beyond the first. */
+    uint32_t tx_bytes; /**< Total bytes sent. */
+    uint32_t rx_bytes; /**< Total bytes received, before decompression. */
+    uint32_t sum_ms[NET_PHASE_COUNT];
+    uint16_t hist[NET_PHASE_COUNT][NET_STATS_BUCKETS];
+} net_stats_endpoint_t;
+
+/** @brief All statistics not yet uploaded, kept in RTC memory across deep sleep. */
+typedef struct {
+    uint32_t magic;
+    net_stats_endpoint_t endpoints[NET_STATS_MAX_ENDPOINTS];
+} net_stats_table_t;
+
+RTC_DATA_ATTR static net_stats_table_t rtc_stats;
+
+/** @brief Protects `rtc_stats`. */
+static SemaphoreHandle_t net_stats_mutex;
+
+/**
+ * @brief Initialises the statistics.
+ *
+ * The table in RTC memory is kept after a deep sleep, so requests of several wakes are
+ * uploaded together. It is reset on power-on.
+ */
+void net_stats_init(void) {
+    if (net_stats_mutex == NULL) {
+        net_stats_mutex = xSemaphoreCreateMutex();
+    }
+    if (rtc_stats.magic != NET_STATS_MAGIC) {
+        memset(&rtc_stats, 0, sizeof(rtc_stats));
+        rtc_stats.magic = NET_STATS_MAGIC;
+    }
+}
+
+/** @brief Adds to a 16-bit counter without wrapping. */
+static void add_u16(uint16_t *counter, uint32_t value) {
+    uint32_t sum = *counter + value;
+    *counter = sum > UINT16_MAX ? UINT16_MAX : sum;
+}
+
+/** @brief Adds to a 32-bit counter without wrapping. */
+static void add_u32(uint32_t *counter, uint32_t value) {
+    *counter = *counter > UINT32_MAX - value ? UINT32_MAX : *counter + value;
+}
+
+/**
+ * @brief Copies the path of `url`, without scheme, host and query, into `path`.
+ *
+ * Truncated to fit; `size` is normally NET_STATS_PATH_LEN.
+ */
+void net_stats_url_path(const char *url, char *path, size_t size) {
+    const char *start = strstr(url, "://");
+    start = start ? strchr(start + 3, '/') : url;
+    if (start == NULL) {
+        start = "/";
+    }
+    size_t len = strcspn(start, "?");
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(path, start, len);
+    path[len] = '\0';
+}
+
+/**
+ * @brief Returns the entry for `path`, claiming a free one if needed.
+ *
+ * When the table is full, the last entry collects all other paths under "*". Must be
+ * called with `net_stats_mutex` held.
+ */
+static net_stats_endpoint_t *endpoint_for(const char *path) {
+    net_stats_endpoint_t *free_entry = NULL;
+    for (int i = 0; i < NET_STATS_MAX_ENDPOINTS - 1; ++i) {
+        net_stats_endpoint_t *ep = &rtc_stats.endpoints[i];
+        if (strcmp(ep->path, path) == 0) {
+            return ep;
+        }
+        if (ep->path[0] == '\0' && free_entry == NULL) {
+            free_entry = ep; // Entries are freed after an upload, so keep looking
+        }
+    }
+    if (free_entry) {
+        strlcpy(free_entry->path, path, sizeof(free_entry->path));
+        return free_entry;
+    }
+    net_stats_endpoint_t *other = &rtc_stats.endpoints[NET_STATS_MAX_ENDPOINTS - 1];
+    strlcpy(other->path, "*", sizeof(other->path));
+    return other;
+}
+
+/**
+ * @brief Records the timings and byte counts of a finished request.
+ *
+ * DNS and connect times are only recorded when a new connection was opened. Requests
+ * that were never sent (cancelled, or refused by the circuit breaker) are not recorded.
+ *
+ * @param path   The request path from `net_stats_url_path`; statistics are kept per path.
+ * @param failed `true` if the request ended in a connection error or a server error.
+ * @param sample The measurements.
+ */
+void net_stats_record(const char *path, bool failed, const net_stats_sample_t *sample) {
+    if (sample->attempts == 0) {
+        return;
+    }
+    xSemaphoreTake(net_stats_mutex, portMAX_DELAY);
+    net_stats_endpoint_t *ep = endpoint_for(path);
+    add_u16(&ep->count, 1);
+    add_u16(&ep->failed, failed);
+    add_u16(&ep->reused, sample->reused);
+    add_u16(&ep->retries, sample->attempts - 1);
+    add_u32(&ep->tx_bytes, sample->tx_bytes);
+    add_u32(&ep->rx_bytes, sample->rx_bytes);
+    for (int phase = 0; phase < NET_PHASE_COUNT; ++phase) {
+        if (sample->reused && (phase == NET_PHASE_DNS || phase == NET_PHASE_CONNECT)) {
+            continue;
+        }
+        uint32_t ms = sample->us[phase] > 0 ? sample->us[phase] / 1000 : 0;
+        int bucket = 0;
+        while (ms > bucket_limits_ms[bucket]) {
+            bucket++; // The last limit is UINT32_MAX
+        }
+        add_u16(&ep->hist[phase][bucket], 1);
+        add_u32(&ep->sum_ms[phase], ms);
+    }
+    xSemaphoreGive(net_stats_mutex);
+}
+
+/**
+ * @brief Subtracts an uploaded snapshot from the statistics.
+ *
+ * Requests recorded while the upload was in flight stay in the table for the next one.
+ */
+static void net_stats_commit(const net_stats_table_t *uploaded) {
+    xSemaphoreTake(net_stats_mutex, portMAX_DELAY);
+    for (int i = 0; i < NET_STATS_MAX_ENDPOINTS; ++i) {
+        const net_stats_endpoint_t *up = &uploaded->endpoints[i];
+        net_stats_endpoint_t *ep = &rtc_stats.endpoints[i];
+        if (up->path[0] == '\0' || strcmp(up->path, ep->path) != 0) {
+            continue;
+        }
+        ep->count -= up->count;
+        ep->failed -= up->failed;
+        ep->reused -= up->reused;
+        ep->retries -= up->retries;
+        ep->tx_bytes -= up->tx_bytes;
+        ep->rx_bytes -= up->rx_bytes;
+        for (int phase = 0; phase < NET_PHASE_COUNT; ++phase) {
+            ep->sum_ms[phase] -= up->sum_ms[phase];
+            for (int b = 0; b < NET_STATS_BUCKETS; ++b) {
+                ep->hist[phase][b] -= up->hist[phase][b];
+            }
+        }
+        if (ep->count == 0) {
+            memset(ep, 0, sizeof(*ep)); // Free the entry for another path
+        }
+    }
+    xSemaphoreGive(net_stats_mutex);
+}
+
+/** @brief Adds an array of numbers to `parent`. */
+static void add_numbers(cJSON *parent, const char *name, const uint32_t *values, int count) {
+    cJSON *array = cJSON_AddArrayToObject(parent, name);
+    for (int i = 0; i < count; ++i) {
+        cJSON_AddItemToArray(array, cJSON_CreateNumber(values[i]));
+    }
+}
+
+/**
+ * @brief Builds the compact summary uploaded to the server.
+ *
+ * {"phases": [...], "buckets_ms": [...], "endpoints": [{"path", "n", "failed", "reused",
+ * "retries", "tx", "rx", "sum_ms": [per phase], "hist": [[per bucket] per phase]}]}.
+ * The last bucket limit is sent as 0, meaning no limit.
+ */
+static cJSON *net_stats_to_json(const net_stats_table_t *table) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "phases", cJSON_CreateStringArray(phase_names, NET_PHASE_COUNT));
+    uint32_t limits[NET_STATS_BUCKETS];
+    memcpy(limits, bucket_limits_ms, sizeof(limits));
+    limits[NET_STATS_BUCKETS - 1] = 0;
+    add_numbers(root, "buckets_ms", limits, NET_STATS_BUCKETS);
+
+    cJSON *endpoints = cJSON_AddArrayToObject(root, "endpoints");
+    for (int i = 0; i < NET_STATS_MAX_ENDPOINTS; ++i) {
+        const net_stats_endpoint_t *ep = &table->endpoints[i];
+        if (ep->count == 0) {
+            continue;
+        }
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "path", ep->path);
+        cJSON_AddNumberToObject(item, "n", ep->count);
+        cJSON_AddNumberToObject(item, "failed", ep->failed);
+        cJSON_AddNumberToObject(item, "reused", ep->reused);
+        cJSON_AddNumberToObject(item, "retries", ep->retries);
+        cJSON_AddNumberToObject(item, "tx", ep->tx_bytes);
+        cJSON_AddNumberToObject(item, "rx", ep->rx_bytes);
+        add_numbers(item, "sum_ms", ep->sum_ms, NET_PHASE_COUNT);
+        cJSON *hist = cJSON_AddArrayToObject(item, "hist");
+        for (int phase = 0; phase < NET_PHASE_COUNT; ++phase) {
+            cJSON *buckets = cJSON_CreateArray();
+            for (int b = 0; b < NET_STATS_BUCKETS; ++b) {
+                cJSON_AddItemToArray(buckets, cJSON_CreateNumber(ep->hist[phase][b]));
+            }
+            cJSON_AddItemToArray(hist, buckets);
+        }
+        cJSON_AddItemToArray(endpoints, item);
+    }
+    return root;
+}
+
+/** @brief Finishes the upload; the snapshot is subtracted once the server has stored it. */
+static void telemetry_callback(net_event_t *event, esp_err_t err) {
+    net_stats_table_t *snapshot = event->user_data;
+    free((void *)event->post_data);
+    event->post_data = NULL;
+    if (err == ESP_OK && event->status_code == 200) {
+        net_stats_commit(snapshot);
+        ESP_LOGI(TAG, "Network statistics uploaded.");
+    } else if (err != NET_ERR_CANCELLED) {
+        ESP_LOGW(TAG, "Statistics upload failed: %s, status %d", esp_err_to_name(err),
+                 event->status_code);
+    }
+    cJSON_Delete(event->json_root);
+    free(snapshot);
+}
+
+/**
+ * @brief Uploads the statistics collected since the last upload.
+ *
+ * Sent as a background request, so it never delays the displayed day and is dropped if
+ * the server is unavailable; the statistics then stay for the next connection.
+ */
+void net_stats_upload(void) {
+    net_stats_table_t *snapshot = malloc(sizeof(*snapshot));
+    if (snapshot == NULL) {
+        return;
+    }
+    xSemaphoreTake(net_stats_mutex, portMAX_DELAY);
+    *snapshot = rtc_stats;
+    xSemaphoreGive(net_stats_mutex);
+
+    bool empty = true;
+    for (int i = 0; i < NET_STATS_MAX_ENDPOINTS; ++i) {
+        empty &= snapshot->endpoints[i].count == 0;
+    }
+    cJSON *root = empty ? NULL : net_stats_to_json(snapshot);
+    char *body = root ? cJSON_PrintUnformatted(root) : NULL;
+    cJSON_Delete(root);
+    if (body == NULL) {
+        free(snapshot);
+        return;
+    }
+
+    net_event_t event = {
+        .url = TELEMETRY_URL,
+        .method = HTTP_METHOD_POST,
+        .post_data = body,
+        .use_jwt = true,
+        .response_buffer_size = NET_RESPONSE_BUFFER_SIZE,
+        .on_finish = telemetry_callback,
+        .user_data = snapshot,
+        .priority = NET_PRIO_BACKGROUND,
+        .key = NET_KEY_TELEMETRY,
+    };
+    if (net_submit(&event, 0) != ESP_OK) {
+        free(body);
+        free(snapshot);
+    }
+}
@@ -3,15 +3,26 @@
 #include "EPD_2in9.h"
 #include "EPD_config.h"
 #include "GUI_Paint.h"
-#include "JWT_storage.h"
+#include "auth_manager.h"
+#include "boot.h"
 #include "cJSON.h"
 #include "calendar.h"
 #include "esp_err.h"
 #include "esp_http_client.h"
+#include "https_client.h"
 #include "esp_log.h"
+#include "esp_sntp.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "mbedtls/base64.h"
+#include "net_health.h"
+#include "net_stats.h"
+#include "sdkconfig.h"
+#include "sleep_manager.h"
+#include "timekeeping.h"
+#include "tls_session.h"
 #include "ui_task.h"
+#include "wake_profile.h"
 #include "wifi_manager.h"
 #include <arpa/inet.h>
 #include <esp_netif.h>
@@ -19,27 +30,30 @@
 #include <freertos/event_groups.h>
 #include <nvs.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
 static const char *TAG = "NET_TASK";
 
 #define NET_QUEUE_SIZE 13
-QueueHandle_t net_queue;
 SemaphoreHandle_t xWifi;
 
-// Root CA certificate for the server.
-extern const char isrgrootx1_pem_start[] asm("_binary_isrgrootx1_pem_start");
-extern const char isrgrootx1_pem_end[] asm("_binary_isrgrootx1_pem_end");
-
-static char responseBuffer[512];
+/** @brief Response buffer size of the bootstrap request (token, status and calendar manifest). */
+#define BOOTSTRAP_RESPONSE_SIZE 1024
 
 // URLs for the backend server.
 #define LOGIN_URL "https://peng-pc.tail941dce.ts.net/login"
+#define BOOTSTRAP_URL "https://peng-pc.tail941dce.ts.net/api/bootstrap"
 #define TEST_URL "https://peng-pc.tail941dce.ts.net/ping"
 #define SETTING_URL "https://peng-pc.tail941dce.ts.net/settings"
 #define CHECK_AUTH_RESULT_URL "https://peng-pc.tail941dce.ts.net/check_auth_result?username=esp32"
-// Maximum backoff time is 15 minutes.
-#define MAX_BACKOFF_MS 15 * 60 * 1000
+#define LOGIN_POST_DATA "{\"username\":\"esp32\", \"password\":\"supersecret\"}"
+// Close the kept-alive server connection after this long without requests.
+#define NET_KEEPALIVE_IDLE_MS 10000
+// While the server is unavailable, requests other than background ones wait at most this
+// long for the next probe before failing.
+#define NET_UNAVAILABLE_MAX_WAIT_MS 10000
 
 // Task handles for network-related tasks.
 TaskHandle_t xServerCheckHandle = NULL;
@@ -51,94 +65,478 @@ TaskHandle_t xButtonSettingDoneHandle = NULL;
 TaskHandle_t xCbContinueNoWifiHandle = NULL;
 EventGroupHandle_t net_event_group;
 
+/** @brief Fires shortly before the token expires to refresh it in the background. */
+static esp_timer_handle_t auth_refresh_timer;
+
+/** @brief One slot of the request scheduler. */
+typedef struct {
+    net_event_t event;
+    uint32_t seq; /**< Submission order, for FIFO order within a priority class. */
+    bool used;
+} net_slot_t;
+
+/** @brief Pending requests; a free worker takes the highest-priority, oldest one. */
+static net_slot_t net_slots[NET_QUEUE_SIZE];
+static uint32_t net_next_seq;
+/** @brief Number of workers currently processing a request. */
+static int net_busy;
+/** @brief SLEEP_HOLD_NET is held, because requests are queued or being processed. */
+static bool net_sched_holding;
+/** @brief Protects `net_slots`, `net_next_seq`, `net_busy` and `net_sched_holding`. */
+static SemaphoreHandle_t net_sched_mutex;
+/** @brief Counting semaphore given when a request is queued, wakes an idle worker. */
+static SemaphoreHandle_t net_sched_ready;
+/** @brief The worker tasks, notified when a request is queued to cut a backoff short. */
+static TaskHandle_t net_workers[CONFIG_NET_WORKER_COUNT];
+/** @brief Given when a slot is freed, wakes a blocked `net_submit`. */
+static SemaphoreHandle_t net_sched_space;
+
+/** @brief Bits (1 << net_radio_hold_t) of the holders that still plan to queue requests. */
+static uint32_t net_radio_holds;
+/** @brief Protects `net_radio_holds`, which may change before the scheduler exists. */
+static portMUX_TYPE net_radio_hold_lock = portMUX_INITIALIZER_UNLOCKED;
+/** @brief Wi-Fi is meant to be on; changed with `net_radio_mutex` and `net_sched_mutex` held. */
+static volatile bool net_radio_on;
+/** @brief Serialises the stop and resume orders, so wifi_manager gets them in decision order. */
+static SemaphoreHandle_t net_radio_mutex;
+
+static void net_radio_update(void);
+
 /**
- * @brief HTTP event handler for logging purposes.
- *
- * This handler logs various HTTP client events to the console for debugging.
- * It does not accumulate response data, as that is handled manually in the worker task.
- *
- * @param evt Pointer to the HTTP client event data.
- * @return ESP_OK always.
- */
-esp_err_t get_response_event_handler(esp_http_client_event_t *evt) {
-
-    switch (evt->event_id) {
-    case HTTP_EVENT_ON_DATA:
-        ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
-        break;
-    case HTTP_EVENT_ERROR:
-        ESP_LOGD(TAG, "HTTP_EVENT_ERROR");
-        break;
-    case HTTP_EVENT_ON_CONNECTED:
-        ESP_LOGD(TAG, "HTTP_EVENT_ON_CONNECTED");
-        break;
-    case HTTP_EVENT_HEADER_SENT:
-        ESP_LOGD(TAG, "HTTP_EVENT_HEADER_SENT");
-        break;
-    case HTTP_EVENT_ON_HEADER:
-        ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
-        break;
-    case HTTP_EVENT_ON_FINISH:
-        ESP_LOGD(TAG, "HTTP_EVENT_ON_FINISH");
-        break;
-    case HTTP_EVENT_DISCONNECTED:
-        ESP_LOGD(TAG, "HTTP_EVENT_DISCONNECTED");
-        break;
-        break;
-    default:
-        break;
+ * @brief Returns the queued slot the worker should process next, or -1.
+ *
+ * Must be called with `net_sched_mutex` held.
+ */
+static int net_sched_next(void) {
+    int best = -1;
+    for (int i = 0; i < NET_QUEUE_SIZE; ++i) {
+        if (!net_slots[i].used) {
+            continue;
+        }
+        if (best < 0 || net_slots[i].event.priority < net_slots[best].event.priority ||
+            (net_slots[i].event.priority == net_slots[best].event.priority &&
+             (int32_t)(net_slots[i].seq - net_slots[best].seq) < 0)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Returns the newest queued background request, which is the first to be dropped
+ * when the queue is full, or -1.
+ *
+ * Must be called with `net_sched_mutex` held.
+ */
+static int net_sched_victim(void) {
+    int victim = -1;
+    for (int i = 0; i < NET_QUEUE_SIZE; ++i) {
+        if (net_slots[i].used && net_slots[i].event.priority == NET_PRIO_BACKGROUND &&
+            (victim < 0 || (int32_t)(net_slots[i].seq - net_slots[victim].seq) > 0)) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/**
+ * @brief Keeps the device awake while requests are queued or being processed.
+ *
+ * Must be called with `net_sched_mutex` held, after every change of the queue or of
+ * `net_busy` that can start or end the pending state.
+ */
+static void net_sched_update_hold(void) {
+    bool pending = net_busy > 0 || net_sched_next() >= 0;
+    if (pending && !net_sched_holding) {
+        sleep_manager_hold(SLEEP_HOLD_NET);
+    } else if (!pending && net_sched_holding) {
+        sleep_manager_release(SLEEP_HOLD_NET);
+    }
+    net_sched_holding = pending;
+}
+
+/** @brief Wakes an idle worker, and lets workers in a retry backoff look for urgent work. */
+static void net_sched_wake(void) {
+    xSemaphoreGive(net_sched_ready);
+    for (int i = 0; i < CONFIG_NET_WORKER_COUNT; ++i) {
+        if (net_workers[i]) {
+            xTaskNotifyGive(net_workers[i]);
+        }
+    }
+}
+
+/** @brief Tells the owner of a request that was removed from the queue without running. */
+static void net_finish_cancelled(net_event_t *event) {
+    ESP_LOGI(TAG, "Request %s (priority %d) cancelled.", event->url, event->priority);
+    if (event->on_finish) {
+        event->on_finish(event, NET_ERR_CANCELLED);
+    }
+}
+
+/**
+ * @brief Queues a request for the network worker.
+ *
+ * A queued request with the same non-zero key is replaced by the new one, which keeps the
+ * old request's place in line. When the queue is full, a background request is rejected
+ * immediately; other requests push out the newest background request, or wait up to
+ * `wait` for a free slot. Requests that are replaced or pushed out get `on_finish` with
+ * NET_ERR_CANCELLED.
+ *
+ * @param event The request; copied into the queue.
+ * @param wait  Longest time to wait for a free slot.
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if a background request was dropped, or
+ *         ESP_ERR_TIMEOUT.
+ */
+esp_err_t net_submit(const net_event_t *event, TickType_t wait) {
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        net_event_t displaced;
+        bool has_displaced = false;
+        int slot = -1;
+
+        xSemaphoreTake(net_sched_mutex, portMAX_DELAY);
+        if (event->key != NET_KEY_NONE) {
+            for (int i = 0; i < NET_QUEUE_SIZE; ++i) {
+                if (net_slots[i].used && net_slots[i].event.key == event->key) {
+                    slot = i; // Supersede, keeping the place in line
+                    displaced = net_slots[i].event;
+                    has_displaced = true;
+                    break;
+                }
+            }
+        }
+        for (int i = 0; slot < 0 && i < NET_QUEUE_SIZE; ++i) {
+            if (!net_slots[i].used) {
+                slot = i;
+                net_slots[i].seq = net_next_seq++;
+            }
+        }
+        if (slot < 0 && event->priority != NET_PRIO_BACKGROUND) {
+            slot = net_sched_victim();
+            if (slot >= 0) {
+                displaced = net_slots[slot].event;
+                has_displaced = true;
+                net_slots[slot].seq = net_next_seq++;
+            }
+        }
+        bool resume = false;
+        if (slot >= 0) {
+            net_slots[slot].event = *event;
+            net_slots[slot].used = true;
+            net_sched_update_hold();
+            resume = !net_radio_on;
+        }
+        bool space_left = false;
+        for (int i = 0; i < NET_QUEUE_SIZE; ++i) {
+            space_left |= !net_slots[i].used;
+        }
+        xSemaphoreGive(net_sched_mutex);
+
+        if (slot >= 0) {
+            if (space_left) {
+                xSemaphoreGive(net_sched_space); // Pass on a wake-up this call didn't need
+            }
+            if (resume) {
+                net_radio_update(); // The radio session had ended, start a new one
+            }
+            net_sched_wake();
+            if (has_displaced) {
+                net_finish_cancelled(&displaced);
+            }
+            return ESP_OK;
+        }
+        if (event->priority == NET_PRIO_BACKGROUND) {
+            ESP_LOGW(TAG, "Request queue full, dropping background request %s", event->url);
+            return ESP_ERR_NO_MEM;
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= wait || xSemaphoreTake(net_sched_space, wait - elapsed) != pdTRUE) {
+            ESP_LOGW(TAG, "Request queue full, request %s timed out", event->url);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+}
+
+/**
+ * @brief Cancels the queued requests with the given key.
+ *
+ * A request the worker has already started is not affected. The cancelled requests get
+ * `on_finish` with NET_ERR_CANCELLED, called from this task.
+ *
+ * @param key The request key; NET_KEY_NONE cancels nothing.
+ * @return The number of cancelled requests.
+ */
+int net_cancel(uint32_t key) {
+    int cancelled = 0;
+    if (key == NET_KEY_NONE) {
+        return 0;
+    }
+    for (;;) {
+        net_event_t event;
+        bool found = false;
+        xSemaphoreTake(net_sched_mutex, portMAX_DELAY);
+        for (int i = 0; i < NET_QUEUE_SIZE; ++i) {
+            if (net_slots[i].used && net_slots[i].event.key == key) {
+                event = net_slots[i].event;
+                net_slots[i].used = false;
+                found = true;
+                break;
+            }
+        }
+        net_sched_update_hold();
+        xSemaphoreGive(net_sched_mutex);
+        if (!found) {
+            if (cancelled > 0) {
+                net_radio_update(); // The cancelled requests may have been the last ones
+            }
+            return cancelled;
+        }
+        xSemaphoreGive(net_sched_space);
+        net_finish_cancelled(&event); // Outside the lock, the callback may submit again
+        cancelled++;
+    }
+}
+
+/**
+ * @brief Takes the next request for a worker, waiting up to `wait` for one.
+ *
+ * Counts the worker as busy until `net_sched_done` is called.
+ *
+ * @return `true` if `event` was filled in.
+ */
+static bool net_sched_take(net_event_t *event, TickType_t wait) {
+    for (;;) {
+        xSemaphoreTake(net_sched_mutex, portMAX_DELAY);
+        int slot = net_sched_next();
+        if (slot >= 0) {
+            *event = net_slots[slot].event;
+            net_slots[slot].used = false;
+            net_busy++;
+        }
+        xSemaphoreGive(net_sched_mutex);
+        if (slot >= 0) {
+            xSemaphoreGive(net_sched_space);
+            return true;
+        }
+        if (xSemaphoreTake(net_sched_ready, wait) != pdTRUE) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Marks a worker idle after a request has finished, and stops the radio if that was
+ * the last work of the radio session.
+ */
+static void net_sched_done(void) {
+    xSemaphoreTake(net_sched_mutex, portMAX_DELAY);
+    net_busy--;
+    net_sched_update_hold();
+    xSemaphoreGive(net_sched_mutex);
+    net_radio_update();
+}
+
+/**
+ * @brief Sleeps for a retry backoff, returning early if more urgent work is queued and no
+ * other worker is free to take it.
+ *
+ * @param priority Priority of the request that is being retried.
+ * @param delay_ms Backoff time.
+ * @return `true` if a request with a higher priority is waiting.
+ */
+static bool net_sched_backoff(net_priority_t priority, uint32_t delay_ms) {
+    TickType_t start = xTaskGetTickCount();
+    TickType_t delay = pdMS_TO_TICKS(delay_ms);
+    for (;;) {
+        xSemaphoreTake(net_sched_mutex, portMAX_DELAY);
+        int slot = net_sched_next();
+        bool preempted = slot >= 0 && net_slots[slot].event.priority < priority &&
+                         net_busy >= CONFIG_NET_WORKER_COUNT;
+        xSemaphoreGive(net_sched_mutex);
+        if (preempted) {
+            return true;
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= delay || ulTaskNotifyTake(pdTRUE, delay - elapsed) == 0) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Fails all queued background requests with NET_ERR_SERVER_UNAVAILABLE.
+ *
+ * Called when the circuit breaker opens, so prefetches queued behind the failing request
+ * do not each wait for their own timeout. Called from the worker, outside the lock.
+ */
+static void net_sched_fail_background(void) {
+    for (;;) {
+        net_event_t event;
+        xSemaphoreTake(net_sched_mutex, portMAX_DELAY);
+        int slot = net_sched_victim();
+        if (slot >= 0) {
+            event = net_slots[slot].event;
+            net_slots[slot].used = false;
+        }
+        xSemaphoreGive(net_sched_mutex);
+        if (slot < 0) {
+            return;
+        }
+        xSemaphoreGive(net_sched_space);
+        ESP_LOGI(TAG, "Request %s failed, server unavailable.", event.url);
+        if (event.on_finish) {
+            event.on_finish(&event, NET_ERR_SERVER_UNAVAILABLE);
+        }
     }
+}
+
+static void net_schedule_token_refresh(void);
 
-    return ESP_OK;
+/**
+ * @brief Stores the token from a /login response.
+ *
+ * @param root The parsed response, may be NULL.
+ * @return ESP_OK if a token was stored.
+ */
+static esp_err_t net_store_login_token(cJSON *root) {
+    cJSON *token_item = cJSON_GetObjectItem(root, "token");
+    if (!cJSON_IsString(token_item) || !token_item->valuestring) {
+        ESP_LOGE(TAG, "No 'token' in JSON response!");
+        return ESP_FAIL;
+    }
+    esp_err_t err = auth_set_token(token_item->valuestring);
+    if (err == ESP_OK) {
+        net_schedule_token_refresh();
+    }
+    return err;
+}
+
+/**
+ * @brief Callback of the background token refresh.
+ *
+ * A failed refresh is not retried here; the worker logs in before the next request that
+ * needs the token instead.
+ */
+static void auth_refresh_callback(net_event_t *event, esp_err_t err) {
+    if (err == ESP_OK && event->status_code == 200 && event->json_root &&
+        net_store_login_token(event->json_root) == ESP_OK) {
+        ESP_LOGI(TAG, "Token refreshed in the background.");
+    } else if (err != NET_ERR_CANCELLED) {
+        ESP_LOGW(TAG, "Background token refresh failed: %s, status %d", esp_err_to_name(err),
+                 event->status_code);
+    }
+    cJSON_Delete(event->json_root);
+    event->json_root = NULL;
+}
+
+/**
+ * @brief Queues a background login when the refresh timer fires.
+ *
+ * Skipped while the radio is off: starting it only for the token is not worth it, the
+ * worker logs in before the next request that needs one instead.
+ */
+static void auth_refresh_timer_cb(void *arg) {
+    if (!net_radio_on) {
+        ESP_LOGI(TAG, "Radio off, token refresh left to the next request.");
+        return;
+    }
+    net_event_t event = {
+        .url = LOGIN_URL,
+        .method = HTTP_METHOD_POST,
+        .post_data = LOGIN_POST_DATA,
+        .use_jwt = false,
+        .response_buffer_size = NET_RESPONSE_BUFFER_SIZE,
+        .on_finish = auth_refresh_callback,
+        .priority = NET_PRIO_BACKGROUND,
+        .key = NET_KEY_AUTH_REFRESH,
+    };
+    net_submit(&event, 0);
+}
+
+/**
+ * @brief Arms the refresh timer for the current token, AUTH_REFRESH_MARGIN_S before it
+ * expires.
+ */
+static void net_schedule_token_refresh(void) {
+    int64_t refresh_in_s = auth_refresh_in_seconds();
+    esp_timer_stop(auth_refresh_timer);
+    if (refresh_in_s >= 0) {
+        esp_timer_start_once(auth_refresh_timer, (refresh_in_s > 0 ? refresh_in_s : 1) * 1000000LL);
+    }
+}
+
+/**
+ * @brief Shows the connection error and lets the button retry.
+ */
+static void server_check_failed(void) {
+    xEventGroupClearBits(net_event_group, NET_SERVER_CONNECTED_BIT);
+    event_t ev = {
+        .event_id = SCREEN_EVENT_NO_CONNECTION,
+        .msg = "Server connection failed, please check your network settings.",
+    };
+    ui_send_event(&ev);
+    ec11_set_button_callback(xServerCheckCallbackHandle);
+    net_radio_release(NET_RADIO_HOLD_CONNECT); // Nothing else to do online this wake
+}
+
+/**
+ * @brief Signals that the server is reachable with a valid token.
+ *
+ * Sets the event group bits for the server connection and token, and notifies other
+ * tasks to proceed with their network-dependent operations.
+ *
+ * This plans the rest of the radio session: the prefetch of the changed days (which queues
+ * the missing glyphs when its response arrives) and the telemetry uploads are queued while
+ * the bootstrap request still counts as running, so the radio stays on until all of them
+ * are done and is stopped right after.
+ */
+static void server_connected(void) {
+    xEventGroupSetBits(net_event_group, NET_TOKEN_AVAILABLE_BIT);
+    xEventGroupSetBits(net_event_group, NET_SERVER_CONNECTED_BIT);
+    if (!isr_woken) {
+        event_t ev = {
+            .event_id = SCREEN_EVENT_CENTER,
+            .msg = "Server connected successfully:)",
+        };
+        ui_send_event(&ev);
+    }
+    if (xEventGroupGetBits(net_event_group) & NET_GOOGLE_TOKEN_AVAILABLE_BIT) {
+        net_radio_hold(NET_RADIO_HOLD_PREFETCH); // Until the prefetch cycle has queued its range
+    }
+    xTaskNotifyGive(xCalendarPrefetchHandle);
+    if (!isr_woken) {
+        xTaskNotify(xCalendarDisplayHandle, 0, eSetValueWithOverwrite);
+    }
+    net_stats_upload();
+    wake_profile_upload();
+    net_radio_release(NET_RADIO_HOLD_CONNECT);
 }
 
 /**
  * @brief Callback to handle the result of the initial server login/check.
  *
  * This function is called after the device attempts to log in to the server.
- * If successful, it saves the received JWT, sets event group bits to signal
- * that the server is connected and a token is available, and notifies other tasks
- * to proceed with their network-dependent operations. If it fails, it updates the
- * UI to show a connection error and sets up a button callback to retry.
+ * If successful, it stores the received JWT and calls `server_connected`. If it fails,
+ * it updates the UI to show a connection error and sets up a button callback to retry.
  *
  * @param event The network event containing the response data.
  * @param err The result of the HTTP request.
  */
 static void server_check_callback(net_event_t *event, esp_err_t err) {
-    if (err == ESP_OK && event->json_root) {
-        cJSON *token_item = cJSON_GetObjectItem(event->json_root, "token");
-        if (token_item && cJSON_IsString(token_item)) {
-            const char *jwt = token_item->valuestring;
-            jwt_save_to_nvs(jwt);
-            ESP_LOGI(TAG, "Login success, token saved.");
-            xEventGroupSetBits(net_event_group, NET_TOKEN_AVAILABLE_BIT);
-            xEventGroupSetBits(net_event_group, NET_SERVER_CONNECTED_BIT);
-            if (!isr_woken) {
-                event_t ev = {
-                    .event_id = SCREEN_EVENT_CENTER,
-                    .msg = "Server connected successfully:)",
-                };
-                xQueueSend(gui_queue, &ev, portMAX_DELAY);
-            }
-            xTaskNotifyGive(xCalendarPrefetchHandle);
-            if (!isr_woken) {
-                xTaskNotify(xCalendarDisplayHandle, 0, eSetValueWithOverwrite);
-            }
-        } else {
-            ESP_LOGE(TAG, "No 'token' in JSON response!");
-        }
+    if (err == NET_ERR_CANCELLED) {
+        return; // Superseded by a newer bootstrap or login request
+    }
+    if (err != ESP_OK || event->status_code != 200 || !event->json_root ||
+        net_store_login_token(event->json_root) != ESP_OK) {
+        ESP_LOGE(TAG, "Login failed: %s, status %d, %s", esp_err_to_name(err), event->status_code,
+                 event->response_buffer ? event->response_buffer : "");
         cJSON_Delete(event->json_root);
-    } else {
-        ESP_LOGE(TAG, "Login failed or JSON parse error: %s, err: %d",
-                 event->response_buffer ? event->response_buffer : "", err);
-        xEventGroupClearBits(net_event_group, NET_SERVER_CONNECTED_BIT);
-        event_t ev = {
-            .event_id = SCREEN_EVENT_NO_CONNECTION,
-            .msg = "Server connection failed, please check your network settings.",
-        };
-        xQueueSend(gui_queue, &ev, portMAX_DELAY);
-        ec11_set_button_callback(xServerCheckCallbackHandle);
+        server_check_failed();
+        return;
     }
+    cJSON_Delete(event->json_root);
+    ESP_LOGI(TAG, "Login success, token saved.");
+    server_connected();
 }
 
 /**
@@ -166,7 +564,7 @@ static void user_settings_callback(net_event_t *event, esp_err_t err) {
                     .event_id = SCREEN_EVENT_QRCODE,
                 };
                 setting_qrcode_setting((char *)buf);
-                xQueueSend(gui_queue, &ev, portMAX_DELAY);
+                ui_send_event(&ev);
                 UBaseType_t stack_remain = uxTaskGetStackHighWaterMark(NULL);
                 ESP_LOGI("TASK", "Stack high water mark: %u words", stack_remain);
                 ec11_set_button_callback(xButtonSettingDoneHandle);
@@ -185,25 +583,127 @@ static void user_settings_callback(net_event_t *event, esp_err_t err) {
 /**
  * @brief Queues a request to log in to the server and obtain a JWT.
  *
- * This function constructs and sends a `net_event_t` to the `net_queue` for the
- * worker task to process.
+ * Fallback for servers without /api/bootstrap. This function constructs a `net_event_t`
+ * and submits it to the request scheduler for the worker task to process.
  */
-
-void server_check(void) {
+static void server_login(void) {
     net_event_t event = {
         .url = LOGIN_URL,
         .method = HTTP_METHOD_POST,
-        .post_data = "{\"username\":\"esp32\", \"password\":\"supersecret\"}",
+        .post_data = LOGIN_POST_DATA,
         .use_jwt = false,
-        .response_buffer = responseBuffer,
-        .response_buffer_size = sizeof(responseBuffer),
+        .response_buffer_size = NET_RESPONSE_BUFFER_SIZE,
         .on_finish = server_check_callback,
         .user_data = NULL,
+        .priority = NET_PRIO_AUTH,
+        .key = NET_KEY_LOGIN,
     };
-    xQueueSend(net_queue, &event, portMAX_DELAY);
+    net_submit(&event, portMAX_DELAY);
     return;
 }
 
+/**
+ * @brief Sets the clock from the server time of the bootstrap response until SNTP has
+ * synchronised.
+ */
+static void net_apply_server_time(const cJSON *server_time) {
+    if (!cJSON_IsNumber(server_time)) {
+        return;
+    }
+    if (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET &&
+        !(xEventGroupGetBits(net_event_group) & NET_TIME_SYNCED_BIT)) {
+        timekeeping_set_coarse((time_t)server_time->valuedouble);
+        ESP_LOGI(TAG, "Clock set from server time.");
+    }
+    xEventGroupSetBits(net_event_group, NET_TIME_SYNCED_BIT);
+}
+
+/**
+ * @brief Callback of the bootstrap request.
+ *
+ * Stores the token, sets the clock, records whether the Google account is linked and
+ * hands the calendar manifest to the prefetch task, then continues like a login. A
+ * server without the endpoint (404) falls back to the separate login request.
+ *
+ * @param event The network event containing the response data.
+ * @param err The result of the HTTP request.
+ */
+static void bootstrap_callback(net_event_t *event, esp_err_t err) {
+    // post_data was allocated by server_check.
+    free((void *)event->post_data);
+    event->post_data = NULL;
+
+    if (err == NET_ERR_CANCELLED) {
+        return; // Superseded by a newer bootstrap or login request
+    }
+    if (err == ESP_OK && event->status_code == 404) {
+        ESP_LOGW(TAG, "Server has no bootstrap endpoint, logging in separately.");
+        cJSON_Delete(event->json_root);
+        server_login();
+        return;
+    }
+    if (err != ESP_OK || event->status_code != 200 || !event->json_root ||
+        net_store_login_token(event->json_root) != ESP_OK) {
+        ESP_LOGE(TAG, "Bootstrap failed: %s, status %d, %s", esp_err_to_name(err),
+                 event->status_code, event->response_buffer ? event->response_buffer : "");
+        cJSON_Delete(event->json_root);
+        server_check_failed();
+        return;
+    }
+
+    net_apply_server_time(cJSON_GetObjectItem(event->json_root, "server_time"));
+    cJSON *calendar = cJSON_GetObjectItem(event->json_root, "calendar");
+    if (calendar) {
+        calendar_apply_bootstrap(calendar);
+    }
+    cJSON *linked = cJSON_GetObjectItem(event->json_root, "google_linked");
+    if (cJSON_IsTrue(linked)) {
+        xEventGroupSetBits(net_event_group, NET_GOOGLE_TOKEN_AVAILABLE_BIT | NET_BOOTSTRAP_BIT);
+    } else if (cJSON_IsFalse(linked)) {
+        xEventGroupSetBits(net_event_group, NET_BOOTSTRAP_BIT);
+        userSettings();
+    }
+    cJSON_Delete(event->json_root);
+    ESP_LOGI(TAG, "Bootstrap success, token saved.");
+    server_connected();
+}
+
+/**
+ * @brief Queues the bootstrap request that starts a session with the server.
+ *
+ * One request returns the JWT, the server time, whether the Google account is linked and
+ * which days of the prefetch window changed, replacing the login, Google token check and
+ * first calendar request that would otherwise follow each other after every connect.
+ */
+void server_check(void) {
+    cJSON *body = cJSON_Parse(LOGIN_POST_DATA);
+    if (body) {
+        calendar_add_sync_state(body);
+    }
+    char *post_data = body ? cJSON_PrintUnformatted(body) : NULL;
+    cJSON_Delete(body);
+    if (!post_data) {
+        ESP_LOGE(TAG, "Failed to build bootstrap request, logging in separately.");
+        server_login();
+        return;
+    }
+
+    net_event_t event = {
+        .url = BOOTSTRAP_URL,
+        .method = HTTP_METHOD_POST,
+        .post_data = post_data,
+        .use_jwt = false,
+        .response_buffer_size = BOOTSTRAP_RESPONSE_SIZE,
+        .on_finish = bootstrap_callback,
+        .user_data = NULL,
+        .priority = NET_PRIO_AUTH,
+        .key = NET_KEY_LOGIN,
+    };
+    if (net_submit(&event, portMAX_DELAY) != ESP_OK) {
+        free(post_data);
+    }
+}
+
 /**
  * @brief Queues a request to fetch user-specific settings from the server.
  *
@@ -217,235 +717,627 @@ void userSettings(void) {
         .event_id = SCREEN_EVENT_CENTER,
         .msg = "No calendar settings found. Generating QR code for calendar setup...",
     };
-    xQueueSend(gui_queue, &ev, portMAX_DELAY);
+    ui_send_event(&ev);
     ESP_LOGI(TAG, "Getting user setting url...");
     net_event_t event = {
         .url = SETTING_URL,
         .method = HTTP_METHOD_POST,
         .post_data = NULL,
         .use_jwt = true,
-        .response_buffer = responseBuffer,
-        .response_buffer_size = sizeof(responseBuffer),
+        .response_buffer_size = NET_RESPONSE_BUFFER_SIZE,
         .on_finish = user_settings_callback,
         .user_data = NULL,
+        .priority = NET_PRIO_AUTH,
+        .key = NET_KEY_SETTINGS,
     };
-    xQueueSendToFront(net_queue, &event, portMAX_DELAY);
+    net_submit(&event, portMAX_DELAY);
     return;
 }
 
+/** @brief A pooled connection, reused by requests to the same server (HTTP/1.1 keep-alive). */
+typedef struct {
+    https_conn_t conn;
+    char host[HTTPS_HOST_MAX_LEN]; /**< Server of the current or last request. */
+    bool in_use;                   /**< Held by a worker for a request. */
+    TickType_t released_at;        /**< When the last request on it finished. */
+} net_pool_conn_t;
+
+/** @brief One connection per worker, so a free connection always exists for a free worker. */
+static net_pool_conn_t net_pool[CONFIG_NET_WORKER_COUNT];
+/** @brief Protects the `in_use`, `host` and `released_at` fields of `net_pool`. */
+static SemaphoreHandle_t net_pool_mutex;
+/** @brief Given when a connection is released, wakes a worker waiting for its server. */
+static SemaphoreHandle_t net_pool_released;
+
+/** @brief Counts the workers using Wi-Fi; the first takes `xWifi`, the last gives it back. */
+static int net_wifi_users;
+/** @brief Protects `net_wifi_users`. */
+static SemaphoreHandle_t net_wifi_mutex;
+/** @brief SLEEP_HOLD_WIFI is held until Wi-Fi connects or the wait is given up. */
+static bool net_wifi_waiting;
+/** @brief Protects `net_wifi_waiting`; the wait may end from the Wi-Fi or a timer task. */
+static portMUX_TYPE net_wifi_wait_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Serialises logins, so parallel workers with an expiring token log in once. */
+static SemaphoreHandle_t net_login_mutex;
+/** @brief Counts the logins of the workers, to tell if a rejected token was replaced since. */
+static volatile uint32_t net_login_generation;
+
 /**
- * @brief A worker task that processes network requests from a queue.
+ * @brief Takes a connection from the pool for a request to `url`.
  *
- * This task waits for `net_event_t` items on `net_queue`. For each event, it
- * performs an HTTP request with retry logic and exponential backoff. It handles
- * setting JWT headers, posting data, receiving responses, and optionally
- * parsing the response as JSON. After the request is complete (or has failed
- * after all retries), it calls the `on_finish` callback specified in the event.
- *
- * @param pvParameters Unused.
+ * Prefers an idle connection that is still open to the same server, then a closed one,
+ * and finally closes one open to another server. Waits while
+ * CONFIG_NET_MAX_CONNS_PER_HOST connections to the server are in use.
  */
-void net_worker_task(void *pvParameters) {
-    net_event_t event;
-    static char auth_header[256]; // Buffer for jwt token header
-    const uint32_t max_backoff_ms = MAX_BACKOFF_MS;
-    const uint8_t max_retry = 5; // Hardcoded maximum number of retries.
-    int http_status_code = 0;
-    esp_err_t err; // Initialize err for this attempt
-    uint8_t try_count;
-    uint32_t delay_ms; // Hardcoded initial delay.
-    uint8_t failure_count;
-    uint8_t success_count;
+static net_pool_conn_t *net_pool_acquire(const char *url) {
+    char host[HTTPS_HOST_MAX_LEN] = "";
+    int port;
+    const char *path;
+    https_parse_url(url, host, &port, &path); // An invalid URL fails later in https_request
+
     for (;;) {
-        if (xQueueReceive(net_queue, &event, portMAX_DELAY) == pdTRUE) {
-            try_count = 0;
-            delay_ms = 1000; // Hardcoded initial delay.
-            failure_count = 0;
-            success_count = 0;
-            while (1) {
-                xSemaphoreTake(xWifi, portMAX_DELAY);
-                // Configure the HTTP client.
-                xEventGroupWaitBits(net_event_group, NET_WIFI_CONNECTED_BIT, false, true,
-                                    portMAX_DELAY);
-                esp_http_client_config_t config = {
-                    .url = event.url,
-                    .method = event.method,
-                    .timeout_ms = 5000,
-                    .event_handler = get_response_event_handler,
-                    .cert_pem = isrgrootx1_pem_start,
-                    .user_data = event.response_buffer,
-                };
-                err = ESP_OK;
-                esp_http_client_handle_t client = esp_http_client_init(&config);
-
-                if (event.use_jwt) {
-                    char *token = jwt_load_from_nvs();
-                    if (token) {
-                        snprintf(auth_header, sizeof(auth_header), "Bearer %s", token);
-                        esp_http_client_set_header(client, "Authorization", auth_header);
-                    }
-                }
-                esp_http_client_set_header(client, "Content-Type", "application/json");
-                esp_http_client_set_header(client, "Accept-Encoding", "identity");
+        net_pool_conn_t *best = NULL;
+        int best_rank = -1;
+        int active = 0;
+        xSemaphoreTake(net_pool_mutex, portMAX_DELAY);
+        for (int i = 0; i < CONFIG_NET_WORKER_COUNT; ++i) {
+            net_pool_conn_t *pc = &net_pool[i];
+            bool same_host = strcmp(pc->host, host) == 0;
+            if (pc->in_use) {
+                active += same_host;
+                continue;
+            }
+            bool open = https_is_connected(&pc->conn);
+            int rank = open && same_host ? 2 : !open ? 1 : 0;
+            if (rank > best_rank) {
+                best = pc;
+                best_rank = rank;
+            }
+        }
+        if (best && active < CONFIG_NET_MAX_CONNS_PER_HOST) {
+            best->in_use = true;
+            strlcpy(best->host, host, sizeof(best->host));
+        } else {
+            best = NULL;
+        }
+        xSemaphoreGive(net_pool_mutex);
 
-                int post_len = 0;
-                if (event.method == HTTP_METHOD_POST && event.post_data) {
-                    post_len = strlen(event.post_data);
-                }
+        if (best) {
+            if (best_rank == 0) {
+                https_close(&best->conn); // Kept alive for another server
+            }
+            return best;
+        }
+        // Re-check now and then, a release may have woken a worker waiting for another server
+        xSemaphoreTake(net_pool_released, pdMS_TO_TICKS(100));
+    }
+}
 
-                err = esp_http_client_open(client, post_len);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-                } else {
-                    if (event.method == HTTP_METHOD_POST && event.post_data) {
-                        int bytes_written =
-                            esp_http_client_write(client, event.post_data, post_len);
-                        if (bytes_written < 0) {
-                            ESP_LOGE(TAG, "esp_http_client_write failed: %s",
-                                     esp_err_to_name(bytes_written));
-                            err = bytes_written; // Propagate error
-                        } else if (bytes_written != post_len) {
-                            ESP_LOGW(TAG, "esp_http_client_write sent %d bytes, expected %d",
-                                     bytes_written, post_len);
-                            err = ESP_FAIL; // Treat as error for simplicity
-                        }
-                    }
-
-                    if (err == ESP_OK) { // Only proceed if open (and write if POST) was successful
-                        int fetch_header_ret = esp_http_client_fetch_headers(client);
-                        if (fetch_header_ret < 0) {
-                            ESP_LOGE(TAG, "esp_http_client_fetch_headers failed: %s",
-                                     esp_err_to_name(fetch_header_ret));
-                            err = fetch_header_ret; // Propagate error
-                        } else {
-                            http_status_code =
-                                esp_http_client_get_status_code(client); // Get HTTP status code
-                            // Headers fetched, now get status and content length for reading
-                            // response
-                            if (event.response_buffer) {
-                                int response_content_length =
-                                    esp_http_client_get_content_length(client);
-                                int total_read_len = 0;
-                                event.response_buffer[0] = '\0';
-
-                                if (response_content_length >
-                                    0) { // If there's response content, then read it
-                                    if (response_content_length < event.response_buffer_size) {
-                                        total_read_len = esp_http_client_read_response(
-                                            client, event.response_buffer, response_content_length);
-                                    } else {
-                                        ESP_LOGW(TAG,
-                                                 "Response content (%d) larger than buffer (%d). "
-                                                 "Truncating.",
-                                                 response_content_length,
-                                                 event.response_buffer_size);
-                                        total_read_len = esp_http_client_read_response(
-                                            client, event.response_buffer,
-                                            event.response_buffer_size - 1);
-                                        // Consume and discard rest of the body
-                                        if (total_read_len >= 0) {
-                                            char discard_buf[64];
-                                            while (esp_http_client_read(client, discard_buf,
-                                                                        sizeof(discard_buf)) > 0)
-                                                ;
-                                        }
-                                    }
-                                    if (total_read_len < 0) { // Read failed, connection closed
-                                        ESP_LOGE(TAG, "Failed to read response data: %s",
-                                                 esp_err_to_name(total_read_len));
-                                        err = total_read_len;
-                                        total_read_len = 0;
-                                    }
-                                } else if (response_content_length == 0) {
-                                    total_read_len = 0; // No content
-                                } else { // response_content_length == -1 (chunked or connection
-                                         // close)
-                                    int read_len;
-                                    while (total_read_len < event.response_buffer_size - 1) {
-                                        read_len = esp_http_client_read(
-                                            client, event.response_buffer + total_read_len,
-                                            event.response_buffer_size - 1 - total_read_len);
-                                        if (read_len < 0) {
-                                            ESP_LOGE(TAG, "Read failed (chunked/unknown): %s",
-                                                     esp_err_to_name(read_len));
-                                            err = read_len; // Propagate error
-                                            break;
-                                        } else if (read_len == 0) { // End of stream
-                                            if (esp_http_client_is_complete_data_received(client)) {
-                                                break;
-                                            } else {
-                                                ESP_LOGW(TAG, "Connection closed prematurely "
-                                                              "(chunked/unknown)");
-                                                err = ESP_FAIL; // Optional: treat as error if
-                                                // data is incomplete
-                                                break;
-                                            }
-                                        }
-                                        total_read_len += read_len;
-                                    }
-                                }
-                                if (event.response_buffer) {
-                                    event.response_buffer[total_read_len] = '\0'; // Null terminate
-                                }
-                            }
-                        }
-                    }
-                }
+/** @brief Returns a connection to the pool, keeping it open for the next request. */
+static void net_pool_release(net_pool_conn_t *pc) {
+    xSemaphoreTake(net_pool_mutex, portMAX_DELAY);
+    pc->in_use = false;
+    pc->released_at = xTaskGetTickCount();
+    xSemaphoreGive(net_pool_mutex);
+    xSemaphoreGive(net_pool_released);
+}
 
-                esp_http_client_close(client); // Close connection
-                xSemaphoreGive(xWifi);         // Release semaphore AFTER all
-
-                // Automatically parse JSON if requested.
-                if (err == ESP_OK && event.response_buffer) {
-                    cJSON *parsed_json = cJSON_Parse(event.response_buffer);
-                    if (!parsed_json) {
-                        ESP_LOGW(TAG, "Failed to parse JSON from response: %s",
-                                 event.response_buffer);
-                    }
-                    event.json_root = parsed_json; // Store parsed result (or NULL if failed)
-                } else if (event.json_root !=
-                           NULL) { // If parsing was requested but HTTP failed or no buffer
-
-                    event.json_root = NULL;
-                }
+/**
+ * @brief Closes the pooled connections that have been idle for at least `min_idle`.
+ *
+ * @param min_idle `NET_KEEPALIVE_IDLE_MS` for the keep-alive timeout, 0 before the radio is
+ *                 stopped.
+ * @return `true` if idle connections are still open, so the caller should check again.
+ */
+static bool net_pool_close_idle(TickType_t min_idle) {
+    bool open_left = false;
+    for (int i = 0; i < CONFIG_NET_WORKER_COUNT; ++i) {
+        net_pool_conn_t *pc = &net_pool[i];
+        bool expired = false;
+        TickType_t idle = 0;
+        xSemaphoreTake(net_pool_mutex, portMAX_DELAY);
+        if (!pc->in_use && https_is_connected(&pc->conn)) {
+            idle = xTaskGetTickCount() - pc->released_at;
+            expired = idle >= min_idle;
+            if (expired) {
+                pc->in_use = true; // Keep other workers off it while it closes
+            } else {
+                open_left = true;
+            }
+        }
+        xSemaphoreGive(net_pool_mutex);
+        if (expired) {
+            ESP_LOGI(TAG, "No requests to %s for %lu ms, closing connection.", pc->host,
+                     (unsigned long)pdTICKS_TO_MS(idle));
+            https_close(&pc->conn);
+            net_pool_release(pc);
+        }
+    }
+    return open_left;
+}
 
-                bool should_retry = false;
-                if (err == ESP_OK) {
-                    success_count++;
-                    failure_count = 0;
-                } else {
-                    failure_count++;
-                    should_retry = (try_count < max_retry);
-                }
+/**
+ * @brief Marks Wi-Fi as in use by a worker.
+ *
+ * `xWifi` is held while any worker sends a request, so the Wi-Fi settings button waits for
+ * all of them.
+ */
+static void net_wifi_acquire(void) {
+    xSemaphoreTake(net_wifi_mutex, portMAX_DELAY);
+    if (net_wifi_users++ == 0) {
+        xSemaphoreTake(xWifi, portMAX_DELAY);
+    }
+    xSemaphoreGive(net_wifi_mutex);
+}
 
-                esp_http_client_cleanup(client);
+/**
+ * @brief Keeps the device awake until Wi-Fi connects.
+ *
+ * Called when the network is started. Calling it again while waiting has no effect.
+ */
+void net_wifi_wait_begin(void) {
+    sleep_manager_hold(SLEEP_HOLD_WIFI);
+    taskENTER_CRITICAL(&net_wifi_wait_lock);
+    bool already = net_wifi_waiting;
+    net_wifi_waiting = true;
+    taskEXIT_CRITICAL(&net_wifi_wait_lock);
+    if (already) {
+        sleep_manager_release(SLEEP_HOLD_WIFI);
+    }
+}
 
-                if (!should_retry)
-                    break;
+/**
+ * @brief Stops keeping the device awake for Wi-Fi.
+ *
+ * Called on every connection, and when a background sync gives up waiting.
+ */
+void net_wifi_wait_end(void) {
+    taskENTER_CRITICAL(&net_wifi_wait_lock);
+    bool waiting = net_wifi_waiting;
+    net_wifi_waiting = false;
+    taskEXIT_CRITICAL(&net_wifi_wait_lock);
+    if (waiting) {
+        sleep_manager_release(SLEEP_HOLD_WIFI);
+    }
+}
 
-                // Backoff logic for retries.
-                if (failure_count == 1) {
-                    delay_ms = 1000;
-                } else if (failure_count < 6) {
-                    delay_ms = 1000;
-                } else if (failure_count < 10) {
-                    delay_ms = 5000;
-                } else if (failure_count < 20) {
-                    delay_ms = 30000;
-                } else {
-                    delay_ms = 5 * 60 * 1000;
-                }
-                if (delay_ms > max_backoff_ms)
-                    delay_ms = max_backoff_ms;
+/** @brief Ends a worker's use of Wi-Fi started with `net_wifi_acquire`. */
+static void net_wifi_release(void) {
+    xSemaphoreTake(net_wifi_mutex, portMAX_DELAY);
+    if (--net_wifi_users == 0) {
+        xSemaphoreGive(xWifi);
+    }
+    xSemaphoreGive(net_wifi_mutex);
+}
+
+/** @brief Set by a resume of the radio, so the reconnection does not start a new bootstrap. */
+static bool net_radio_resumed;
+/** @brief When the current radio session started, for the log. */
+static int64_t net_radio_started_us;
+
+/**
+ * @brief Switches Wi-Fi on or off to match the network work that is left.
+ *
+ * The radio is needed while a holder still plans to queue requests, or requests are queued
+ * or being processed. Once neither is the case, the pooled connections are closed and Wi-Fi
+ * is stopped at once, even if the screen is still being rendered; deep sleep does not have
+ * to come first. The next request resumes it, and wifi_manager reconnects on the saved
+ * channel and lease. The radio stays on while the SoftAP of the setup portal runs.
+ */
+static void net_radio_update(void) {
+#ifdef CONFIG_NET_RADIO_STOP_WHEN_IDLE
+    if (net_radio_mutex == NULL) {
+        return; // Before netStartup; it switches the radio on itself
+    }
+    xSemaphoreTake(net_radio_mutex, portMAX_DELAY);
+    // Decided with the queue locked: a request queued after this sees the radio off and
+    // resumes it, once this call is done
+    xSemaphoreTake(net_sched_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&net_radio_hold_lock);
+    bool wanted = net_radio_holds != 0;
+    taskEXIT_CRITICAL(&net_radio_hold_lock);
+    wanted |= net_busy > 0 || net_sched_next() >= 0 || wifi_manager_is_ap_started();
+    bool was_on = net_radio_on;
+    net_radio_on = wanted;
+    xSemaphoreGive(net_sched_mutex);
+
+    if (wanted && !was_on) {
+        ESP_LOGI(TAG, "Network work queued, resuming Wi-Fi.");
+        net_radio_started_us = esp_timer_get_time();
+        wifi_manager_resume_sta_async();
+    } else if (!wanted && was_on) {
+        ESP_LOGI(TAG, "Radio session done after %lu ms, stopping Wi-Fi.",
+                 (unsigned long)((esp_timer_get_time() - net_radio_started_us) / 1000));
+        // Requests queued from now on wait for the resumed connection
+        xEventGroupClearBits(net_event_group, NET_WIFI_CONNECTED_BIT);
+        net_pool_close_idle(0); // The workers are idle, so all connections are
+        wifi_manager_stop_sta_async();
+    }
+    xSemaphoreGive(net_radio_mutex);
+#endif
+}
+
+/**
+ * @brief Keeps the radio on while `holder` still plans to queue requests.
+ *
+ * Does not switch a stopped radio on; the first request the holder queues does.
+ */
+void net_radio_hold(net_radio_hold_t holder) {
+    taskENTER_CRITICAL(&net_radio_hold_lock);
+    net_radio_holds |= 1u << holder;
+    taskEXIT_CRITICAL(&net_radio_hold_lock);
+}
+
+/**
+ * @brief Ends a hold of `net_radio_hold`, stopping the radio if no other work is left.
+ */
+void net_radio_release(net_radio_hold_t holder) {
+    taskENTER_CRITICAL(&net_radio_hold_lock);
+    net_radio_holds &= ~(1u << holder);
+    taskEXIT_CRITICAL(&net_radio_hold_lock);
+    net_radio_update();
+}
+
+/**
+ * @brief Called by wifi_manager once Wi-Fi is stopped.
+ *
+ * @param pvParameter Unused.
+ */
+static void cb_radio_stopped(void *pvParameter) { wake_profile_radio(false); }
+
+/**
+ * @brief Called by wifi_manager when Wi-Fi is started again, before it reconnects.
+ *
+ * @param pvParameter Unused.
+ */
+static void cb_radio_resumed(void *pvParameter) {
+    net_radio_resumed = true;
+    wake_profile_radio(true);
+}
+
+/** @brief Returns the request-line method for an esp_http_client method. */
+static const char *net_method_name(esp_http_client_method_t method) {
+    switch (method) {
+    case HTTP_METHOD_POST:
+        return "POST";
+    case HTTP_METHOD_PUT:
+        return "PUT";
+    case HTTP_METHOD_DELETE:
+        return "DELETE";
+    default:
+        return "GET";
+    }
+}
+
+/**
+ * @brief Sends one request on a pooled connection and reads the response into the
+ * event buffer, or passes it to the event's `on_data` sink in chunks.
+ *
+ * The remaining response body is discarded so the connection can carry the next request.
+ * `https_client` closes the connection itself on any failure.
+ *
+ * @param conn  The connection.
+ * @param event The request; its response buffer receives the body.
+ * @return ESP_OK on success, or the error from the failing step.
+ */
+static esp_err_t net_perform_request(https_conn_t *conn, net_event_t *event) {
+    char auth_header[AUTH_TOKEN_MAX_LEN + 8]; // "Bearer " + token
+    esp_err_t err = ESP_OK;
+
+    https_request_t req = {
+        .method = net_method_name(event->method),
+        .url = event->url,
+    };
+    if (event->use_jwt) {
+        const size_t prefix_len = strlen("Bearer ");
+        strcpy(auth_header, "Bearer ");
+        if (auth_get_token(auth_header + prefix_len, sizeof(auth_header) - prefix_len)) {
+            req.authorization = auth_header;
+        }
+    }
+    if (event->method == HTTP_METHOD_POST && event->post_data) {
+        req.body = event->post_data;
+        req.body_len = strlen(event->post_data);
+    }
+
+    err = https_request(conn, &req);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Request to %s failed: %s", event->url, esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGD(TAG, "HTTP %d %s", conn->status_code, event->url);
+    event->status_code = conn->status_code;
+
+    if (event->on_data) {
+        // Stream the body to the request's sink in constant memory
+        char chunk[512];
+        int read_len;
+        event->on_data(event, NULL, 0);
+        while ((read_len = https_read(conn, chunk, sizeof(chunk))) > 0) {
+            err = event->on_data(event, chunk, read_len);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Response sink for %s failed: %s", event->url, esp_err_to_name(err));
+                https_close(conn); // Don't drain the rest of a rejected body
+                return err;
+            }
+        }
+        if (read_len < 0) {
+            ESP_LOGE(TAG, "Failed to read response data");
+            err = ESP_FAIL;
+        }
+    } else if (event->response_buffer) {
+        int total_read_len = 0;
+        int read_len = 0;
+        while (total_read_len < event->response_buffer_size - 1) {
+            read_len = https_read(conn, event->response_buffer + total_read_len,
+                                  event->response_buffer_size - 1 - total_read_len);
+            if (read_len <= 0) {
+                break;
+            }
+            total_read_len += read_len;
+        }
+        event->response_buffer[total_read_len] = '\0'; // Null terminate
+        if (read_len < 0) {
+            ESP_LOGE(TAG, "Failed to read response data");
+            err = ESP_FAIL;
+        } else if (!conn->body_done) {
+            ESP_LOGW(TAG, "Response larger than buffer (%d). Truncating.",
+                     event->response_buffer_size);
+        }
+    }
+
+    // Consume and discard rest of the body so the connection can be reused
+    esp_err_t finish_err = https_finish(conn);
+    return err != ESP_OK ? err : finish_err;
+}
+
+/**
+ * @brief Performs a request, retrying once on a fresh connection if a kept-alive one
+ * failed (e.g. the server closed it while idle).
+ */
+static esp_err_t net_send(https_conn_t *conn, net_event_t *event) {
+    bool reused = https_is_connected(conn);
+    esp_err_t err = net_perform_request(conn, event);
+    if (err != ESP_OK && reused) {
+        ESP_LOGW(TAG, "Kept-alive connection failed (%s), reconnecting.", esp_err_to_name(err));
+        https_close(conn);
+        err = net_perform_request(conn, event);
+    }
+    return err;
+}
+
+/**
+ * @brief Logs in from a worker and stores the new token.
+ *
+ * Used to refresh a missing or expiring token before a request that needs it, and to
+ * recover from a rejected token, without queueing a separate request. Logins are
+ * serialised, and skipped if another worker has already replaced the token: for a refresh,
+ * if the token no longer needs one; for a rejected token, if a login succeeded since
+ * `generation` was read.
+ *
+ * @param conn       The worker's connection.
+ * @param rejected   `true` if the server rejected the current token.
+ * @param generation Value of `net_login_generation` when the rejected request was sent.
+ * @return ESP_OK if a new token was stored or is already available.
+ */
+static esp_err_t net_login(https_conn_t *conn, bool rejected, uint32_t generation) {
+    xSemaphoreTake(net_login_mutex, portMAX_DELAY);
+    if (rejected ? net_login_generation != generation : !auth_needs_refresh()) {
+        xSemaphoreGive(net_login_mutex);
+        return ESP_OK;
+    }
+    if (rejected) {
+        auth_invalidate();
+    }
+
+    char buffer[512];
+    net_event_t login = {
+        .url = LOGIN_URL,
+        .method = HTTP_METHOD_POST,
+        .post_data = LOGIN_POST_DATA,
+        .response_buffer = buffer,
+        .response_buffer_size = sizeof(buffer),
+    };
+    esp_err_t err = net_send(conn, &login);
+    if (err == ESP_OK && login.status_code != 200) {
+        err = ESP_FAIL;
+    }
+    if (err == ESP_OK) {
+        cJSON *root = cJSON_Parse(buffer);
+        err = net_store_login_token(root);
+        cJSON_Delete(root);
+    }
+    if (err == ESP_OK) {
+        net_login_generation++;
+    } else {
+        ESP_LOGE(TAG, "Login failed: %s, status %d", esp_err_to_name(err), login.status_code);
+    }
+    xSemaphoreGive(net_login_mutex);
+    return err;
+}
 
-                ESP_LOGW("NET_TASK", "Request failed, retry %u/%u after %lu ms", try_count + 1,
-                         max_retry, (unsigned long)delay_ms);
-                vTaskDelay(delay_ms / portTICK_PERIOD_MS);
-                try_count++;
+/**
+ * @brief Sends a request on a pooled connection, logging in first or again if needed.
+ *
+ * Holds the connection and Wi-Fi only for this attempt, so other workers can use them
+ * during the retry backoff. The connection's timings of the request go into `sample`.
+ */
+static esp_err_t net_attempt(net_event_t *event, net_stats_sample_t *sample) {
+    net_pool_conn_t *pc = net_pool_acquire(event->url);
+    net_wifi_acquire();
+    xEventGroupWaitBits(net_event_group, NET_WIFI_CONNECTED_BIT, false, true, portMAX_DELAY);
+    if (event->use_jwt && auth_needs_refresh()) {
+        net_login(&pc->conn, false, 0);
+    }
+    uint32_t generation = net_login_generation;
+    esp_err_t err = net_send(&pc->conn, event);
+    if (err == ESP_OK && event->use_jwt &&
+        (event->status_code == 401 || event->status_code == 403)) {
+        ESP_LOGW(TAG, "Token rejected (HTTP %d), logging in again.", event->status_code);
+        if (net_login(&pc->conn, true, generation) == ESP_OK) {
+            err = net_send(&pc->conn, event);
+        }
+    }
+    const https_timing_t *timing = &pc->conn.timing;
+    sample->us[NET_PHASE_DNS] = timing->dns_us;
+    sample->us[NET_PHASE_CONNECT] = timing->connect_us;
+    sample->us[NET_PHASE_TTFB] = timing->ttfb_us;
+    sample->us[NET_PHASE_BODY] = timing->body_us;
+    sample->tx_bytes = timing->tx_bytes;
+    sample->rx_bytes = timing->rx_bytes;
+    sample->reused = timing->reused;
+    sample->attempts++;
+    net_wifi_release();
+    net_pool_release(pc);
+    return err;
+}
+
+/**
+ * @brief Performs a request with retries, following the shared circuit breaker.
+ *
+ * @param event  The request.
+ * @param sample Receives the timings of the last attempt and the number of attempts.
+ * @return The result passed to the event's `on_finish`.
+ */
+static esp_err_t net_process(net_event_t *event, net_stats_sample_t *sample) {
+    const uint8_t max_retry = 5; // Hardcoded maximum number of retries.
+    uint8_t try_count = 0;
+    uint32_t delay_ms;
+    esp_err_t err;
+    while (1) {
+        // While the server is known to be down, background requests fail at once and
+        // other requests only wait if the next probe is due soon.
+        if (!net_health_allow(&delay_ms)) {
+            if (event->priority == NET_PRIO_BACKGROUND || delay_ms > NET_UNAVAILABLE_MAX_WAIT_MS ||
+                try_count >= max_retry) {
+                ESP_LOGW(TAG, "Server unavailable, failing %s.", event->url);
+                return NET_ERR_SERVER_UNAVAILABLE;
             }
-            if (event.on_finish) {
-                event.on_finish(&event, err);
+            ESP_LOGW(TAG, "Server unavailable, waiting %lu ms before %s.", (unsigned long)delay_ms,
+                     event->url);
+            if (net_sched_backoff(event->priority, delay_ms)) {
+                return NET_ERR_SERVER_UNAVAILABLE;
             }
+            try_count++;
+            continue;
         }
+
+        err = net_attempt(event, sample);
+
+        // Automatically parse JSON if requested.
+        if (err == ESP_OK && event->response_buffer) {
+            int64_t parse_start = esp_timer_get_time();
+            cJSON *parsed_json = cJSON_Parse(event->response_buffer);
+            sample->us[NET_PHASE_PARSE] = esp_timer_get_time() - parse_start;
+            if (!parsed_json) {
+                ESP_LOGW(TAG, "Failed to parse JSON from response: %s", event->response_buffer);
+            }
+            event->json_root = parsed_json; // Store parsed result (or NULL if failed)
+        } else if (event->json_root != NULL) { // If parsing was requested but HTTP failed
+            event->json_root = NULL;
+        }
+
+        // Connection errors and server errors count against the shared circuit breaker.
+        if (net_health_report(err == ESP_OK && event->status_code < 500)) {
+            net_sched_fail_background();
+        }
+        if (err == ESP_OK || try_count >= max_retry) {
+            return err;
+        }
+
+        delay_ms = net_health_retry_delay_ms();
+        ESP_LOGW(TAG, "Request failed, retry %u/%u after %lu ms", try_count + 1, max_retry,
+                 (unsigned long)delay_ms);
+        if (net_sched_backoff(event->priority, delay_ms)) {
+            ESP_LOGW(TAG, "Giving up on %s, more urgent requests are waiting.", event->url);
+            return err;
+        }
+        try_count++;
+    }
+}
+
+/**
+ * @brief A worker task that processes network requests from a queue.
+ *
+ * CONFIG_NET_WORKER_COUNT of these tasks take `net_event_t` items from the request
+ * scheduler, highest priority first, so a slow download on one worker does not hold up
+ * the request for the displayed day. For each event, a worker performs an HTTP request
+ * with retry logic and exponential backoff. It handles setting JWT headers, posting data,
+ * receiving responses, and optionally parsing the response as JSON. After the request is
+ * complete (or has failed after all retries), it calls the `on_finish` callback specified
+ * in the event. A retry backoff is cut short when a request with a higher priority is
+ * queued and no other worker is free, so a failing background request never holds up the
+ * displayed day.
+ *
+ * Workers share a pool of persistent connections, so consecutive requests to the server
+ * reuse a TLS connection; at most CONFIG_NET_MAX_CONNS_PER_HOST are used for one server at
+ * a time. A new connection resumes the TLS session saved by `tls_session` where possible.
+ * A failure on a reused connection (e.g. the server closed it while idle) is retried once
+ * on a fresh connection without counting as a failed attempt. Connections are closed after
+ * `NET_KEEPALIVE_IDLE_MS` without requests.
+ *
+ * Requests are done in radio sessions: when the last one finishes and no `net_radio_hold`
+ * holder plans more, the connections are closed and Wi-Fi is stopped right away; the next
+ * queued request starts it again.
+ *
+ * A request without `response_buffer` but with a `response_buffer_size` gets a buffer of
+ * its own, freed after `on_finish` returns, so parallel requests never share one.
+ *
+ * The time of each phase (DNS, connect, first byte, body, JSON parse, callback) and the
+ * bytes transferred are recorded per endpoint by `net_stats`, which uploads a summary
+ * after the next successful connection to the server.
+ *
+ * The JWT comes from `auth_manager` without touching NVS. If it is missing or about to
+ * expire, the worker logs in first; if the server rejects it (401/403), the worker logs in
+ * and repeats the request once.
+ *
+ * Failures of all requests feed one circuit breaker (`net_health`). Retries back off
+ * exponentially with jitter based on the shared failure count. Once the breaker opens,
+ * queued and new background requests fail with NET_ERR_SERVER_UNAVAILABLE without
+ * touching the network, and other requests fail too unless the next probe is due within
+ * NET_UNAVAILABLE_MAX_WAIT_MS. The breaker state survives deep sleep.
+ *
+ * @param pvParameters Unused.
+ */
+void net_worker_task(void *pvParameters) {
+    net_event_t event;
+    bool idle_open = false; // Pooled connections are open and waiting to be closed
+    for (;;) {
+        TickType_t wait = idle_open ? pdMS_TO_TICKS(NET_KEEPALIVE_IDLE_MS) : portMAX_DELAY;
+        if (!net_sched_take(&event, wait)) {
+            idle_open = net_pool_close_idle(pdMS_TO_TICKS(NET_KEEPALIVE_IDLE_MS));
+            continue;
+        }
+
+        wake_profile_mark(WAKE_PHASE_FIRST_REQUEST);
+        esp_err_t err;
+        net_stats_sample_t sample = {0};
+        int64_t start = esp_timer_get_time();
+        char *owned_buffer = NULL;
+        if (event.response_buffer == NULL && event.response_buffer_size > 0) {
+            owned_buffer = calloc(1, event.response_buffer_size);
+            event.response_buffer = owned_buffer;
+        }
+        if (event.response_buffer_size > 0 && event.response_buffer == NULL) {
+            ESP_LOGE(TAG, "No memory for the response of %s", event.url);
+            err = ESP_ERR_NO_MEM;
+        } else {
+            err = net_process(&event, &sample);
+        }
+        char path[NET_STATS_PATH_LEN]; // The URL may be freed by on_finish
+        net_stats_url_path(event.url, path, sizeof(path));
+        int64_t callback_start = esp_timer_get_time();
+        if (event.on_finish) {
+            event.on_finish(&event, err);
+        }
+        int64_t end = esp_timer_get_time();
+        sample.us[NET_PHASE_CALLBACK] = end - callback_start;
+        sample.us[NET_PHASE_TOTAL] = end - start;
+        net_stats_record(path, err != ESP_OK || event.status_code >= 500, &sample);
+        free(owned_buffer);
+        net_sched_done();
+        idle_open = true;
     }
 }
 
@@ -554,16 +1446,17 @@ static void check_auth_result_callback(net_event_t *event, esp_err_t err) {
                 ESP_LOGI(TAG, "Status: %s", status);
                 ev.msg[26] = '\0'; // Ensure string is null-terminated
                 strncat(ev.msg, status, MAX_MSG_LEN - strlen(ev.msg) - 1);
-                xQueueSend(gui_queue, &ev, portMAX_DELAY);
+                ui_send_event(&ev);
                 xSemaphoreTake(xScreen, portMAX_DELAY);
                 ec11_set_button_callback(xButtonSettingDoneHandle);
                 xSemaphoreGive(xScreen);
-                xQueueSend(gui_queue, &evqr, portMAX_DELAY);
+                ui_send_event(&evqr);
             }
         } else {
             http_response_save_to_nvs(event->json_root, "calendar", "access_token");
             http_response_save_to_nvs(event->json_root, "calendar", "refresh_token");
             xEventGroupSetBits(net_event_group, NET_GOOGLE_TOKEN_AVAILABLE_BIT);
+            net_radio_hold(NET_RADIO_HOLD_PREFETCH);
             xTaskNotifyGive(xCalendarPrefetchHandle);
             if (!isr_woken) {
                 xTaskNotify(xCalendarDisplayHandle, 0, eSetValueWithOverwrite);
@@ -590,15 +1483,16 @@ void cb_button_setting_done(void *pvParameters) {
         .method = HTTP_METHOD_GET,
         .post_data = NULL,
         .use_jwt = true,
-        .response_buffer = responseBuffer,
-        .response_buffer_size = sizeof(responseBuffer),
+        .response_buffer_size = NET_RESPONSE_BUFFER_SIZE,
         .on_finish = check_auth_result_callback,
         .user_data = NULL,
+        .priority = NET_PRIO_AUTH,
+        .key = NET_KEY_AUTH_RESULT,
     };
     for (;;) {
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         ec11_clean_button_callback();
-        xQueueSend(net_queue, &event, portMAX_DELAY);
+        net_submit(&event, portMAX_DELAY);
     }
 }
 
@@ -619,16 +1513,23 @@ void cb_connection_ok(void *pvParameter) {
     esp_ip4addr_ntoa(&param->ip_info.ip, str_ip, IP4ADDR_STRLEN_MAX);
 
     ESP_LOGI(TAG, "I have a connection and my IP is %s!", str_ip);
+    wake_profile_mark(WAKE_PHASE_WIFI_UP);
     xEventGroupSetBits(net_event_group, NET_WIFI_CONNECTED_BIT);
+    if (net_radio_resumed) {
+        // The radio was only stopped between bursts: the session with the server still holds
+        net_radio_resumed = false;
+        return;
+    }
     if (!isr_woken) {
         event_t ev = {
             .event_id = SCREEN_EVENT_CENTER,
             .msg = "WiFi connected:)",
         };
-        xQueueSend(gui_queue, &ev, portMAX_DELAY);
+        ui_send_event(&ev);
     }
     xSemaphoreGive(xWifi);
-    server_check(); // Check server connection
+    server_check();      // Check server connection
+    net_wifi_wait_end(); // After queueing the check, so the device stays awake in between
 }
 
 /**
@@ -646,26 +1547,55 @@ void cb_wifi_required(void *pvParameter) {
         .event_id = SCREEN_EVENT_WIFI_REQUIRED,
         .msg = "WiFi required, switching to AP mode",
     };
-    xQueueSend(gui_queue, &ev, portMAX_DELAY);
+    ui_send_event(&ev);
     ec11_set_button_callback(xCbContinueNoWifiHandle);
 }
 
 /**
  * @brief Initializes the network components and starts all related tasks.
  *
- * This function should be called once at startup. It starts the wifi_manager,
- * sets up callbacks for Wi-Fi events, creates the network request queue, and
+ * This function should be called once at startup. It initializes the credential cache
+ * and its refresh timer and the circuit breaker, creates the request scheduler, starts
+ * the first radio session and the wifi_manager, sets up callbacks for Wi-Fi events, and
  * creates all the tasks responsible for handling network operations and related
  * button callbacks.
  *
  * @param pvParameters Unused.
  */
 void netStartup(void *pvParameters) {
+    boot_wait(BOOT_NVS_READY_BIT); // Wi-Fi credentials and the login are kept in NVS
+    auth_init();
+    net_health_init();
+    net_stats_init();
+    tls_session_init();
+    const esp_timer_create_args_t refresh_timer_args = {
+        .callback = auth_refresh_timer_cb,
+        .name = "auth_refresh",
+    };
+    esp_timer_create(&refresh_timer_args, &auth_refresh_timer);
+    net_sched_mutex = xSemaphoreCreateMutex();
+    net_sched_ready = xSemaphoreCreateCounting(NET_QUEUE_SIZE, 0);
+    net_sched_space = xSemaphoreCreateBinary();
+    net_pool_mutex = xSemaphoreCreateMutex();
+    net_pool_released = xSemaphoreCreateBinary();
+    net_wifi_mutex = xSemaphoreCreateMutex();
+    net_login_mutex = xSemaphoreCreateMutex();
+    // The first radio session lasts until the bootstrap has queued the work of this wake
+    net_radio_hold(NET_RADIO_HOLD_CONNECT);
+    net_radio_on = true;
+    net_radio_started_us = esp_timer_get_time();
+    net_radio_mutex = xSemaphoreCreateMutex();
+    wake_profile_radio(true);
     wifi_manager_start();
     wifi_manager_set_callback(WM_EVENT_STA_GOT_IP, &cb_connection_ok);
     wifi_manager_set_callback(WM_ORDER_START_AP, &cb_wifi_required);
-    net_queue = xQueueCreate(NET_QUEUE_SIZE, sizeof(net_event_t));
-    xTaskCreate(net_worker_task, "net_worker_task", 8192, NULL, 4, NULL);
+    wifi_manager_set_callback(WM_ORDER_STOP_STA, &cb_radio_stopped);
+    wifi_manager_set_callback(WM_ORDER_RESUME_STA, &cb_radio_resumed);
+    for (int i = 0; i < CONFIG_NET_WORKER_COUNT; ++i) {
+        char name[configMAX_TASK_NAME_LEN];
+        snprintf(name, sizeof(name), "net_worker_%d", i);
+        xTaskCreate(net_worker_task, name, 8192, NULL, 4, &net_workers[i]);
+    }
     xTaskCreate(cb_button_wifi_settings, "cb_button_wifi_settings", 2048, NULL, 4,
                 &xServerCheckCallbackHandle);
     xTaskCreate(cb_button_setting_done, "cb_button_setting_done", 2048, NULL, 4,
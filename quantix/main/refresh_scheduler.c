@@ -0,0 +1,249 @@
+#include "refresh_scheduler.h"
+#include "EPD_2in9.h"
+#include "EPD_store.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "wake_profile.h"
+#include <stdint.h>
+#include <time.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "REFRESH_SCHED";
+
+/** @brief Magic value marking `refresh_state` as initialised. */
+#define REFRESH_STATE_MAGIC 0x52465348
+/** @brief Earliest year treated as a synchronised wall clock. */
+#define REFRESH_MIN_VALID_YEAR 2023
+
+/** @brief Ghosting bookkeeping kept in RTC memory so it survives deep sleep. */
+typedef struct {
+    uint32_t magic;         /**< REFRESH_STATE_MAGIC once initialised. */
+    uint32_t ghost_score;   /**< Accumulated ghosting cost since the last full refresh. */
+    uint16_t partial_count; /**< Partial refreshes since the last full refresh. */
+    uint16_t fast_count;    /**< Fast refreshes since the last full refresh. */
+    time_t last_full_ts;    /**< Wall-clock time of the last full refresh (0 if unknown). */
+} refresh_state_t;
+
+/** @brief Refresh history, preserved across deep sleep. */
+RTC_DATA_ATTR static refresh_state_t refresh_state;
+
+/**
+ * @brief Whether the controller's "old" RAM matches what is on the glass.
+ *
+ * The panel loses its RAM when the module is powered down during deep sleep, so this
+ * deliberately lives in normal RAM and starts out false on every boot.
+ */
+static bool panel_base_valid = false;
+
+/** @brief Returns the ghosting cost added by a refresh of the given mode. */
+static uint32_t refresh_cost(epd_refresh_mode_t mode) {
+    switch (mode) {
+    case EPD_REFRESH_PARTIAL:
+        return CONFIG_EPD_GHOST_COST_PARTIAL;
+    case EPD_REFRESH_FAST:
+        return CONFIG_EPD_GHOST_COST_FAST;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Reads the wall clock if it has been synchronised.
+ *
+ * @param now_out Receives the current time.
+ * @param tm_out  Receives the broken-down local time.
+ * @return `true` if the clock looks valid, `false` before the first SNTP sync.
+ */
+static bool refresh_get_time(time_t *now_out, struct tm *tm_out) {
+    time(now_out);
+    localtime_r(now_out, tm_out);
+    return tm_out->tm_year >= (REFRESH_MIN_VALID_YEAR - 1900);
+}
+
+/** @brief Returns true if `hour` falls inside the configured night window. */
+static bool refresh_is_night(int hour) {
+    if (CONFIG_EPD_NIGHT_START_HOUR <= CONFIG_EPD_NIGHT_END_HOUR) {
+        return hour >= CONFIG_EPD_NIGHT_START_HOUR && hour < CONFIG_EPD_NIGHT_END_HOUR;
+    }
+    return hour >= CONFIG_EPD_NIGHT_START_HOUR || hour < CONFIG_EPD_NIGHT_END_HOUR;
+}
+
+/**
+ * @brief Chooses the cheapest waveform that keeps ghosting within budget.
+ *
+ * A full refresh is forced when the refresh history is unknown, when the ghosting
+ * budget would be exceeded, or when the last full refresh is older than the configured
+ * maximum age (counted from the first refresh committed with a valid clock). During the
+ * night window a full refresh is taken opportunistically once some ghosting has
+ * accumulated. Otherwise a partial refresh is used if the controller RAM matches the
+ * glass, falling back to a fast refresh. Nothing is changed, so it can be called as a query.
+ *
+ * @return The waveform to use for the next refresh.
+ */
+epd_refresh_mode_t refresh_scheduler_select(void) {
+    if (refresh_state.magic != REFRESH_STATE_MAGIC) {
+        ESP_LOGI(TAG, "No refresh history, using full refresh.");
+        return EPD_REFRESH_FULL;
+    }
+
+    time_t now;
+    struct tm now_tm;
+    if (refresh_get_time(&now, &now_tm)) {
+        // last_full_ts 為 0 表示還沒有有效時間的紀錄，由 commit 開始計算
+        if (refresh_state.last_full_ts != 0 &&
+            now - refresh_state.last_full_ts >= CONFIG_EPD_FULL_REFRESH_MAX_HOURS * 3600) {
+            ESP_LOGI(TAG, "Last full refresh older than %d h, using full refresh.",
+                     CONFIG_EPD_FULL_REFRESH_MAX_HOURS);
+            return EPD_REFRESH_FULL;
+        }
+        if (refresh_is_night(now_tm.tm_hour) &&
+            refresh_state.ghost_score >= CONFIG_EPD_NIGHT_FULL_THRESHOLD) {
+            ESP_LOGI(TAG, "Night window, ghost score %lu, using full refresh.",
+                     (unsigned long)refresh_state.ghost_score);
+            return EPD_REFRESH_FULL;
+        }
+    }
+
+    if (panel_base_valid &&
+        refresh_state.ghost_score + refresh_cost(EPD_REFRESH_PARTIAL) <= CONFIG_EPD_GHOST_BUDGET) {
+        return EPD_REFRESH_PARTIAL;
+    }
+    if (refresh_state.ghost_score + refresh_cost(EPD_REFRESH_FAST) <= CONFIG_EPD_GHOST_BUDGET) {
+        return EPD_REFRESH_FAST;
+    }
+    ESP_LOGI(TAG, "Ghost budget exhausted (%lu/%d), using full refresh.",
+             (unsigned long)refresh_state.ghost_score, CONFIG_EPD_GHOST_BUDGET);
+    return EPD_REFRESH_FULL;
+}
+
+/**
+ * @brief Records a completed refresh.
+ *
+ * A full refresh resets the ghosting score and counters; partial and fast refreshes add
+ * their configured cost. Every mode leaves the controller's old RAM equal to the glass.
+ * If the time of the last full refresh is unknown, the age is counted from this one.
+ *
+ * @param mode The waveform that was used.
+ */
+void refresh_scheduler_commit(epd_refresh_mode_t mode) {
+    time_t now;
+    struct tm now_tm;
+    bool time_valid = refresh_get_time(&now, &now_tm);
+
+    if (mode == EPD_REFRESH_FULL || refresh_state.magic != REFRESH_STATE_MAGIC) {
+        refresh_state.magic = REFRESH_STATE_MAGIC;
+        refresh_state.ghost_score = 0;
+        refresh_state.partial_count = 0;
+        refresh_state.fast_count = 0;
+        refresh_state.last_full_ts = time_valid ? now : 0;
+    } else if (refresh_state.last_full_ts == 0 && time_valid) {
+        refresh_state.last_full_ts = now;
+    }
+    if (mode == EPD_REFRESH_PARTIAL) {
+        refresh_state.partial_count++;
+    } else if (mode == EPD_REFRESH_FAST) {
+        refresh_state.fast_count++;
+    }
+    refresh_state.ghost_score += refresh_cost(mode);
+    panel_base_valid = true;
+    ESP_LOGI(TAG, "Refresh mode %d done. Ghost score %lu/%d (partial %u, fast %u)", mode,
+             (unsigned long)refresh_state.ghost_score, CONFIG_EPD_GHOST_BUDGET,
+             refresh_state.partial_count, refresh_state.fast_count);
+}
+
+/**
+ * @brief Reloads the image that is physically on the glass into the controller RAM.
+ *
+ * Called once at screen start-up. The copy kept in RTC memory survives deep sleep; after
+ * a cold boot the LittleFS copy written before the last sleep is used instead. Either way
+ * the boot-time panel clear can be skipped. Only the RTC copy is sure to match the glass,
+ * so only then may the next refresh be a partial one: the LittleFS copy is flushed on the
+ * way into deep sleep and may be one refresh older after a reset or brown-out, so it is
+ * followed by a fast or full refresh. A cold boot also loses the RTC ghosting history, so
+ * it is seeded at half the budget.
+ *
+ * @param scratch Buffer of EPD_2IN9_V2_IMAGE_SIZE bytes, overwritten.
+ * @return `true` if the controller now holds the image on the glass.
+ */
+bool refresh_scheduler_restore_base(UBYTE *scratch) {
+    if (scratch == NULL) {
+        return false;
+    }
+    epd_store_source_t source = EPD_Store_Recall(scratch);
+    if (source == EPD_STORE_NONE) {
+        ESP_LOGI(TAG, "No stored panel image, panel content unknown.");
+        return false;
+    }
+
+    EPD_2IN9_V2_Load_Base(scratch);
+    panel_base_valid = source == EPD_STORE_RTC;
+    if (refresh_state.magic != REFRESH_STATE_MAGIC) {
+        refresh_state.magic = REFRESH_STATE_MAGIC;
+        refresh_state.ghost_score = CONFIG_EPD_GHOST_BUDGET / 2;
+        refresh_state.partial_count = 0;
+        refresh_state.fast_count = 0;
+        refresh_state.last_full_ts = 0;
+    }
+    ESP_LOGI(TAG, "Panel image restored from %s.", source == EPD_STORE_RTC ? "RTC" : "LittleFS");
+    return true;
+}
+
+/**
+ * @brief Marks the controller RAM as no longer matching the glass.
+ */
+void refresh_scheduler_invalidate_base(void) { panel_base_valid = false; }
+
+/**
+ * @brief Returns true if an idle-time full refresh is worthwhile.
+ *
+ * Used by the UI task to clean up ghosting while nobody is interacting with the device,
+ * so that a forced full refresh is less likely to land in the middle of scrolling.
+ */
+bool refresh_scheduler_wants_maintenance(void) {
+    return refresh_state.magic == REFRESH_STATE_MAGIC &&
+           refresh_state.ghost_score >= CONFIG_EPD_IDLE_FULL_THRESHOLD;
+}
+
+/**
+ * @brief Drives the panel with the given waveform and records the refresh.
+ *
+ * Fast and full refreshes write both controller RAMs so that subsequent partial
+ * refreshes have a valid base image.
+ *
+ * @param image Frame buffer to display.
+ * @param mode  Waveform to use.
+ */
+void screen_refresh_with(UBYTE *image, epd_refresh_mode_t mode) {
+    wake_profile_mark(WAKE_PHASE_RENDER_DONE);
+    switch (mode) {
+    case EPD_REFRESH_PARTIAL:
+        EPD_2IN9_V2_Display_Partial(image);
+        break;
+    case EPD_REFRESH_FAST:
+        EPD_2IN9_V2_Init_Fast();
+        EPD_2IN9_V2_Display_Base(image);
+        break;
+    case EPD_REFRESH_FULL:
+    default:
+        EPD_2IN9_V2_Init();
+        EPD_2IN9_V2_Display_Base(image);
+        mode = EPD_REFRESH_FULL;
+        break;
+    }
+    refresh_scheduler_commit(mode);
+    EPD_Store_Remember(image);
+    wake_profile_mark(WAKE_PHASE_REFRESH_DONE);
+}
+
+/**
+ * @brief Refreshes the panel with the waveform chosen by the scheduler.
+ *
+ * @param image Frame buffer to display.
+ * @return The waveform that was used.
+ */
+epd_refresh_mode_t screen_refresh(UBYTE *image) {
+    epd_refresh_mode_t mode = refresh_scheduler_select();
+    screen_refresh_with(image, mode);
+    return mode;
+}
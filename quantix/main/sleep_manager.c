@@ -1,12 +1,271 @@
 #include "sleep_manager.h"
 #include "EC11_driver.h"
-#include "esp_sleep.h" // For deep sleep wakeup cause
+#include "EPD_store.h"
+#include "calendar.h"
+#include "clock_face.h"
+#include "driver/rtc_io.h" // For RTC GPIO pull-up/down control
+#include "esp_sleep.h"     // For deep sleep wakeup cause
+#include "freertos/semphr.h"
+#include "sync_scheduler.h"
 #include "task_handles.h"
+#include "wake_profile.h"
+#include <stdio.h>
 
 #define TAG "SleepManager"
 
+/** @brief Bit in `sleep_event_group`: the user interaction is over, sleep once idle. */
+#define SLEEP_REQUESTED_BIT BIT0
+/** @brief Bit in `sleep_event_group`: no activity holds the device awake. */
+#define SLEEP_IDLE_BIT BIT1
+
 RTC_DATA_ATTR bool isr_woken = false;
 
+/** @brief Names of the activities, for the diagnostic log. */
+static const char *const sleep_hold_names[SLEEP_HOLD_COUNT] = {
+    [SLEEP_HOLD_WIFI] = "wifi",
+    [SLEEP_HOLD_NET] = "net",
+    [SLEEP_HOLD_SCREEN] = "screen",
+    [SLEEP_HOLD_STORAGE] = "storage",
+    [SLEEP_HOLD_PREFETCH] = "prefetch",
+};
+
+/** @brief Sleep request and idle state, waited on by `deep_sleep_manager_task`. */
+static EventGroupHandle_t sleep_event_group;
+/** @brief Protects the counts below and keeps `SLEEP_IDLE_BIT` in step with them. */
+static SemaphoreHandle_t sleep_mutex;
+/** @brief Reference count of each activity. */
+static int sleep_holds[SLEEP_HOLD_COUNT];
+/** @brief Sum of `sleep_holds`. */
+static int sleep_hold_total;
+/** @brief Set once the device is entering deep sleep; new activities would be cut off. */
+static bool sleep_committed;
+
+/**
+ * @brief Creates the sleep state. The device starts idle but without a sleep request.
+ */
+void sleep_manager_init(void) {
+    sleep_event_group = xEventGroupCreate();
+    sleep_mutex = xSemaphoreCreateMutex();
+    if (sleep_event_group == NULL || sleep_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create the sleep state!");
+        return;
+    }
+    xEventGroupSetBits(sleep_event_group, SLEEP_IDLE_BIT);
+}
+
+/** @brief Counts one more `holder`. Must be called with `sleep_mutex` held. */
+static void sleep_manager_add(sleep_hold_t holder) {
+    sleep_holds[holder]++;
+    if (sleep_hold_total++ == 0) {
+        xEventGroupClearBits(sleep_event_group, SLEEP_IDLE_BIT);
+    }
+}
+
+/**
+ * @brief Starts an activity that keeps the device awake.
+ *
+ * Every call must be matched by `sleep_manager_release` with the same holder.
+ */
+void sleep_manager_hold(sleep_hold_t holder) {
+    xSemaphoreTake(sleep_mutex, portMAX_DELAY);
+    if (sleep_committed) {
+        ESP_LOGW(TAG, "Activity %s started while entering deep sleep.",
+                 sleep_hold_names[holder]);
+    }
+    sleep_manager_add(holder);
+    xSemaphoreGive(sleep_mutex);
+}
+
+/**
+ * @brief Starts an optional activity unless the device is already entering deep sleep.
+ *
+ * @return `true` if the activity was started and must be released.
+ */
+bool sleep_manager_try_hold(sleep_hold_t holder) {
+    xSemaphoreTake(sleep_mutex, portMAX_DELAY);
+    bool held = !sleep_committed;
+    if (held) {
+        sleep_manager_add(holder);
+    }
+    xSemaphoreGive(sleep_mutex);
+    return held;
+}
+
+/**
+ * @brief Ends an activity started with `sleep_manager_hold`.
+ *
+ * The last release sets `SLEEP_IDLE_BIT`, which sends the device to sleep right away if
+ * sleep has been requested.
+ */
+void sleep_manager_release(sleep_hold_t holder) {
+    xSemaphoreTake(sleep_mutex, portMAX_DELAY);
+    if (sleep_holds[holder] == 0) {
+        ESP_LOGE(TAG, "Unbalanced release of activity %s.", sleep_hold_names[holder]);
+    } else {
+        sleep_holds[holder]--;
+        if (--sleep_hold_total == 0) {
+            xEventGroupSetBits(sleep_event_group, SLEEP_IDLE_BIT);
+        }
+    }
+    xSemaphoreGive(sleep_mutex);
+}
+
+/** @brief Allows deep sleep as soon as no activity holds the device awake. */
+void sleep_manager_request(void) {
+    xEventGroupSetBits(sleep_event_group, SLEEP_REQUESTED_BIT);
+}
+
+/** @brief Withdraws a sleep request, e.g. because the user turned the knob again. */
+void sleep_manager_cancel_request(void) {
+    xEventGroupClearBits(sleep_event_group, SLEEP_REQUESTED_BIT);
+}
+
+/** @brief Logs the activities that currently keep the device awake. */
+void sleep_manager_log_holders(void) {
+    char list[96] = "";
+    size_t len = 0;
+    xSemaphoreTake(sleep_mutex, portMAX_DELAY);
+    for (int i = 0; i < SLEEP_HOLD_COUNT && len < sizeof(list); ++i) {
+        if (sleep_holds[i] > 0) {
+            len += snprintf(list + len, sizeof(list) - len, " %s=%d", sleep_hold_names[i],
+                            sleep_holds[i]);
+        }
+    }
+    xSemaphoreGive(sleep_mutex);
+    ESP_LOGI(TAG, "Kept awake by:%s", len > 0 ? list : " nothing");
+}
+
+/**
+ * @brief Commits to deep sleep if it is still requested and nothing holds the device.
+ *
+ * Checked under `sleep_mutex`, so an activity that starts at the same moment either
+ * prevents the sleep or is reported by `sleep_manager_hold`.
+ */
+static bool sleep_manager_commit(void) {
+    xSemaphoreTake(sleep_mutex, portMAX_DELAY);
+    sleep_committed = sleep_hold_total == 0 &&
+                      (xEventGroupGetBits(sleep_event_group) & SLEEP_REQUESTED_BIT) != 0;
+    bool committed = sleep_committed;
+    xSemaphoreGive(sleep_mutex);
+    return committed;
+}
+
+/**
+ * @brief Configures the wakeup sources: the knob, and a timer for the earlier of the next
+ * background sync and the next change of the clock face.
+ *
+ * @return `false` if the wakeup sources could not be set.
+ */
+static bool sleep_manager_arm(void) {
+    uint64_t ext1_wakeup_pins_mask =
+        (1ULL << PIN_BUTTON) | (1ULL << PIN_ENCODER_A) | (1ULL << PIN_ENCODER_B);
+    esp_err_t err_wakeup = esp_sleep_enable_ext1_wakeup(ext1_wakeup_pins_mask,
+                                                        ESP_EXT1_WAKEUP_ANY_LOW);
+    if (err_wakeup != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable ext1 wakeup: %s. Aborting sleep attempt.",
+                 esp_err_to_name(err_wakeup));
+        return false;
+    }
+    uint64_t wake_in_us = sync_scheduler_next_wake_us();
+    uint64_t tick_in_us = clock_face_next_tick_us();
+    if (tick_in_us > 0 && (wake_in_us == 0 || tick_in_us < wake_in_us)) {
+        wake_in_us = tick_in_us;
+    }
+    if (wake_in_us > 0) {
+        esp_sleep_enable_timer_wakeup(wake_in_us);
+    }
+
+    ec11_clean_button_callback();
+    ec11_clean_encoder_callback();
+    if (rtc_gpio_is_valid_gpio(PIN_BUTTON)) {
+        rtc_gpio_pullup_en(PIN_BUTTON);
+        rtc_gpio_pulldown_dis(PIN_BUTTON);
+    }
+    if (rtc_gpio_is_valid_gpio(PIN_ENCODER_A)) {
+        rtc_gpio_pullup_en(PIN_ENCODER_A);
+        rtc_gpio_pulldown_dis(PIN_ENCODER_A);
+    }
+    if (rtc_gpio_is_valid_gpio(PIN_ENCODER_B)) {
+        rtc_gpio_pullup_en(PIN_ENCODER_B);
+        rtc_gpio_pulldown_dis(PIN_ENCODER_B);
+    }
+    return true;
+}
+
+/**
+ * @brief Configures the wakeup sources and enters deep sleep.
+ *
+ * Returns only if the wakeup sources could not be set.
+ */
+static void sleep_manager_enter(void) {
+    if (!sleep_manager_arm()) {
+        return;
+    }
+
+    // 冷開機時用來還原面板內容
+    if (!EPD_Store_Flush()) {
+        ESP_LOGW(TAG, "Failed to save panel image.");
+    }
+
+    wake_profile_finish();
+    ESP_LOGI(TAG, "Entering deep sleep NOW.");
+    vTaskDelay(pdMS_TO_TICKS(100)); // Ensure log is flushed.
+    esp_deep_sleep_start();
+}
+
+/**
+ * @brief Enters deep sleep at once, from a wake that started no tasks or file system.
+ *
+ * Used by the early boot path of the clock face. Nothing is written to LittleFS, and the
+ * console is flushed by `esp_deep_sleep_start` itself. Returns only if the wakeup sources
+ * could not be set.
+ */
+void sleep_manager_sleep_now(void) {
+    if (!sleep_manager_arm()) {
+        return;
+    }
+    wake_profile_finish();
+    ESP_LOGI(TAG, "Entering deep sleep NOW.");
+    esp_deep_sleep_start();
+}
+
+/**
+ * @brief Manages the transition to deep sleep.
+ *
+ * Waits until sleep has been requested and the last activity has been released, then
+ * configures the wakeup sources (GPIO pins and the next background sync) and puts the
+ * device into deep sleep. While a request waits for busy activities, the holders are
+ * logged every SLEEP_HOLD_REPORT_MS.
+ *
+ * @param pvParameters Unused.
+ */
+void deep_sleep_manager_task(void *pvParameters) {
+    const EventBits_t ready = SLEEP_REQUESTED_BIT | SLEEP_IDLE_BIT;
+    ESP_LOGI(TAG, "Deep Sleep Manager task started.");
+
+    for (;;) {
+        xEventGroupWaitBits(sleep_event_group, SLEEP_REQUESTED_BIT, pdFALSE, pdTRUE,
+                            portMAX_DELAY);
+        EventBits_t bits = xEventGroupWaitBits(sleep_event_group, ready, pdFALSE, pdTRUE,
+                                               pdMS_TO_TICKS(SLEEP_HOLD_REPORT_MS));
+        if ((bits & ready) != ready) {
+            if (bits & SLEEP_REQUESTED_BIT) {
+                sleep_manager_log_holders();
+            }
+            continue;
+        }
+        if (!sleep_manager_commit()) {
+            continue;
+        }
+        sleep_manager_enter();
+        // Code only gets here if the wakeup sources could not be set
+        xSemaphoreTake(sleep_mutex, portMAX_DELAY);
+        sleep_committed = false;
+        xSemaphoreGive(sleep_mutex);
+        vTaskDelay(pdMS_TO_TICKS(SLEEP_HOLD_REPORT_MS));
+    }
+}
+
 void wakeup_handler(void) {
     // 檢查喚醒原因
     esp_sleep_wakeup_cause_t wakeup_cause = esp_sleep_get_wakeup_cause();
@@ -17,8 +276,9 @@ void wakeup_handler(void) {
         ESP_LOGI(TAG, "Woke up from deep sleep by EXT1. Wakeup pin mask: 0x%llx", wakeup_pin_mask);
         xTaskCreate(screenStartup, "screenStartup", 4096, NULL, 6, NULL);
         xTaskCreate(calendar_display, "calendar_display", 4096, NULL, 6, &xCalendarDisplayHandle);
+        // 只轉動旋鈕時先不開 Wi-Fi，按鈕喚醒則照常連線
+        calendar_start_network((wakeup_pin_mask & (1ULL << PIN_BUTTON)) == 0);
         ec11Startup();
-        font_table_init();
         ec11_set_encoder_callback(xCalendarDisplayHandle);
         xEventGroupSetBits(net_event_group, NET_CALENDAR_AVAILABLE_BIT);
         if (wakeup_pin_mask & (1ULL << PIN_BUTTON)) {
@@ -36,6 +296,17 @@ void wakeup_handler(void) {
     }
     case ESP_SLEEP_WAKEUP_TIMER:
         ESP_LOGI(TAG, "Woke up from deep sleep by timer.");
+        isr_woken = true;
+        xTaskCreate(calendar_display, "calendar_display", 4096, NULL, 6, &xCalendarDisplayHandle);
+        if (clock_face_new_day()) {
+            calendar_start_new_day_wake();
+        } else {
+            // 背景同步：螢幕先不啟動，顯示中的日期有變動或使用者轉動旋鈕時才更新
+            calendar_start_sync_wake();
+        }
+        ec11Startup();
+        ec11_set_encoder_callback(xCalendarDisplayHandle);
+        xEventGroupSetBits(net_event_group, NET_CALENDAR_AVAILABLE_BIT);
         break;
     // 其他喚醒原因，通常視為正常啟動或初次啟動
     default:
@@ -47,12 +318,12 @@ void wakeup_handler(void) {
             xTaskCreate(calendar_display, "calendar_display", 4096, NULL, 6,
                         &xCalendarDisplayHandle); // Create CalenderStartupNoWifi task
             ec11Startup();
-            font_table_init();
             ESP_LOGI(TAG, "All tasks created");
         } else {
             ESP_LOGI(TAG, "Normal boot or wake up from non-deep-sleep event (cause: %d).",
                      wakeup_cause);
         }
+        calendar_start_network(false);
         break;
     }
 }
\ No newline at end of file
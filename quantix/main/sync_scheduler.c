@@ -0,0 +1,169 @@
+#include "sync_scheduler.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include <time.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "SYNC_SCHED";
+
+/** @brief Magic value marking `sync_state` as initialised. */
+#define SYNC_STATE_MAGIC 0x53594E43
+/** @brief Earliest year treated as a synchronised wall clock. */
+#define SYNC_MIN_VALID_YEAR 2023
+
+/** @brief Background sync schedule kept in RTC memory so it survives deep sleep. */
+typedef struct {
+    uint32_t magic;      /**< SYNC_STATE_MAGIC once initialised. */
+    uint32_t interval_s; /**< Current interval between background syncs. */
+    time_t next_sync_ts; /**< Wall-clock time of the next background sync (0 if unknown). */
+} sync_state_t;
+
+/** @brief Sync schedule, preserved across deep sleep. */
+RTC_DATA_ATTR static sync_state_t sync_state;
+
+/** @brief A sync succeeded during this wake. */
+static bool wake_synced = false;
+/** @brief A sync during this wake found changed days. */
+static bool wake_changed = false;
+/** @brief Protects the wake results, reported by the net worker. */
+static portMUX_TYPE wake_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Returns true if `hour` falls inside the configured quiet hours. */
+static bool sync_is_quiet(int hour) {
+    if (CONFIG_SYNC_QUIET_START_HOUR <= CONFIG_SYNC_QUIET_END_HOUR) {
+        return hour >= CONFIG_SYNC_QUIET_START_HOUR && hour < CONFIG_SYNC_QUIET_END_HOUR;
+    }
+    return hour >= CONFIG_SYNC_QUIET_START_HOUR || hour < CONFIG_SYNC_QUIET_END_HOUR;
+}
+
+/**
+ * @brief Records the result of a calendar sync.
+ *
+ * Results are only collected here; the interval is adapted once per wake in
+ * `sync_scheduler_next_wake_us`, however many requests the sync needed.
+ *
+ * @param changed `true` if the events of at least one day changed.
+ */
+void sync_scheduler_report(bool changed) {
+    taskENTER_CRITICAL(&wake_lock);
+    wake_synced = true;
+    wake_changed = wake_changed || changed;
+    taskEXIT_CRITICAL(&wake_lock);
+}
+
+/**
+ * @brief Adapts the interval to how often the calendar actually changes.
+ *
+ * A sync that found changes halves the interval, down to the minimum; one that found none
+ * lengthens it by half, up to the maximum. A calendar that is edited often is checked often,
+ * and a quiet one costs few wakes.
+ */
+static void sync_adapt_interval(bool changed) {
+    uint32_t interval = sync_state.interval_s;
+    interval = changed ? interval / 2 : interval + interval / 2;
+    if (interval < CONFIG_SYNC_INTERVAL_MIN_MINUTES * 60) {
+        interval = CONFIG_SYNC_INTERVAL_MIN_MINUTES * 60;
+    } else if (interval > CONFIG_SYNC_INTERVAL_MAX_MINUTES * 60) {
+        interval = CONFIG_SYNC_INTERVAL_MAX_MINUTES * 60;
+    }
+    if (interval != sync_state.interval_s) {
+        ESP_LOGI(TAG, "Calendar %s, sync interval %lu -> %lu min.",
+                 changed ? "changed" : "unchanged", (unsigned long)sync_state.interval_s / 60,
+                 (unsigned long)interval / 60);
+    }
+    sync_state.interval_s = interval;
+}
+
+/** @brief Moves a wake time that falls inside the quiet hours to their end. */
+static time_t sync_skip_quiet_hours(time_t next) {
+    struct tm next_tm;
+    localtime_r(&next, &next_tm);
+    if (!sync_is_quiet(next_tm.tm_hour)) {
+        return next;
+    }
+    if (next_tm.tm_hour >= CONFIG_SYNC_QUIET_END_HOUR) {
+        next_tm.tm_mday += 1; // The quiet hours started before midnight
+    }
+    next_tm.tm_hour = CONFIG_SYNC_QUIET_END_HOUR;
+    next_tm.tm_min = 0;
+    next_tm.tm_sec = 0;
+    next_tm.tm_isdst = -1;
+    return mktime(&next_tm);
+}
+
+/**
+ * @brief Computes when the next background sync should wake the device.
+ *
+ * A wake that synced adapts the interval and schedules the next sync one interval later.
+ * A scheduled sync that failed is retried one interval later too, so an unreachable network
+ * does not wake the device every minute. Other wakes (e.g. offline knob turns) keep the
+ * schedule. Wakes falling inside the quiet hours are moved to their end. Until the clock has
+ * been set, the interval is used as is.
+ *
+ * @return Microseconds until the next sync, or 0 if background syncs are disabled.
+ */
+uint64_t sync_scheduler_next_wake_us(void) {
+#ifdef CONFIG_SYNC_SCHEDULER
+    if (sync_state.magic != SYNC_STATE_MAGIC) {
+        sync_state = (sync_state_t){
+            .magic = SYNC_STATE_MAGIC,
+            .interval_s = CONFIG_SYNC_INTERVAL_MIN_MINUTES * 60,
+        };
+    }
+
+    taskENTER_CRITICAL(&wake_lock);
+    bool synced = wake_synced;
+    bool changed = wake_changed;
+    wake_synced = false;
+    wake_changed = false;
+    taskEXIT_CRITICAL(&wake_lock);
+    if (synced) {
+        sync_adapt_interval(changed);
+    }
+
+    time_t now;
+    struct tm now_tm;
+    time(&now);
+    localtime_r(&now, &now_tm);
+    if (now_tm.tm_year < (SYNC_MIN_VALID_YEAR - 1900)) {
+        sync_state.next_sync_ts = 0;
+        return (uint64_t)sync_state.interval_s * 1000000ULL;
+    }
+
+    // A schedule more than a day ahead was made before the clock was set backwards
+    if (synced || sync_state.next_sync_ts == 0 || now >= sync_state.next_sync_ts ||
+        sync_state.next_sync_ts - now > 24 * 3600 + sync_state.interval_s) {
+        sync_state.next_sync_ts = sync_skip_quiet_hours(now + sync_state.interval_s);
+    }
+    time_t sleep_s = sync_state.next_sync_ts - now;
+    if (sleep_s < SYNC_MIN_SLEEP_S) {
+        sleep_s = SYNC_MIN_SLEEP_S;
+    }
+    ESP_LOGI(TAG, "Next background sync in %ld min.", (long)sleep_s / 60);
+    return (uint64_t)sleep_s * 1000000ULL;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Returns true if the background sync is due, e.g. on a timer wake.
+ *
+ * The device also wakes on a timer for other reasons, such as the clock face. Those wakes
+ * come before `next_sync_ts`; a wake within SYNC_DUE_SLACK_S of it, or while the schedule
+ * is unknown, is treated as the sync.
+ */
+bool sync_scheduler_due(void) {
+#ifdef CONFIG_SYNC_SCHEDULER
+    if (sync_state.magic != SYNC_STATE_MAGIC || sync_state.next_sync_ts == 0) {
+        return true;
+    }
+    time_t now;
+    time(&now);
+    return now + SYNC_DUE_SLACK_S >= sync_state.next_sync_ts;
+#else
+    return false;
+#endif
+}
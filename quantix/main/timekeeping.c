@@ -0,0 +1,246 @@
+#include "timekeeping.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "net_task.h"
+#include "sdkconfig.h"
+#include <sys/time.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "TIMEKEEPING";
+
+/** @brief Magic value marking `rtc_clock` as valid. */
+#define TIMEKEEPING_MAGIC 0x544B4550
+/** @brief Largest drift accepted from a measurement; anything beyond is a bad sample. */
+#define TIMEKEEPING_MAX_DRIFT_PPM 20000
+/** @brief Longest time the radio is kept on for an SNTP reply; then it is left for later. */
+#define TIMEKEEPING_SNTP_MAX_WAIT_S 10
+
+/** @brief The last SNTP sync and the drift of the clock, kept in RTC memory. */
+typedef struct {
+    uint32_t magic;
+    int64_t sync_us;         /**< Time (us since the epoch) set by the last SNTP sync. */
+    int64_t corrected_us;    /**< Correction subtracted from the clock since then. */
+    int64_t anchor_us;       /**< Sync the next drift measurement starts from. */
+    int64_t anchor_error_us; /**< Raw error measured by the syncs since `anchor_us`. */
+    int32_t drift_ppm;       /**< Estimated drift; positive if the clock runs fast. */
+    bool calibrated;         /**< `drift_ppm` was measured at least once. */
+} timekeeping_rtc_t;
+
+RTC_DATA_ATTR static timekeeping_rtc_t rtc_clock;
+
+/** @brief SNTP has been started during this wake. */
+static bool sntp_started = false;
+/** @brief Ends the radio hold of SNTP, on a reply or when none came in time. */
+static esp_timer_handle_t sntp_wait_timer;
+/** @brief An SNTP reply arrived while `sntp_wait_timer` was running. */
+static volatile bool sntp_replied;
+
+/** @brief Current system time in microseconds; keeps running through deep sleep. */
+static int64_t timekeeping_now_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/** @brief Sets the system time in microseconds. */
+static void timekeeping_set_us(int64_t us) {
+    struct timeval tv = {
+        .tv_sec = us / 1000000,
+        .tv_usec = us % 1000000,
+    };
+    settimeofday(&tv, NULL);
+}
+
+/** @brief Microseconds elapsed since the last SNTP sync, or -1 if there was none. */
+static int64_t timekeeping_elapsed_us(void) {
+    if (rtc_clock.magic != TIMEKEEPING_MAGIC) {
+        return -1;
+    }
+    int64_t elapsed = timekeeping_now_us() - rtc_clock.sync_us;
+    return elapsed < 0 ? -1 : elapsed;
+}
+
+/**
+ * @brief Worst-case error of the clock in milliseconds, or -1 if it is unknown.
+ *
+ * Grows with the time since the last sync: by TIMEKEEPING_RESIDUAL_PPM once the drift has
+ * been estimated, by CONFIG_TIMEKEEPING_UNCALIBRATED_PPM before.
+ */
+static int64_t timekeeping_uncertainty_ms(void) {
+    int64_t elapsed = timekeeping_elapsed_us();
+    if (elapsed < 0) {
+        return -1;
+    }
+    int64_t ppm =
+        rtc_clock.calibrated ? TIMEKEEPING_RESIDUAL_PPM : CONFIG_TIMEKEEPING_UNCALIBRATED_PPM;
+    return elapsed / 1000 * ppm / 1000000;
+}
+
+/**
+ * @brief Corrects the clock for the drift accumulated since the last sync.
+ *
+ * The RTC keeps counting through deep sleep, but its slow clock runs fast or slow by an
+ * amount that is fairly stable for a given chip. The drift measured between SNTP syncs is
+ * subtracted from the clock on every boot; `corrected_us` remembers how much has been
+ * subtracted so far, so each boot only applies what accumulated since the previous one.
+ */
+void timekeeping_init(void) {
+    int64_t elapsed = timekeeping_elapsed_us();
+    if (elapsed < 0 || !rtc_clock.calibrated) {
+        return;
+    }
+    int64_t expected_us = elapsed * rtc_clock.drift_ppm / 1000000;
+    int64_t delta_us = expected_us - rtc_clock.corrected_us;
+    if (delta_us > -1000 && delta_us < 1000) {
+        return; // Below a millisecond, not worth a settimeofday
+    }
+    timekeeping_set_us(timekeeping_now_us() - delta_us);
+    rtc_clock.corrected_us = expected_us;
+    ESP_LOGI(TAG, "Clock corrected by %lld ms for a drift of %ld ppm.", (long long)(-delta_us / 1000),
+             (long)rtc_clock.drift_ppm);
+}
+
+/**
+ * @brief Returns true if the clock can be used without waiting for SNTP.
+ *
+ * That is the case after an SNTP sync (the state survives deep sleep but not power-on) for
+ * as long as the worst-case drift stays within CONFIG_TIMEKEEPING_MAX_ERROR_MS.
+ */
+bool timekeeping_is_trusted(void) {
+    int64_t uncertainty = timekeeping_uncertainty_ms();
+    return uncertainty >= 0 && uncertainty <= CONFIG_TIMEKEEPING_MAX_ERROR_MS;
+}
+
+/**
+ * @brief Returns true if an SNTP sync is worth the radio time during this wake.
+ *
+ * A sync is done before the clock stops being trusted, when half of the error budget has
+ * been used up, and once enough time has passed to measure the drift of an uncalibrated
+ * clock.
+ */
+static bool timekeeping_needs_sync(void) {
+    int64_t uncertainty = timekeeping_uncertainty_ms();
+    if (uncertainty < 0 || uncertainty > CONFIG_TIMEKEEPING_MAX_ERROR_MS / 2) {
+        return true;
+    }
+    return !rtc_clock.calibrated && timekeeping_now_us() - rtc_clock.anchor_us >=
+                                        (int64_t)TIMEKEEPING_MIN_CALIBRATION_S * 1000000;
+}
+
+/**
+ * @brief Sets the clock from SNTP and updates the drift estimate.
+ *
+ * Replaces the weak default of ESP-IDF so the error of the clock can be read before it is
+ * overwritten. Adding back the correction already applied gives the raw drift of the RTC
+ * since the previous sync. Syncs closer together than TIMEKEEPING_MIN_CALIBRATION_S are
+ * accumulated until the span is long enough; the measurement is then averaged with the
+ * previous estimate.
+ *
+ * @param tv The time received from the NTP server.
+ */
+void sntp_sync_time(struct timeval *tv) {
+    int64_t now_us = timekeeping_now_us();
+    int64_t sync_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    timekeeping_set_us(sync_us);
+    sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
+
+    if (rtc_clock.magic == TIMEKEEPING_MAGIC) {
+        int64_t span = sync_us - rtc_clock.anchor_us;
+        rtc_clock.anchor_error_us += now_us - sync_us + rtc_clock.corrected_us;
+        ESP_LOGI(TAG, "SNTP sync, clock was off by %lld ms.", (long long)((now_us - sync_us) / 1000));
+        if (span >= (int64_t)TIMEKEEPING_MIN_CALIBRATION_S * 1000000) {
+            int64_t measured = rtc_clock.anchor_error_us * 1000000 / span;
+            if (measured > -TIMEKEEPING_MAX_DRIFT_PPM && measured < TIMEKEEPING_MAX_DRIFT_PPM) {
+                rtc_clock.drift_ppm = rtc_clock.calibrated
+                                          ? (int32_t)((rtc_clock.drift_ppm + measured) / 2)
+                                          : (int32_t)measured;
+                rtc_clock.calibrated = true;
+                ESP_LOGI(TAG, "Measured drift %lld ppm, estimate %ld ppm.", (long long)measured,
+                         (long)rtc_clock.drift_ppm);
+            }
+            rtc_clock.anchor_us = sync_us;
+            rtc_clock.anchor_error_us = 0;
+        } else if (span < 0) {
+            rtc_clock.anchor_us = sync_us; // The clock was set backwards, start over
+            rtc_clock.anchor_error_us = 0;
+        }
+    } else {
+        ESP_LOGI(TAG, "First SNTP sync since power-on.");
+        rtc_clock.drift_ppm = 0;
+        rtc_clock.calibrated = false;
+        rtc_clock.anchor_us = sync_us;
+        rtc_clock.anchor_error_us = 0;
+    }
+    rtc_clock.magic = TIMEKEEPING_MAGIC;
+    rtc_clock.sync_us = sync_us;
+    rtc_clock.corrected_us = 0;
+    xEventGroupSetBits(net_event_group, NET_TIME_SYNCED_BIT);
+    // Runs in the tcpip thread, which must not wait for the network locks or close sockets:
+    // the radio hold is released from the esp_timer task instead
+    if (sntp_wait_timer && esp_timer_is_active(sntp_wait_timer)) {
+        sntp_replied = true;
+        esp_timer_stop(sntp_wait_timer);
+        esp_timer_start_once(sntp_wait_timer, 0);
+    }
+}
+
+/**
+ * @brief Ends the radio hold of SNTP, after its reply or when none came within
+ * TIMEKEEPING_SNTP_MAX_WAIT_S; a later poll may still sync the clock.
+ */
+static void timekeeping_sntp_wait_cb(void *arg) {
+    if (!sntp_replied) {
+        ESP_LOGW(TAG, "No SNTP reply within %d s, not waiting for it.",
+                 TIMEKEEPING_SNTP_MAX_WAIT_S);
+    }
+    net_radio_release(NET_RADIO_HOLD_SNTP);
+}
+
+/**
+ * @brief Sets the clock from a time with one-second resolution, such as the server time.
+ *
+ * The step is booked as a correction, so it does not distort the drift measured by the
+ * next SNTP sync.
+ */
+void timekeeping_set_coarse(time_t now) {
+    int64_t step_us = (int64_t)now * 1000000 - timekeeping_now_us();
+    timekeeping_set_us((int64_t)now * 1000000);
+    if (rtc_clock.magic == TIMEKEEPING_MAGIC) {
+        rtc_clock.corrected_us -= step_us;
+    }
+    ESP_LOGI(TAG, "Clock stepped by %lld ms.", (long long)(step_us / 1000));
+}
+
+/**
+ * @brief Makes the clock available once Wi-Fi is connected.
+ *
+ * A trusted clock sets NET_TIME_SYNCED_BIT at once, so the prefetch does not wait for an
+ * NTP round trip. SNTP is only started when `timekeeping_needs_sync` says so; it runs in
+ * the background and is simply lost if the device goes back to sleep first. It is part of
+ * the radio session: Wi-Fi stays on for the reply, but at most TIMEKEEPING_SNTP_MAX_WAIT_S.
+ */
+void timekeeping_start_sync(void) {
+    if (timekeeping_is_trusted()) {
+        ESP_LOGI(TAG, "Clock trusted, worst-case error %lld ms.",
+                 (long long)timekeeping_uncertainty_ms());
+        xEventGroupSetBits(net_event_group, NET_TIME_SYNCED_BIT);
+    }
+    if (sntp_started || !timekeeping_needs_sync()) {
+        return;
+    }
+    sntp_started = true;
+    const esp_timer_create_args_t wait_timer_args = {
+        .callback = timekeeping_sntp_wait_cb,
+        .name = "sntp_wait",
+    };
+    if (esp_timer_create(&wait_timer_args, &sntp_wait_timer) == ESP_OK) {
+        net_radio_hold(NET_RADIO_HOLD_SNTP);
+        esp_timer_start_once(sntp_wait_timer, TIMEKEEPING_SNTP_MAX_WAIT_S * 1000000LL);
+    }
+    esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, "pool.ntp.org");
+    esp_sntp_init();
+    ESP_LOGI(TAG, "SNTP started in the background.");
+}
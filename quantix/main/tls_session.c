@@ -0,0 +1,213 @@
+#include "tls_session.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "TLS_SESSION";
+
+/** @brief Handshake counters, preserved across deep sleep to compare wakes. */
+RTC_DATA_ATTR static uint32_t handshakes_full;
+/** @brief Protects the RTC state; several pooled connections may handshake at once. */
+static SemaphoreHandle_t tls_session_mutex;
+
+#ifdef CONFIG_NET_TLS_SESSION_RESUMPTION
+
+#include "mbedtls/ssl.h"
+
+RTC_DATA_ATTR static uint32_t handshakes_resumed;
+
+/** @brief Magic value marking `rtc_session` as valid. */
+#define TLS_SESSION_MAGIC 0x544C5354
+/**
+ * @brief Space for a serialised session.
+ *
+ * With CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE disabled (sdkconfig.defaults) mbedTLS keeps
+ * only a digest of the server certificate, and a session with its ticket takes a few hundred
+ * bytes. A larger session is not saved, and the next connection does a full handshake.
+ */
+#define TLS_SESSION_MAX_SIZE 512
+#define TLS_SESSION_HOST_LEN 64
+
+/** @brief Serialised mbedTLS session kept in RTC memory so it survives deep sleep. */
+typedef struct {
+    uint32_t magic;
+    char host[TLS_SESSION_HOST_LEN]; /**< Server the session belongs to. */
+    time_t saved_at;                 /**< System time when the session was saved. */
+    uint16_t len;                    /**< Bytes used in `data`. */
+    uint8_t data[TLS_SESSION_MAX_SIZE];
+} tls_rtc_session_t;
+
+RTC_DATA_ATTR static tls_rtc_session_t rtc_session;
+
+/**
+ * @brief Offers the saved session for `host` to the next handshake.
+ *
+ * The session is skipped if it belongs to another host or is older than
+ * CONFIG_NET_TLS_SESSION_MAX_AGE_MIN. The system time keeps running through deep sleep,
+ * so the age is meaningful even before SNTP has synchronised.
+ *
+ * @param cfg  TLS configuration; `client_session` is set on success.
+ * @param host Server host name.
+ * @return `true` if a session was offered.
+ */
+static bool session_apply(esp_tls_cfg_t *cfg, const char *host) {
+    cfg->client_session = NULL;
+    if (rtc_session.magic != TLS_SESSION_MAGIC || strcmp(rtc_session.host, host) != 0) {
+        return false;
+    }
+    time_t now = time(NULL);
+    if (now < rtc_session.saved_at ||
+        now - rtc_session.saved_at > CONFIG_NET_TLS_SESSION_MAX_AGE_MIN * 60) {
+        ESP_LOGI(TAG, "Saved session expired, using full handshake.");
+        rtc_session.magic = 0;
+        return false;
+    }
+
+    esp_tls_client_session_t *session = calloc(1, sizeof(esp_tls_client_session_t));
+    if (session == NULL) {
+        return false;
+    }
+    mbedtls_ssl_session_init(&session->saved_session);
+    int ret = mbedtls_ssl_session_load(&session->saved_session, rtc_session.data, rtc_session.len);
+    if (ret != 0) {
+        ESP_LOGW(TAG, "Failed to load saved session: -0x%04x", -ret);
+        esp_tls_free_client_session(session);
+        rtc_session.magic = 0;
+        return false;
+    }
+    cfg->client_session = session;
+    return true;
+}
+
+/**
+ * @brief Returns true if the server resumed the offered session.
+ *
+ * An abbreviated TLS 1.2 handshake keeps the master secret of the offered session, a full
+ * one derives a new one. The session ID says nothing when a ticket is offered: the client
+ * then sends a freshly generated ID (RFC 5077 3.4).
+ */
+static bool tls_session_resumed(const esp_tls_client_session_t *offered,
+                                const esp_tls_client_session_t *current) {
+    if (offered == NULL || current == NULL ||
+        current->saved_session.MBEDTLS_PRIVATE(tls_version) != MBEDTLS_SSL_VERSION_TLS1_2) {
+        return false;
+    }
+    return memcmp(offered->saved_session.MBEDTLS_PRIVATE(master),
+                  current->saved_session.MBEDTLS_PRIVATE(master),
+                  sizeof(current->saved_session.MBEDTLS_PRIVATE(master))) == 0;
+}
+
+/**
+ * @brief Logs the handshake and saves the negotiated session to RTC memory.
+ *
+ * Only a full handshake saves its new session and stamps its time. A resumed session is
+ * the one already saved, so its original time is kept and the saved session expires once
+ * it is CONFIG_NET_TLS_SESSION_MAX_AGE_MIN old, however often it was resumed. Frees the
+ * session offered through `tls_session_apply`.
+ *
+ * @param tls          Connected TLS handle.
+ * @param cfg          Configuration used for the handshake.
+ * @param host         Server host name.
+ * @param handshake_us Duration of TCP connect and TLS handshake.
+ */
+static void session_update(esp_tls_t *tls, esp_tls_cfg_t *cfg, const char *host,
+                           int64_t handshake_us) {
+    esp_tls_client_session_t *current = esp_tls_get_client_session(tls);
+    bool resumed = tls_session_resumed(cfg->client_session, current);
+
+    if (resumed) {
+        handshakes_resumed++;
+    } else {
+        handshakes_full++;
+    }
+    ESP_LOGI(TAG, "%s handshake to %s in %lld ms (since power-on: %lu full, %lu resumed)",
+             resumed ? "Resumed" : "Full", host, handshake_us / 1000,
+             (unsigned long)handshakes_full, (unsigned long)handshakes_resumed);
+
+    if (current && !resumed) {
+        size_t olen = 0;
+        int ret = mbedtls_ssl_session_save(&current->saved_session, rtc_session.data,
+                                           sizeof(rtc_session.data), &olen);
+        if (ret == 0) {
+            strlcpy(rtc_session.host, host, sizeof(rtc_session.host));
+            rtc_session.len = olen;
+            rtc_session.saved_at = time(NULL);
+            rtc_session.magic = TLS_SESSION_MAGIC;
+        } else {
+            ESP_LOGW(TAG, "Session not saved (-0x%04x, %u bytes needed)", -ret, (unsigned)olen);
+            rtc_session.magic = 0;
+        }
+    }
+    if (current) {
+        esp_tls_free_client_session(current);
+    }
+    if (cfg->client_session) {
+        esp_tls_free_client_session(cfg->client_session);
+        cfg->client_session = NULL;
+    }
+}
+
+/**
+ * @brief Drops the offered session after a failed handshake so the retry is a full one.
+ *
+ * @param cfg Configuration used for the failed handshake.
+ */
+static void session_discard(esp_tls_cfg_t *cfg) {
+    if (cfg->client_session) {
+        ESP_LOGW(TAG, "Handshake with saved session failed, discarding it.");
+        esp_tls_free_client_session(cfg->client_session);
+        cfg->client_session = NULL;
+        rtc_session.magic = 0;
+    }
+}
+
+#else // !CONFIG_NET_TLS_SESSION_RESUMPTION
+
+static bool session_apply(esp_tls_cfg_t *cfg, const char *host) { return false; }
+
+static void session_update(esp_tls_t *tls, esp_tls_cfg_t *cfg, const char *host,
+                           int64_t handshake_us) {
+    handshakes_full++;
+    ESP_LOGI(TAG, "Full handshake to %s in %lld ms (since power-on: %lu full)", host,
+             handshake_us / 1000, (unsigned long)handshakes_full);
+}
+
+static void session_discard(esp_tls_cfg_t *cfg) {}
+
+#endif // CONFIG_NET_TLS_SESSION_RESUMPTION
+
+/** @brief Initialises the session cache. Must be called before the first connection. */
+void tls_session_init(void) {
+    if (tls_session_mutex == NULL) {
+        tls_session_mutex = xSemaphoreCreateMutex();
+    }
+}
+
+/** @brief See `session_apply`. */
+bool tls_session_apply(esp_tls_cfg_t *cfg, const char *host) {
+    xSemaphoreTake(tls_session_mutex, portMAX_DELAY);
+    bool offered = session_apply(cfg, host);
+    xSemaphoreGive(tls_session_mutex);
+    return offered;
+}
+
+/** @brief See `session_update`. */
+void tls_session_update(esp_tls_t *tls, esp_tls_cfg_t *cfg, const char *host,
+                        int64_t handshake_us) {
+    xSemaphoreTake(tls_session_mutex, portMAX_DELAY);
+    session_update(tls, cfg, host, handshake_us);
+    xSemaphoreGive(tls_session_mutex);
+}
+
+/** @brief See `session_discard`. */
+void tls_session_discard(esp_tls_cfg_t *cfg) {
+    xSemaphoreTake(tls_session_mutex, portMAX_DELAY);
+    session_discard(cfg);
+    xSemaphoreGive(tls_session_mutex);
+}
@@ -4,10 +4,16 @@
 #include "EPD_config.h"
 #include "GUI_Paint.h"
 #include "ImageData.h"
+#include "EPD_store.h"
+#include "boot.h"
 #include "cJSON.h" // For parsing event JSON
 #include "calendar.h"
+#include "clock_face.h"
 #include "esp_log.h"
 #include "font_task.h"
+#include "refresh_scheduler.h"
+#include "sleep_manager.h"
+#include "wake_profile.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
@@ -30,6 +36,9 @@ QueueHandle_t gui_queue;
 /** @brief Log tag for this module. */
 static const char *TAG = "UI_TASK";
 
+/** @brief Set while the screen is off; events are dropped instead of queued. */
+static volatile bool ui_discarding = false;
+
 /** @brief Static buffer to store the QR code data for user settings. */
 static char setting_qrcode[256];
 
@@ -114,6 +123,39 @@ static void format_date_for_display(const char *yyyymmdd_str, char *out_day_str,
     out_month_abbr[month_abbr_size - 1] = '\0';
 }
 
+/**
+ * @brief Queues a screen update for `viewDisplay`.
+ *
+ * Every queued event keeps the device awake until it has been drawn. While the screen is
+ * off (`ui_set_discard`), events are dropped instead.
+ *
+ * @param ev The event; copied into the queue.
+ */
+void ui_send_event(const event_t *ev) {
+    if (ui_discarding) {
+        return;
+    }
+    sleep_manager_hold(SLEEP_HOLD_SCREEN);
+    xQueueSend(gui_queue, ev, portMAX_DELAY);
+    event_t dropped;
+    if (ui_discarding && xQueueReceive(gui_queue, &dropped, 0) == pdTRUE) {
+        sleep_manager_release(SLEEP_HOLD_SCREEN); // Discarding started while this was sent
+    }
+}
+
+/**
+ * @brief Drops screen events while the screen is off, e.g. during a background sync.
+ *
+ * Events already queued are dropped too, so they do not keep the device awake.
+ */
+void ui_set_discard(bool discard) {
+    ui_discarding = discard;
+    event_t dropped;
+    while (discard && xQueueReceive(gui_queue, &dropped, 0) == pdTRUE) {
+        sleep_manager_release(SLEEP_HOLD_SCREEN);
+    }
+}
+
 /**
  * @brief The main UI task responsible for updating the E-Paper display.
  *
@@ -122,7 +164,8 @@ static void format_date_for_display(const char *yyyymmdd_str, char *out_day_str,
  * display according to the event ID. It handles rendering different screens
  * such as Wi-Fi setup, connection status, calendar view, and QR codes.
  * It also includes logic to prevent unnecessary redraws if the view or data
- * has not changed.
+ * has not changed. The waveform for each redraw is chosen by the refresh scheduler,
+ * and when the queue stays idle the current screen may get a maintenance full refresh.
  *
  * @param PvParameters Unused.
  */
@@ -131,15 +174,27 @@ void viewDisplay(void *PvParameters) {
     uint32_t view_current = 0;
     char displayStr[MAX_MSG_LEN] = "";
     for (;;) {
-        if (xQueueReceive(gui_queue, &event, portMAX_DELAY)) {
+        if (xQueueReceive(gui_queue, &event, pdMS_TO_TICKS(CONFIG_EPD_IDLE_MAINTENANCE_MS)) !=
+            pdTRUE) {
+            // Idle: clean up accumulated ghosting on the current screen before a forced full
+            // refresh has to happen in the middle of user interaction.
+            if (view_current != 0 && refresh_scheduler_wants_maintenance() &&
+                sleep_manager_try_hold(SLEEP_HOLD_SCREEN)) {
+                if (xSemaphoreTake(xScreen, 0) == pdTRUE) {
+                    ESP_LOGI(TAG, "UI idle, running maintenance full refresh.");
+                    screen_refresh_with(BlackImage, EPD_REFRESH_FULL);
+                    EPD_2IN9_V2_Sleep();
+                    xSemaphoreGive(xScreen);
+                }
+                sleep_manager_release(SLEEP_HOLD_SCREEN);
+            }
+        } else {
             ESP_LOGI("UI_TASK", "Received event: %ld", event.event_id);
             switch (event.event_id) {
             case SCREEN_EVENT_WIFI_REQUIRED:
                 if ((view_current != SCREEN_EVENT_WIFI_REQUIRED) &&
                     (xSemaphoreTake(xScreen, portMAX_DELAY) == pdTRUE)) {
                     strncpy(displayStr, "Scan QR code to setup Wi-Fi", sizeof(displayStr) - 1);
-                    EPD_2IN9_V2_Init_Fast();
-                    EPD_2IN9_V2_Clear();
                     Paint_SelectImage(BlackImage);
                     Paint_Clear(WHITE);
                     Paint_DrawBitMap_Paste(gImage_wifiqrcode, 14, 14, 99, 99, 1);
@@ -148,7 +203,7 @@ void viewDisplay(void *PvParameters) {
                     Paint_DrawString_EN_Center(130, 70, 166, 58, "Continue without WiFi", &Font12,
                                                BLACK, WHITE, 0);
                     Paint_DrawBitMap_Paste(gImage_arrow, 128, 93, 12, 12, 1);
-                    EPD_2IN9_V2_Display(BlackImage);
+                    screen_refresh(BlackImage);
 
                     printf("Goto Sleep...\r\n");
                     EPD_2IN9_V2_Sleep();
@@ -163,8 +218,6 @@ void viewDisplay(void *PvParameters) {
                     (xSemaphoreTake(xScreen, portMAX_DELAY) == pdTRUE)) {
                     strncpy(displayStr, "No server connection, retrying...",
                             sizeof(displayStr) - 1);
-                    EPD_2IN9_V2_Init_Fast();
-                    EPD_2IN9_V2_Clear();
                     Paint_SelectImage(BlackImage);
                     Paint_Clear(WHITE);
                     Paint_DrawString_EN_Center(0, 0, EPD_2IN9_V2_HEIGHT, EPD_2IN9_V2_WIDTH,
@@ -172,7 +225,7 @@ void viewDisplay(void *PvParameters) {
                     Paint_DrawString_EN_Center(0, 81, EPD_2IN9_V2_HEIGHT, 47, "Wifi setting",
                                                &Font12, BLACK, WHITE, 5);
                     Paint_DrawBitMap_Paste(gImage_arrow, 90, 98, 12, 12, 1);
-                    EPD_2IN9_V2_Display(BlackImage);
+                    screen_refresh(BlackImage);
                     view_current = event.event_id;
                     EPD_2IN9_V2_Sleep();
                     vTaskDelay(2000 / portTICK_PERIOD_MS);
@@ -184,13 +237,11 @@ void viewDisplay(void *PvParameters) {
                     (xSemaphoreTake(xScreen, portMAX_DELAY) == pdTRUE)) {
                     strncpy(displayStr, event.msg, sizeof(displayStr) - 1);
                     displayStr[sizeof(displayStr) - 1] = '\0';
-                    EPD_2IN9_V2_Init_Fast();
-                    // EPD_2IN9_V2_Clear();
                     Paint_SelectImage(BlackImage);
                     Paint_Clear(WHITE);
                     Paint_DrawString_EN_Center(0, 0, EPD_2IN9_V2_HEIGHT, EPD_2IN9_V2_WIDTH,
                                                displayStr, &Font16, WHITE, BLACK, 5);
-                    EPD_2IN9_V2_Display(BlackImage);
+                    screen_refresh(BlackImage);
                     view_current = event.event_id;
                     EPD_2IN9_V2_Sleep();
                     vTaskDelay(2000 / portTICK_PERIOD_MS);
@@ -200,11 +251,9 @@ void viewDisplay(void *PvParameters) {
             case SCREEN_EVENT_CLEAR:
                 if (xSemaphoreTake(xScreen, portMAX_DELAY) == pdTRUE) {
                     displayStr[0] = '\0'; // Clear the display string cache
-                    EPD_2IN9_V2_Init();
-                    EPD_2IN9_V2_Clear();
                     Paint_SelectImage(BlackImage);
                     Paint_Clear(WHITE);
-                    EPD_2IN9_V2_Display(BlackImage);
+                    screen_refresh_with(BlackImage, EPD_REFRESH_FULL);
                     view_current = event.event_id;
                     EPD_2IN9_V2_Sleep();
                     vTaskDelay(2000 / portTICK_PERIOD_MS);
@@ -232,7 +281,6 @@ void viewDisplay(void *PvParameters) {
                     format_date_for_display(displayStr, disp_day, sizeof(disp_day), disp_month,
                                             sizeof(disp_month));
 
-                    EPD_2IN9_V2_Init_Fast();
                     Paint_SelectImage(BlackImage);
                     Paint_Clear(WHITE);
 
@@ -243,7 +291,9 @@ void viewDisplay(void *PvParameters) {
                                         BLACK, WHITE);
                     Paint_DrawRectangle(5, 5, 51, 69, BLACK, 1, DRAW_FILL_EMPTY);
 
-                    // 2. Load and draw events for the selected date from LittleFS.
+                    // 2. Load and draw events for the selected date from LittleFS. The
+                    // glyphs of the summaries need the font index.
+                    boot_wait(BOOT_FONTS_READY_BIT);
                     if (strcmp(displayStr, "NoDate") != 0 && strlen(displayStr) == 10) {
                         char file_path[64];
                         int calendar_dir_len = strlen(CALENDAR_DIR);
@@ -369,7 +419,10 @@ void viewDisplay(void *PvParameters) {
                                              WHITE);
                     }
 
-                    EPD_2IN9_V2_Display(BlackImage);
+                    // 3. Draw the clock below the date; timer wakes keep it current.
+                    clock_face_draw(BlackImage);
+
+                    screen_refresh(BlackImage);
                     view_current = event.event_id;
                     xSemaphoreGive(xScreen);
                 }
@@ -379,7 +432,6 @@ void viewDisplay(void *PvParameters) {
                     (xSemaphoreTake(xScreen, portMAX_DELAY) == pdTRUE)) {
                     strncpy(displayStr, "Scan QR code to enter user settings",
                             sizeof(displayStr) - 1);
-                    EPD_2IN9_V2_Init_Fast();
                     Paint_SelectImage(BlackImage);
                     Paint_Clear(WHITE);
                     Paint_DrawBitMap_Paste_Scale((UBYTE *)setting_qrcode, 14, 9, 37, 37, 0, 3);
@@ -387,7 +439,7 @@ void viewDisplay(void *PvParameters) {
                                                5);
                     Paint_DrawString_EN_Center(130, 70, 166, 58, "Done", &Font12, BLACK, WHITE, 0);
                     Paint_DrawBitMap_Paste(gImage_arrow, 181, 93, 12, 12, 1);
-                    EPD_2IN9_V2_Display(BlackImage);
+                    screen_refresh(BlackImage);
                     view_current = event.event_id;
                     EPD_2IN9_V2_Sleep();
                     vTaskDelay(2000 / portTICK_PERIOD_MS);
@@ -397,6 +449,10 @@ void viewDisplay(void *PvParameters) {
             default:
                 break;
             }
+            if (view_current != SCREEN_EVENT_CALENDAR) {
+                clock_face_hide();
+            }
+            sleep_manager_release(SLEEP_HOLD_SCREEN); // Taken by ui_send_event
         }
     }
 }
@@ -413,10 +469,11 @@ void viewDisplay(void *PvParameters) {
  * @param pvParameters Unused.
  */
 void screenStartup(void *pvParameters) {
+    sleep_manager_hold(SLEEP_HOLD_SCREEN);
     if (DEV_Module_Init() != 0) {
         // TODO: Handle display initialization error.
     }
-    printf("e-Paper Init and Clear...\r\n");
+    printf("e-Paper Init...\r\n");
 
     for (uint8_t i = 0; i < 10; i++) {
         if (xScreen == NULL) {
@@ -425,12 +482,6 @@ void screenStartup(void *pvParameters) {
             break;
         }
     }
-    if (!isr_woken) {
-        EPD_2IN9_V2_Init();
-        vTaskDelay(10);
-        EPD_2IN9_V2_Clear();
-    }
-
     // Create a new image cache
     UWORD Imagesize =
         ((EPD_2IN9_V2_WIDTH % 8 == 0) ? (EPD_2IN9_V2_WIDTH / 8) : (EPD_2IN9_V2_WIDTH / 8 + 1)) *
@@ -439,10 +490,23 @@ void screenStartup(void *pvParameters) {
         printf("Failed to apply for black memory...\r\n");
     }
 
+    // 將面板上最後一張影像載回控制器 RAM，成功時不需要開機清屏。
+    // 深度睡眠喚醒時影像在 RTC 記憶體中，不必等 LittleFS 掛載
+    if (!EPD_Store_In_RTC()) {
+        boot_wait(BOOT_FS_READY_BIT);
+    }
+    bool base_restored = refresh_scheduler_restore_base(BlackImage);
+
     Paint_NewImage(BlackImage, EPD_2IN9_V2_WIDTH, EPD_2IN9_V2_HEIGHT, 90, WHITE);
     Paint_SelectImage(BlackImage);
     Paint_Clear(WHITE);
+    if (!base_restored && !isr_woken) {
+        // 面板內容未知，以完整全刷清成白色
+        screen_refresh_with(BlackImage, EPD_REFRESH_FULL);
+    }
+    wake_profile_mark(WAKE_PHASE_EPD_INIT);
     xTaskCreate(viewDisplay, "viewDisplay", 4096, NULL, 6, &xViewDisplayHandle);
     xSemaphoreGive(xScreen);
+    sleep_manager_release(SLEEP_HOLD_SCREEN);
     vTaskDelete(NULL);
 }
\ No newline at end of file
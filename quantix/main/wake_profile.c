@@ -0,0 +1,357 @@
+#include "wake_profile.h"
+#include "cJSON.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "net_task.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief Log tag for this module. */
+static const char *TAG = "WAKE_PROFILE";
+
+#define WAKE_PROFILE_URL "https://peng-pc.tail941dce.ts.net/api/wake_profile"
+
+/** @brief Magic value marking `rtc_wakes` as valid; change it when the layout changes. */
+#define WAKE_PROFILE_MAGIC 0x57414B33
+/** @brief Value of a phase that was not reached, or a time that was not measured. */
+#define WAKE_PROFILE_NONE UINT32_MAX
+/** @brief Earliest year treated as a synchronised wall clock. */
+#define WAKE_PROFILE_MIN_VALID_YEAR 2023
+/** @brief `cause` of a timer wake that only updated the clock; never stored in the ring. */
+#define WAKE_CAUSE_CLOCK_TICK 0xFF
+
+/** @brief Phase names used in the upload, in `wake_phase_t` order. */
+static const char *const phase_names[WAKE_PHASE_COUNT] = {
+    "boot",     "app_main", "nvs_ready",     "fs_mounted",  "fonts_ready",
+    "epd_init", "wifi_up",  "first_request", "render_done", "refresh_done",
+    "sleep",
+};
+
+/** @brief Timings of one wake. */
+typedef struct {
+    uint32_t seq;                        /**< Number of the wake since power-on. */
+    uint32_t started;                    /**< Wall-clock start (Unix s), 0 if unknown. */
+    uint32_t phase_ms[WAKE_PHASE_COUNT]; /**< Time since boot each phase was first reached. */
+    uint32_t radio_ms;                   /**< Time the radio was on. */
+    uint32_t cpu_ms;                     /**< CPU time summed over the cores. */
+    uint8_t cause;                       /**< `esp_sleep_wakeup_cause_t` of the wake. */
+} wake_record_t;
+
+/**
+ * @brief The wakes not yet uploaded, kept in RTC memory across deep sleep.
+ *
+ * Clock ticks come every minute by default and would push the other wakes out of the ring
+ * before a networked wake uploads them, so they are only counted.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t next_seq;
+    uint8_t head;  /**< Slot the next record is written to. */
+    uint8_t count; /**< Records not uploaded yet; the oldest is `count` slots before `head`. */
+    uint32_t tick_count;    /**< Clock tick wakes not uploaded yet. */
+    uint64_t tick_awake_us; /**< Time those wakes were awake, summed. */
+    wake_record_t records[WAKE_PROFILE_RECORDS];
+} wake_ring_t;
+
+RTC_DATA_ATTR static wake_ring_t rtc_wakes;
+
+/** @brief Time (esp_timer, us) at which the constructors of the app ran. */
+static int64_t boot_us;
+
+/** @brief The wake in progress; stored in `rtc_wakes` by `wake_profile_finish`. */
+static wake_record_t current;
+/** @brief Time the radio was switched on, or -1 while it is off. */
+static int64_t radio_on_since = -1;
+/** @brief Radio time of the earlier on/off periods of this wake. */
+static int64_t radio_us;
+/** @brief Protects `current` and the radio time, updated from many tasks. */
+static portMUX_TYPE current_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Protects `rtc_wakes`. */
+static SemaphoreHandle_t wake_profile_mutex;
+
+/**
+ * @brief Takes the first timestamp of the wake.
+ *
+ * Constructors run once ROM, bootloader and the early startup of the app are done, before
+ * the scheduler starts.
+ */
+__attribute__((constructor)) static void wake_profile_boot(void) {
+    boot_us = esp_timer_get_time();
+}
+
+/**
+ * @brief Starts the record of this wake.
+ *
+ * The ring in RTC memory keeps the wakes of several deep sleeps until they are uploaded. It
+ * is reset on power-on.
+ */
+void wake_profile_init(void) {
+    if (wake_profile_mutex == NULL) {
+        wake_profile_mutex = xSemaphoreCreateMutex();
+    }
+    if (rtc_wakes.magic != WAKE_PROFILE_MAGIC) {
+        memset(&rtc_wakes, 0, sizeof(rtc_wakes));
+        rtc_wakes.magic = WAKE_PROFILE_MAGIC;
+    }
+    memset(&current, 0, sizeof(current));
+    for (int phase = 0; phase < WAKE_PHASE_COUNT; ++phase) {
+        current.phase_ms[phase] = WAKE_PROFILE_NONE;
+    }
+    current.seq = rtc_wakes.next_seq++;
+    current.cause = esp_sleep_get_wakeup_cause();
+    current.phase_ms[WAKE_PHASE_BOOT] = boot_us / 1000;
+    wake_profile_mark(WAKE_PHASE_APP_MAIN);
+}
+
+/**
+ * @brief Records that `phase` has been reached.
+ *
+ * Only the first time counts, so e.g. the render and refresh phases describe the first
+ * screen of the wake.
+ */
+void wake_profile_mark(wake_phase_t phase) {
+    uint32_t ms = esp_timer_get_time() / 1000;
+    taskENTER_CRITICAL(&current_lock);
+    if (current.phase_ms[phase] == WAKE_PROFILE_NONE) {
+        current.phase_ms[phase] = ms;
+    }
+    taskEXIT_CRITICAL(&current_lock);
+}
+
+/** @brief Reports this timer wake as a clock tick, which skips the normal boot. */
+void wake_profile_clock_tick(void) { current.cause = WAKE_CAUSE_CLOCK_TICK; }
+
+/** @brief Accumulates the time between switching the radio on and off. */
+void wake_profile_radio(bool on) {
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&current_lock);
+    if (on && radio_on_since < 0) {
+        radio_on_since = now;
+    } else if (!on && radio_on_since >= 0) {
+        radio_us += now - radio_on_since;
+        radio_on_since = -1;
+    }
+    taskEXIT_CRITICAL(&current_lock);
+}
+
+/**
+ * @brief CPU time of this wake, summed over the cores.
+ *
+ * Startup before app_main runs on one core; after that, everything but the idle tasks
+ * counts. Needs the FreeRTOS run-time statistics clocked by esp_timer.
+ */
+static uint32_t wake_profile_cpu_ms(int64_t now) {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER
+    int64_t scheduler_us = (int64_t)current.phase_ms[WAKE_PHASE_APP_MAIN] * 1000;
+    int64_t busy_us = scheduler_us;
+    for (int core = 0; core < portNUM_PROCESSORS; ++core) {
+        int64_t active = now - scheduler_us - ulTaskGetIdleRunTimeCounterForCore(core);
+        busy_us += active > 0 ? active : 0;
+    }
+    return busy_us / 1000;
+#else
+    return WAKE_PROFILE_NONE;
+#endif
+}
+
+/**
+ * @brief Ends the record of this wake and stores it in the ring.
+ *
+ * Called right before deep sleep. When the ring is full, the oldest record is overwritten.
+ * A clock tick is only added to the tick count and awake time.
+ */
+void wake_profile_finish(void) {
+    wake_profile_mark(WAKE_PHASE_SLEEP);
+    wake_profile_radio(false);
+    int64_t now = esp_timer_get_time();
+    if (current.cause == WAKE_CAUSE_CLOCK_TICK) {
+        // 時鐘喚醒只在 app_main 一開始執行，沒有其他 task，不需要 mutex
+        rtc_wakes.tick_count++;
+        rtc_wakes.tick_awake_us += now;
+        return;
+    }
+    time_t wall = time(NULL);
+    struct tm wall_tm;
+    localtime_r(&wall, &wall_tm);
+
+    taskENTER_CRITICAL(&current_lock);
+    current.radio_ms = radio_us / 1000;
+    taskEXIT_CRITICAL(&current_lock);
+    current.cpu_ms = wake_profile_cpu_ms(now);
+    if (wall_tm.tm_year >= WAKE_PROFILE_MIN_VALID_YEAR - 1900) {
+        current.started = wall - now / 1000000;
+    }
+
+    xSemaphoreTake(wake_profile_mutex, portMAX_DELAY);
+    rtc_wakes.records[rtc_wakes.head] = current;
+    rtc_wakes.head = (rtc_wakes.head + 1) % WAKE_PROFILE_RECORDS;
+    if (rtc_wakes.count < WAKE_PROFILE_RECORDS) {
+        rtc_wakes.count++;
+    }
+    xSemaphoreGive(wake_profile_mutex);
+    ESP_LOGI(TAG, "Wake %lu: awake %lu ms, radio %lu ms, %lu records pending.",
+             (unsigned long)current.seq, (unsigned long)current.phase_ms[WAKE_PHASE_SLEEP],
+             (unsigned long)current.radio_ms, (unsigned long)rtc_wakes.count);
+}
+
+/** @brief Slot of the `index`-th pending record, oldest first. Needs `wake_profile_mutex`. */
+static int wake_profile_slot(int index) {
+    return (rtc_wakes.head + WAKE_PROFILE_RECORDS - rtc_wakes.count + index) %
+           WAKE_PROFILE_RECORDS;
+}
+
+/** @brief What an upload contains, so that exactly that can be removed once it is stored. */
+typedef struct {
+    uint32_t last_seq;      /**< Newest uploaded wake. */
+    uint32_t tick_count;    /**< Uploaded clock ticks. */
+    uint64_t tick_awake_us; /**< Their awake time. */
+} wake_upload_t;
+
+/**
+ * @brief Removes the uploaded records, up to and including wake `upload->last_seq`, and
+ * the uploaded clock ticks.
+ *
+ * Records of wakes that ended while the upload was in flight stay for the next one.
+ */
+static void wake_profile_commit(const wake_upload_t *upload) {
+    xSemaphoreTake(wake_profile_mutex, portMAX_DELAY);
+    while (rtc_wakes.count > 0 &&
+           (int32_t)(rtc_wakes.records[wake_profile_slot(0)].seq - upload->last_seq) <= 0) {
+        rtc_wakes.count--;
+    }
+    rtc_wakes.tick_count -= upload->tick_count;
+    rtc_wakes.tick_awake_us -= upload->tick_awake_us;
+    xSemaphoreGive(wake_profile_mutex);
+}
+
+/** @brief Name of a wakeup cause in the upload. */
+static const char *wake_cause_name(uint8_t cause) {
+    switch (cause) {
+    case ESP_SLEEP_WAKEUP_EXT1:
+        return "gpio";
+    case ESP_SLEEP_WAKEUP_TIMER:
+        return "timer";
+    case ESP_SLEEP_WAKEUP_UNDEFINED:
+        return "power_on";
+    default:
+        return "other";
+    }
+}
+
+/** @brief A time in the upload, or null if it was not measured. */
+static cJSON *ms_item(uint32_t ms) {
+    return ms == WAKE_PROFILE_NONE ? cJSON_CreateNull() : cJSON_CreateNumber(ms);
+}
+
+/**
+ * @brief Builds the upload.
+ *
+ * {"phases": [...], "wakes": [{"seq", "cause", "started", "phase_ms": [per phase, null if
+ * not reached], "radio_ms", "cpu_ms"}], "ticks": {"count", "awake_ms"}}. Phase times are
+ * milliseconds since boot; "ticks" sums the clock tick wakes since the last upload.
+ */
+static cJSON *wake_profile_to_json(const wake_record_t *records, int count,
+                                   const wake_upload_t *upload) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "phases", cJSON_CreateStringArray(phase_names, WAKE_PHASE_COUNT));
+    cJSON *wakes = cJSON_AddArrayToObject(root, "wakes");
+    for (int i = 0; i < count; ++i) {
+        const wake_record_t *record = &records[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "seq", record->seq);
+        cJSON_AddStringToObject(item, "cause", wake_cause_name(record->cause));
+        cJSON_AddNumberToObject(item, "started", record->started);
+        cJSON *phases = cJSON_AddArrayToObject(item, "phase_ms");
+        for (int phase = 0; phase < WAKE_PHASE_COUNT; ++phase) {
+            cJSON_AddItemToArray(phases, ms_item(record->phase_ms[phase]));
+        }
+        cJSON_AddItemToObject(item, "radio_ms", ms_item(record->radio_ms));
+        cJSON_AddItemToObject(item, "cpu_ms", ms_item(record->cpu_ms));
+        cJSON_AddItemToArray(wakes, item);
+    }
+    cJSON *ticks = cJSON_AddObjectToObject(root, "ticks");
+    cJSON_AddNumberToObject(ticks, "count", upload->tick_count);
+    cJSON_AddNumberToObject(ticks, "awake_ms", (double)(upload->tick_awake_us / 1000));
+    return root;
+}
+
+/** @brief Finishes the upload; the records are removed once the server has stored them. */
+static void wake_profile_callback(net_event_t *event, esp_err_t err) {
+    wake_upload_t *upload = event->user_data;
+    free((void *)event->post_data);
+    event->post_data = NULL;
+    if (err == ESP_OK && event->status_code == 200) {
+        wake_profile_commit(upload);
+        ESP_LOGI(TAG, "Wake profiles uploaded.");
+    } else if (err != NET_ERR_CANCELLED) {
+        ESP_LOGW(TAG, "Wake profile upload failed: %s, status %d", esp_err_to_name(err),
+                 event->status_code);
+    }
+    cJSON_Delete(event->json_root);
+    free(upload);
+    event->user_data = NULL;
+}
+
+/**
+ * @brief Uploads the stored wakes once CONFIG_WAKE_PROFILE_UPLOAD_BATCH have accumulated.
+ *
+ * Batching keeps the upload from adding a request to every wake. Sent as a background
+ * request, so it is dropped when the server is unavailable and the records stay for the
+ * next connection.
+ */
+void wake_profile_upload(void) {
+#ifdef CONFIG_WAKE_PROFILE_UPLOAD
+    wake_record_t *records = malloc(sizeof(rtc_wakes.records));
+    wake_upload_t *upload = calloc(1, sizeof(wake_upload_t));
+    if (records == NULL || upload == NULL) {
+        free(records);
+        free(upload);
+        return;
+    }
+    xSemaphoreTake(wake_profile_mutex, portMAX_DELAY);
+    int count = rtc_wakes.count;
+    for (int i = 0; i < count; ++i) {
+        records[i] = rtc_wakes.records[wake_profile_slot(i)];
+    }
+    upload->tick_count = rtc_wakes.tick_count;
+    upload->tick_awake_us = rtc_wakes.tick_awake_us;
+    xSemaphoreGive(wake_profile_mutex);
+
+    char *body = NULL;
+    if (count >= CONFIG_WAKE_PROFILE_UPLOAD_BATCH) {
+        cJSON *root = wake_profile_to_json(records, count, upload);
+        body = cJSON_PrintUnformatted(root);
+        cJSON_Delete(root);
+    }
+    upload->last_seq = count > 0 ? records[count - 1].seq : 0;
+    free(records);
+    if (body == NULL) {
+        free(upload);
+        return;
+    }
+
+    net_event_t event = {
+        .url = WAKE_PROFILE_URL,
+        .method = HTTP_METHOD_POST,
+        .post_data = body,
+        .use_jwt = true,
+        .response_buffer_size = NET_RESPONSE_BUFFER_SIZE,
+        .on_finish = wake_profile_callback,
+        .user_data = upload,
+        .priority = NET_PRIO_BACKGROUND,
+        .key = NET_KEY_WAKE_PROFILE,
+    };
+    if (net_submit(&event, 0) != ESP_OK) {
+        free(body);
+        free(upload);
+    }
+#endif
+}